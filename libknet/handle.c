@@ -22,6 +22,10 @@
 #include "internals.h"
 #include "crypto.h"
 #include "links.h"
+#include "host.h"
+#include "large.h"
+#include "relay.h"
+#include "tree.h"
 #include "compress.h"
 #include "compat.h"
 #include "common.h"
@@ -34,6 +38,7 @@
 #include "transports.h"
 #include "transport_common.h"
 #include "logging.h"
+#include "uring.h"
 
 static pthread_mutex_t handle_config_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -225,14 +230,14 @@ static int _init_buffers(knet_handle_t knet_h)
 	}
 	memset(knet_h->recv_from_sock_buf, 0, KNET_DATABUFSIZE);
 
-	knet_h->pingbuf = malloc(KNET_HEADER_PING_SIZE);
+	knet_h->pingbuf = malloc(KNET_HEADER_PING_EXT_SIZE);
 	if (!knet_h->pingbuf) {
 		savederrno = errno;
 		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for hearbeat buffer: %s",
 			strerror(savederrno));
 		goto exit_fail;
 	}
-	memset(knet_h->pingbuf, 0, KNET_HEADER_PING_SIZE);
+	memset(knet_h->pingbuf, 0, KNET_HEADER_PING_EXT_SIZE);
 
 	knet_h->pmtudbuf = malloc(KNET_PMTUD_SIZE_V6);
 	if (!knet_h->pmtudbuf) {
@@ -243,6 +248,33 @@ static int _init_buffers(knet_handle_t knet_h)
 	}
 	memset(knet_h->pmtudbuf, 0, KNET_PMTUD_SIZE_V6);
 
+	knet_h->bwprobebuf = malloc(KNET_PMTUD_SIZE_V6);
+	if (!knet_h->bwprobebuf) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for bandwidth probe buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->bwprobebuf, 0, KNET_PMTUD_SIZE_V6);
+
+	knet_h->creditbuf = malloc(KNET_HEADER_CREDIT_MAX_SIZE);
+	if (!knet_h->creditbuf) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for flow control buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->creditbuf, 0, KNET_HEADER_CREDIT_MAX_SIZE);
+
+	knet_h->ackbuf = malloc(KNET_HEADER_ACK_SIZE);
+	if (!knet_h->ackbuf) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for ack buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->ackbuf, 0, KNET_HEADER_ACK_SIZE);
+
 	for (i = 0; i < PCKT_FRAG_MAX; i++) {
 		bufsize = ceil((float)KNET_MAX_PACKET_SIZE / (i + 1)) + KNET_HEADER_ALL_SIZE + KNET_DATABUFSIZE_CRYPT_PAD;
 		knet_h->send_to_links_buf_crypt[i] = malloc(bufsize);
@@ -291,6 +323,33 @@ static int _init_buffers(knet_handle_t knet_h)
 	}
 	memset(knet_h->pmtudbuf_crypt, 0, KNET_DATABUFSIZE_CRYPT);
 
+	knet_h->bwprobebuf_crypt = malloc(KNET_DATABUFSIZE_CRYPT);
+	if (!knet_h->bwprobebuf_crypt) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for crypto bandwidth probe buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->bwprobebuf_crypt, 0, KNET_DATABUFSIZE_CRYPT);
+
+	knet_h->creditbuf_crypt = malloc(KNET_DATABUFSIZE_CRYPT);
+	if (!knet_h->creditbuf_crypt) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for crypto flow control buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->creditbuf_crypt, 0, KNET_DATABUFSIZE_CRYPT);
+
+	knet_h->ackbuf_crypt = malloc(KNET_DATABUFSIZE_CRYPT);
+	if (!knet_h->ackbuf_crypt) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for crypto ack buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->ackbuf_crypt, 0, KNET_DATABUFSIZE_CRYPT);
+
 	knet_h->recv_from_links_buf_decompress = malloc(KNET_DATABUFSIZE_COMPRESS);
 	if (!knet_h->recv_from_links_buf_decompress) {
 		savederrno = errno;
@@ -309,6 +368,24 @@ static int _init_buffers(knet_handle_t knet_h)
 	}
 	memset(knet_h->send_to_links_buf_compress, 0, KNET_DATABUFSIZE_COMPRESS);
 
+	knet_h->send_to_links_buf_fec = malloc(KNET_FEC_BUFSIZE);
+	if (!knet_h->send_to_links_buf_fec) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for parity buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->send_to_links_buf_fec, 0, KNET_FEC_BUFSIZE);
+
+	knet_h->send_to_links_buf_fec_crypt = malloc(KNET_FEC_BUFSIZE);
+	if (!knet_h->send_to_links_buf_fec_crypt) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for crypto parity buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(knet_h->send_to_links_buf_fec_crypt, 0, KNET_FEC_BUFSIZE);
+
 	memset(knet_h->knet_transport_fd_tracker, KNET_MAX_TRANSPORTS, sizeof(knet_h->knet_transport_fd_tracker));
 
 	return 0;
@@ -333,6 +410,10 @@ static void _destroy_buffers(knet_handle_t knet_h)
 
 	free(knet_h->recv_from_links_buf_decompress);
 	free(knet_h->send_to_links_buf_compress);
+	free(knet_h->send_to_links_buf_fec);
+	free(knet_h->send_to_links_buf_fec_crypt);
+	_relay_fini(knet_h);
+	_tree_fini(knet_h);
 	free(knet_h->recv_from_sock_buf);
 	free(knet_h->recv_from_links_buf_decrypt);
 	free(knet_h->recv_from_links_buf_crypt);
@@ -340,6 +421,12 @@ static void _destroy_buffers(knet_handle_t knet_h)
 	free(knet_h->pingbuf_crypt);
 	free(knet_h->pmtudbuf);
 	free(knet_h->pmtudbuf_crypt);
+	free(knet_h->bwprobebuf);
+	free(knet_h->bwprobebuf_crypt);
+	free(knet_h->creditbuf);
+	free(knet_h->creditbuf_crypt);
+	free(knet_h->ackbuf);
+	free(knet_h->ackbuf_crypt);
 }
 
 static int _init_epolls(knet_handle_t knet_h)
@@ -440,6 +527,7 @@ static void _close_epolls(knet_handle_t knet_h)
 			if  (knet_h->sockfd[i].sockfd[knet_h->sockfd[i].is_created]) {
 				 _close_socketpair(knet_h, knet_h->sockfd[i].sockfd);
 			}
+			_large_tx_reset(&knet_h->sockfd[i]);
 		}
 	}
 
@@ -546,6 +634,7 @@ knet_handle_t knet_handle_new(knet_node_id_t host_id,
 	knet_handle_t knet_h;
 	int savederrno = 0;
 	struct rlimit cur;
+	struct timespec epoch;
 
 	if (getrlimit(RLIMIT_NOFILE, &cur) < 0) {
 		return NULL;
@@ -565,11 +654,18 @@ knet_handle_t knet_handle_new(knet_node_id_t host_id,
 		return NULL;
 	}
 
-	if (flags > KNET_HANDLE_FLAG_PRIVILEGED * 2 - 1) {
+	if (flags > KNET_HANDLE_FLAG_IO_URING * 2 - 1) {
 		errno = EINVAL;
 		return NULL;
 	}
 
+#ifndef HAVE_IO_URING
+	if (flags & KNET_HANDLE_FLAG_IO_URING) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+#endif
+
 	/*
 	 * allocate handle
 	 */
@@ -624,6 +720,13 @@ knet_handle_t knet_handle_new(knet_node_id_t host_id,
 	knet_h->stats.tx_crypt_time_min = UINT64_MAX;
 	knet_h->stats.rx_crypt_time_min = UINT64_MAX;
 
+	/*
+	 * flow control credits and reliable channels carry this
+	 * to let other nodes know when we restart
+	 */
+	clock_gettime(CLOCK_REALTIME, &epoch);
+	knet_h->epoch = (uint32_t)epoch.tv_sec ^ (uint32_t)epoch.tv_nsec ^ (uint32_t)getpid();
+
 	/*
 	 * init global shlib tracker
 	 */
@@ -690,6 +793,15 @@ knet_handle_t knet_handle_new(knet_node_id_t host_id,
 		goto exit_fail;
 	}
 
+#ifdef HAVE_IO_URING
+	if (flags & KNET_HANDLE_FLAG_IO_URING) {
+		if (uring_init(knet_h)) {
+			savederrno = errno;
+			goto exit_fail;
+		}
+	}
+#endif
+
 	/*
 	 * start transports
 	 */
@@ -752,6 +864,9 @@ int knet_handle_free(knet_handle_t knet_h)
 
 	_stop_threads(knet_h);
 	stop_all_transports(knet_h);
+#ifdef HAVE_IO_URING
+	uring_fini(knet_h);
+#endif
 	_close_epolls(knet_h);
 	_destroy_buffers(knet_h);
 	_close_socks(knet_h);
@@ -889,6 +1004,21 @@ int knet_handle_add_datafd(knet_handle_t knet_h, int *datafd, int8_t *channel)
 	knet_h->sockfd[*channel].is_created = 0;
 	knet_h->sockfd[*channel].is_socket = 0;
 	knet_h->sockfd[*channel].has_error = 0;
+	knet_h->sockfd[*channel].is_bulk = 0;
+	knet_h->sockfd[*channel].is_reliable = 0;
+	knet_h->sockfd[*channel].is_unordered = 0;
+	knet_h->sockfd[*channel].is_large = 0;
+	knet_h->sockfd[*channel].large_dst = NULL;
+	knet_h->sockfd[*channel].large_dst_entries = 0;
+	knet_h->sockfd[*channel].large_frag_num = 0;
+	knet_h->sockfd[*channel].large_seq = 0;
+	if (knet_h->sockfd[*channel].is_paced) {
+		knet_h->tx_paced_channels--;
+	}
+	knet_h->sockfd[*channel].is_paced = 0;
+	knet_h->sockfd[*channel].fc_blocked = 0;
+	knet_h->sockfd[*channel].fc_rx_avg = 0;
+	knet_h->sockfd[*channel].fc_channel = 0;
 
 	if (*datafd > 0) {
 		int sockopt;
@@ -1008,6 +1138,7 @@ int knet_handle_remove_datafd(knet_handle_t knet_h, int datafd)
 		_close_socketpair(knet_h, knet_h->sockfd[channel].sockfd);
 	}
 
+	_large_tx_reset(&knet_h->sockfd[channel]);
 	memset(&knet_h->sockfd[channel], 0, sizeof(struct knet_sock));
 
 out_unlock:
@@ -1107,26 +1238,25 @@ out_unlock:
 	return err;
 }
 
-int knet_handle_enable_filter(knet_handle_t knet_h,
-			      void *dst_host_filter_fn_private_data,
-			      int (*dst_host_filter_fn) (
-					void *private_data,
-					const unsigned char *outdata,
-					ssize_t outdata_len,
-					uint8_t tx_rx,
-					knet_node_id_t this_host_id,
-					knet_node_id_t src_node_id,
-					int8_t *channel,
-					knet_node_id_t *dst_host_ids,
-					size_t *dst_host_ids_entries))
+int knet_handle_set_channel_bulk(knet_handle_t knet_h, const int8_t channel, unsigned int enabled)
 {
-	int savederrno = 0;
+	int err = 0, savederrno = 0;
 
 	if (!knet_h) {
 		errno = EINVAL;
 		return -1;
 	}
 
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled > 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
 	savederrno = get_global_wrlock(knet_h);
 	if (savederrno) {
 		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
@@ -1135,130 +1265,166 @@ int knet_handle_enable_filter(knet_handle_t knet_h,
 		return -1;
 	}
 
-	knet_h->dst_host_filter_fn_private_data = dst_host_filter_fn_private_data;
-	knet_h->dst_host_filter_fn = dst_host_filter_fn;
-	if (knet_h->dst_host_filter_fn) {
-		log_debug(knet_h, KNET_SUB_HANDLE, "dst_host_filter_fn enabled");
-	} else {
-		log_debug(knet_h, KNET_SUB_HANDLE, "dst_host_filter_fn disabled");
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
 	}
 
-	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	knet_h->sockfd[channel].is_bulk = enabled;
 
-	errno = 0;
-	return 0;
+	log_debug(knet_h, KNET_SUB_HANDLE, "channel %d bulk: %u", channel, enabled);
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
 }
 
-int knet_handle_setfwd(knet_handle_t knet_h, unsigned int enabled)
+int knet_handle_get_channel_bulk(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled)
 {
-	int savederrno = 0;
+	int err = 0, savederrno = 0;
 
 	if (!knet_h) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (enabled > 1) {
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	savederrno = get_global_wrlock(knet_h);
+	if (enabled == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
 	if (savederrno) {
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
 			strerror(savederrno));
 		errno = savederrno;
 		return -1;
 	}
 
-	knet_h->enabled = enabled;
-
-	if (enabled) {
-		log_debug(knet_h, KNET_SUB_HANDLE, "Data forwarding is enabled");
-	} else {
-		log_debug(knet_h, KNET_SUB_HANDLE, "Data forwarding is disabled");
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
 	}
 
-	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	*enabled = knet_h->sockfd[channel].is_bulk;
 
-	errno = 0;
-	return 0;
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
 }
 
-int knet_handle_pmtud_getfreq(knet_handle_t knet_h, unsigned int *interval)
+int knet_handle_set_channel_reliable(knet_handle_t knet_h, const int8_t channel, unsigned int enabled)
 {
-	int savederrno = 0;
+	int err = 0, savederrno = 0;
 
 	if (!knet_h) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (!interval) {
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (enabled > 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
 	if (savederrno) {
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
 			strerror(savederrno));
 		errno = savederrno;
 		return -1;
 	}
 
-	*interval = knet_h->pmtud_interval;
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
 
-	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	knet_h->sockfd[channel].is_reliable = enabled;
 
-	errno = 0;
-	return 0;
+	log_debug(knet_h, KNET_SUB_HANDLE, "channel %d reliable: %u", channel, enabled);
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
 }
 
-int knet_handle_pmtud_setfreq(knet_handle_t knet_h, unsigned int interval)
+int knet_handle_get_channel_reliable(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled)
 {
-	int savederrno = 0;
+	int err = 0, savederrno = 0;
 
 	if (!knet_h) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if ((!interval) || (interval > 86400)) {
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	savederrno = get_global_wrlock(knet_h);
+	if (enabled == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
 	if (savederrno) {
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
 			strerror(savederrno));
 		errno = savederrno;
 		return -1;
 	}
 
-	knet_h->pmtud_interval = interval;
-	log_debug(knet_h, KNET_SUB_HANDLE, "PMTUd interval set to: %u seconds", interval);
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
 
-	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	*enabled = knet_h->sockfd[channel].is_reliable;
 
-	errno = 0;
-	return 0;
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
 }
 
-int knet_handle_enable_pmtud_notify(knet_handle_t knet_h,
-				    void *pmtud_notify_fn_private_data,
-				    void (*pmtud_notify_fn) (
-						void *private_data,
-						unsigned int data_mtu))
+int knet_handle_set_channel_unordered(knet_handle_t knet_h, const int8_t channel, unsigned int enabled)
 {
-	int savederrno = 0;
+	int err = 0, savederrno = 0;
 
 	if (!knet_h) {
 		errno = EINVAL;
 		return -1;
 	}
 
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled > 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
 	savederrno = get_global_wrlock(knet_h);
 	if (savederrno) {
 		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
@@ -1267,31 +1433,37 @@ int knet_handle_enable_pmtud_notify(knet_handle_t knet_h,
 		return -1;
 	}
 
-	knet_h->pmtud_notify_fn_private_data = pmtud_notify_fn_private_data;
-	knet_h->pmtud_notify_fn = pmtud_notify_fn;
-	if (knet_h->pmtud_notify_fn) {
-		log_debug(knet_h, KNET_SUB_HANDLE, "pmtud_notify_fn enabled");
-	} else {
-		log_debug(knet_h, KNET_SUB_HANDLE, "pmtud_notify_fn disabled");
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
 	}
 
-	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	knet_h->sockfd[channel].is_unordered = enabled;
 
-	errno = 0;
-	return 0;
+	log_debug(knet_h, KNET_SUB_HANDLE, "channel %d unordered: %u", channel, enabled);
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
 }
 
-int knet_handle_pmtud_get(knet_handle_t knet_h,
-			  unsigned int *data_mtu)
+int knet_handle_get_channel_unordered(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled)
 {
-	int savederrno = 0;
+	int err = 0, savederrno = 0;
 
 	if (!knet_h) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (!data_mtu) {
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
@@ -1304,25 +1476,35 @@ int knet_handle_pmtud_get(knet_handle_t knet_h,
 		return -1;
 	}
 
-	*data_mtu = knet_h->data_mtu;
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
 
-	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	*enabled = knet_h->sockfd[channel].is_unordered;
 
-	errno = 0;
-	return 0;
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
 }
 
-int knet_handle_crypto(knet_handle_t knet_h, struct knet_handle_crypto_cfg *knet_handle_crypto_cfg)
+int knet_handle_set_channel_large(knet_handle_t knet_h, const int8_t channel, unsigned int enabled)
 {
-	int savederrno = 0;
-	int err = 0;
+	int err = 0, savederrno = 0;
 
 	if (!knet_h) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (!knet_handle_crypto_cfg) {
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled > 1) {
 		errno = EINVAL;
 		return -1;
 	}
@@ -1335,11 +1517,524 @@ int knet_handle_crypto(knet_handle_t knet_h, struct knet_handle_crypto_cfg *knet
 		return -1;
 	}
 
-	crypto_fini(knet_h);
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
 
-	if ((!strncmp("none", knet_handle_crypto_cfg->crypto_model, 4)) || 
-	    ((!strncmp("none", knet_handle_crypto_cfg->crypto_cipher_type, 4)) &&
-	     (!strncmp("none", knet_handle_crypto_cfg->crypto_hash_type, 4)))) {
+	/*
+	 * fragments need record boundaries, there are none in a stream
+	 */
+	if ((enabled) && (!knet_h->sockfd[channel].is_socket)) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
+
+	if ((!enabled) && (knet_h->sockfd[channel].large_frag_num)) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "channel %d: dropping large message being sent",
+			  channel);
+		_large_tx_reset(&knet_h->sockfd[channel]);
+	}
+
+	knet_h->sockfd[channel].is_large = enabled;
+
+	log_debug(knet_h, KNET_SUB_HANDLE, "channel %d large messages: %u", channel, enabled);
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_handle_get_channel_large(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled)
+{
+	int err = 0, savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	if (!knet_h->sockfd[channel].in_use) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
+
+	*enabled = knet_h->sockfd[channel].is_large;
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_handle_set_flow_control(knet_handle_t knet_h, unsigned int enabled)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled > 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->flow_control = enabled;
+
+	if (enabled) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Flow control is enabled");
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Flow control is disabled");
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_get_flow_control(knet_handle_t knet_h, unsigned int *enabled)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!enabled) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*enabled = knet_h->flow_control;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_set_relay(knet_handle_t knet_h, unsigned int enabled)
+{
+	int err = 0, savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled > 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	if ((enabled) && (_relay_init(knet_h) < 0)) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for relay buffers");
+		goto out_unlock;
+	}
+
+	knet_h->relay = enabled;
+
+	if (enabled) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Relay routing is enabled");
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Relay routing is disabled");
+	}
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_handle_get_relay(knet_handle_t knet_h, unsigned int *enabled)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!enabled) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*enabled = knet_h->relay;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_set_bcast_tree(knet_handle_t knet_h, unsigned int fanout)
+{
+	int err = 0, savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((fanout) &&
+	    ((fanout < KNET_TREE_FANOUT_MIN) || (fanout > KNET_TREE_FANOUT_MAX))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	if ((fanout) && (_tree_init(knet_h) < 0)) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for broadcast tree buffers");
+		goto out_unlock;
+	}
+
+	knet_h->bcast_tree = fanout;
+
+	if (fanout) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Broadcast tree is enabled with fanout %u", fanout);
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Broadcast tree is disabled");
+	}
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_handle_get_bcast_tree(knet_handle_t knet_h, unsigned int *fanout)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!fanout) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*fanout = knet_h->bcast_tree;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_enable_filter(knet_handle_t knet_h,
+			      void *dst_host_filter_fn_private_data,
+			      int (*dst_host_filter_fn) (
+					void *private_data,
+					const unsigned char *outdata,
+					ssize_t outdata_len,
+					uint8_t tx_rx,
+					knet_node_id_t this_host_id,
+					knet_node_id_t src_node_id,
+					int8_t *channel,
+					knet_node_id_t *dst_host_ids,
+					size_t *dst_host_ids_entries))
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->dst_host_filter_fn_private_data = dst_host_filter_fn_private_data;
+	knet_h->dst_host_filter_fn = dst_host_filter_fn;
+	if (knet_h->dst_host_filter_fn) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "dst_host_filter_fn enabled");
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "dst_host_filter_fn disabled");
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_setfwd(knet_handle_t knet_h, unsigned int enabled)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (enabled > 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->enabled = enabled;
+
+	if (enabled) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Data forwarding is enabled");
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Data forwarding is disabled");
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_pmtud_getfreq(knet_handle_t knet_h, unsigned int *interval)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!interval) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*interval = knet_h->pmtud_interval;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_pmtud_setfreq(knet_handle_t knet_h, unsigned int interval)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((!interval) || (interval > 86400)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->pmtud_interval = interval;
+	log_debug(knet_h, KNET_SUB_HANDLE, "PMTUd interval set to: %u seconds", interval);
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_enable_pmtud_notify(knet_handle_t knet_h,
+				    void *pmtud_notify_fn_private_data,
+				    void (*pmtud_notify_fn) (
+						void *private_data,
+						unsigned int data_mtu))
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->pmtud_notify_fn_private_data = pmtud_notify_fn_private_data;
+	knet_h->pmtud_notify_fn = pmtud_notify_fn;
+	if (knet_h->pmtud_notify_fn) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "pmtud_notify_fn enabled");
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "pmtud_notify_fn disabled");
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_pmtud_get(knet_handle_t knet_h,
+			  unsigned int *data_mtu)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!data_mtu) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*data_mtu = knet_h->data_mtu;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_crypto(knet_handle_t knet_h, struct knet_handle_crypto_cfg *knet_handle_crypto_cfg)
+{
+	int savederrno = 0;
+	int err = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!knet_handle_crypto_cfg) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	crypto_fini(knet_h);
+
+	if ((!strncmp("none", knet_handle_crypto_cfg->crypto_model, 4)) || 
+	    ((!strncmp("none", knet_handle_crypto_cfg->crypto_cipher_type, 4)) &&
+	     (!strncmp("none", knet_handle_crypto_cfg->crypto_hash_type, 4)))) {
 		log_debug(knet_h, KNET_SUB_CRYPTO, "crypto is not enabled");
 		err = 0;
 		goto exit_unlock;
@@ -1427,7 +2122,7 @@ ssize_t knet_recv(knet_handle_t knet_h, char *buff, const size_t buff_len, const
 		return -1;
 	}
 
-	if (buff_len > KNET_MAX_PACKET_SIZE) {
+	if (buff_len > KNET_MAX_MESSAGE_SIZE) {
 		errno = EINVAL;
 		return -1;
 	}
@@ -1456,6 +2151,18 @@ ssize_t knet_recv(knet_handle_t knet_h, char *buff, const size_t buff_len, const
 		goto out_unlock;
 	}
 
+	if (knet_h->sockfd[channel].is_large) {
+		err = _large_recv(knet_h, channel, buff, buff_len);
+		savederrno = errno;
+		goto out_unlock;
+	}
+
+	if (buff_len > KNET_MAX_PACKET_SIZE) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
+
 	memset(&iov_in, 0, sizeof(iov_in));
 	iov_in.iov_base = (void *)buff;
 	iov_in.iov_len = buff_len;
@@ -1490,7 +2197,7 @@ ssize_t knet_send(knet_handle_t knet_h, const char *buff, const size_t buff_len,
 		return -1;
 	}
 
-	if (buff_len > KNET_MAX_PACKET_SIZE) {
+	if (buff_len > KNET_MAX_MESSAGE_SIZE) {
 		errno = EINVAL;
 		return -1;
 	}
@@ -1519,6 +2226,18 @@ ssize_t knet_send(knet_handle_t knet_h, const char *buff, const size_t buff_len,
 		goto out_unlock;
 	}
 
+	if (knet_h->sockfd[channel].is_large) {
+		err = _large_send(knet_h, channel, buff, buff_len);
+		savederrno = errno;
+		goto out_unlock;
+	}
+
+	if (buff_len > KNET_MAX_PACKET_SIZE) {
+		savederrno = EINVAL;
+		err = -1;
+		goto out_unlock;
+	}
+
 	memset(iov_out, 0, sizeof(iov_out));
 
 	iov_out[0].iov_base = (void *)buff;
@@ -1687,3 +2406,78 @@ int knet_handle_get_threads_timer_res(knet_handle_t knet_h,
 	errno = err ? savederrno : 0;
 	return err;
 }
+
+int knet_handle_set_busy_poll(knet_handle_t knet_h, uint32_t usecs)
+{
+	int savederrno = 0;
+	int i;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (usecs > KNET_BUSY_POLL_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->busy_poll = usecs;
+
+	/*
+	 * new sockets pick it up in _configure_common_socket
+	 */
+	for (i = 0; i < KNET_MAX_FDS; i++) {
+		if ((knet_h->knet_transport_fd_tracker[i].transport == KNET_TRANSPORT_UDP) ||
+		    (knet_h->knet_transport_fd_tracker[i].transport == KNET_TRANSPORT_SCTP)) {
+			_configure_busy_poll(knet_h, i, "link");
+		}
+	}
+
+	if (usecs) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Busy polling links for %u usecs", usecs);
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Busy polling disabled");
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_get_busy_poll(knet_handle_t knet_h, uint32_t *usecs)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!usecs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*usecs = knet_h->busy_poll;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = 0;
+	return 0;
+}
@@ -14,19 +14,49 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
-
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#ifdef KNET_LINUX
+#include <linux/sockios.h>
+#endif
+
+#include "crypto.h"
 #include "host.h"
 #include "internals.h"
+#include "large.h"
 #include "logging.h"
+#include "reliable.h"
+#include "relay.h"
 #include "threads_common.h"
+#include "transports.h"
+#include "transport_common.h"
+
+#if defined(SIOCOUTQ)
+#define KNET_FC_OUTQ SIOCOUTQ
+#elif defined(FIONWRITE)
+#define KNET_FC_OUTQ FIONWRITE
+#endif
 
+/*
+ * host_ids is kept sorted, the broadcast tree (see tree.c)
+ * walks it in node id order
+ */
 static void _host_list_update(knet_handle_t knet_h)
 {
 	struct knet_host *host;
+	size_t i;
+
 	knet_h->host_ids_entries = 0;
 
 	for (host = knet_h->host_head; host != NULL; host = host->next) {
-		knet_h->host_ids[knet_h->host_ids_entries] = host->host_id;
+		for (i = knet_h->host_ids_entries; i > 0; i--) {
+			if (knet_h->host_ids[i - 1] < host->host_id) {
+				break;
+			}
+			knet_h->host_ids[i] = knet_h->host_ids[i - 1];
+		}
+		knet_h->host_ids[i] = host->host_id;
 		knet_h->host_ids_entries++;
 	}
 }
@@ -173,6 +203,12 @@ int knet_host_remove(knet_handle_t knet_h, knet_node_id_t host_id)
 	}
 
 	knet_h->host_index[host_id] = NULL;
+	_reliable_free(removed);
+	_large_free(removed);
+	_relay_free(removed);
+	for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+		free(removed->defrag_buf[link_idx].fec_buf);
+	}
 	free(removed);
 
 	_host_list_update(knet_h);
@@ -490,6 +526,51 @@ exit_unlock:
 	return err;
 }
 
+int knet_host_pmtud_get(knet_handle_t knet_h, knet_node_id_t host_id,
+			unsigned int *data_mtu)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!data_mtu) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HOST, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_HOST, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	if (host->data_mtu) {
+		*data_mtu = host->data_mtu;
+	} else {
+		*data_mtu = knet_h->data_mtu;
+	}
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
 int knet_host_enable_status_change_notify(knet_handle_t knet_h,
 					  void *host_status_change_notify_fn_private_data,
 					  void (*host_status_change_notify_fn) (
@@ -552,14 +633,23 @@ int _send_host_info(knet_handle_t knet_h, const void *data, const size_t datalen
 static void _clear_cbuffers(struct knet_host *host, seq_num_t rx_seq_num)
 {
 	int i;
+	unsigned char *fec_buf;
+	size_t fec_buf_size;
 
 	memset(host->circular_buffer, 0, KNET_CBUFFER_SIZE);
 	host->rx_seq_num = rx_seq_num;
 
 	memset(host->circular_buffer_defrag, 0, KNET_CBUFFER_SIZE);
 
+	/*
+	 * keep the parity buffers, they are freed with the host
+	 */
 	for (i = 0; i < KNET_MAX_LINK; i++) {
+		fec_buf = host->defrag_buf[i].fec_buf;
+		fec_buf_size = host->defrag_buf[i].fec_buf_size;
 		memset(&host->defrag_buf[i], 0, sizeof(struct knet_host_defrag_buf));
+		host->defrag_buf[i].fec_buf = fec_buf;
+		host->defrag_buf[i].fec_buf_size = fec_buf_size;
 	}
 }
 
@@ -650,9 +740,12 @@ int _host_dstcache_update_sync(knet_handle_t knet_h, struct knet_host *host)
 	int link_idx;
 	int best_priority = -1;
 	int reachable = 0;
+	int remote = 0;
 
 	if (knet_h->host_id == host->host_id && knet_h->has_loop_link) {
 		host->active_link_entries = 1;
+		host->backup_link_entries = 0;
+		host->data_mtu = 0;
 		return 0;
 	}
 
@@ -679,6 +772,53 @@ int _host_dstcache_update_sync(knet_handle_t knet_h, struct knet_host *host)
 		}
 	}
 
+	/*
+	 * precompute the failover list for passive mode.
+	 * When the active link goes down, the TX thread walks this list
+	 * and switches to the next usable link on its own, without waiting
+	 * for the dst cache to be updated.
+	 */
+	host->backup_link_entries = 0;
+	if ((host->link_handler_policy == KNET_LINK_POLICY_PASSIVE) &&
+	    (host->active_link_entries)) {
+		for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+			int i;
+
+			if (link_idx == host->active_links[0])
+				continue;
+			if (host->link[link_idx].status.enabled != 1)
+				continue;
+			if (host->link[link_idx].has_valid_mtu != 1)
+				continue;
+
+			/* keep the list sorted by priority, highest first */
+			for (i = host->backup_link_entries; i > 0; i--) {
+				if (host->link[host->backup_links[i - 1]].priority >= host->link[link_idx].priority)
+					break;
+				host->backup_links[i] = host->backup_links[i - 1];
+			}
+			host->backup_links[i] = link_idx;
+			host->backup_link_entries++;
+		}
+	}
+
+	/*
+	 * data for this host can go out on any of the links above,
+	 * fragment it to fit the smallest one
+	 */
+	host->data_mtu = 0;
+	for (link_idx = 0; link_idx < host->active_link_entries; link_idx++) {
+		if ((!host->data_mtu) ||
+		    (host->link[host->active_links[link_idx]].status.mtu < host->data_mtu)) {
+			host->data_mtu = host->link[host->active_links[link_idx]].status.mtu;
+		}
+	}
+	for (link_idx = 0; link_idx < host->backup_link_entries; link_idx++) {
+		if (host->link[host->backup_links[link_idx]].status.mtu < host->data_mtu) {
+			host->data_mtu = host->link[host->backup_links[link_idx]].status.mtu;
+		}
+	}
+
 	if (host->link_handler_policy == KNET_LINK_POLICY_PASSIVE) {
 		log_debug(knet_h, KNET_SUB_HOST, "host: %u (passive) best link: %u (pri: %u)",
 			  host->host_id, host->link[host->active_links[0]].link_id,
@@ -690,14 +830,25 @@ int _host_dstcache_update_sync(knet_handle_t knet_h, struct knet_host *host)
 
 	/* no active links, we can clean the circular buffers and indexes */
 	if (!host->active_link_entries) {
-		log_warn(knet_h, KNET_SUB_HOST, "host: %u has no active links", host->host_id);
-		_clear_cbuffers(host, 0);
+		if ((knet_h->relay) && (host->relay_active)) {
+			/* reachable through other nodes, see relay.c */
+			log_info(knet_h, KNET_SUB_HOST, "host: %u has no active links, relaying through host %u",
+				 host->host_id, host->relay_via);
+			host->data_mtu = _relay_data_mtu(knet_h, host);
+			reachable = 1;
+			remote = 1;
+		} else {
+			log_warn(knet_h, KNET_SUB_HOST, "host: %u has no active links", host->host_id);
+			_clear_cbuffers(host, 0);
+		}
 	} else {
 		reachable = 1;
 	}
 
-	if (host->status.reachable != reachable) {
+	if ((host->status.reachable != reachable) ||
+	    (host->status.remote != remote)) {
 		host->status.reachable = reachable;
+		host->status.remote = remote;
 		if (knet_h->host_status_change_notify_fn) {
 			knet_h->host_status_change_notify_fn(
 						     knet_h->host_status_change_notify_fn_private_data,
@@ -710,3 +861,378 @@ int _host_dstcache_update_sync(knet_handle_t knet_h, struct knet_host *host)
 
 	return 0;
 }
+
+/*
+ * link used to send control packets that are not bound to a link
+ */
+struct knet_link *_host_get_ctrl_link(struct knet_host *host)
+{
+	int i;
+
+	for (i = 0; i < host->active_link_entries; i++) {
+		if ((host->link[host->active_links[i]].transport_type != KNET_TRANSPORT_LOOPBACK) &&
+		    (host->link[host->active_links[i]].status.connected)) {
+			return &host->link[host->active_links[i]];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * flow control
+ *
+ * receivers advertise to each node, per channel, how many data bytes
+ * they received from it and how many more the channel sock can take
+ * (window). Senders stop reading from the datafd once they have sent
+ * up to rx_bytes + window and resume when a new credit opens the window.
+ *
+ * Data lost on the wire is never counted by the receiver. A sender that
+ * has been idle long enough to have nothing in flight resyncs its counter
+ * with the receiver, so losses can only shrink the window for a while.
+ *
+ * A sender with a closed window sends nothing that would make us look
+ * at the window again, so while any window we advertised is closed the
+ * RX thread rechecks them every KNET_FC_RECHECK and the new credit goes
+ * out as soon as the application reads.
+ */
+
+static int _fc_channel_window(knet_handle_t knet_h, int8_t channel, uint32_t *window)
+{
+#ifdef KNET_FC_OUTQ
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+	int sockfd = sock->sockfd[sock->is_created];
+	int outq, sndbuf;
+	socklen_t optlen = sizeof(sndbuf);
+	uint64_t pkt, pkt_size;
+
+	if (ioctl(sockfd, KNET_FC_OUTQ, &outq) < 0) {
+		return -1;
+	}
+
+	if (getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen) < 0) {
+		return -1;
+	}
+
+	/*
+	 * the kernel accounts way more than the payload for small packets.
+	 * Keep room for one more packet too, senders can overshoot
+	 * the window by one packet.
+	 */
+	pkt = sock->fc_rx_avg ? sock->fc_rx_avg : KNET_FC_PACKET_SIZE;
+	pkt_size = (2 * pkt) + KNET_FC_SOCK_OVERHEAD;
+
+	if ((uint64_t)sndbuf < (uint64_t)outq + pkt_size) {
+		*window = 0;
+	} else {
+		*window = (((uint64_t)sndbuf - outq - pkt_size) * pkt) / pkt_size;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * the channel sock is shared by all the nodes sending to it
+ */
+static uint32_t _fc_channel_senders(knet_handle_t knet_h, int8_t channel, struct timespec clock_now)
+{
+	struct knet_host *host;
+	unsigned long long diff;
+	uint32_t senders = 0;
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		if ((!host->fc_rx_last[channel].tv_sec) && (!host->fc_rx_last[channel].tv_nsec)) {
+			continue;
+		}
+		timespec_diff(host->fc_rx_last[channel], clock_now, &diff);
+		if (diff < KNET_FC_REFRESH) {
+			senders++;
+		}
+	}
+
+	return senders ? senders : 1;
+}
+
+/*
+ * needs tx_mutex, creditbuf is shared between RX and heartbeat threads
+ */
+static void _fc_send_credit(knet_handle_t knet_h, struct knet_host *host, struct timespec clock_now, int force)
+{
+	struct knet_credit_entry *entry = (struct knet_credit_entry *)knet_h->creditbuf->khp_credit_data;
+	struct knet_link *link;
+	uint32_t windows[KNET_DATAFD_MAX];
+	uint32_t mask = 0, pkt;
+	int8_t channel;
+	int changed = force;
+	ssize_t len, outlen = KNET_HEADER_CREDIT_SIZE;
+	unsigned char *outbuf = (unsigned char *)knet_h->creditbuf;
+
+	link = _host_get_ctrl_link(host);
+	if (!link) {
+		return;
+	}
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		if ((!knet_h->sockfd[channel].in_use) ||
+		    (_fc_channel_window(knet_h, channel, &windows[channel]) < 0)) {
+			continue;
+		}
+		windows[channel] = windows[channel] / _fc_channel_senders(knet_h, channel, clock_now);
+
+		/*
+		 * new data to acknowledge or the application made some room
+		 */
+		if ((host->fc_rx_bytes[channel] != host->fc_rx_advertised[channel]) ||
+		    (windows[channel] > host->fc_rx_window[channel] + (host->fc_rx_window[channel] / 4))) {
+			changed = 1;
+		}
+
+		entry->kce_rx_bytes = htonl(host->fc_rx_bytes[channel]);
+		entry->kce_window = htonl(windows[channel]);
+		entry++;
+		outlen += sizeof(struct knet_credit_entry);
+		mask |= (1U << channel);
+	}
+
+	if ((!changed) || (!mask)) {
+		return;
+	}
+
+	knet_h->creditbuf->khp_credit_link = link->link_id;
+	knet_h->creditbuf->khp_credit_epoch = htonl(knet_h->epoch);
+	knet_h->creditbuf->khp_credit_mask = htonl(mask);
+
+	if (knet_h->crypto_instance) {
+		if (crypto_encrypt_and_sign(knet_h,
+					    (const unsigned char *)knet_h->creditbuf,
+					    outlen,
+					    knet_h->creditbuf_crypt,
+					    &outlen) < 0) {
+			log_debug(knet_h, KNET_SUB_HOST, "Unable to crypto flow control packet");
+			return;
+		}
+		outbuf = knet_h->creditbuf_crypt;
+	}
+
+	len = transport_link_sendto_ctrl(knet_h, link, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (len != outlen) {
+		/*
+		 * state is not updated, the credit will go out next time
+		 */
+		log_debug(knet_h, KNET_SUB_HOST, "Unable to send flow control packet to host %u: %s",
+			  host->host_id, strerror(errno));
+		return;
+	}
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		if (mask & (1U << channel)) {
+			host->fc_rx_advertised[channel] = host->fc_rx_bytes[channel];
+			host->fc_rx_window[channel] = windows[channel];
+			pkt = knet_h->sockfd[channel].fc_rx_avg ? knet_h->sockfd[channel].fc_rx_avg : KNET_FC_PACKET_SIZE;
+			if (windows[channel] < pkt) {
+				host->fc_rx_closed |= (1U << channel);
+			} else {
+				host->fc_rx_closed &= ~(1U << channel);
+			}
+		}
+	}
+	host->fc_rx_credit_last = clock_now;
+
+	if (host->fc_rx_closed) {
+		knet_h->fc_rx_closed = 1;
+	}
+}
+
+void _host_fc_rx_data(knet_handle_t knet_h, struct knet_host *host, int8_t channel, size_t len)
+{
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+	struct timespec clock_now;
+
+	host->fc_rx_bytes[channel] += len;
+	if (sock->fc_rx_avg) {
+		sock->fc_rx_avg = ((sock->fc_rx_avg * 7) + len) / 8;
+	} else {
+		sock->fc_rx_avg = len;
+	}
+
+	if (!knet_h->flow_control) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+	host->fc_rx_last[channel] = clock_now;
+
+	/*
+	 * move the window well before the sender runs out of it
+	 */
+	if (host->fc_rx_bytes[channel] - host->fc_rx_advertised[channel] < host->fc_rx_window[channel] / 4) {
+		return;
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_HOST, "Unable to get TX mutex lock");
+		return;
+	}
+	_fc_send_credit(knet_h, host, clock_now, 0);
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
+
+void _host_fc_send_credits(knet_handle_t knet_h)
+{
+	struct knet_host *host;
+	struct timespec clock_now;
+	unsigned long long diff;
+	int closed = 0;
+
+	if (!knet_h->flow_control) {
+		return;
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_HOST, "Unable to get TX mutex lock");
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		if (host->host_id == knet_h->host_id) {
+			continue;
+		}
+		timespec_diff(host->fc_rx_credit_last, clock_now, &diff);
+		_fc_send_credit(knet_h, host, clock_now, (diff >= KNET_FC_REFRESH));
+		if (host->fc_rx_closed) {
+			closed = 1;
+		}
+	}
+
+	knet_h->fc_rx_closed = closed;
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
+
+void _host_fc_parse_credit(knet_handle_t knet_h, struct knet_host *host, struct knet_header *inbuf, ssize_t len)
+{
+	struct knet_credit_entry *entry = (struct knet_credit_entry *)inbuf->khp_credit_data;
+	struct timespec clock_now;
+	unsigned long long diff;
+	uint32_t mask, epoch, rx_bytes, bit;
+	int8_t channel;
+
+	if (!knet_h->flow_control) {
+		return;
+	}
+
+	if (len < (ssize_t)KNET_HEADER_CREDIT_SIZE) {
+		return;
+	}
+
+	mask = ntohl(inbuf->khp_credit_mask);
+	epoch = ntohl(inbuf->khp_credit_epoch);
+
+	if (len < (ssize_t)(KNET_HEADER_CREDIT_SIZE + (__builtin_popcount(mask) * sizeof(struct knet_credit_entry)))) {
+		log_debug(knet_h, KNET_SUB_HOST, "Flow control packet from host %u is too short", host->host_id);
+		return;
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_HOST, "Unable to get TX mutex lock");
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+
+	if (epoch != host->fc_tx_epoch) {
+		host->fc_tx_epoch = epoch;
+		host->fc_tx_mask = 0;
+	}
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		bit = 1U << channel;
+
+		if (!(mask & bit)) {
+			host->fc_tx_mask &= ~bit;
+			continue;
+		}
+
+		rx_bytes = ntohl(entry->kce_rx_bytes);
+
+		/*
+		 * credits can be reordered on the wire
+		 */
+		if ((host->fc_tx_mask & bit) &&
+		    ((int32_t)(rx_bytes - host->fc_tx_rx_bytes[channel]) < 0)) {
+			entry++;
+			continue;
+		}
+
+		timespec_diff(host->fc_tx_last[channel], clock_now, &diff);
+		if ((!(host->fc_tx_mask & bit)) || (diff >= KNET_FC_IDLE)) {
+			host->fc_tx_sent[channel] = rx_bytes;
+		}
+
+		host->fc_tx_rx_bytes[channel] = rx_bytes;
+		host->fc_tx_limit[channel] = rx_bytes + ntohl(entry->kce_window);
+		host->fc_tx_mask |= bit;
+		entry++;
+	}
+
+	host->fc_tx_credit_last = clock_now;
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
+
+/*
+ * needs tx_mutex. Returns 1 if the host has no more room on the channel
+ */
+int _host_fc_tx_data(knet_handle_t knet_h, struct knet_host *host, int8_t channel, size_t len)
+{
+	if ((!knet_h->flow_control) || (!(host->fc_tx_mask & (1U << channel)))) {
+		return 0;
+	}
+
+	host->fc_tx_sent[channel] += len;
+	clock_gettime(CLOCK_MONOTONIC, &host->fc_tx_last[channel]);
+
+	return ((int32_t)(host->fc_tx_limit[channel] - host->fc_tx_sent[channel]) <= 0);
+}
+
+/*
+ * needs tx_mutex
+ */
+int _host_fc_channel_blocked(knet_handle_t knet_h, int8_t channel)
+{
+	struct knet_host *host;
+	struct timespec clock_now;
+	unsigned long long diff;
+
+	if (!knet_h->flow_control) {
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		if (!(host->fc_tx_mask & (1U << channel))) {
+			continue;
+		}
+
+		/*
+		 * the remote node stopped sending credits (restarted, disabled
+		 * flow control or is gone). Don't wait for it forever.
+		 */
+		timespec_diff(host->fc_tx_credit_last, clock_now, &diff);
+		if (diff >= KNET_FC_TIMEOUT) {
+			continue;
+		}
+
+		if ((int32_t)(host->fc_tx_limit[channel] - host->fc_tx_sent[channel]) <= 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -18,5 +18,24 @@ void _seq_num_set(struct knet_host *host, seq_num_t seq_num, int defrag_buf);
 int _send_host_info(knet_handle_t knet_h, const void *data, const size_t datalen);
 int _host_dstcache_update_async(knet_handle_t knet_h, struct knet_host *host);
 int _host_dstcache_update_sync(knet_handle_t knet_h, struct knet_host *host);
+struct knet_link *_host_get_ctrl_link(struct knet_host *host);
+
+/*
+ * flow control, see host.c
+ */
+#define KNET_FC_REFRESH		1000000000llu		/* nsecs, credits are sent at least this often */
+#define KNET_FC_TIMEOUT		(3 * KNET_FC_REFRESH)	/* nsecs, older credits are ignored */
+#define KNET_FC_IDLE		100000000llu		/* nsecs, a sender idle this long has nothing in flight */
+#define KNET_FC_SOCK_OVERHEAD	768			/* kernel accounting of a packet in a sock, on top of 2 * size */
+#define KNET_FC_PACKET_SIZE	1024			/* packet size guess before any data is received */
+#define KNET_FC_RECHECK		1			/* msecs between checks of a blocked or closed channel */
+
+#define KNET_HEADER_CREDIT_MAX_SIZE (KNET_HEADER_CREDIT_SIZE + (KNET_DATAFD_MAX * sizeof(struct knet_credit_entry)))
+
+void _host_fc_rx_data(knet_handle_t knet_h, struct knet_host *host, int8_t channel, size_t len);
+void _host_fc_send_credits(knet_handle_t knet_h);
+void _host_fc_parse_credit(knet_handle_t knet_h, struct knet_host *host, struct knet_header *inbuf, ssize_t len);
+int _host_fc_tx_data(knet_handle_t knet_h, struct knet_host *host, int8_t channel, size_t len);
+int _host_fc_channel_blocked(knet_handle_t knet_h, int8_t channel);
 
 #endif
@@ -20,7 +20,10 @@
 #include "compat.h"
 #include "threads_common.h"
 
-#define KNET_DATABUFSIZE KNET_MAX_PACKET_SIZE + KNET_HEADER_ALL_SIZE
+/*
+ * reliable channels add their header in front of the user data
+ */
+#define KNET_DATABUFSIZE KNET_MAX_PACKET_SIZE + KNET_HEADER_ALL_SIZE + KNET_HEADER_RELIABLE_SIZE
 
 #define KNET_DATABUFSIZE_CRYPT_PAD 1024
 #define KNET_DATABUFSIZE_CRYPT KNET_DATABUFSIZE + KNET_DATABUFSIZE_CRYPT_PAD
@@ -28,6 +31,13 @@
 #define KNET_DATABUFSIZE_COMPRESS_PAD 1024
 #define KNET_DATABUFSIZE_COMPRESS KNET_DATABUFSIZE + KNET_DATABUFSIZE_COMPRESS_PAD
 
+/*
+ * parity fragments of a packet, with their headers and crypto overhead.
+ * Each one is as long as a data fragment, and there are at most as many
+ * as data fragments
+ */
+#define KNET_FEC_BUFSIZE (((KNET_MAX_PACKET_SIZE + KNET_HEADER_ALL_SIZE) * 2) + (PCKT_FRAG_MAX * (KNET_HEADER_ALL_SIZE + KNET_DATABUFSIZE_CRYPT_PAD)))
+
 #define KNET_RING_RCVBUFF 8388608
 
 #define PCKT_FRAG_MAX UINT8_MAX
@@ -35,6 +45,17 @@
 
 #define KNET_EPOLL_MAX_EVENTS KNET_DATAFD_MAX
 
+#define KNET_PMTUD_PROBES 8	/* max PMTUd probes in flight per link */
+#define KNET_LINK_BW_SAMPLES 8	/* capacity samples kept per link to compute the median */
+#define KNET_LINK_CC_BASE_HISTORY 10	/* minutes of RTT minimums kept for the base delay */
+
+#define KNET_PMTUD_IDLE    0	/* link is not part of the current PMTUd run */
+#define KNET_PMTUD_RUNNING 1	/* link is being probed */
+#define KNET_PMTUD_DONE    2	/* PMTUd found the link MTU */
+#define KNET_PMTUD_FAILED  3	/* PMTUd failed on this link */
+
+#define KNET_PMTUD_REQUEST (1ULL << 32)	/* pmtud_request flag, the low 32 bits are the hint */
+
 typedef void *knet_transport_link_t; /* per link transport handle */
 typedef void *knet_transport_t;      /* per knet_h transport handle */
 struct  knet_transport_ops;          /* Forward because of circular dependancy */
@@ -67,18 +88,70 @@ struct knet_link {
 	int outsock;
 	unsigned int configured:1;		/* set to 1 if src/dst have been configured transport initialized on this link*/
 	unsigned int transport_connected:1;	/* set to 1 if lower level transport is connected */
+	unsigned int outsock_connected:1;	/* outsock is connect()ed to dst_addr, send without address */
 	unsigned int latency_exp;
 	uint8_t received_pong;
 	struct timespec ping_last;
+	struct timespec ping_sent;		/* last ping handed to the kernel, see KNET_LINK_FLAG_TIMESTAMP */
+	unsigned long long latency_last;	/* last latency sample in usecs, used for jitter */
+	uint8_t remote_mcast;			/* the node listens to the multicast group of this link id */
+	uint32_t latency_histogram[KNET_LINK_LATENCY_BUCKETS];	/* see _link_latency_histogram_add */
 	/* used by PMTUD thread as temp per-link variables and should always contain the onwire_len value! */
 	uint32_t proto_overhead;
 	struct timespec pmtud_last;
 	uint32_t last_ping_size;
 	uint32_t last_good_mtu;
 	uint32_t last_bad_mtu;
-	uint32_t last_sent_mtu;
-	uint32_t last_recv_mtu;
 	uint8_t has_valid_mtu;
+	/* PMTUd per run state. probe sizes/acks are protected by pmtud_mutex */
+	uint8_t pmtud_state;			/* see KNET_PMTUD_ define above */
+	uint8_t pmtud_warned;
+	uint8_t pmtud_saved_valid_mtu;
+	unsigned int pmtud_saved_mtu;
+	uint32_t pmtud_max_mtu;
+	uint32_t pmtud_overhead;
+	uint8_t pmtud_probes;			/* probes in flight */
+	uint32_t pmtud_probe_size[KNET_PMTUD_PROBES];	/* onwire size, also used as probe id */
+	uint8_t pmtud_probe_acked[KNET_PMTUD_PROBES];
+	uint32_t pmtud_lost_mtu;		/* smallest probe size lost, retried before it becomes last_bad_mtu */
+	uint8_t pmtud_lost;			/* rounds pmtud_lost_mtu has been lost */
+	/* PMTUd events and data validation, see threads_pmtud.c */
+	uint64_t pmtud_request;			/* rerun requested by ICMP/EMSGSIZE or black hole detection, KNET_PMTUD_REQUEST |
+						 * onwire MTU reported by the kernel or network (0 if unknown). Atomic, set from any thread */
+	uint8_t pmtud_validated;		/* data packets of current MTU size are getting through */
+	uint8_t pmtud_blackhole;		/* consecutive pongs reporting missing big data packets */
+	uint32_t pmtud_tx_data_max;		/* biggest data packet sent since last ping */
+	uint32_t pmtud_tx_data_check;		/* pmtud_tx_data_max at the time of the last ping */
+	uint32_t pmtud_rx_data_max;		/* biggest data packet received since last pong */
+	/* bandwidth estimation, see threads_heartbeat.c */
+	uint32_t bw_probe_interval;		/* msecs between probe trains, 0 disabled */
+	uint8_t bw_probe_count;			/* packets per probe train */
+	uint32_t bw_probe_id;			/* id of the last train sent */
+	struct timespec bw_probe_last;		/* time of the last train sent */
+	uint32_t bw_rx_probe_id;		/* train being received */
+	uint8_t bw_rx_probe_seq;		/* next packet expected in the train */
+	uint8_t bw_rx_probe_kernel;		/* train timestamped by the kernel */
+	uint8_t bw_rx_tstamp_tried;		/* tried to enable kernel timestamps on the socket */
+	uint64_t bw_rx_probe_bytes;		/* bytes received after the first packet of the train */
+	struct timespec bw_rx_probe_first;	/* arrival time of the first packet of the train */
+	uint32_t bw_rx_samples[KNET_LINK_BW_SAMPLES];	/* capacity samples in kbit/s */
+	uint8_t bw_rx_sample_idx;
+	uint32_t bw_rx_estimate;		/* median of bw_rx_samples in kbit/s */
+	uint64_t bw_rx_rate_bytes;		/* rx_data_bytes at the time of the last pong */
+	struct timespec bw_rx_rate_last;	/* time of the last pong */
+	/* congestion control, see _link_cc_update and _link_cc_pace */
+	uint32_t cc_target_delay;		/* usecs, 0 disabled */
+	uint32_t cc_base_delay[KNET_LINK_CC_BASE_HISTORY];	/* per minute RTT minimums in usecs */
+	uint8_t cc_base_idx;
+	struct timespec cc_base_last;		/* start of the current base delay minute */
+	int64_t cc_tokens;			/* bytes bulk channels can send, negative when in debt */
+	struct timespec cc_tokens_last;		/* last token refill */
+	/* forward error correction, see knet_link_set_fec */
+	uint8_t fec_group;			/* data fragments per parity fragment, 0 disabled */
+	/* socket buffers, see _sockbuf_update */
+	uint32_t sockbuf_drops;			/* socket drops at the last pass */
+	uint8_t sockbuf_rx_quiet;		/* passes with an almost empty receive queue */
+	uint8_t sockbuf_tx_quiet;		/* passes with an almost empty send queue */
 };
 
 #define KNET_CBUFFER_SIZE 4096
@@ -93,6 +166,12 @@ struct knet_host_defrag_buf {
 	uint16_t frag_size;		/* normal frag size (not the last one) */
 	uint16_t last_frag_size;	/* the last fragment might not be aligned with MTU size */
 	struct timespec last_update;	/* keep time of the last pckt */
+	unsigned char *fec_buf;		/* parity fragments, allocated on first use, see knet_link_set_fec */
+	size_t fec_buf_size;
+	uint8_t fec_recv;		/* how many parity frags did we receive */
+	uint8_t fec_map[PCKT_FRAG_MAX];	/* 1 parity received for the group starting at this fragment, 2 used */
+	uint8_t fec_frags[PCKT_FRAG_MAX];/* data fragments in that group */
+	uint16_t fec_len[PCKT_FRAG_MAX];/* XOR of their length */
 };
 
 struct knet_host {
@@ -109,6 +188,8 @@ struct knet_host {
 	seq_num_t untimed_rx_seq_num;
 	seq_num_t timed_rx_seq_num;
 	uint8_t got_data;
+	uint32_t caps;		/* KNET_CAP_* from the last ping or pong, 0 for older nodes */
+	struct knet_link *rx_src_link;	/* last link data came from, only used by the RX thread */
 	/* defrag/reassembly buffers */
 	struct knet_host_defrag_buf defrag_buf[KNET_MAX_LINK];
 	char circular_buffer_defrag[KNET_CBUFFER_SIZE];
@@ -116,6 +197,41 @@ struct knet_host {
 	struct knet_link link[KNET_MAX_LINK];
 	uint8_t active_link_entries;
 	uint8_t active_links[KNET_MAX_LINK];
+	/* passive mode failover list, sorted by priority */
+	uint8_t backup_link_entries;
+	uint8_t backup_links[KNET_MAX_LINK];
+	/* smallest MTU of the links above, 0 if unknown */
+	unsigned int data_mtu;
+	unsigned int tx_data_mtu;	/* data_mtu copy used while sending a packet, protected by tx_mutex */
+	int tx_mcast_link;		/* multicast group used while sending a packet, -1 if none */
+	/* flow control towards the remote node, see host.c. protected by tx_mutex */
+	uint32_t fc_tx_epoch;
+	uint32_t fc_tx_mask;				/* channels with a valid credit */
+	uint32_t fc_tx_sent[KNET_DATAFD_MAX];		/* data bytes sent */
+	uint32_t fc_tx_limit[KNET_DATAFD_MAX];		/* fc_tx_sent can grow up to this */
+	uint32_t fc_tx_rx_bytes[KNET_DATAFD_MAX];	/* received bytes in the last credit */
+	struct timespec fc_tx_last[KNET_DATAFD_MAX];	/* last data sent */
+	struct timespec fc_tx_credit_last;		/* last credit received */
+	/* flow control from the remote node */
+	uint32_t fc_rx_bytes[KNET_DATAFD_MAX];		/* data bytes received */
+	uint32_t fc_rx_advertised[KNET_DATAFD_MAX];	/* fc_rx_bytes in the last credit sent */
+	uint32_t fc_rx_window[KNET_DATAFD_MAX];		/* window in the last credit sent */
+	uint32_t fc_rx_closed;				/* channels whose last window can't take a packet */
+	struct timespec fc_rx_last[KNET_DATAFD_MAX];	/* last data received */
+	struct timespec fc_rx_credit_last;		/* last credit sent */
+	/* reliable channels state, allocated on first use. protected by tx_mutex */
+	struct knet_reliable *reliable[KNET_DATAFD_MAX];
+	/* large messages being received, allocated on first use. protected by tx_mutex */
+	struct knet_large_rx *large_rx[KNET_DATAFD_MAX];
+	/* relay routing, see relay.c. protected by tx_mutex */
+	struct knet_relay_entry *relay_table;	/* nodes this host can reach, from its last link table */
+	uint16_t relay_table_entries;
+	struct timespec relay_table_last;	/* last link table received */
+	uint8_t relay_active;			/* there is a route through another node */
+	knet_node_id_t relay_via;		/* next hop of the route */
+	uint8_t relay_hops;
+	uint32_t relay_latency;			/* usecs */
+	uint32_t relay_mtu;			/* smallest data MTU on the route */
 	struct knet_host *next;
 };
 
@@ -127,12 +243,31 @@ struct knet_sock {
 	int in_use;      /* set to 1 if it's use, 0 if free */
 	int has_error;   /* set to 1 if there were errors reading from the sock
 			  * and socket has been removed from epoll */
+	int is_bulk;     /* paced by links congestion control */
+	int is_reliable; /* retransmit and deliver in order, see reliable.c */
+	int is_unordered; /* no order across packets on transports with streams */
+	int is_paced;    /* removed from epoll until paced_until */
+	struct timespec paced_until;
+	int fc_blocked;  /* a remote node has no room for more data, see host.c */
+	uint32_t fc_rx_avg; /* average size of the packets written to the sock */
+	int8_t fc_channel;  /* channel whose window is closed, it may differ from the sock after filtering */
+	int is_large;    /* carries messages up to KNET_MAX_MESSAGE_SIZE in fragments, see large.c */
+	uint32_t large_send_id; /* last message sent by knet_send */
+	uint32_t large_id;  /* large message being sent, protected by tx_mutex */
+	uint32_t large_frag_num; /* 0 if none */
+	uint32_t large_seq; /* next fragment */
+	int large_bcast;    /* dst_host_filter_fn decision for the first fragment */
+	int8_t large_channel;
+	knet_node_id_t *large_dst;
+	size_t large_dst_entries;
 };
 
 struct knet_fd_trackers {
 	uint8_t transport; /* transport type (UDP/SCTP...) */
 	uint8_t data_type; /* internal use for transport to define what data are associated
 			    * to this fd */
+	uint8_t sockbuf_pass; /* last _sockbuf_update pass that resized the socket */
+	uint32_t rx_drops; /* packets dropped by the kernel (SO_RXQ_OVFL) */
 	void *data;	   /* pointer to the data */
 };
 
@@ -158,6 +293,7 @@ struct knet_handle {
 	int send_to_links_epollfd;
 	int recv_from_links_epollfd;
 	int dst_link_handler_epollfd;
+	struct knet_uring *uring;	/* KNET_HANDLE_FLAG_IO_URING, see uring.c */
 	unsigned int pmtud_interval;
 	unsigned int data_mtu;	/* contains the max data size that we can send onwire
 				 * without frags */
@@ -168,6 +304,9 @@ struct knet_handle {
 	struct knet_handle_stats stats;
 	struct knet_handle_stats_extra stats_extra;
 	uint32_t reconnect_int;
+	uint32_t sockbuf_min;	/* knet_handle_set_sockbuf_limits, 0 disabled */
+	uint32_t sockbuf_max;
+	uint8_t sockbuf_pass;
 	knet_node_id_t host_ids[KNET_MAX_HOST];
 	size_t host_ids_entries;
 	struct knet_header *recv_from_sock_buf;
@@ -175,8 +314,12 @@ struct knet_handle {
 	struct knet_header *recv_from_links_buf[PCKT_RX_BUFS];
 	struct knet_header *pingbuf;
 	struct knet_header *pmtudbuf;
+	struct knet_header *bwprobebuf;
+	struct knet_header *creditbuf;
+	struct knet_header *ackbuf;
 	uint8_t threads_status[KNET_THREAD_MAX];
 	useconds_t threads_timer_res;
+	uint32_t busy_poll;	/* knet_handle_set_busy_poll, usecs, 0 disabled */
 	pthread_mutex_t threads_status_mutex;
 	pthread_t send_to_links_thread;
 	pthread_t recv_from_links_thread;
@@ -195,6 +338,7 @@ struct knet_handle {
 	int pmtud_running;
 	int pmtud_forcerun;
 	int pmtud_abort;
+	unsigned int pmtud_outstanding;		/* PMTUd probes waiting for a reply, all links */
 	struct crypto_instance *crypto_instance;
 	size_t sec_header_size;
 	size_t sec_block_size;
@@ -205,16 +349,34 @@ struct knet_handle {
 	unsigned char *recv_from_links_buf_decrypt;
 	unsigned char *pingbuf_crypt;
 	unsigned char *pmtudbuf_crypt;
+	unsigned char *bwprobebuf_crypt;
+	unsigned char *creditbuf_crypt;
+	unsigned char *ackbuf_crypt;
 	int compress_model;
 	int compress_level;
 	size_t compress_threshold;
 	void *compress_int_data[KNET_MAX_COMPRESS_METHODS]; /* for compress method private data */
 	unsigned char *recv_from_links_buf_decompress;
 	unsigned char *send_to_links_buf_compress;
+	unsigned char *send_to_links_buf_fec;		/* parity fragments, see knet_link_set_fec */
+	unsigned char *send_to_links_buf_fec_crypt;
+	struct knet_header *relaybuf;		/* relay header, see knet_handle_set_relay */
+	unsigned char *relaybuf_crypt[PCKT_FRAG_MAX];
+	unsigned char *relay_tablebuf;		/* link table sent to the other nodes */
+	unsigned char *treebuf_crypt[PCKT_FRAG_MAX];	/* broadcast tree, see knet_handle_set_bcast_tree */
 	seq_num_t tx_seq_num;
 	pthread_mutex_t tx_seq_num_mutex;
 	uint8_t has_loop_link;
 	uint8_t loop_link;
+	unsigned int flow_control;	/* advertise credits to the other nodes */
+	int fc_rx_closed;		/* a node got a closed window, the RX thread rechecks it, protected by tx_mutex */
+	unsigned int relay;		/* route data through other nodes, see relay.c */
+	unsigned int bcast_tree;	/* fanout of the broadcast tree, 0 disabled, see tree.c */
+	uint32_t epoch;			/* random instance id, see knet_handle_new */
+	int reliable_ack_pending;	/* some reliable channel has acks to send, protected by tx_mutex */
+	int reliable_in_flight;		/* some reliable channel needs the timers, protected by tx_mutex */
+	int tx_paced_channels;		/* channels with is_paced set, protected by tx_mutex */
+	struct timespec reliable_timers_last;
 	void *dst_host_filter_fn_private_data;
 	int (*dst_host_filter_fn) (
 		void *private_data,
@@ -329,19 +491,41 @@ typedef struct knet_transport_ops {
 	int (*transport_tx_sock_error)(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno);
 
 /*
- * this function is called on _every_ received packet
- * to verify if the packet is data or internal protocol error handling
+ * this function is called on _every_ batch of received packets
+ * to verify which packets are data and handle internal protocol
+ * packets and errors. Transports can rewrite the batch, for example
+ * to reassemble short reads in the first msg of a packet.
  *
- * it should return:
- * -1 on error
- *  0 packet is not data and we should continue the packet process loop
- *  1 packet is not data and we should STOP the packet process loop
- *  2 packet is data and should be parsed as such
+ * it should set is_data[i] to 1 for packets that are data and should
+ * be parsed as such, 0 for the others, and return the number of msgs
+ * at the head of the batch that have been classified. The packet process
+ * loop stops there, anything after it is dropped.
  *
  * transport_rx_is_data is invoked with both global_rwlock
  * and fd_tracker read lock (from RX thread)
  */
-	int (*transport_rx_is_data)(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg);
+	int (*transport_rx_is_data)(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data);
+
+/*
+ * transports that don't move packets through sockets provide
+ * their own sendmmsg/recvmmsg, with the same return values.
+ * NULL means link->outsock and sockfd are sockets.
+ *
+ * transport_tx_msgs is invoked with global_rwlock
+ * transport_rx_msgs is invoked with global_rwlock from the RX thread
+ */
+	int (*transport_tx_msgs)(knet_handle_t knet_h, struct knet_link *link, struct knet_mmsghdr *msg, unsigned int vlen);
+	int (*transport_rx_msgs)(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, unsigned int vlen);
+
+/*
+ * transports that can keep data channels apart on the wire
+ * (for example SCTP streams) tag the msgs of a channel before
+ * they are sent. channel is -1 for packets that don't belong
+ * to a data channel. NULL if all packets share the same path.
+ *
+ * transport_tx_channel is invoked with global_rwlock
+ */
+	void (*transport_tx_channel)(knet_handle_t knet_h, struct knet_link *link, struct knet_mmsghdr *msg, unsigned int vlen, int8_t channel);
 } knet_transport_ops_t;
 
 socklen_t sockaddr_len(const struct sockaddr_storage *ss);
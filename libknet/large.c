@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "internals.h"
+#include "large.h"
+#include "logging.h"
+
+/*
+ * large messages
+ *
+ * knet_send splits a message in fragments of KNET_LARGE_SEGMENT_SIZE
+ * bytes and writes them to the datafd, each one with a struct
+ * knet_header_large in front, so that nothing bigger than
+ * KNET_MAX_PACKET_SIZE crosses the socket.
+ * The TX thread reads them like any other packet, checks that they
+ * follow each other and sends every one of them as a data packet with
+ * the header in network byte order and KNET_HEADER_VERSION_LARGE.
+ * They go through compression, the reliable layer, fragmentation and
+ * crypto like any other packet. Messages that fit in one fragment lose
+ * the header and go out as plain data packets.
+ *
+ * The receiver writes each fragment to the datafd, with the header in
+ * host byte order again, as soon as the ones before it are in, and
+ * knet_recv copies them in place in the buffer of the application.
+ * Plain data packets are written as one fragment messages.
+ * Nothing is buffered: a fragment that doesn't follow the last one
+ * written means that one got lost (or is late, it can't be written
+ * anyway), and the rest of the message is dropped. Reliable channels
+ * hand fragments over in order.
+ *
+ * The TX and RX parts are protected by tx_mutex.
+ */
+
+static int _large_frag_valid(const struct knet_header_large *hdr, size_t frag_len)
+{
+	if ((!hdr->klh_len) ||
+	    (hdr->klh_len > KNET_MAX_MESSAGE_SIZE) ||
+	    (hdr->klh_frag_num != (hdr->klh_len + KNET_LARGE_SEGMENT_SIZE - 1) / KNET_LARGE_SEGMENT_SIZE) ||
+	    (hdr->klh_frag_seq >= hdr->klh_frag_num)) {
+		return 0;
+	}
+
+	if (hdr->klh_frag_seq + 1 < hdr->klh_frag_num) {
+		return (frag_len == KNET_LARGE_SEGMENT_SIZE);
+	}
+
+	return (frag_len == hdr->klh_len - (size_t)hdr->klh_frag_seq * KNET_LARGE_SEGMENT_SIZE);
+}
+
+/*
+ * wait for the datafd to be ready in the middle of a message
+ */
+static int _large_wait(int fd, short events)
+{
+	struct pollfd pfd;
+	int err;
+
+	memset(&pfd, 0, sizeof(struct pollfd));
+	pfd.fd = fd;
+	pfd.events = events;
+
+	do {
+		err = poll(&pfd, 1, KNET_LARGE_TIMEOUT);
+	} while ((err < 0) && (errno == EINTR));
+
+	if (!err) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	return (err < 0) ? -1 : 0;
+}
+
+ssize_t _large_send(knet_handle_t knet_h, int8_t channel, const char *buff, size_t buff_len)
+{
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+	struct knet_header_large hdr;
+	struct iovec iov[2];
+	size_t offset;
+
+	hdr.klh_msg_id = ++sock->large_send_id;
+	hdr.klh_len = buff_len;
+	hdr.klh_frag_num = (buff_len + KNET_LARGE_SEGMENT_SIZE - 1) / KNET_LARGE_SEGMENT_SIZE;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+
+	for (hdr.klh_frag_seq = 0; hdr.klh_frag_seq < hdr.klh_frag_num; hdr.klh_frag_seq++) {
+		offset = (size_t)hdr.klh_frag_seq * KNET_LARGE_SEGMENT_SIZE;
+		iov[1].iov_base = (void *)(buff + offset);
+		iov[1].iov_len = buff_len - offset;
+		if (iov[1].iov_len > KNET_LARGE_SEGMENT_SIZE) {
+			iov[1].iov_len = KNET_LARGE_SEGMENT_SIZE;
+		}
+
+		while (writev(sock->sockfd[0], iov, 2) < 0) {
+			/*
+			 * nothing has been sent yet, let the application try again
+			 */
+			if ((!hdr.klh_frag_seq) ||
+			    ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+				return -1;
+			}
+			if (_large_wait(sock->sockfd[0], POLLOUT) < 0) {
+				log_debug(knet_h, KNET_SUB_HANDLE, "Unable to send the rest of large message %u on channel %d: %s",
+					  hdr.klh_msg_id, channel, strerror(errno));
+				return -1;
+			}
+		}
+	}
+
+	return buff_len;
+}
+
+ssize_t _large_recv(knet_handle_t knet_h, int8_t channel, char *buff, size_t buff_len)
+{
+	int fd = knet_h->sockfd[channel].sockfd[0];
+	struct knet_header_large hdr, cur;
+	struct iovec iov[2];
+	struct msghdr msg;
+	ssize_t len;
+	int flags = 0; /* the first fragment behaves as the datafd */
+	int drop, fits = 0;
+
+	memset(&cur, 0, sizeof(cur));
+
+	while (1) {
+		memset(&msg, 0, sizeof(struct msghdr));
+		iov[0].iov_base = &hdr;
+		iov[0].iov_len = sizeof(hdr);
+		iov[1].iov_base = buff;
+		iov[1].iov_len = 0;
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 1;
+
+		/*
+		 * look at the header first, the data goes straight
+		 * to its place in buff
+		 */
+		len = recvmsg(fd, &msg, flags | MSG_PEEK | MSG_TRUNC);
+		if (len < 0) {
+			if ((!cur.klh_frag_num) ||
+			    ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+				return -1;
+			}
+			if (_large_wait(fd, POLLIN) < 0) {
+				log_debug(knet_h, KNET_SUB_HANDLE, "Dropping large message %u on channel %d, the rest did not come in: %s",
+					  cur.klh_msg_id, channel, strerror(errno));
+				return -1;
+			}
+			continue;
+		}
+		if (!len) {
+			return 0;
+		}
+
+		drop = 0;
+		if (((size_t)len < sizeof(hdr)) ||
+		    (!_large_frag_valid(&hdr, len - sizeof(hdr)))) {
+			log_debug(knet_h, KNET_SUB_HANDLE, "Dropping invalid large message fragment on channel %d", channel);
+			drop = 1;
+		} else if (!hdr.klh_frag_seq) {
+			if (cur.klh_frag_num) {
+				log_debug(knet_h, KNET_SUB_HANDLE, "Dropping the rest of large message %u on channel %d",
+					  cur.klh_msg_id, channel);
+			}
+			memmove(&cur, &hdr, sizeof(hdr));
+			fits = (hdr.klh_len <= buff_len);
+		} else if ((!cur.klh_frag_num) ||
+			   (hdr.klh_msg_id != cur.klh_msg_id) ||
+			   (hdr.klh_len != cur.klh_len) ||
+			   (hdr.klh_frag_seq != cur.klh_frag_seq + 1)) {
+			drop = 1;
+		} else {
+			cur.klh_frag_seq = hdr.klh_frag_seq;
+		}
+
+		if ((!drop) && (fits)) {
+			iov[1].iov_base = buff + (size_t)hdr.klh_frag_seq * KNET_LARGE_SEGMENT_SIZE;
+			iov[1].iov_len = len - sizeof(hdr);
+		}
+		msg.msg_iovlen = 2;
+
+		if (recvmsg(fd, &msg, MSG_DONTWAIT) < 0) {
+			return -1;
+		}
+
+		if ((drop) || (!cur.klh_frag_num)) {
+			continue;
+		}
+
+		flags = MSG_DONTWAIT;
+
+		if (cur.klh_frag_seq + 1 < cur.klh_frag_num) {
+			continue;
+		}
+
+		if (!fits) {
+			log_debug(knet_h, KNET_SUB_HANDLE, "Large message %u of %u bytes on channel %d does not fit in %zu bytes",
+				  cur.klh_msg_id, cur.klh_len, channel, buff_len);
+			errno = EMSGSIZE;
+			return -1;
+		}
+
+		return cur.klh_len;
+	}
+}
+
+void _large_tx_reset(struct knet_sock *sock)
+{
+	free(sock->large_dst);
+	sock->large_dst = NULL;
+	sock->large_dst_entries = 0;
+	sock->large_frag_num = 0;
+	sock->large_seq = 0;
+}
+
+/*
+ * check the fragment read from the sock of a large channel
+ * (in recv_from_sock_buf).
+ * returns 0 if it can be sent, -1 if it has to be dropped
+ */
+int _large_tx_check(knet_handle_t knet_h, int8_t channel, size_t inlen)
+{
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+	struct knet_header_large hdr;
+
+	if (inlen < sizeof(hdr)) {
+		log_debug(knet_h, KNET_SUB_TX, "Large message fragment on channel %d is too short", channel);
+		return -1;
+	}
+
+	memmove(&hdr, knet_h->recv_from_sock_buf->khp_data_userdata, sizeof(hdr));
+
+	if (!_large_frag_valid(&hdr, inlen - sizeof(hdr))) {
+		log_debug(knet_h, KNET_SUB_TX, "Invalid large message fragment on channel %d (%u of %u, len %zu total %u)",
+			  channel, hdr.klh_frag_seq, hdr.klh_frag_num, inlen - sizeof(hdr), hdr.klh_len);
+		return -1;
+	}
+
+	if (!hdr.klh_frag_seq) {
+		if (sock->large_frag_num) {
+			log_debug(knet_h, KNET_SUB_TX, "Dropping the rest of large message %u on channel %d (%u of %u fragments sent)",
+				  sock->large_id, channel, sock->large_seq, sock->large_frag_num);
+		}
+		_large_tx_reset(sock);
+		sock->large_id = hdr.klh_msg_id;
+		sock->large_frag_num = hdr.klh_frag_num;
+		return 0;
+	}
+
+	/*
+	 * the rest of a message that could not be sent is dropped quietly
+	 */
+	if ((!sock->large_frag_num) ||
+	    (hdr.klh_msg_id != sock->large_id) ||
+	    (hdr.klh_frag_num != sock->large_frag_num) ||
+	    (hdr.klh_frag_seq != sock->large_seq)) {
+		if (sock->large_frag_num) {
+			log_debug(knet_h, KNET_SUB_TX, "Dropping out of order fragment of large message %u on channel %d (%u)",
+				  hdr.klh_msg_id, channel, hdr.klh_frag_seq);
+			_large_tx_reset(sock);
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * the first fragment went through dst_host_filter_fn,
+ * the other ones go to the same place
+ */
+int _large_tx_filter(knet_handle_t knet_h, struct knet_sock *sock, int bcast, int8_t channel,
+		     knet_node_id_t *dst_host_ids, size_t dst_host_ids_entries)
+{
+	sock->large_bcast = bcast;
+	sock->large_channel = channel;
+
+	if ((bcast) || (sock->large_frag_num <= 1)) {
+		return 0;
+	}
+
+	sock->large_dst = malloc(dst_host_ids_entries * sizeof(knet_node_id_t));
+	if (!sock->large_dst) {
+		log_debug(knet_h, KNET_SUB_TX, "Unable to allocate memory for large message %u destinations",
+			  sock->large_id);
+		return -1;
+	}
+	memmove(sock->large_dst, dst_host_ids, dst_host_ids_entries * sizeof(knet_node_id_t));
+	sock->large_dst_entries = dst_host_ids_entries;
+
+	return 0;
+}
+
+/*
+ * err is the result of sending the fragment checked by _large_tx_check
+ */
+void _large_tx_done(knet_handle_t knet_h, int8_t channel, int err)
+{
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+
+	if (err < 0) {
+		log_debug(knet_h, KNET_SUB_TX, "Unable to send large message %u on channel %d: %s",
+			  sock->large_id, channel, strerror(errno));
+		_large_tx_reset(sock);
+		return;
+	}
+
+	sock->large_seq++;
+	if (sock->large_seq >= sock->large_frag_num) {
+		if (sock->large_frag_num > 1) {
+			knet_h->stats.tx_large_messages++;
+		}
+		_large_tx_reset(sock);
+	}
+}
+
+static void _large_rx_reset(struct knet_large_rx *lrx)
+{
+	lrx->msg_id = 0;
+	lrx->frag_num = 0;
+	lrx->next = 0;
+	lrx->channel = -1;
+}
+
+void _large_free(struct knet_host *host)
+{
+	int8_t channel;
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		free(host->large_rx[channel]);
+		host->large_rx[channel] = NULL;
+	}
+}
+
+static struct knet_large_rx *_large_rx_get(knet_handle_t knet_h, struct knet_host *host, int8_t channel)
+{
+	struct knet_large_rx *lrx = host->large_rx[channel];
+
+	if (lrx) {
+		return lrx;
+	}
+
+	lrx = calloc(1, sizeof(struct knet_large_rx));
+	if (!lrx) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to allocate memory for large messages from host %u",
+			  host->host_id);
+		return NULL;
+	}
+	lrx->channel = -1;
+
+	host->large_rx[channel] = lrx;
+
+	return lrx;
+}
+
+/*
+ * large is set if data starts with the struct knet_header_large of a
+ * fragment, otherwise data is a whole message for a large channel.
+ * channel is only meaningful for the first fragment (it went through
+ * dst_host_filter_fn).
+ * returns 1 if the fragment has been consumed (written or dropped),
+ * 0 if the sock is full and we need to try again later
+ */
+int _large_rx_write(knet_handle_t knet_h, struct knet_host *host, int8_t wire_channel,
+		    int8_t channel, unsigned char *data, size_t len, int large)
+{
+	struct knet_header_large *wire_hdr = (struct knet_header_large *)data;
+	struct knet_header_large hdr;
+	struct knet_large_rx *lrx = NULL;
+	struct iovec iov[2];
+	ssize_t outlen;
+
+	if (large) {
+		if (len < KNET_HEADER_LARGE_SIZE) {
+			log_debug(knet_h, KNET_SUB_RX, "Large message fragment from host %u is too short", host->host_id);
+			return 1;
+		}
+
+		hdr.klh_msg_id = ntohl(wire_hdr->klh_msg_id);
+		hdr.klh_len = ntohl(wire_hdr->klh_len);
+		hdr.klh_frag_num = ntohl(wire_hdr->klh_frag_num);
+		hdr.klh_frag_seq = ntohl(wire_hdr->klh_frag_seq);
+		data += KNET_HEADER_LARGE_SIZE;
+		len -= KNET_HEADER_LARGE_SIZE;
+
+		if (!_large_frag_valid(&hdr, len)) {
+			log_debug(knet_h, KNET_SUB_RX, "Invalid large message fragment from host %u (%u of %u, len %zu total %u)",
+				  host->host_id, hdr.klh_frag_seq, hdr.klh_frag_num, len, hdr.klh_len);
+			return 1;
+		}
+
+		lrx = _large_rx_get(knet_h, host, wire_channel);
+		if (!lrx) {
+			return 1;
+		}
+
+		if (!hdr.klh_frag_seq) {
+			if (lrx->next) {
+				log_debug(knet_h, KNET_SUB_RX, "Dropping the rest of large message %u from host %u (%u of %u fragments received)",
+					  lrx->msg_id, host->host_id, lrx->next, lrx->frag_num);
+			}
+			lrx->msg_id = hdr.klh_msg_id;
+			lrx->frag_num = hdr.klh_frag_num;
+			lrx->next = 0;
+			lrx->channel = channel;
+		} else if ((!lrx->frag_num) ||
+			   (hdr.klh_msg_id != lrx->msg_id) ||
+			   (hdr.klh_frag_num != lrx->frag_num) ||
+			   (hdr.klh_frag_seq != lrx->next)) {
+			if (lrx->frag_num) {
+				log_debug(knet_h, KNET_SUB_RX, "Lost a fragment of large message %u from host %u, dropping the rest (%u, expected %u)",
+					  lrx->msg_id, host->host_id, hdr.klh_frag_seq, lrx->next);
+				_large_rx_reset(lrx);
+			}
+			return 1;
+		}
+
+		channel = lrx->channel;
+	} else {
+		if (!len) {
+			return 1;
+		}
+		hdr.klh_msg_id = 0;
+		hdr.klh_len = len;
+		hdr.klh_frag_num = 1;
+		hdr.klh_frag_seq = 0;
+	}
+
+	/*
+	 * channels that are not marked as large never see the header
+	 */
+	if ((!knet_h->sockfd[channel].in_use) ||
+	    (!knet_h->sockfd[channel].is_large)) {
+		if (hdr.klh_frag_seq == 0) {
+			log_debug(knet_h, KNET_SUB_RX, "Dropping large message %u from host %u, channel %d does not take large messages",
+				  hdr.klh_msg_id, host->host_id, channel);
+		}
+		if (lrx) {
+			_large_rx_reset(lrx);
+		}
+		return 1;
+	}
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = data;
+	iov[1].iov_len = len;
+
+	outlen = writev(knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], iov, 2);
+	if ((outlen < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		return 0;
+	}
+	if (outlen <= 0) {
+		knet_h->sock_notify_fn(knet_h->sock_notify_fn_private_data,
+				       knet_h->sockfd[channel].sockfd[0],
+				       channel,
+				       KNET_NOTIFY_RX,
+				       outlen,
+				       errno);
+		if (lrx) {
+			_large_rx_reset(lrx);
+		}
+		return 1;
+	}
+
+	if (lrx) {
+		lrx->next++;
+		if (lrx->next >= lrx->frag_num) {
+			knet_h->stats.rx_large_messages++;
+			_large_rx_reset(lrx);
+		}
+	}
+
+	return 1;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#ifndef __KNET_LARGE_H__
+#define __KNET_LARGE_H__
+
+#include "internals.h"
+#include "onwire.h"
+
+/*
+ * fragments of large messages cross the datafd with a struct
+ * knet_header_large in host byte order in front, and still have
+ * to fit in KNET_MAX_PACKET_SIZE
+ */
+#define KNET_LARGE_SEGMENT_SIZE (KNET_MAX_PACKET_SIZE - KNET_HEADER_LARGE_SIZE)
+
+/*
+ * how long knet_send and knet_recv wait, in msecs, for room
+ * for the next fragment or for the next fragment to come in
+ */
+#define KNET_LARGE_TIMEOUT 1000
+
+/*
+ * a message being received from a node on a channel.
+ * Fragments are written to the sock as soon as the ones
+ * before them are in.
+ */
+
+struct knet_large_rx {
+	uint32_t msg_id;
+	uint32_t frag_num;		/* fragments of the message, 0 if none */
+	uint32_t next;			/* next fragment to write */
+	int8_t channel;			/* local channel, from the first fragment */
+};
+
+/*
+ * application side, called by knet_send and knet_recv
+ * with the global read lock held
+ */
+ssize_t _large_send(knet_handle_t knet_h, int8_t channel, const char *buff, size_t buff_len);
+
+ssize_t _large_recv(knet_handle_t knet_h, int8_t channel, char *buff, size_t buff_len);
+
+void _large_free(struct knet_host *host);
+
+/*
+ * needs tx_mutex
+ */
+void _large_tx_reset(struct knet_sock *sock);
+
+int _large_tx_check(knet_handle_t knet_h, int8_t channel, size_t inlen);
+
+int _large_tx_filter(knet_handle_t knet_h, struct knet_sock *sock, int bcast, int8_t channel,
+		     knet_node_id_t *dst_host_ids, size_t dst_host_ids_entries);
+
+void _large_tx_done(knet_handle_t knet_h, int8_t channel, int err);
+
+int _large_rx_write(knet_handle_t knet_h, struct knet_host *host, int8_t wire_channel,
+		    int8_t channel, unsigned char *data, size_t len, int large);
+
+#endif
@@ -51,6 +51,13 @@ typedef uint16_t knet_node_id_t;
 
 #define KNET_MAX_PACKET_SIZE 65536
 
+/*
+ * Maximum message size that can be sent on a channel
+ * marked as large, see knet_handle_set_channel_large
+ */
+
+#define KNET_MAX_MESSAGE_SIZE 4194304
+
 /*
  * Buffers used for pretty logging
  *  host is used to store both ip addresses and hostnames
@@ -78,6 +85,39 @@ typedef uint16_t knet_node_id_t;
 
 #define KNET_LINK_FLAG_TRAFFICHIPRIO (1ULL << 0)
 
+/*
+ * Where possible, ask the kernel to timestamp packets received
+ * on the link socket (SO_TIMESTAMPING) and use those timestamps
+ * to compute latency and jitter. Links that share the same source
+ * address share the socket, the flag is applied when the socket
+ * is created. If the kernel does not provide timestamps, latency
+ * is measured by libknet threads as usual.
+ */
+
+#define KNET_LINK_FLAG_TIMESTAMP (1ULL << 1)
+
+/*
+ * Only valid for KNET_TRANSPORT_SHM links: data is passed in clear
+ * even if crypto is enabled on the handle. It applies to the data
+ * sent to hosts that have no other enabled links, when the packet
+ * doesn't go along the broadcast tree, to a multicast group or with
+ * parity fragments. Reliable channels and internal protocol packets
+ * are still encrypted.
+ * Both ends must set it.
+ */
+
+#define KNET_LINK_FLAG_NOCRYPT (1ULL << 2)
+
+/*
+ * Only valid for KNET_TRANSPORT_UDP links: give the link its own
+ * socket, bound to src_addr and connect()ed to dst_addr, instead of
+ * sharing the socket of src_addr with other links. The kernel keeps
+ * the route cached on the socket and ICMP errors from the peer are
+ * reported on it. Dynamic links (dst_addr NULL) ignore the flag.
+ */
+
+#define KNET_LINK_FLAG_CONNECTED (1ULL << 3)
+
 /*
  * Handle flags
  */
@@ -88,6 +128,13 @@ typedef uint16_t knet_node_id_t;
 
 #define KNET_HANDLE_FLAG_PRIVILEGED (1ULL << 0)
 
+/*
+ * Drive UDP link sockets with io_uring instead of epoll and
+ * recvmmsg/sendmmsg (Linux >= 6.0 only).
+ */
+
+#define KNET_HANDLE_FLAG_IO_URING (1ULL << 1)
+
 /*
  * threads timer resolution (see knet_handle_set_threads_timer_res below)
  */
@@ -131,6 +178,11 @@ typedef struct knet_handle *knet_handle_t;
  *            communication sockets.  If disabled, failure to acquire large
  *            enough socket buffers is ignored but logged.  Inadequate buffers
  *            lead to poor performance.
+ *            KNET_HANDLE_FLAG_IO_URING: receive from UDP links with multishot
+ *            io_uring requests into a pool of buffers registered with the kernel,
+ *            and submit the TX batches as a single io_uring submission,
+ *            instead of waking up on epoll and calling recvmmsg/sendmmsg
+ *            for every socket. Other transports are not affected.
  *
  * @return
  * on success, a new knet_handle_t is returned.
@@ -138,6 +190,8 @@ typedef struct knet_handle *knet_handle_t;
  * knet-specific errno values:
  *   ENAMETOOLONG - socket buffers couldn't be set big enough and KNET_HANDLE_FLAG_PRIVILEGED was specified
  *   ERANGE       - buffer size readback returned unexpected type
+ *   EOPNOTSUPP   - KNET_HANDLE_FLAG_IO_URING was specified but libknet was built
+ *                  without io_uring support
  */
 
 knet_handle_t knet_handle_new(knet_node_id_t host_id,
@@ -210,6 +264,60 @@ int knet_handle_set_threads_timer_res(knet_handle_t knet_h,
 int knet_handle_get_threads_timer_res(knet_handle_t knet_h,
 				      useconds_t *timeres);
 
+#define KNET_BUSY_POLL_MAX 100000
+
+/**
+ * knet_handle_set_busy_poll
+ * @brief Trade CPU for lower receive latency
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * usecs    - spin budget in usecs, 0 (default) disables busy polling,
+ *            up to KNET_BUSY_POLL_MAX
+ *
+ * After receiving packets, the thread reading from the links keeps
+ * polling them without sleeping for up to usecs, before blocking again
+ * until the next packet arrives. Bursts of packets and request/reply
+ * traffic are then picked up without paying the thread wakeup latency,
+ * at the cost of a CPU core busy while traffic is flowing.
+ *
+ * The link sockets also get SO_BUSY_POLL set to usecs and
+ * SO_PREFER_BUSY_POLL, to let the kernel poll the NIC queues directly.
+ * Raising SO_BUSY_POLL above net.core.busy_read and setting
+ * SO_PREFER_BUSY_POLL require CAP_NET_ADMIN, otherwise only the
+ * userspace spinning is used.
+ *
+ * Busy polling is experimental. It only pays off when the receiving
+ * thread has a core to itself: on a shared core the spinning thread
+ * competes with the threads it is waiting for, and tail latency gets
+ * worse with bigger budgets (knet_bench -T latency measured a higher
+ * p99 at 100 usecs than with busy polling off on a single core).
+ * Measure with the target workload before enabling it.
+ *
+ * @return
+ * knet_handle_set_busy_poll returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_set_busy_poll(knet_handle_t knet_h, uint32_t usecs);
+
+/**
+ * knet_handle_get_busy_poll
+ * @brief Get the busy polling spin budget
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * usecs    - pointer where to store the spin budget, 0 if disabled
+ *
+ * @return
+ * knet_handle_get_busy_poll returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_get_busy_poll(knet_handle_t knet_h, uint32_t *usecs);
+
 /**
  * knet_handle_enable_sock_notify
  * @brief Register a callback to receive socket events
@@ -275,6 +383,8 @@ int knet_handle_enable_sock_notify(knet_handle_t knet_h,
  *            proper error if the packet size is not within boundaries.
  *            Applications using their own functions to write to the
  *            datafd should NOT write more than KNET_MAX_PACKET_SIZE.
+ *            Channels marked with knet_handle_set_channel_large(3)
+ *            take bigger messages through knet_send/knet_recv.
  *
  *            Please refer to handle.c on how to set up a socketpair.
  *
@@ -378,6 +488,369 @@ int knet_handle_get_channel(knet_handle_t knet_h, const int datafd, int8_t *chan
 
 int knet_handle_get_datafd(knet_handle_t knet_h, const int8_t channel, int *datafd);
 
+/**
+ * knet_handle_set_channel_bulk
+ * @brief Mark a channel as carrying bulk traffic
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - channel to mark, see knet_handle_add_datafd(3)
+ *
+ * enabled  - 1 to mark the channel as bulk, 0 (default) for normal traffic
+ *
+ * Data read from a bulk channel is paced at the rate allowed by the
+ * congestion controller of each link it is sent over, see
+ * knet_link_set_congestion_control(3). While the channel is paced,
+ * knet stops reading from datafd and writes from the application
+ * will block or fail with EAGAIN once the socket buffer is full.
+ * Links without congestion control are not paced.
+ * Data sent with knet_send_sync(3) is accounted for but never delayed.
+ * The flag is reset when the datafd is removed.
+ *
+ * @return
+ * knet_handle_set_channel_bulk returns
+ * @retval 0 on success
+ * @retval -1 on error and errno is set.
+ */
+
+int knet_handle_set_channel_bulk(knet_handle_t knet_h, const int8_t channel, unsigned int enabled);
+
+/**
+ * knet_handle_get_channel_bulk
+ * @brief Get the bulk flag of a channel
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - see knet_handle_add_datafd(3)
+ *
+ * *enabled - will contain 1 if the channel is marked as bulk, 0 otherwise
+ *
+ * @return
+ * knet_handle_get_channel_bulk returns
+ * @retval 0 on success
+ *   and *enabled will contain the result
+ * @retval -1 on error and errno is set.
+ *   and *enabled content is meaningless
+ */
+
+int knet_handle_get_channel_bulk(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled);
+
+/**
+ * knet_handle_set_channel_reliable
+ * @brief Enable or disable reliable, ordered delivery on a channel
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - channel to mark, see knet_handle_add_datafd(3)
+ *
+ * enabled  - 1 to make the channel reliable, 0 (default) for best effort
+ *
+ * Data read from a reliable channel is retransmitted by knet until
+ * each destination node acks it, and the destination nodes deliver it
+ * to their datafd in the order it was sent, without duplicates.
+ * Ordering and retransmissions are per destination node. Lost packets
+ * are retransmitted after 3 later packets have been acked or after
+ * a timeout derived from the links latency.
+ *
+ * Up to 256 packets per destination node can be in flight, after that
+ * knet stops reading from datafd (knet_send_sync(3) fails with EAGAIN)
+ * until some are acked. A packet that is not acked after 10 retransmits
+ * is given up on and the destination node stops waiting for it.
+ * Destination nodes need to support reliable channels, but don't need
+ * to configure them. Data sent to nodes running a knet version without
+ * reliable channels (that don't advertise them in their pings) is sent
+ * best effort, as on any other channel. Broadcast data on a reliable channel is compressed
+ * once but encrypted separately for each destination node.
+ * The flag is reset when the datafd is removed.
+ *
+ * @return
+ * knet_handle_set_channel_reliable returns
+ * @retval 0 on success
+ * @retval -1 on error and errno is set.
+ */
+
+int knet_handle_set_channel_reliable(knet_handle_t knet_h, const int8_t channel, unsigned int enabled);
+
+/**
+ * knet_handle_get_channel_reliable
+ * @brief Get the reliable flag of a channel
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - see knet_handle_add_datafd(3)
+ *
+ * *enabled - will contain 1 if the channel is reliable, 0 otherwise
+ *
+ * @return
+ * knet_handle_get_channel_reliable returns
+ * @retval 0 on success
+ *   and *enabled will contain the result
+ * @retval -1 on error and errno is set.
+ *   and *enabled content is meaningless
+ */
+
+int knet_handle_get_channel_reliable(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled);
+
+/**
+ * knet_handle_set_channel_unordered
+ * @brief Let a transport deliver the packets of a channel out of order
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - channel to mark, see knet_handle_add_datafd(3)
+ *
+ * enabled  - 1 to allow out of order delivery, 0 (default) to keep
+ *            the transport ordering
+ *
+ * SCTP links send each data channel on its own stream, so a lost
+ * chunk only delays the packets of its channel. Packets of an unordered
+ * channel are sent as unordered SCTP chunks and are not delayed by
+ * lost chunks at all, same as on UDP links. Applications that need
+ * order on top of it can use knet_handle_set_channel_reliable(3),
+ * which reorders on the destination node.
+ * Transports without streams ignore the flag.
+ * The flag is reset when the datafd is removed.
+ *
+ * @return
+ * knet_handle_set_channel_unordered returns
+ * @retval 0 on success
+ * @retval -1 on error and errno is set.
+ */
+
+int knet_handle_set_channel_unordered(knet_handle_t knet_h, const int8_t channel, unsigned int enabled);
+
+/**
+ * knet_handle_get_channel_unordered
+ * @brief Get the unordered flag of a channel
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - see knet_handle_add_datafd(3)
+ *
+ * *enabled - will contain 1 if the channel is unordered, 0 otherwise
+ *
+ * @return
+ * knet_handle_get_channel_unordered returns
+ * @retval 0 on success
+ *   and *enabled will contain the result
+ * @retval -1 on error and errno is set.
+ *   and *enabled content is meaningless
+ */
+
+int knet_handle_get_channel_unordered(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled);
+
+/**
+ * knet_handle_set_channel_large
+ * @brief Enable or disable messages bigger than KNET_MAX_PACKET_SIZE on a channel
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - channel to mark, see knet_handle_add_datafd(3)
+ *
+ * enabled  - 1 to carry messages up to KNET_MAX_MESSAGE_SIZE, 0 (default)
+ *            to carry up to KNET_MAX_PACKET_SIZE
+ *
+ * Large channels take messages of 1 to KNET_MAX_MESSAGE_SIZE bytes with
+ * knet_send(3) and return whole messages with knet_recv(3). knet splits
+ * the messages in fragments that fit in one data packet and puts them
+ * back together in the buffer given to knet_recv(3), as they come in,
+ * without buffering them. The datafd carries the fragments with a knet
+ * header in front, so large channels must be used through knet_send(3)
+ * and knet_recv(3) only, each one called by one thread at a time.
+ * Nothing bigger than KNET_MAX_PACKET_SIZE crosses the datafd, so the
+ * default socket buffers are enough: large messages don't need
+ * KNET_HANDLE_FLAG_PRIVILEGED or bigger net.core.wmem_max/rmem_max.
+ *
+ * Messages that fit in one data packet are sent as on any other channel.
+ * Bigger ones are only sent to the nodes that support large messages,
+ * and only delivered on channels marked as large: older nodes, or nodes
+ * that don't mark the channel, never get fragments of them.
+ *
+ * A message that misses a fragment is dropped. Use
+ * knet_handle_set_channel_reliable(3) if messages must not be lost.
+ *
+ * The datafd must be a socket that preserves message boundaries
+ * (the default SOCK_SEQPACKET socketpair created by knet_handle_add_datafd(3)
+ * or a datagram socket). dst_host_filter_fn is called with the data of the
+ * first fragment, on TX and RX, and its decision applies to the whole message.
+ * knet_send_sync(3) can't be used on large channels.
+ * The flag is reset when the datafd is removed.
+ *
+ * @return
+ * knet_handle_set_channel_large returns
+ * @retval 0 on success
+ * @retval -1 on error and errno is set.
+ */
+
+int knet_handle_set_channel_large(knet_handle_t knet_h, const int8_t channel, unsigned int enabled);
+
+/**
+ * knet_handle_get_channel_large
+ * @brief Get the large messages flag of a channel
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * channel  - see knet_handle_add_datafd(3)
+ *
+ * *enabled - will contain 1 if the channel accepts large messages, 0 otherwise
+ *
+ * @return
+ * knet_handle_get_channel_large returns
+ * @retval 0 on success
+ *   and *enabled will contain the result
+ * @retval -1 on error and errno is set.
+ *   and *enabled content is meaningless
+ */
+
+int knet_handle_get_channel_large(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled);
+
+/**
+ * knet_handle_set_flow_control
+ * @brief Enable or disable flow control between nodes
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * enabled  - 1 to enable flow control, 0 (default) to disable it
+ *
+ * With flow control enabled, a node tells every other node, per channel,
+ * how much more data its local datafd can take before the application
+ * reads from it. A sender that has used up the window of any of the
+ * destinations stops reading from its datafd, instead of sending (and
+ * encrypting) packets that would be dropped at the receiver.
+ * Writes from the application will block or fail with EAGAIN once the
+ * socket buffer is full, and knet_send_sync(3) fails with EAGAIN.
+ *
+ * Only datafds created by knet, or sockets whose queue can be measured,
+ * advertise a window. Nodes that don't send credits (older versions or
+ * flow control disabled) are never waited for, and a window is ignored
+ * if the node stops refreshing it.
+ * Both nodes need flow control enabled for it to take effect.
+ *
+ * @return
+ * knet_handle_set_flow_control returns
+ * @retval 0 on success
+ * @retval -1 on error and errno is set.
+ */
+
+int knet_handle_set_flow_control(knet_handle_t knet_h, unsigned int enabled);
+
+/**
+ * knet_handle_get_flow_control
+ * @brief Get the flow control status
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * *enabled - will contain 1 if flow control is enabled, 0 otherwise
+ *
+ * @return
+ * knet_handle_get_flow_control returns
+ * @retval 0 on success
+ *   and *enabled will contain the result
+ * @retval -1 on error and errno is set.
+ *   and *enabled content is meaningless
+ */
+
+int knet_handle_get_flow_control(knet_handle_t knet_h, unsigned int *enabled);
+
+/**
+ * knet_handle_set_relay
+ * @brief Enable or disable relaying data through other nodes
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * enabled  - 1 to enable relay routing, 0 (default) to disable it
+ *
+ * With relay enabled, every second a node tells the other nodes which
+ * nodes it can reach, directly or through other relays, with the latency
+ * and data MTU of the path. When a node has no active links to another node,
+ * but some of the nodes it is connected to can reach it, it sends the data
+ * through the one with the lowest latency. The node is then reported as
+ * reachable with remote set to 1 (see knet_host_get_status(3)) and its data
+ * MTU is the one of the whole path, minus the relay overhead.
+ * A packet goes through at most 3 relays.
+ *
+ * Only data and host info are relayed. Pings, PMTUd, flow control credits
+ * and reliable channels acks are sent on the links of each node, so flow
+ * control and reliable channels need the nodes to be directly connected
+ * in both directions. Relayed packets are encrypted twice, once for the
+ * destination node and once for each relay.
+ * All the nodes on the path need relay enabled.
+ *
+ * @return
+ * knet_handle_set_relay returns
+ * @retval 0 on success
+ * @retval -1 on error and errno is set.
+ */
+
+int knet_handle_set_relay(knet_handle_t knet_h, unsigned int enabled);
+
+/**
+ * knet_handle_get_relay
+ * @brief Get the relay routing status
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * *enabled - will contain 1 if relay routing is enabled, 0 otherwise
+ *
+ * @return
+ * knet_handle_get_relay returns
+ * @retval 0 on success
+ *   and *enabled will contain the result
+ * @retval -1 on error and errno is set.
+ *   and *enabled content is meaningless
+ */
+
+int knet_handle_get_relay(knet_handle_t knet_h, unsigned int *enabled);
+
+/**
+ * knet_handle_set_bcast_tree
+ * @brief Send broadcasts along a tree of nodes
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * fanout   - 0 (default) to send broadcasts to every node, or the number
+ *            of nodes (2 to 16) each node sends a broadcast to
+ *
+ * When a broadcast goes to more than fanout nodes, the sender splits
+ * the other nodes, in node id order, into fanout groups and sends the
+ * packet only to the node with the lowest latency of each group, which
+ * delivers it and does the same with the rest of its group. The sender
+ * then sends fanout packets instead of one per node, and a broadcast
+ * goes through about log(nodes) / log(fanout) nodes before reaching
+ * the last one.
+ *
+ * Broadcasts along the tree are fragmented once, for the smallest data MTU
+ * of all the nodes, minus the tree overhead, and are encrypted twice,
+ * once by the sender and once by each node on the way. Reliable channels
+ * and forward error correction are not used along the tree.
+ * All the nodes need to support it, but only the senders need it enabled.
+ *
+ * @return
+ * knet_handle_set_bcast_tree returns
+ * @retval 0 on success
+ * @retval -1 on error and errno is set.
+ */
+
+int knet_handle_set_bcast_tree(knet_handle_t knet_h, unsigned int fanout);
+
+/**
+ * knet_handle_get_bcast_tree
+ * @brief Get the broadcast tree fanout
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * *fanout  - will contain the fanout, 0 if broadcasts are sent to every node
+ *
+ * @return
+ * knet_handle_get_bcast_tree returns
+ * @retval 0 on success
+ *   and *fanout will contain the result
+ * @retval -1 on error and errno is set.
+ *   and *fanout content is meaningless
+ */
+
+int knet_handle_get_bcast_tree(knet_handle_t knet_h, unsigned int *fanout);
+
 /**
  * knet_recv
  * @brief Receive data from knet nodes
@@ -393,6 +866,12 @@ int knet_handle_get_datafd(knet_handle_t knet_h, const int8_t channel, int *data
  * @return
  * knet_recv is a commodity function to wrap iovec operations
  * around a socket. It returns a call to readv(2).
+ * On large channels it returns one whole message, up to
+ * KNET_MAX_MESSAGE_SIZE bytes (see knet_handle_set_channel_large(3)).
+ * Once the first fragment of a message is in, it waits for the
+ * others even on a non blocking datafd. It fails with ETIMEDOUT if
+ * the rest of the message doesn't come, and with EMSGSIZE, after
+ * dropping it, if the message doesn't fit in buff.
  */
 
 ssize_t knet_recv(knet_handle_t knet_h,
@@ -415,6 +894,11 @@ ssize_t knet_recv(knet_handle_t knet_h,
  * @return
  * knet_send is a commodity function to wrap iovec operations
  * around a socket. It returns a call to writev(2).
+ * On large channels it sends one whole message, up to
+ * KNET_MAX_MESSAGE_SIZE bytes (see knet_handle_set_channel_large(3)).
+ * Once the first fragment is queued, it waits for room for the
+ * others even on a non blocking datafd, and fails with ETIMEDOUT
+ * if there is none for too long.
  */
 
 ssize_t knet_send(knet_handle_t knet_h,
@@ -444,6 +928,7 @@ ssize_t knet_send(knet_handle_t knet_h,
  * knet_send_sync sends only one packet to one host at a time.
  * It does NOT support multiple destinations or multicast packets.
  * Decision is still based on dst_host_filter_fn.
+ * Channels marked with knet_handle_set_channel_large(3) are not supported.
  *
  * @return
  * knet_send_sync returns 0 on success and -1 on error.
@@ -818,6 +1303,33 @@ struct knet_handle_stats {
 	uint64_t rx_crypt_time_ave;
 	uint64_t rx_crypt_time_min;
 	uint64_t rx_crypt_time_max;
+
+	/* reliable channels, see knet_handle_set_channel_reliable(3) */
+	uint64_t tx_reliable_retransmits;
+	uint64_t tx_reliable_lost;
+	uint64_t rx_reliable_duplicates;
+	uint64_t rx_reliable_out_of_order;
+
+	/* forward error correction, see knet_link_set_fec(3) */
+	uint64_t tx_fec_packets;
+	uint64_t rx_fec_rebuilt;
+
+	/* large messages, see knet_handle_set_channel_large(3) */
+	uint64_t tx_large_messages;
+	uint64_t rx_large_messages;
+
+	/* relay routing, see knet_handle_set_relay(3) */
+	uint64_t tx_relayed_packets;
+	uint64_t rx_relayed_packets;
+	uint64_t rx_relay_forwarded;
+
+	/* broadcast tree, see knet_handle_set_bcast_tree(3) */
+	uint64_t tx_bcast_tree_packets;
+	uint64_t rx_bcast_tree_forwarded;
+
+	/* IP multicast, see knet_handle_set_mcast(3) */
+	uint64_t tx_mcast_packets;
+	uint64_t rx_mcast_packets;
 };
 
 /**
@@ -1207,6 +1719,33 @@ struct knet_host_status {
 int knet_host_get_status(knet_handle_t knet_h, knet_node_id_t host_id,
 			 struct knet_host_status *status);
 
+/**
+ * knet_host_pmtud_get
+ *
+ * @brief Get the data MTU used to send packets to a host
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * host_id  - see knet_host_add(3)
+ *
+ * data_mtu - pointer where to store data_mtu
+ *
+ * Packets to a host are fragmented to fit the smallest MTU of
+ * the links that can be used to reach it, instead of the
+ * handle data MTU (see knet_handle_pmtud_get(3)), that is the
+ * smallest across all hosts.
+ * If the host has no links with a known MTU yet, the handle
+ * data MTU is returned.
+ *
+ * @return
+ * knet_host_pmtud_get returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_host_pmtud_get(knet_handle_t knet_h, knet_node_id_t host_id,
+			unsigned int *data_mtu);
+
 /*
  * link structs/API calls
  *
@@ -1284,6 +1823,8 @@ int knet_addrtostr(const struct sockaddr_storage *ss, socklen_t sslen,
 #define KNET_TRANSPORT_LOOPBACK 0
 #define KNET_TRANSPORT_UDP      1
 #define KNET_TRANSPORT_SCTP     2
+#define KNET_TRANSPORT_MCAST    3
+#define KNET_TRANSPORT_SHM      4
 #define KNET_MAX_TRANSPORTS     UINT8_MAX
 
 /*
@@ -1296,6 +1837,16 @@ int knet_addrtostr(const struct sockaddr_storage *ss, socklen_t sslen,
  * local host.
  */
 
+/*
+ * The SHM transport connects two handles running on the same machine
+ * through a pair of shared memory rings, without going through the network
+ * stack. src_addr and dst_addr are only used to name the rings and must be
+ * swapped on the other end, for example 127.0.0.1 and two different ports.
+ * The rings are only accessible to the user running the process, and the
+ * link comes up once both ends are configured. Dynamic links are not
+ * supported.
+ */
+
 struct knet_transport_info {
 	const char *name;   /* UDP/SCTP/etc... */
 	uint8_t id;         /* value that can be used for link_set_config */
@@ -1393,28 +1944,152 @@ int knet_handle_set_transport_reconnect_interval(knet_handle_t knet_h, uint32_t
 
 int knet_handle_get_transport_reconnect_interval(knet_handle_t knet_h, uint32_t *msecs);
 
+#define KNET_SOCKBUF_MIN_SIZE 65536
+#define KNET_SOCKBUF_MAX_SIZE 1073741824
+
 /**
- * knet_link_set_config
+ * knet_handle_set_sockbuf_limits
  *
- * @brief Configure the link to a host
+ * @brief Resize the link socket buffers based on kernel drops and usage
  *
  * knet_h    - pointer to knet_handle_t
  *
- * host_id   - see knet_host_add(3)
- *
- * link_id   - see knet_link_set_config(3)
+ * min_size  - smallest receive/send buffer in bytes, from
+ *             KNET_SOCKBUF_MIN_SIZE to max_size
  *
- * transport - one of the KNET_TRANSPORT_xxx constants
+ * max_size  - biggest receive/send buffer in bytes, up to
+ *             KNET_SOCKBUF_MAX_SIZE
  *
- * src_addr  - sockaddr_storage that can be either IPv4 or IPv6
+ * Link sockets are created with 8MB buffers. Once both limits are set,
+ * every second the buffers of each socket are doubled, up to max_size,
+ * when the kernel dropped packets on it or the queue is more than 3/4 full,
+ * and halved, down to min_size, after a minute with the queue almost empty.
+ * Sizes are the ones passed to SO_RCVBUF/SO_SNDBUF, the kernel might
+ * account for more. Buffers above net.core.rmem_max/wmem_max require
+ * a handle with KNET_HANDLE_FLAG_PRIVILEGED.
  *
- * dst_addr  - sockaddr_storage that can be either IPv4 or IPv6
- *             this can be null if we don't know the incoming
- *             IP address/port and the link will remain quiet
- *             till the node on the other end will initiate a
- *             connection
+ * Setting both limits to 0 (default) stops resizing, the buffers are
+ * left at their current size.
  *
- * flags     - KNET_LINK_FLAG_*
+ * Kernel drops and buffer sizes are reported in knet_link_get_status(3)
+ * either way.
+ *
+ * @return
+ * knet_handle_set_sockbuf_limits returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_set_sockbuf_limits(knet_handle_t knet_h, uint32_t min_size, uint32_t max_size);
+
+/**
+ * knet_handle_get_sockbuf_limits
+ *
+ * @brief Get the link socket buffer limits
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * min_size  - pointer where to store the smallest buffer size
+ *
+ * max_size  - pointer where to store the biggest buffer size
+ *
+ * both are 0 if the buffers are not resized.
+ *
+ * @return
+ * knet_handle_get_sockbuf_limits returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_get_sockbuf_limits(knet_handle_t knet_h, uint32_t *min_size, uint32_t *max_size);
+
+/**
+ * knet_handle_set_mcast
+ *
+ * @brief Send broadcast data to an IP multicast group
+ *
+ * knet_h     - pointer to knet_handle_t
+ *
+ * link_id    - the links with this id to the other hosts
+ *              (see knet_link_set_config(3)) reach the group
+ *
+ * src_addr   - local address of the interface used to join the group,
+ *              same family as mcast_addr. The port is ignored.
+ *
+ * mcast_addr - IPv4 or IPv6 multicast address and port of the group,
+ *              or NULL to leave the group.
+ *
+ * Broadcast data (see knet_send(3)) is sent once to the group instead
+ * of once on the link to each host, as long as that host reported it
+ * joined the same group and its link with link_id is connected.
+ * Hosts that don't are sent the data on their links as usual.
+ * Unicast data, reliable channels, heartbeats and PMTUD stay on
+ * the links, and the data MTU used for the group is the smallest
+ * data MTU of the hosts that receive it.
+ *
+ * All the nodes must use the same group for the same link_id and the
+ * network between them must carry multicast. Packets received from the
+ * group go through the same checks and deduplication as the ones
+ * received from the links.
+ *
+ * @return
+ * knet_handle_set_mcast returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_set_mcast(knet_handle_t knet_h, uint8_t link_id,
+			  struct sockaddr_storage *src_addr,
+			  struct sockaddr_storage *mcast_addr);
+
+/**
+ * knet_handle_get_mcast
+ *
+ * @brief Get the IP multicast group of a link id
+ *
+ * knet_h     - pointer to knet_handle_t
+ *
+ * link_id    - see knet_handle_set_mcast(3)
+ *
+ * src_addr   - sockaddr_storage where the local address is written
+ *
+ * mcast_addr - sockaddr_storage where the group is written
+ *
+ * enabled    - set to 1 if a group is configured for link_id, 0 otherwise
+ *
+ * @return
+ * knet_handle_get_mcast returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_get_mcast(knet_handle_t knet_h, uint8_t link_id,
+			  struct sockaddr_storage *src_addr,
+			  struct sockaddr_storage *mcast_addr,
+			  uint8_t *enabled);
+
+/**
+ * knet_link_set_config
+ *
+ * @brief Configure the link to a host
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * host_id   - see knet_host_add(3)
+ *
+ * link_id   - see knet_link_set_config(3)
+ *
+ * transport - one of the KNET_TRANSPORT_xxx constants
+ *
+ * src_addr  - sockaddr_storage that can be either IPv4 or IPv6
+ *
+ * dst_addr  - sockaddr_storage that can be either IPv4 or IPv6
+ *             this can be null if we don't know the incoming
+ *             IP address/port and the link will remain quiet
+ *             till the node on the other end will initiate a
+ *             connection
+ *
+ * flags     - KNET_LINK_FLAG_*
  *
  * @return
  * knet_link_set_config returns
@@ -1799,6 +2474,32 @@ struct knet_link_stats {
 	time_t   last_down_times[MAX_LINK_EVENTS];
 	int8_t   last_up_time_index;
 	int8_t   last_down_time_index;
+
+	/*
+	 * how many times data for this link has been redirected
+	 * to a backup link by the TX failover fast path
+	 */
+	uint64_t tx_data_failovers;
+
+	/*
+	 * latency jitter in usecs, smoothed variation between
+	 * consecutive latency samples (see RFC3550 6.4.1)
+	 */
+	uint32_t latency_jitter;
+
+	/*
+	 * packets dropped by the kernel because the receive buffer
+	 * of the link socket was full (SO_RXQ_OVFL). Links can share
+	 * the same socket, the counter is per socket.
+	 */
+	uint32_t rx_sock_drops;
+
+	/*
+	 * current receive/send buffer sizes of the link socket,
+	 * see knet_handle_set_sockbuf_limits(3)
+	 */
+	uint32_t sock_rcvbuf;
+	uint32_t sock_sndbuf;
 	/* Always add new stats at the end */
 };
 
@@ -1824,6 +2525,26 @@ struct knet_link_status {
 					 * requirements to pad packets to some specific boundaries. */
 	/* Link statistics */
 	struct knet_link_stats stats;
+	/*
+	 * bandwidth estimation in kbit/s, see knet_link_set_bandwidth_probe(3)
+	 * bw_capacity  - capacity of the link towards the remote node, estimated
+	 *                by bandwidth probes. 0 if probing is disabled or
+	 *                no estimate is available yet.
+	 * bw_delivered - data rate delivered to the remote node over the last
+	 *                ping interval, as reported by the remote node.
+	 * bw_available - bw_capacity not used by bw_delivered. 0 if unknown.
+	 */
+	uint32_t bw_capacity;
+	uint32_t bw_delivered;
+	uint32_t bw_available;
+	/*
+	 * congestion control, see knet_link_set_congestion_control(3)
+	 * cc_rate        - rate in kbit/s allowed to bulk channels on this link.
+	 *                  0 if congestion control is disabled.
+	 * cc_queue_delay - last queuing delay estimate in usecs
+	 */
+	uint32_t cc_rate;
+	uint32_t cc_queue_delay;
 };
 
 /**
@@ -1853,6 +2574,401 @@ struct knet_link_status {
 int knet_link_get_status(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
 			 struct knet_link_status *status, size_t struct_size);
 
+/**
+ * struct knet_link_cache
+ *
+ * @brief what knet has learned about a link and can be reused
+ *        after a restart
+ *
+ * size                  ABI checking, filled in by knet_link_get_cache
+ *
+ * path_mtu              onwire path MTU discovered by PMTUd, including
+ *                       IP/transport headers. knet and crypto overheads
+ *                       are added back when the value is restored, so it
+ *                       can be reused even if crypto configuration changes.
+ *                       0 if PMTUd has not completed on this link yet.
+ *
+ * latency               average latency of the link (see knet_link_status),
+ *                       0 if unknown.
+ */
+
+struct knet_link_cache {
+	size_t size;                    /* For ABI checking */
+	uint32_t path_mtu;
+	unsigned long long latency;
+};
+
+/**
+ * knet_link_get_cache
+ *
+ * @brief Get the link MTU and latency to restore them later
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * host_id   - see knet_host_add(3)
+ *
+ * link_id   - see knet_link_set_config(3)
+ *
+ * cache     - pointer to knet_link_cache struct
+ *
+ * struct_size - max size of knet_link_cache - allows library to
+ *               add fields without ABI change. Returned structure
+ *               will be truncated to this length and .size member
+ *               indicates the full size.
+ *
+ * The application can store the content of the struct (for example
+ * at shutdown) and pass it back to knet_link_set_cache(3) after
+ * a restart.
+ *
+ * @return
+ * knet_link_get_cache returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_get_cache(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+			struct knet_link_cache *cache, size_t struct_size);
+
+/**
+ * knet_link_set_cache
+ *
+ * @brief Restore link MTU and latency from a previous run
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * host_id   - see knet_host_add(3)
+ *
+ * link_id   - see knet_link_set_config(3)
+ *
+ * cache     - pointer to knet_link_cache struct as returned
+ *             by knet_link_get_cache(3)
+ *
+ * struct_size - size of the knet_link_cache struct the application
+ *               has been built with.
+ *
+ * Without cache, knet starts sending data fragmented for the minimum
+ * IPv4 MTU until PMTUd has completed on every link, and latency
+ * starts from 0. Restoring the values from a previous run lets
+ * knet use the last known MTU right away.
+ * The restored MTU is validated lazily: traffic flows with it, and
+ * PMTUd runs again only if packets are reported too big or data
+ * packets don't reach the other node, or at the next PMTUd interval.
+ * Fields set to 0 are ignored.
+ * The link must be configured (see knet_link_set_config(3)) and
+ * have a destination address.
+ *
+ * @return
+ * knet_link_set_cache returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_set_cache(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+			const struct knet_link_cache *cache, size_t struct_size);
+
+/*
+ * latency histogram layout (see knet_link_get_latency_histogram)
+ * values 0 to 7 usecs have one bucket each, every following power of 2
+ * range is split in KNET_LINK_LATENCY_SUB_BUCKETS linear buckets.
+ * The relative error of a bucket is at most 1/KNET_LINK_LATENCY_SUB_BUCKETS.
+ */
+
+#define KNET_LINK_LATENCY_SUB_BUCKETS 8
+#define KNET_LINK_LATENCY_BUCKETS     240
+
+/**
+ * struct knet_link_latency_histogram
+ *
+ * @brief distribution of the latency samples of a link
+ *
+ * size                  ABI checking, filled in by
+ *                       knet_link_get_latency_histogram
+ *
+ * samples               number of samples in the histogram
+ *
+ * p50, p90, p99, p999   50th, 90th, 99th and 99.9th percentile in usecs,
+ *                       reported as the highest value of the bucket
+ *                       the percentile falls in. 0 if there are no samples.
+ *
+ * max                   highest value of the highest non empty bucket in usecs
+ *
+ * buckets               number of samples per bucket. Bucket i < 8 counts
+ *                       samples of i usecs, for i >= 8 given
+ *                       e = (i / 8) + 2 and m = i % 8, bucket i counts
+ *                       samples from (8 + m) << (e - 3) to
+ *                       ((9 + m) << (e - 3)) - 1 usecs.
+ *
+ * Latency samples are the round trip time of each ping/pong on the link,
+ * not the averaged latency reported by knet_link_get_status(3).
+ */
+
+struct knet_link_latency_histogram {
+	size_t size;                    /* For ABI checking */
+	uint64_t samples;
+	uint32_t p50;
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t p999;
+	uint32_t max;
+	uint32_t buckets[KNET_LINK_LATENCY_BUCKETS];
+};
+
+/**
+ * knet_link_get_latency_histogram
+ *
+ * @brief Get the latency histogram and percentiles of a link
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * host_id   - see knet_host_add(3)
+ *
+ * link_id   - see knet_link_set_config(3)
+ *
+ * histogram - pointer to knet_link_latency_histogram struct
+ *
+ * struct_size - max size of knet_link_latency_histogram - allows library to
+ *               add fields without ABI change. Returned structure
+ *               will be truncated to this length and .size member
+ *               indicates the full size.
+ *
+ * The histogram is updated while it is being read, the percentiles are
+ * consistent with the returned buckets.
+ *
+ * @return
+ * knet_link_get_latency_histogram returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_get_latency_histogram(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				    struct knet_link_latency_histogram *histogram, size_t struct_size);
+
+/**
+ * knet_link_clear_latency_histogram
+ *
+ * @brief Reset the latency histogram of a link
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * host_id   - see knet_host_add(3)
+ *
+ * link_id   - see knet_link_set_config(3)
+ *
+ * Only the histogram is reset, link stats are not affected.
+ * Link stats reset by knet_handle_clear_stats(3) also reset the histogram.
+ *
+ * @return
+ * knet_link_clear_latency_histogram returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_clear_latency_histogram(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id);
+
+/*
+ * bandwidth probe default and limits (see knet_link_set_bandwidth_probe)
+ */
+
+#define KNET_LINK_BW_PROBE_COUNT_DEFAULT 2
+#define KNET_LINK_BW_PROBE_COUNT_MAX     8
+
+/**
+ * knet_link_set_bandwidth_probe
+ *
+ * @brief Enable link capacity estimation with bandwidth probes
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * host_id   - see knet_host_add(3)
+ *
+ * link_id   - see knet_link_set_config(3)
+ *
+ * interval  - time in milliseconds between two probe trains.
+ *             0 disables probing (default).
+ *
+ * count     - number of packets per probe train, from 2 (packet pair)
+ *             to KNET_LINK_BW_PROBE_COUNT_MAX.
+ *
+ * Every interval, knet sends a train of count back to back packets of the
+ * link MTU size to the remote node together with the heartbeats.
+ * The remote node estimates the link capacity from the time between the
+ * first and the last packet of the train and reports it back in its pongs.
+ * Probing costs count * MTU bytes per interval on the link, the estimate
+ * is the median of the last samples so it can be run at a low rate.
+ * The remote node needs kernel receive timestamps to measure the trains
+ * (see KNET_LINK_FLAG_TIMESTAMP), knet enables them on the receiving
+ * socket on demand where the platform supports them.
+ * The data rate delivered to the remote node is always measured passively
+ * and reported, even when probing is disabled.
+ * Results are available in knet_link_status (see knet_link_get_status(3)).
+ *
+ * @return
+ * knet_link_set_bandwidth_probe returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_set_bandwidth_probe(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				  uint32_t interval, uint8_t count);
+
+/**
+ * knet_link_get_bandwidth_probe
+ *
+ * @brief Get the link bandwidth probe configuration
+ *
+ * knet_h    - pointer to knet_handle_t
+ *
+ * host_id   - see knet_host_add(3)
+ *
+ * link_id   - see knet_link_set_config(3)
+ *
+ * interval  - pointer to store the probe interval in milliseconds
+ *
+ * count     - pointer to store the number of packets per probe train
+ *
+ * @return
+ * knet_link_get_bandwidth_probe returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_get_bandwidth_probe(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				  uint32_t *interval, uint8_t *count);
+
+/*
+ * congestion control default target queuing delay in usecs
+ * (see knet_link_set_congestion_control)
+ */
+
+#define KNET_LINK_CC_TARGET_DELAY_DEFAULT 25000
+
+/**
+ * knet_link_set_congestion_control
+ *
+ * @brief Enable delay based congestion control for bulk channels
+ *
+ * knet_h       - pointer to knet_handle_t
+ *
+ * host_id      - see knet_host_add(3)
+ *
+ * link_id      - see knet_link_set_config(3)
+ *
+ * target_delay - queuing delay in usecs that bulk traffic is allowed to
+ *                add on the link (KNET_LINK_CC_TARGET_DELAY_DEFAULT is
+ *                a sensible value for WAN links).
+ *                0 disables congestion control (default).
+ *
+ * The controller is LEDBAT-like: the lowest round trip time seen over the
+ * last minutes is taken as the base delay of the path and anything above it
+ * as queuing delay. Every pong, the rate allowed to bulk channels
+ * (see knet_handle_set_channel_bulk(3)) grows while the queuing delay is
+ * below target_delay and shrinks, down to half per pong, when it is above.
+ * The rate never exceeds twice the rate delivered to the remote node, nor
+ * the link capacity if bandwidth probes are enabled (see
+ * knet_link_set_bandwidth_probe(3)).
+ * As a consequence, bulk transfers back off as soon as they start queuing
+ * behind or in front of other traffic, and the controller reacts once per
+ * ping interval (see knet_link_set_ping_timers(3)).
+ * Current rate and queuing delay are available in knet_link_status
+ * (see knet_link_get_status(3)).
+ *
+ * @return
+ * knet_link_set_congestion_control returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_set_congestion_control(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				     uint32_t target_delay);
+
+/**
+ * knet_link_get_congestion_control
+ *
+ * @brief Get the link congestion control configuration
+ *
+ * knet_h       - pointer to knet_handle_t
+ *
+ * host_id      - see knet_host_add(3)
+ *
+ * link_id      - see knet_link_set_config(3)
+ *
+ * target_delay - pointer to store the target queuing delay in usecs,
+ *                0 if congestion control is disabled
+ *
+ * @return
+ * knet_link_get_congestion_control returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_get_congestion_control(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				     uint32_t *target_delay);
+
+/**
+ * knet_link_set_fec
+ *
+ * @brief Add forward error correction to fragmented packets sent on the link
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * host_id  - see knet_host_add(3)
+ *
+ * link_id  - see knet_link_set_config(3)
+ *
+ * group    - number of data fragments protected by one parity fragment.
+ *            1 sends every fragment twice, 4 adds 25% of traffic and so on.
+ *            0 disables forward error correction (default).
+ *
+ * Packets bigger than the data MTU are split in fragments, and losing any
+ * of them loses the whole packet. With forward error correction, every group
+ * of fragments is followed by a parity fragment (the XOR of the group)
+ * and the receiver rebuilds one lost fragment per group without waiting
+ * for a retransmission. Packets that fit in one fragment are not affected.
+ *
+ * Fragments are slightly smaller to leave room for the parity header.
+ * The fragments are the same for all the links to a node, so when the links
+ * ask for different groups, the smallest one is used and the parity
+ * is only sent on the links that enabled it.
+ * Groups can be made bigger when the packet would need more than 255
+ * fragments in total.
+ *
+ * Parity is only sent to nodes that advertise forward error correction
+ * support in their pings, older nodes get the data fragments alone.
+ * tx_fec_packets and rx_fec_rebuilt in knet_handle_stats
+ * (see knet_handle_get_stats(3)) count parity sent and fragments rebuilt.
+ *
+ * @return
+ * knet_link_set_fec returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_set_fec(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+		      uint8_t group);
+
+/**
+ * knet_link_get_fec
+ *
+ * @brief Get the link forward error correction configuration
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * host_id  - see knet_host_add(3)
+ *
+ * link_id  - see knet_link_set_config(3)
+ *
+ * group    - pointer to store the number of data fragments per parity
+ *            fragment, 0 if forward error correction is disabled
+ *
+ * @return
+ * knet_link_get_fec returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_link_get_fec(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+		      uint8_t *group);
+
 /**
  * knet_link_enable_status_change_notify
  *
@@ -1934,6 +3050,8 @@ int knet_link_enable_status_change_notify(knet_handle_t knet_h,
 #define KNET_SUB_TRANSP_LOOPBACK (KNET_SUB_TRANSP_BASE + KNET_TRANSPORT_LOOPBACK)
 #define KNET_SUB_TRANSP_UDP      (KNET_SUB_TRANSP_BASE + KNET_TRANSPORT_UDP)
 #define KNET_SUB_TRANSP_SCTP     (KNET_SUB_TRANSP_BASE + KNET_TRANSPORT_SCTP)
+#define KNET_SUB_TRANSP_MCAST    (KNET_SUB_TRANSP_BASE + KNET_TRANSPORT_MCAST)
+#define KNET_SUB_TRANSP_SHM      (KNET_SUB_TRANSP_BASE + KNET_TRANSPORT_SHM)
 
 #define KNET_SUB_NSSCRYPTO     60 /* nsscrypto.c */
 #define KNET_SUB_OPENSSLCRYPTO 61 /* opensslcrypto.c */
@@ -20,6 +20,7 @@
 #include "transports.h"
 #include "host.h"
 #include "threads_common.h"
+#include "threads_pmtud.h"
 
 int _link_updown(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
 		 unsigned int enabled, unsigned int connected)
@@ -74,6 +75,202 @@ int _link_updown(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
 	return 0;
 }
 
+/*
+ * latency histogram, see KNET_LINK_LATENCY_BUCKETS in libknet.h
+ *
+ * samples are added by the RX thread and the histogram can be read
+ * or reset by API calls at the same time, all holding only the read lock.
+ * Buckets are accessed with atomic operations, there is no need for
+ * a consistent snapshot across buckets.
+ */
+
+static unsigned int _link_latency_bucket(uint32_t latency)
+{
+	unsigned int msb;
+
+	if (latency < KNET_LINK_LATENCY_SUB_BUCKETS) {
+		return latency;
+	}
+
+	msb = 31 - __builtin_clz(latency);
+
+	return ((msb - 2) * KNET_LINK_LATENCY_SUB_BUCKETS) +
+	       ((latency >> (msb - 3)) & (KNET_LINK_LATENCY_SUB_BUCKETS - 1));
+}
+
+static uint32_t _link_latency_bucket_max(unsigned int bucket)
+{
+	unsigned int exp, sub;
+
+	if (bucket < KNET_LINK_LATENCY_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	exp = (bucket / KNET_LINK_LATENCY_SUB_BUCKETS) + 2;
+	sub = bucket % KNET_LINK_LATENCY_SUB_BUCKETS;
+
+	return (uint32_t)((((uint64_t)KNET_LINK_LATENCY_SUB_BUCKETS + sub + 1) << (exp - 3)) - 1);
+}
+
+void _link_latency_histogram_add(struct knet_link *link, unsigned long long latency)
+{
+	if (latency > UINT32_MAX) {
+		latency = UINT32_MAX;
+	}
+
+	__atomic_fetch_add(&link->latency_histogram[_link_latency_bucket(latency)], 1, __ATOMIC_RELAXED);
+}
+
+static void _link_cc_reset(struct knet_link *link)
+{
+	int i;
+
+	for (i = 0; i < KNET_LINK_CC_BASE_HISTORY; i++) {
+		link->cc_base_delay[i] = UINT32_MAX;
+	}
+	link->cc_base_idx = 0;
+	clock_gettime(CLOCK_MONOTONIC, &link->cc_base_last);
+	link->cc_tokens = KNET_LINK_CC_BURST;
+	link->cc_tokens_last = link->cc_base_last;
+	if (link->cc_target_delay) {
+		link->status.cc_rate = KNET_LINK_CC_RATE_INIT;
+	} else {
+		link->status.cc_rate = 0;
+	}
+	link->status.cc_queue_delay = 0;
+}
+
+/*
+ * LEDBAT-like controller fed by pong RTT samples (usecs).
+ * The lowest RTT of the last KNET_LINK_CC_BASE_HISTORY minutes is
+ * the base delay of the path, anything above is queuing delay.
+ */
+void _link_cc_update(struct knet_link *link, unsigned long long rtt)
+{
+	struct timespec clock_now;
+	unsigned long long diff;
+	uint64_t rate, delta, ceiling, off_target;
+	uint32_t base = UINT32_MAX, qdelay, target = link->cc_target_delay;
+	int i;
+
+	if (rtt > UINT32_MAX) {
+		rtt = UINT32_MAX;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+	timespec_diff(link->cc_base_last, clock_now, &diff);
+	if (diff >= KNET_LINK_CC_BASE_PERIOD) {
+		link->cc_base_idx = (link->cc_base_idx + 1) % KNET_LINK_CC_BASE_HISTORY;
+		link->cc_base_delay[link->cc_base_idx] = UINT32_MAX;
+		link->cc_base_last = clock_now;
+	}
+	if (rtt < link->cc_base_delay[link->cc_base_idx]) {
+		link->cc_base_delay[link->cc_base_idx] = rtt;
+	}
+	for (i = 0; i < KNET_LINK_CC_BASE_HISTORY; i++) {
+		if (link->cc_base_delay[i] < base) {
+			base = link->cc_base_delay[i];
+		}
+	}
+
+	qdelay = rtt - base;
+	link->status.cc_queue_delay = qdelay;
+
+	rate = link->status.cc_rate;
+	if (qdelay < target) {
+		delta = ((rate * (target - qdelay)) / target) >> KNET_LINK_CC_GAIN_SHIFT;
+		if (delta < KNET_LINK_CC_RATE_STEP) {
+			delta = KNET_LINK_CC_RATE_STEP;
+		}
+		rate = rate + delta;
+	} else {
+		/*
+		 * back off proportionally to how far we are from target,
+		 * at most by half
+		 */
+		off_target = qdelay - target;
+		if (off_target > target) {
+			off_target = target;
+		}
+		rate = rate - ((rate * off_target) / target / 2);
+	}
+
+	/*
+	 * don't build up a rate the link has never been asked to carry
+	 */
+	ceiling = 2 * (uint64_t)link->status.bw_delivered;
+	if (ceiling < KNET_LINK_CC_RATE_INIT) {
+		ceiling = KNET_LINK_CC_RATE_INIT;
+	}
+	if ((link->status.bw_capacity) && (ceiling > link->status.bw_capacity)) {
+		ceiling = link->status.bw_capacity;
+	}
+	if (rate > ceiling) {
+		rate = ceiling;
+	}
+	if (rate < KNET_LINK_CC_RATE_MIN) {
+		rate = KNET_LINK_CC_RATE_MIN;
+	}
+	if (rate > UINT32_MAX) {
+		rate = UINT32_MAX;
+	}
+
+	link->status.cc_rate = rate;
+}
+
+/*
+ * token bucket refilled at cc_rate. Charges bytes sent by a bulk channel
+ * and returns how many usecs the channel has to wait before sending again.
+ */
+uint64_t _link_cc_pace(struct knet_link *link, size_t bytes)
+{
+	struct timespec clock_now;
+	unsigned long long diff;
+	uint64_t rate = link->status.cc_rate;
+	int64_t burst;
+
+	if (!rate) {
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+	timespec_diff(link->cc_tokens_last, clock_now, &diff);
+	link->cc_tokens_last = clock_now;
+	if (diff > 1000000000llu) {
+		diff = 1000000000llu;
+	}
+
+	/*
+	 * kbit/s * nsecs / 8000000 = bytes.
+	 * Allow bursts of 2ms worth of data, so that pacing still works
+	 * with the msecs resolution of the TX thread
+	 */
+	link->cc_tokens += (rate * diff) / 8000000llu;
+	burst = (rate * 1000llu) / 8000llu * 2;
+	if (burst < KNET_LINK_CC_BURST) {
+		burst = KNET_LINK_CC_BURST;
+	}
+	if (link->cc_tokens > burst) {
+		link->cc_tokens = burst;
+	}
+
+	link->cc_tokens -= bytes;
+	if (link->cc_tokens >= 0) {
+		return 0;
+	}
+
+	return ((uint64_t)(-link->cc_tokens) * 8000llu) / rate;
+}
+
+static void _link_latency_histogram_clear(struct knet_link *link)
+{
+	int i;
+
+	for (i = 0; i < KNET_LINK_LATENCY_BUCKETS; i++) {
+		__atomic_store_n(&link->latency_histogram[i], 0, __ATOMIC_RELAXED);
+	}
+}
+
 void _link_clear_stats(knet_handle_t knet_h)
 {
 	struct knet_host *host;
@@ -89,6 +286,7 @@ void _link_clear_stats(knet_handle_t knet_h)
 		for (link_id = 0; link_id < KNET_MAX_LINK; link_id++) {
 			link = &host->link[link_id];
 			memset(&link->status.stats, 0, sizeof(struct knet_link_stats));
+			_link_latency_histogram_clear(link);
 		}
 	}
 }
@@ -123,6 +321,16 @@ int knet_link_set_config(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t l
 		return -1;
 	}
 
+	if ((flags & KNET_LINK_FLAG_NOCRYPT) && (transport != KNET_TRANSPORT_SHM)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((flags & KNET_LINK_FLAG_CONNECTED) && (transport != KNET_TRANSPORT_UDP)) {
+		errno = EINVAL;
+		return -1;
+	}
+
 	savederrno = get_global_wrlock(knet_h);
 	if (savederrno) {
 		log_err(knet_h, KNET_SUB_LINK, "Unable to get write lock: %s",
@@ -232,6 +440,7 @@ int knet_link_set_config(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t l
 	}
 
 	link->pong_count = KNET_LINK_DEFAULT_PONG_COUNT;
+	link->bw_probe_count = KNET_LINK_BW_PROBE_COUNT_DEFAULT;
 	link->has_valid_mtu = 0;
 	link->ping_interval = KNET_LINK_DEFAULT_PING_INTERVAL * 1000; /* microseconds */
 	link->pong_timeout = KNET_LINK_DEFAULT_PING_TIMEOUT * 1000; /* microseconds */
@@ -1104,6 +1313,718 @@ exit_unlock:
 	return err;
 }
 
+int knet_link_get_cache(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+			struct knet_link_cache *cache, size_t struct_size)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+	struct knet_link_cache link_cache;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!cache) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (struct_size < sizeof(size_t)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	memset(&link_cache, 0, sizeof(struct knet_link_cache));
+	link_cache.size = sizeof(struct knet_link_cache);
+
+	/*
+	 * pmtud_last is only set once PMTUd has completed (or a value
+	 * has been restored), before that mtu is just a safe default
+	 */
+	if ((link->transport_type != KNET_TRANSPORT_LOOPBACK) &&
+	    (link->has_valid_mtu) &&
+	    ((link->pmtud_last.tv_sec) || (link->pmtud_last.tv_nsec))) {
+		link_cache.path_mtu = link->status.mtu + link->status.proto_overhead;
+	}
+
+	if (link->status.stats.latency_samples) {
+		link_cache.latency = link->status.latency;
+	}
+
+	if (struct_size > sizeof(struct knet_link_cache)) {
+		struct_size = sizeof(struct knet_link_cache);
+	}
+	memmove(cache, &link_cache, struct_size);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_set_cache(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+			const struct knet_link_cache *cache, size_t struct_size)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+	struct knet_link_cache link_cache;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!cache) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (struct_size < sizeof(size_t)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/*
+	 * older applications might pass a smaller struct,
+	 * missing fields are left to 0 and ignored
+	 */
+	memset(&link_cache, 0, sizeof(struct knet_link_cache));
+	if (struct_size > sizeof(struct knet_link_cache)) {
+		struct_size = sizeof(struct knet_link_cache);
+	}
+	memmove(&link_cache, cache, struct_size);
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	if (link->transport_type == KNET_TRANSPORT_LOOPBACK) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is a loopback link: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	if (link_cache.path_mtu) {
+		if (_pmtud_link_restore(knet_h, host, link, link_cache.path_mtu) < 0) {
+			err = -1;
+			savederrno = errno;
+			log_err(knet_h, KNET_SUB_LINK, "Unable to restore MTU %u for host %u link %u: %s",
+				link_cache.path_mtu, host_id, link_id, strerror(savederrno));
+			goto exit_unlock;
+		}
+	}
+
+	if (link_cache.latency) {
+		link->status.latency = link_cache.latency;
+	}
+
+	log_debug(knet_h, KNET_SUB_LINK, "host: %u link: %u cache restored (path mtu: %u latency: %llu)",
+		  host_id, link_id, link_cache.path_mtu, link_cache.latency);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_get_latency_histogram(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				    struct knet_link_latency_histogram *histogram, size_t struct_size)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+	struct knet_link_latency_histogram link_histogram;
+	uint64_t count = 0;
+	int i;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!histogram) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (struct_size < sizeof(size_t)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	memset(&link_histogram, 0, sizeof(struct knet_link_latency_histogram));
+	link_histogram.size = sizeof(struct knet_link_latency_histogram);
+
+	for (i = 0; i < KNET_LINK_LATENCY_BUCKETS; i++) {
+		link_histogram.buckets[i] = __atomic_load_n(&link->latency_histogram[i], __ATOMIC_RELAXED);
+		link_histogram.samples += link_histogram.buckets[i];
+	}
+
+	/*
+	 * percentiles are computed on the copy so they match the buckets
+	 */
+	for (i = 0; i < KNET_LINK_LATENCY_BUCKETS; i++) {
+		if (!link_histogram.buckets[i]) {
+			continue;
+		}
+		count += link_histogram.buckets[i];
+		if ((!link_histogram.p50) && (count * 2 >= link_histogram.samples)) {
+			link_histogram.p50 = _link_latency_bucket_max(i);
+		}
+		if ((!link_histogram.p90) && (count * 10 >= link_histogram.samples * 9)) {
+			link_histogram.p90 = _link_latency_bucket_max(i);
+		}
+		if ((!link_histogram.p99) && (count * 100 >= link_histogram.samples * 99)) {
+			link_histogram.p99 = _link_latency_bucket_max(i);
+		}
+		if ((!link_histogram.p999) && (count * 1000 >= link_histogram.samples * 999)) {
+			link_histogram.p999 = _link_latency_bucket_max(i);
+		}
+		link_histogram.max = _link_latency_bucket_max(i);
+	}
+
+	if (struct_size > sizeof(struct knet_link_latency_histogram)) {
+		struct_size = sizeof(struct knet_link_latency_histogram);
+	}
+	memmove(histogram, &link_histogram, struct_size);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_clear_latency_histogram(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	_link_latency_histogram_clear(link);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_set_bandwidth_probe(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				  uint32_t interval, uint8_t count)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((count < 2) || (count > KNET_LINK_BW_PROBE_COUNT_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	if (link->transport_type == KNET_TRANSPORT_LOOPBACK) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is a loopback link: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link->bw_probe_interval = interval;
+	link->bw_probe_count = count;
+
+	if (!interval) {
+		link->status.bw_capacity = 0;
+		link->status.bw_available = 0;
+	}
+
+	log_debug(knet_h, KNET_SUB_LINK,
+		  "host: %u link: %u bandwidth probe update - interval: %u count: %u",
+		  host_id, link_id, link->bw_probe_interval, link->bw_probe_count);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_get_bandwidth_probe(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				  uint32_t *interval, uint8_t *count)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!interval) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!count) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	*interval = link->bw_probe_interval;
+	*count = link->bw_probe_count;
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_set_congestion_control(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				     uint32_t target_delay)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	if (link->transport_type == KNET_TRANSPORT_LOOPBACK) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is a loopback link: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	if (link->cc_target_delay != target_delay) {
+		link->cc_target_delay = target_delay;
+		_link_cc_reset(link);
+	}
+
+	log_debug(knet_h, KNET_SUB_LINK,
+		  "host: %u link: %u congestion control update - target delay: %u",
+		  host_id, link_id, link->cc_target_delay);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_get_congestion_control(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+				     uint32_t *target_delay)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!target_delay) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	*target_delay = link->cc_target_delay;
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_set_fec(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+		      uint8_t group)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	if (link->transport_type == KNET_TRANSPORT_LOOPBACK) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is a loopback link: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link->fec_group = group;
+
+	log_debug(knet_h, KNET_SUB_LINK,
+		  "host: %u link: %u forward error correction update - group: %u",
+		  host_id, link_id, link->fec_group);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_link_get_fec(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
+		      uint8_t *group)
+{
+	int savederrno = 0, err = 0;
+	struct knet_host *host;
+	struct knet_link *link;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!group) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_LINK, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	host = knet_h->host_index[host_id];
+	if (!host) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "Unable to find host %u: %s",
+			host_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	link = &host->link[link_id];
+
+	if (!link->configured) {
+		err = -1;
+		savederrno = EINVAL;
+		log_err(knet_h, KNET_SUB_LINK, "host %u link %u is not configured: %s",
+			host_id, link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	*group = link->fec_group;
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
 int knet_link_enable_status_change_notify(knet_handle_t knet_h,
 					  void *link_status_change_notify_fn_private_data,
 					  void (*link_status_change_notify_fn) (
@@ -30,9 +30,25 @@
  */
 #define KNET_LINK_PONG_TIMEOUT_LAT_MUL	2
 
+/*
+ * congestion control, rates in kbit/s, see _link_cc_update
+ */
+#define KNET_LINK_CC_RATE_INIT		10000
+#define KNET_LINK_CC_RATE_MIN		256
+#define KNET_LINK_CC_RATE_STEP		64
+#define KNET_LINK_CC_GAIN_SHIFT		2
+#define KNET_LINK_CC_BASE_PERIOD	60000000000llu	/* nsecs covered by each base delay entry */
+#define KNET_LINK_CC_BURST		(2 * KNET_MAX_PACKET_SIZE)
+
 int _link_updown(knet_handle_t knet_h, knet_node_id_t node_id, uint8_t link_id,
 		 unsigned int enabled, unsigned int connected);
 
 void _link_clear_stats(knet_handle_t knet_h);
 
+void _link_latency_histogram_add(struct knet_link *link, unsigned long long latency);
+
+void _link_cc_update(struct knet_link *link, unsigned long long rtt);
+
+uint64_t _link_cc_pace(struct knet_link *link, size_t bytes);
+
 #endif
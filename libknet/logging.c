@@ -39,6 +39,8 @@ static struct pretty_names subsystem_names[] =
 	{ "loopback", KNET_SUB_TRANSP_LOOPBACK },
 	{ "udp", KNET_SUB_TRANSP_UDP },
 	{ "sctp", KNET_SUB_TRANSP_SCTP },
+	{ "mcast", KNET_SUB_TRANSP_MCAST },
+	{ "shm", KNET_SUB_TRANSP_SHM },
 	{ "nsscrypto", KNET_SUB_NSSCRYPTO },
 	{ "opensslcrypto", KNET_SUB_OPENSSLCRYPTO },
 	{ "zlibcomp", KNET_SUB_ZLIBCOMP },
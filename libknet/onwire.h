@@ -19,32 +19,26 @@
 
 #include "libknet.h"
 
-#if 0
-
 /*
- * for future protocol extension (re-switching table calculation)
+ * relay routing (see relay.c). Nodes with relay enabled broadcast the
+ * nodes they can reach, directly or through other relays, so that the
+ * nodes that can't reach each other directly can still exchange data.
+ * Latency and MTU are the ones of the whole path from the sender.
  */
 
-struct knet_hinfo_link {
-	uint8_t			khl_link_id;
-	uint8_t			khl_link_dynamic;
-	uint8_t			khl_link_priority;
-	uint64_t		khl_link_latency;
-	char			khl_link_dst_ipaddr[KNET_MAX_HOST_LEN];
-	char			khl_link_dst_port[KNET_MAX_PORT_LEN];
-} __attribute__((packed));
-
-struct knet_hinfo_link_table {
-	knet_node_id_t		khlt_node_id;
-	uint8_t			khlt_local; /* we have this node connected locally */
-	struct knet_hinfo_link	khlt_link[KNET_MAX_LINK]; /* info we send about each link in the node */
+struct knet_hostinfo_link_table_entry {
+	knet_node_id_t	khlt_node_id;		/* node reachable from the sender */
+	knet_node_id_t	khlt_next_hop;		/* first node on the path, khlt_node_id if direct */
+	uint8_t		khlt_hops;		/* 1 if connected directly to the sender */
+	uint8_t		khlt_pad;		/* padding, set to 0 */
+	uint32_t	khlt_latency;		/* latency of the path in usecs */
+	uint32_t	khlt_mtu;		/* smallest data MTU of the links on the path */
 } __attribute__((packed));
 
-struct link_table {
-	knet_node_id_t		khdt_host_entries;
-	uint8_t			khdt_host_maps[0]; /* array of knet_hinfo_link_table[khdt_host_entries] */
+struct knet_hostinfo_payload_link_table {
+	uint16_t	khlt_entries;		/* number of entries that follow */
+	uint8_t		khlt_data[0];		/* array of struct knet_hostinfo_link_table_entry */
 } __attribute__((packed));
-#endif
 
 #define KNET_HOSTINFO_LINK_STATUS_DOWN 0
 #define KNET_HOSTINFO_LINK_STATUS_UP   1
@@ -54,12 +48,27 @@ struct knet_hostinfo_payload_link_status {
 	uint8_t		khip_link_status_status;	/* up/down status */
 } __attribute__((packed));
 
+/*
+ * bandwidth probes are sent in short trains of back to back packets
+ * of the link MTU size. The receiver measures the dispersion of the
+ * train to estimate the link capacity (see threads_heartbeat.c)
+ */
+
+struct knet_header_payload_bwprobe {
+	uint8_t		khp_bwprobe_link;	/* source link id */
+	uint32_t	khp_bwprobe_id;		/* train id */
+	uint8_t		khp_bwprobe_seq;	/* packet index in the train */
+	uint8_t		khp_bwprobe_count;	/* number of packets in the train */
+	uint8_t		khp_bwprobe_data[0];	/* pointer to empty/random data/fill buffer */
+} __attribute__((packed));
+
 /*
  * union to reference possible individual payloads
  */
 
 union knet_hostinfo_payload {
 	struct knet_hostinfo_payload_link_status knet_hostinfo_payload_link_status;
+	struct knet_hostinfo_payload_link_table knet_hostinfo_payload_link_table;
 } __attribute__((packed));
 
 /*
@@ -72,7 +81,7 @@ union knet_hostinfo_payload {
  */
 
 #define KNET_HOSTINFO_TYPE_LINK_UP_DOWN 0 // UNUSED
-#define KNET_HOSTINFO_TYPE_LINK_TABLE   1 // NOT IMPLEMENTED
+#define KNET_HOSTINFO_TYPE_LINK_TABLE   1 /* see knet_handle_set_relay */
 
 #define KNET_HOSTINFO_UCAST 0	/* send info to a specific host */
 #define KNET_HOSTINFO_BCAST 1	/* send info to all known / connected hosts */
@@ -87,9 +96,12 @@ struct knet_hostinfo {
 #define KNET_HOSTINFO_ALL_SIZE sizeof(struct knet_hostinfo)
 #define KNET_HOSTINFO_SIZE (KNET_HOSTINFO_ALL_SIZE - sizeof(union knet_hostinfo_payload))
 #define KNET_HOSTINFO_LINK_STATUS_SIZE (KNET_HOSTINFO_SIZE + sizeof(struct knet_hostinfo_payload_link_status))
+#define KNET_HOSTINFO_LINK_TABLE_SIZE (KNET_HOSTINFO_SIZE + sizeof(struct knet_hostinfo_payload_link_table))
 
 #define khip_link_status_status khi_payload.knet_hostinfo_payload_link_status.khip_link_status_status
 #define khip_link_status_link_id khi_payload.knet_hostinfo_payload_link_status.khip_link_status_link_id
+#define khip_link_table_entries khi_payload.knet_hostinfo_payload_link_table.khlt_entries
+#define khip_link_table_data khi_payload.knet_hostinfo_payload_link_table.khlt_data
 
 /*
  * typedef uint64_t seq_num_t;
@@ -101,7 +113,7 @@ typedef uint16_t seq_num_t;
 struct knet_header_payload_data {
 	seq_num_t	khp_data_seq_num;	/* pckt seq number used to deduplicate pkcts */
 	uint8_t		khp_data_compress;	/* identify if user data are compressed */
-	uint8_t		khp_data_pad1;		/* make sure to have space in the header to grow features */
+	uint8_t		khp_data_flags;		/* KNET_DATA_FLAG_*, was padding so older nodes send 0 */
 	uint8_t		khp_data_bcast;		/* data destination bcast/ucast */
 	uint8_t		khp_data_frag_num;	/* number of fragments of this pckt. 1 is not fragmented */
 	uint8_t		khp_data_frag_seq;	/* as above, indicates the frag sequence number */
@@ -109,13 +121,127 @@ struct knet_header_payload_data {
 	uint8_t		khp_data_userdata[0];	/* pointer to the real user data */
 } __attribute__((packed));
 
+#define KNET_DATA_FLAG_RELIABLE 0x01 /* user data starts with struct knet_header_reliable */
+#define KNET_DATA_FLAG_PARITY   0x02 /* FEC fragment, user data is a struct knet_header_fec */
+
+/*
+ * forward error correction (see knet_link_set_fec). A parity fragment
+ * carries the XOR of kfh_frags data fragments of the same packet, starting
+ * from khp_data_frag_seq, so that any one of them can be rebuilt.
+ * The shorter last fragment is zero padded, kfh_len restores its size.
+ * Parity fragments are not counted in khp_data_frag_num.
+ */
+
+struct knet_header_fec {
+	uint8_t		kfh_frags;		/* data fragments covered by this parity */
+	uint8_t		kfh_pad;		/* padding, set to 0 */
+	uint16_t	kfh_len;		/* XOR of the covered data fragments length */
+	uint8_t		kfh_parity[0];		/* XOR of the data, as long as a full fragment */
+} __attribute__((packed));
+
+/*
+ * reliable channels (see reliable.c). Sequence numbers are per destination
+ * node and channel, acks refer to the data sent the other way on the same channel.
+ * It goes in front of the user data, KNET_DATABUFSIZE has room for it on
+ * top of a full KNET_MAX_PACKET_SIZE.
+ */
+
+struct knet_header_reliable {
+	uint32_t	krh_epoch;		/* changes when the source node restarts */
+	uint32_t	krh_seq;		/* sequence number of this packet */
+	uint32_t	krh_una;		/* oldest packet not acked yet, older ones are not retransmitted */
+	uint32_t	krh_ack;		/* next packet expected from the destination node */
+	uint32_t	krh_sack;		/* bitmap of packets received after krh_ack + 1 */
+	uint8_t		krh_flags;		/* KNET_RELIABLE_FLAG_* */
+} __attribute__((packed));
+
+#define KNET_RELIABLE_FLAG_ACK 0x01 /* krh_ack and krh_sack are valid, not set until the first packet from the destination node */
+
+/*
+ * large messages (see knet_handle_set_channel_large and large.c).
+ * knet_send splits a message bigger than one data packet in fragments
+ * of KNET_LARGE_SEGMENT_SIZE bytes (the last one can be shorter), each
+ * one sent as a KNET_HEADER_VERSION_LARGE data packet with this header
+ * in front of the data (after the reliable header if any).
+ * The counters are wider than khp_data_frag_num, that still counts the
+ * fragments of each data packet on the links.
+ */
+
+struct knet_header_large {
+	uint32_t	klh_msg_id;		/* changes for every message sent on the channel */
+	uint32_t	klh_len;		/* total length of the message */
+	uint32_t	klh_frag_num;		/* number of fragments of the message */
+	uint32_t	klh_frag_seq;		/* fragment sequence number, from 0 */
+} __attribute__((packed));
+
+/*
+ * a packet sent to a node through a relay (see relay.c). The payload is
+ * the data packet as it would have been sent to khp_relay_dst_node,
+ * already encrypted. Relays only rewrite this header.
+ */
+
+struct knet_header_payload_relay {
+	knet_node_id_t	khp_relay_dst_node;	/* final destination of the packet */
+	uint8_t		khp_relay_ttl;		/* relays left before the packet is dropped */
+	uint8_t		khp_relay_pad;		/* padding, set to 0 */
+	uint8_t		khp_relay_data[0];	/* the packet for khp_relay_dst_node */
+} __attribute__((packed));
+
+/*
+ * a broadcast sent along a tree (see knet_handle_set_bcast_tree).
+ * The payload is the data packet as sent by khp_tree_src_node, already
+ * encrypted. The receiver delivers it and passes it on to the other nodes
+ * in the range of node ids from khp_tree_first to khp_tree_last,
+ * that can wrap around.
+ */
+
+struct knet_header_payload_tree {
+	knet_node_id_t	khp_tree_src_node;	/* node that sent the broadcast */
+	knet_node_id_t	khp_tree_first;		/* first node id of the range */
+	knet_node_id_t	khp_tree_last;		/* last node id of the range */
+	uint8_t		khp_tree_fanout;	/* nodes each receiver passes the packet to */
+	uint8_t		khp_tree_pad;		/* padding, set to 0 */
+	uint8_t		khp_tree_data[0];	/* the packet from khp_tree_src_node */
+} __attribute__((packed));
+
+/*
+ * set in khp_ping_link of pings when the sender listens to the multicast
+ * group of the link id, see transport_mcast.c
+ */
+#define KNET_PING_LINK_MCAST 0x80
+
 struct knet_header_payload_ping {
 	uint8_t		khp_ping_link;		/* source link id */
 	uint32_t	khp_ping_time[4];	/* ping timestamp */
 	seq_num_t	khp_ping_seq_num;	/* transport host seq_num */
 	uint8_t		khp_ping_timed;		/* timed pinged (1) or forced by seq_num (0) */
+	uint8_t		khp_ping_ext[0];	/* pointer to struct knet_header_ping_ext */
 }  __attribute__((packed));
 
+/*
+ * appended to pings and pongs. Older nodes don't send it and answer
+ * pings with a KNET_HEADER_PING_SIZE pong, so the length of the packet
+ * tells if it is there.
+ */
+
+struct knet_header_ping_ext {
+	uint32_t	kpe_caps;		/* KNET_CAP_* supported by the sender */
+	uint32_t	kpe_rx_data_max;	/* pong only: biggest data packet received on the link since last pong */
+	uint32_t	kpe_rx_bw;		/* pong only: link capacity estimated from bandwidth probes in kbit/s, 0 if unknown */
+	uint32_t	kpe_rx_rate;		/* pong only: data rate received on the link since last pong in kbit/s */
+} __attribute__((packed));
+
+/*
+ * features older nodes don't know about. They are only used towards
+ * the nodes that advertise them in kpe_caps
+ */
+
+#define KNET_CAP_RELIABLE 0x00000001 /* KNET_DATA_FLAG_RELIABLE data */
+#define KNET_CAP_FEC      0x00000002 /* KNET_DATA_FLAG_PARITY fragments */
+#define KNET_CAP_LARGE    0x00000004 /* KNET_HEADER_VERSION_LARGE data */
+
+#define KNET_CAPS (KNET_CAP_RELIABLE | KNET_CAP_FEC | KNET_CAP_LARGE) /* all the KNET_CAP_* supported by this node */
+
 /* taken from tracepath6 */
 #define KNET_PMTUD_SIZE_V4 65535
 #define KNET_PMTUD_SIZE_V6 KNET_PMTUD_SIZE_V4
@@ -133,6 +259,31 @@ struct knet_header_payload_pmtud {
 	uint8_t		khp_pmtud_data[0];	/* pointer to empty/random data/fill buffer */
 } __attribute__((packed));
 
+/*
+ * receivers advertise, per channel, how much data they can take
+ * (see host.c). Only channels set in khp_credit_mask have an entry,
+ * in channel order, after the fixed part of the payload.
+ */
+
+struct knet_header_payload_credit {
+	uint8_t		khp_credit_link;	/* source link id */
+	uint32_t	khp_credit_epoch;	/* changes when the remote node restarts */
+	uint32_t	khp_credit_mask;	/* channels with flow control */
+	uint8_t		khp_credit_data[0];	/* array of struct knet_credit_entry */
+} __attribute__((packed));
+
+struct knet_header_payload_ack {
+	uint8_t		khp_ack_link;		/* source link id */
+	int8_t		khp_ack_channel;	/* channel of the data being acked */
+	uint32_t	khp_ack_ack;		/* next packet expected */
+	uint32_t	khp_ack_sack;		/* bitmap of packets received after khp_ack_ack + 1 */
+} __attribute__((packed));
+
+struct knet_credit_entry {
+	uint32_t	kce_rx_bytes;		/* data bytes received on the channel from the dst node */
+	uint32_t	kce_window;		/* data bytes the channel can take on top of kce_rx_bytes */
+} __attribute__((packed));
+
 /*
  * union to reference possible individual payloads
  */
@@ -141,22 +292,34 @@ union knet_header_payload {
 	struct knet_header_payload_data		khp_data;  /* pure data packet struct */
 	struct knet_header_payload_ping		khp_ping;  /* heartbeat packet struct */
 	struct knet_header_payload_pmtud 	khp_pmtud; /* Path MTU discovery packet struct */
+	struct knet_header_payload_bwprobe	khp_bwprobe; /* bandwidth probe packet struct */
+	struct knet_header_payload_credit	khp_credit; /* flow control credit packet struct */
+	struct knet_header_payload_ack		khp_ack;    /* reliable channels ack packet struct */
+	struct knet_header_payload_relay	khp_relay;  /* relayed packet struct */
+	struct knet_header_payload_tree		khp_tree;   /* broadcast tree packet struct */
 } __attribute__((packed));
 
 /*
  * starting point
  */
 
-#define KNET_HEADER_VERSION          0x01 /* we currently support only one version */
+#define KNET_HEADER_VERSION          0x01 /* all packets but the ones below */
+#define KNET_HEADER_VERSION_LARGE    0x02 /* data packets that carry a struct knet_header_large,
+					   * only sent to nodes with KNET_CAP_LARGE, older ones drop them */
 
 #define KNET_HEADER_TYPE_DATA        0x00 /* pure data packet */
 #define KNET_HEADER_TYPE_HOST_INFO   0x01 /* host status information pckt */
+#define KNET_HEADER_TYPE_RELAY       0x02 /* packet for another node, see relay.c */
+#define KNET_HEADER_TYPE_TREE        0x03 /* broadcast passed on by the receivers, see tree.c */
 
 #define KNET_HEADER_TYPE_PMSK        0x80 /* packet mask */
 #define KNET_HEADER_TYPE_PING        0x81 /* heartbeat */
 #define KNET_HEADER_TYPE_PONG        0x82 /* reply to heartbeat */
 #define KNET_HEADER_TYPE_PMTUD       0x83 /* Used to determine Path MTU */
 #define KNET_HEADER_TYPE_PMTUD_REPLY 0x84 /* reply from remote host */
+#define KNET_HEADER_TYPE_BWPROBE     0x85 /* bandwidth estimation probe, no reply */
+#define KNET_HEADER_TYPE_CREDIT      0x86 /* flow control credits, no reply */
+#define KNET_HEADER_TYPE_ACK         0x87 /* reliable channels acks, no reply */
 
 struct knet_header {
 	uint8_t				kh_version; /* pckt format/version */
@@ -179,16 +342,45 @@ struct knet_header {
 #define khp_data_bcast    kh_payload.khp_data.khp_data_bcast
 #define khp_data_channel  kh_payload.khp_data.khp_data_channel
 #define khp_data_compress kh_payload.khp_data.khp_data_compress
+#define khp_data_flags    kh_payload.khp_data.khp_data_flags
 
 #define khp_ping_link     kh_payload.khp_ping.khp_ping_link
 #define khp_ping_time     kh_payload.khp_ping.khp_ping_time
 #define khp_ping_seq_num  kh_payload.khp_ping.khp_ping_seq_num
 #define khp_ping_timed    kh_payload.khp_ping.khp_ping_timed
+#define khp_ping_ext      kh_payload.khp_ping.khp_ping_ext
 
 #define khp_pmtud_link    kh_payload.khp_pmtud.khp_pmtud_link
 #define khp_pmtud_size    kh_payload.khp_pmtud.khp_pmtud_size
 #define khp_pmtud_data    kh_payload.khp_pmtud.khp_pmtud_data
 
+#define khp_bwprobe_link  kh_payload.khp_bwprobe.khp_bwprobe_link
+#define khp_bwprobe_id    kh_payload.khp_bwprobe.khp_bwprobe_id
+#define khp_bwprobe_seq   kh_payload.khp_bwprobe.khp_bwprobe_seq
+#define khp_bwprobe_count kh_payload.khp_bwprobe.khp_bwprobe_count
+
+#define khp_credit_link   kh_payload.khp_credit.khp_credit_link
+#define khp_credit_epoch  kh_payload.khp_credit.khp_credit_epoch
+#define khp_credit_mask   kh_payload.khp_credit.khp_credit_mask
+#define khp_credit_data   kh_payload.khp_credit.khp_credit_data
+
+#define khp_ack_link      kh_payload.khp_ack.khp_ack_link
+#define khp_ack_channel   kh_payload.khp_ack.khp_ack_channel
+#define khp_ack_ack       kh_payload.khp_ack.khp_ack_ack
+#define khp_ack_sack      kh_payload.khp_ack.khp_ack_sack
+
+#define khp_relay_dst_node kh_payload.khp_relay.khp_relay_dst_node
+#define khp_relay_ttl     kh_payload.khp_relay.khp_relay_ttl
+#define khp_relay_pad     kh_payload.khp_relay.khp_relay_pad
+#define khp_relay_data    kh_payload.khp_relay.khp_relay_data
+
+#define khp_tree_src_node kh_payload.khp_tree.khp_tree_src_node
+#define khp_tree_first    kh_payload.khp_tree.khp_tree_first
+#define khp_tree_last     kh_payload.khp_tree.khp_tree_last
+#define khp_tree_fanout   kh_payload.khp_tree.khp_tree_fanout
+#define khp_tree_pad      kh_payload.khp_tree.khp_tree_pad
+#define khp_tree_data     kh_payload.khp_tree.khp_tree_data
+
 /*
  * extra defines to avoid mingling with sizeof() too much
  */
@@ -196,7 +388,16 @@ struct knet_header {
 #define KNET_HEADER_ALL_SIZE sizeof(struct knet_header)
 #define KNET_HEADER_SIZE (KNET_HEADER_ALL_SIZE - sizeof(union knet_header_payload))
 #define KNET_HEADER_PING_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_ping))
+#define KNET_HEADER_PING_EXT_SIZE (KNET_HEADER_PING_SIZE + sizeof(struct knet_header_ping_ext))
 #define KNET_HEADER_PMTUD_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_pmtud))
+#define KNET_HEADER_BWPROBE_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_bwprobe))
+#define KNET_HEADER_CREDIT_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_credit))
+#define KNET_HEADER_ACK_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_ack))
+#define KNET_HEADER_RELAY_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_relay))
+#define KNET_HEADER_TREE_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_tree))
 #define KNET_HEADER_DATA_SIZE (KNET_HEADER_SIZE + sizeof(struct knet_header_payload_data))
+#define KNET_HEADER_FEC_SIZE sizeof(struct knet_header_fec)
+#define KNET_HEADER_RELIABLE_SIZE sizeof(struct knet_header_reliable)
+#define KNET_HEADER_LARGE_SIZE sizeof(struct knet_header_large)
 
 #endif
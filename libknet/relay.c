@@ -0,0 +1,526 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+
+#include "crypto.h"
+#include "host.h"
+#include "internals.h"
+#include "logging.h"
+#include "relay.h"
+#include "threads_common.h"
+#include "threads_tx.h"
+
+/*
+ * relay routing
+ *
+ * Nodes with relay enabled broadcast a link table (KNET_HOSTINFO_TYPE_LINK_TABLE)
+ * about once a second, listing the nodes they can reach: the ones they
+ * have active links to and the ones they reach through a relay themselves,
+ * with the latency and the smallest data MTU of the path.
+ *
+ * Every node keeps the last table of the nodes it has active links to and,
+ * for every other node, picks the neighbour with the lowest latency to it
+ * (latency of our links to the neighbour plus the latency it advertises).
+ * Routes that go back through us, that are longer than KNET_RELAY_MAX_HOPS
+ * or that come from a table older than KNET_RELAY_TIMEOUT are ignored.
+ *
+ * A route is only used when there are no active links to the node.
+ * The node is then reachable, with status.remote set, and the packets
+ * for it (fragmented and encrypted as usual) go to the next hop inside
+ * a KNET_HEADER_TYPE_RELAY packet. Relays only rewrite the relay header,
+ * the destination parses what is inside as if it came from the source node.
+ * Pings, PMTUd, credits and acks are sent on the links of the node
+ * and are never relayed.
+ *
+ * Everything here is protected by tx_mutex.
+ */
+
+int _relay_init(knet_handle_t knet_h)
+{
+	int i;
+
+	if (knet_h->relaybuf) {
+		return 0;
+	}
+
+	knet_h->relaybuf = calloc(1, KNET_HEADER_RELAY_SIZE);
+	if (!knet_h->relaybuf) {
+		goto out_nomem;
+	}
+
+	knet_h->relay_tablebuf = calloc(1, KNET_MAX_PACKET_SIZE);
+	if (!knet_h->relay_tablebuf) {
+		goto out_nomem;
+	}
+
+	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+		knet_h->relaybuf_crypt[i] = malloc(KNET_RELAY_BUFSIZE);
+		if (!knet_h->relaybuf_crypt[i]) {
+			goto out_nomem;
+		}
+	}
+
+	return 0;
+
+out_nomem:
+	_relay_fini(knet_h);
+	errno = ENOMEM;
+	return -1;
+}
+
+void _relay_fini(knet_handle_t knet_h)
+{
+	int i;
+
+	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+		free(knet_h->relaybuf_crypt[i]);
+		knet_h->relaybuf_crypt[i] = NULL;
+	}
+	free(knet_h->relay_tablebuf);
+	knet_h->relay_tablebuf = NULL;
+	free(knet_h->relaybuf);
+	knet_h->relaybuf = NULL;
+}
+
+void _relay_free(struct knet_host *host)
+{
+	free(host->relay_table);
+	host->relay_table = NULL;
+	host->relay_table_entries = 0;
+}
+
+unsigned int _relay_data_mtu(knet_handle_t knet_h, struct knet_host *host)
+{
+	size_t overhead = KNET_HEADER_RELAY_SIZE + knet_h->sec_header_size;
+
+	if (host->relay_mtu <= overhead) {
+		return 0;
+	}
+
+	return host->relay_mtu - overhead;
+}
+
+/*
+ * lowest latency of the active links to a host
+ */
+static uint32_t _relay_link_latency(struct knet_host *host)
+{
+	unsigned long long latency = UINT32_MAX;
+	int link_idx;
+
+	for (link_idx = 0; link_idx < host->active_link_entries; link_idx++) {
+		if (host->link[host->active_links[link_idx]].status.latency < latency) {
+			latency = host->link[host->active_links[link_idx]].status.latency;
+		}
+	}
+
+	return latency;
+}
+
+uint32_t _relay_host_latency(struct knet_host *host)
+{
+	if (host->active_link_entries) {
+		return _relay_link_latency(host);
+	}
+
+	return host->relay_latency;
+}
+
+/*
+ * next node on the way to dst_host, NULL if there is none
+ */
+static struct knet_host *_relay_next_hop(knet_handle_t knet_h, struct knet_host *dst_host)
+{
+	struct knet_host *next_hop;
+
+	if (dst_host->active_link_entries) {
+		return dst_host;
+	}
+
+	if (!dst_host->relay_active) {
+		return NULL;
+	}
+
+	next_hop = knet_h->host_index[dst_host->relay_via];
+	if ((!next_hop) || (!next_hop->active_link_entries)) {
+		return NULL;
+	}
+
+	return next_hop;
+}
+
+/*
+ * send packets that start with a relay header to the next hop.
+ * If add_header is set, knet_h->relaybuf goes in front of each packet.
+ */
+static int _relay_dispatch(knet_handle_t knet_h, struct knet_host *next_hop,
+			   struct knet_mmsghdr *msg, int msgs_to_send, int add_header, int8_t channel)
+{
+	struct knet_mmsghdr relay_msg[PCKT_FRAG_MAX];
+	struct iovec iov[PCKT_FRAG_MAX][3];
+	ssize_t outlen;
+	int msg_idx, iovcnt;
+	unsigned int i;
+
+	memset(&relay_msg, 0, sizeof(struct knet_mmsghdr) * msgs_to_send);
+
+	for (msg_idx = 0; msg_idx < msgs_to_send; msg_idx++) {
+		iovcnt = 0;
+		if (add_header) {
+			iov[msg_idx][iovcnt].iov_base = knet_h->relaybuf;
+			iov[msg_idx][iovcnt].iov_len = KNET_HEADER_RELAY_SIZE;
+			iovcnt++;
+		}
+		/* Cast for Linux/BSD compatibility */
+		for (i = 0; i < (unsigned int)msg[msg_idx].msg_hdr.msg_iovlen; i++) {
+			if (iovcnt == 3) {
+				log_debug(knet_h, KNET_SUB_TX, "Too many buffers to relay a packet");
+				errno = EINVAL;
+				return -1;
+			}
+			iov[msg_idx][iovcnt] = msg[msg_idx].msg_hdr.msg_iov[i];
+			iovcnt++;
+		}
+
+		if (knet_h->crypto_instance) {
+			if (crypto_encrypt_and_signv(knet_h,
+						     iov[msg_idx], iovcnt,
+						     knet_h->relaybuf_crypt[msg_idx],
+						     &outlen) < 0) {
+				log_debug(knet_h, KNET_SUB_TX, "Unable to encrypt relayed packet");
+				errno = ECHILD;
+				return -1;
+			}
+			iov[msg_idx][0].iov_base = knet_h->relaybuf_crypt[msg_idx];
+			iov[msg_idx][0].iov_len = outlen;
+			iovcnt = 1;
+		}
+
+		relay_msg[msg_idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		relay_msg[msg_idx].msg_hdr.msg_iov = iov[msg_idx];
+		relay_msg[msg_idx].msg_hdr.msg_iovlen = iovcnt;
+	}
+
+	return _dispatch_to_links(knet_h, next_hop, &relay_msg[0], msgs_to_send, 0, channel);
+}
+
+int _relay_send(knet_handle_t knet_h, struct knet_host *dst_host,
+		struct knet_mmsghdr *msg, int msgs_to_send, int8_t channel)
+{
+	struct knet_host *next_hop;
+
+	if (!knet_h->relaybuf) {
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+
+	next_hop = _relay_next_hop(knet_h, dst_host);
+	if ((!next_hop) || (next_hop == dst_host)) {
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+
+	knet_h->relaybuf->kh_version = KNET_HEADER_VERSION;
+	knet_h->relaybuf->kh_type = KNET_HEADER_TYPE_RELAY;
+	knet_h->relaybuf->kh_node = htons(knet_h->host_id);
+	knet_h->relaybuf->khp_relay_dst_node = htons(dst_host->host_id);
+	knet_h->relaybuf->khp_relay_ttl = KNET_RELAY_MAX_HOPS - 1;
+	knet_h->relaybuf->khp_relay_pad = 0;
+
+	knet_h->stats.tx_relayed_packets += msgs_to_send;
+
+	return _relay_dispatch(knet_h, next_hop, msg, msgs_to_send, 1, channel);
+}
+
+void _relay_forward(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t len)
+{
+	struct knet_host *dst_host, *next_hop;
+	struct knet_mmsghdr msg;
+	struct iovec iov;
+	knet_node_id_t dst_host_id = ntohs(inbuf->khp_relay_dst_node);
+
+	dst_host = knet_h->host_index[dst_host_id];
+	if ((!dst_host) || (dst_host_id == knet_h->host_id)) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to find host %u to relay packet from host %u",
+			  dst_host_id, inbuf->kh_node);
+		return;
+	}
+
+	if (!inbuf->khp_relay_ttl) {
+		log_debug(knet_h, KNET_SUB_RX, "Dropping packet from host %u to host %u, too many relays",
+			  inbuf->kh_node, dst_host_id);
+		return;
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+		return;
+	}
+
+	next_hop = _relay_next_hop(knet_h, dst_host);
+	if (!next_hop) {
+		log_debug(knet_h, KNET_SUB_RX, "No route to relay packet from host %u to host %u",
+			  inbuf->kh_node, dst_host_id);
+		goto out_unlock;
+	}
+
+	inbuf->kh_node = htons(knet_h->host_id);
+	inbuf->khp_relay_ttl--;
+
+	memset(&msg, 0, sizeof(struct knet_mmsghdr));
+	iov.iov_base = inbuf;
+	iov.iov_len = len;
+	msg.msg_hdr.msg_iov = &iov;
+	msg.msg_hdr.msg_iovlen = 1;
+
+	if (!_relay_dispatch(knet_h, next_hop, &msg, 1, 0, -1)) {
+		knet_h->stats.rx_relay_forwarded++;
+	}
+
+out_unlock:
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
+
+void _relay_parse_table(knet_handle_t knet_h, struct knet_host *src_host,
+			struct knet_hostinfo *knet_hostinfo, ssize_t len)
+{
+	struct knet_hostinfo_link_table_entry *entry;
+	struct knet_relay_entry *table = NULL;
+	uint16_t entries, i;
+
+	if (!knet_h->relay) {
+		return;
+	}
+
+	/*
+	 * tables relayed from farther nodes are of no use,
+	 * routes only go through the nodes we have links to
+	 */
+	if (!src_host->active_link_entries) {
+		return;
+	}
+
+	if (len < (ssize_t)KNET_HOSTINFO_LINK_TABLE_SIZE) {
+		log_debug(knet_h, KNET_SUB_RX, "Link table from host %u is too short", src_host->host_id);
+		return;
+	}
+
+	entries = ntohs(knet_hostinfo->khip_link_table_entries);
+	if (len < (ssize_t)(KNET_HOSTINFO_LINK_TABLE_SIZE + (entries * sizeof(struct knet_hostinfo_link_table_entry)))) {
+		log_debug(knet_h, KNET_SUB_RX, "Link table from host %u is too short", src_host->host_id);
+		return;
+	}
+
+	if (entries) {
+		table = malloc(entries * sizeof(struct knet_relay_entry));
+		if (!table) {
+			log_debug(knet_h, KNET_SUB_RX, "Unable to allocate memory for link table from host %u",
+				  src_host->host_id);
+			return;
+		}
+	}
+
+	entry = (struct knet_hostinfo_link_table_entry *)knet_hostinfo->khip_link_table_data;
+	for (i = 0; i < entries; i++) {
+		table[i].node_id = ntohs(entry[i].khlt_node_id);
+		table[i].next_hop = ntohs(entry[i].khlt_next_hop);
+		table[i].hops = entry[i].khlt_hops;
+		table[i].latency = ntohl(entry[i].khlt_latency);
+		table[i].mtu = ntohl(entry[i].khlt_mtu);
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+		free(table);
+		return;
+	}
+
+	_relay_free(src_host);
+	src_host->relay_table = table;
+	src_host->relay_table_entries = entries;
+	clock_gettime(CLOCK_MONOTONIC, &src_host->relay_table_last);
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
+
+/*
+ * pick the lowest latency route to host through the nodes we have links to
+ */
+static void _relay_route(knet_handle_t knet_h, struct knet_host *host, struct timespec clock_now)
+{
+	struct knet_host *via;
+	struct knet_relay_entry *entry;
+	unsigned long long diff;
+	uint32_t latency;
+	uint16_t i;
+	uint8_t found = 0;
+	knet_node_id_t relay_via = 0;
+	uint8_t hops = 0;
+	uint32_t best_latency = UINT32_MAX, mtu = 0;
+
+	for (via = knet_h->host_head; via != NULL; via = via->next) {
+		if ((via == host) ||
+		    (via->host_id == knet_h->host_id) ||
+		    (!via->active_link_entries) ||
+		    (!via->relay_table_entries)) {
+			continue;
+		}
+
+		timespec_diff(via->relay_table_last, clock_now, &diff);
+		if (diff > KNET_RELAY_TIMEOUT) {
+			continue;
+		}
+
+		for (i = 0; i < via->relay_table_entries; i++) {
+			entry = &via->relay_table[i];
+			if (entry->node_id != host->host_id) {
+				continue;
+			}
+			if ((entry->next_hop == knet_h->host_id) ||
+			    (entry->hops >= KNET_RELAY_MAX_HOPS)) {
+				break;
+			}
+			latency = _relay_link_latency(via);
+			if (entry->latency > UINT32_MAX - latency) {
+				latency = UINT32_MAX;
+			} else {
+				latency += entry->latency;
+			}
+			if ((!found) || (latency < best_latency)) {
+				found = 1;
+				relay_via = via->host_id;
+				hops = entry->hops + 1;
+				best_latency = latency;
+				mtu = entry->mtu;
+				if (via->data_mtu < mtu) {
+					mtu = via->data_mtu;
+				}
+			}
+			break;
+		}
+	}
+
+	if ((host->relay_active == found) &&
+	    ((!found) || ((host->relay_via == relay_via) && (host->relay_mtu == mtu)))) {
+		host->relay_latency = best_latency;
+		host->relay_hops = hops;
+		return;
+	}
+
+	if (found) {
+		log_info(knet_h, KNET_SUB_HOST, "host: %u can be reached through host %u (%u hops, latency %u us)",
+			 host->host_id, relay_via, hops, best_latency);
+	} else {
+		log_info(knet_h, KNET_SUB_HOST, "host: %u can not be reached through other hosts",
+			 host->host_id);
+	}
+
+	host->relay_active = found;
+	host->relay_via = relay_via;
+	host->relay_hops = hops;
+	host->relay_latency = best_latency;
+	host->relay_mtu = mtu;
+
+	/*
+	 * the route is used only if there are no links to the host,
+	 * let the dst cache know about the change
+	 */
+	if (!host->active_link_entries) {
+		_host_dstcache_update_async(knet_h, host);
+	}
+}
+
+static void _relay_send_table(knet_handle_t knet_h)
+{
+	struct knet_hostinfo *knet_hostinfo = (struct knet_hostinfo *)knet_h->relay_tablebuf;
+	struct knet_hostinfo_link_table_entry *entry;
+	struct knet_host *host;
+	uint16_t entries = 0;
+
+	knet_hostinfo->khi_type = KNET_HOSTINFO_TYPE_LINK_TABLE;
+	knet_hostinfo->khi_bcast = KNET_HOSTINFO_BCAST;
+	knet_hostinfo->khi_dst_node_id = 0;
+
+	entry = (struct knet_hostinfo_link_table_entry *)knet_hostinfo->khip_link_table_data;
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		if (host->host_id == knet_h->host_id) {
+			continue;
+		}
+		if (entries >= KNET_RELAY_TABLE_MAX) {
+			break;
+		}
+		if (host->active_link_entries) {
+			entry[entries].khlt_next_hop = htons(host->host_id);
+			entry[entries].khlt_hops = 1;
+			entry[entries].khlt_latency = htonl(_relay_link_latency(host));
+			entry[entries].khlt_mtu = htonl(host->data_mtu);
+		} else if ((host->relay_active) && (host->status.reachable)) {
+			entry[entries].khlt_next_hop = htons(host->relay_via);
+			entry[entries].khlt_hops = host->relay_hops;
+			entry[entries].khlt_latency = htonl(host->relay_latency);
+			entry[entries].khlt_mtu = htonl(host->relay_mtu);
+		} else {
+			continue;
+		}
+		entry[entries].khlt_node_id = htons(host->host_id);
+		entry[entries].khlt_pad = 0;
+		entries++;
+	}
+
+	knet_hostinfo->khip_link_table_entries = htons(entries);
+
+	_send_host_info(knet_h, knet_hostinfo,
+			KNET_HOSTINFO_LINK_TABLE_SIZE + (entries * sizeof(struct knet_hostinfo_link_table_entry)));
+}
+
+void _relay_update(knet_handle_t knet_h)
+{
+	struct knet_host *host;
+	struct timespec clock_now;
+
+	if ((!knet_h->relay) && (!knet_h->relaybuf)) {
+		return;
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_HOST, "Unable to get TX mutex lock");
+		return;
+	}
+
+	/*
+	 * relay has been disabled, forget the tables and the routes
+	 */
+	if (!knet_h->relay) {
+		for (host = knet_h->host_head; host != NULL; host = host->next) {
+			_relay_free(host);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		if (host->host_id == knet_h->host_id) {
+			continue;
+		}
+		_relay_route(knet_h, host, clock_now);
+	}
+
+	if (knet_h->relay) {
+		_relay_send_table(knet_h);
+	}
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#ifndef __KNET_RELAY_H__
+#define __KNET_RELAY_H__
+
+#include "internals.h"
+#include "onwire.h"
+
+#define KNET_RELAY_TIMEOUT	3000000000llu		/* nsecs, older link tables are ignored */
+#define KNET_RELAY_MAX_HOPS	4			/* relays a packet can go through */
+#define KNET_RELAY_TABLE_MAX	((KNET_MAX_PACKET_SIZE - KNET_HOSTINFO_LINK_TABLE_SIZE) / sizeof(struct knet_hostinfo_link_table_entry))
+#define KNET_RELAY_BUFSIZE	(KNET_HEADER_RELAY_SIZE + KNET_DATABUFSIZE_CRYPT + KNET_DATABUFSIZE_CRYPT_PAD)
+
+/*
+ * an entry of the last link table received from a node
+ */
+
+struct knet_relay_entry {
+	knet_node_id_t node_id;
+	knet_node_id_t next_hop;
+	uint8_t hops;
+	uint32_t latency;		/* usecs */
+	uint32_t mtu;
+};
+
+int _relay_init(knet_handle_t knet_h);
+void _relay_fini(knet_handle_t knet_h);
+void _relay_free(struct knet_host *host);
+
+/*
+ * data MTU towards a host that is reached through a relay
+ */
+unsigned int _relay_data_mtu(knet_handle_t knet_h, struct knet_host *host);
+
+/*
+ * lowest latency to a host, directly or through the relay route
+ */
+uint32_t _relay_host_latency(struct knet_host *host);
+
+/*
+ * called about once a second by the heartbeat thread
+ */
+void _relay_update(knet_handle_t knet_h);
+
+void _relay_parse_table(knet_handle_t knet_h, struct knet_host *src_host,
+			struct knet_hostinfo *knet_hostinfo, ssize_t len);
+void _relay_forward(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t len);
+
+/*
+ * needs tx_mutex
+ */
+int _relay_send(knet_handle_t knet_h, struct knet_host *dst_host,
+		struct knet_mmsghdr *msg, int msgs_to_send, int8_t channel);
+
+#endif
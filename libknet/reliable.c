@@ -0,0 +1,834 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+
+#include "crypto.h"
+#include "host.h"
+#include "internals.h"
+#include "large.h"
+#include "logging.h"
+#include "reliable.h"
+#include "threads_common.h"
+#include "threads_tx.h"
+#include "transports.h"
+#include "transport_common.h"
+
+/*
+ * reliable channels
+ *
+ * Data read from a reliable channel gets, for each destination node,
+ * a sequence number in a struct knet_header_reliable in front of the
+ * (compressed) user data, so every node gets its own copy of the packet.
+ * The sender keeps the packets, as they went on the wire, until the node
+ * acks them.
+ *
+ * Acks carry the next sequence number expected and a bitmap of the packets
+ * received after it (selective acks). They are piggybacked on reliable data
+ * going the other way and otherwise sent in ACK packets at the end of each
+ * RX batch.
+ *
+ * A packet is retransmitted when KNET_RELIABLE_DUPTHRESH later packets
+ * have been acked (fast retransmit, at most once per round trip) or after
+ * a timeout based on the links latency, with exponential backoff.
+ * After KNET_RELIABLE_RETRIES the sender gives up on the packet and
+ * krh_una tells the receiver not to wait for it anymore.
+ *
+ * The receiver delivers in order and holds the packets received after a gap,
+ * or that could not be written because the application is not reading.
+ *
+ * Everything here is protected by tx_mutex.
+ */
+
+static struct knet_reliable *_reliable_get(knet_handle_t knet_h, struct knet_host *host, int8_t channel)
+{
+	struct knet_reliable *rel = host->reliable[channel];
+
+	if (rel) {
+		return rel;
+	}
+
+	rel = calloc(1, sizeof(struct knet_reliable));
+	if (!rel) {
+		log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for reliable channel %d of host %u",
+			channel, host->host_id);
+		return NULL;
+	}
+
+	/*
+	 * start from a different sequence number on every restart, so that
+	 * acks sent to a previous instance fall out of the window
+	 */
+	rel->tx_next = knet_h->epoch ^ ((uint32_t)host->host_id << 8) ^ (uint8_t)channel;
+	rel->tx_una = rel->tx_next;
+	rel->host = host;
+	rel->channel = channel;
+
+	host->reliable[channel] = rel;
+
+	return rel;
+}
+
+static void _reliable_rx_reset(struct knet_reliable *rel)
+{
+	int i;
+
+	for (i = 0; i < KNET_RELIABLE_WINDOW; i++) {
+		free(rel->rx_pckt[i]);
+		rel->rx_pckt[i] = NULL;
+	}
+}
+
+void _reliable_free(struct knet_host *host)
+{
+	struct knet_reliable *rel;
+	int8_t channel;
+	int i;
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		rel = host->reliable[channel];
+		if (!rel) {
+			continue;
+		}
+		for (i = 0; i < KNET_RELIABLE_WINDOW; i++) {
+			free(rel->tx_pckt[i]);
+		}
+		_reliable_rx_reset(rel);
+		free(rel);
+		host->reliable[channel] = NULL;
+	}
+}
+
+/*
+ * smallest round trip time of the links to the host, in nsecs. 0 if unknown
+ */
+static uint64_t _reliable_rtt(struct knet_host *host)
+{
+	struct knet_link *link;
+	uint64_t rtt = 0;
+	int i;
+
+	for (i = 0; i < host->active_link_entries; i++) {
+		link = &host->link[host->active_links[i]];
+		if ((link->transport_type == KNET_TRANSPORT_LOOPBACK) ||
+		    (!link->status.latency)) {
+			continue;
+		}
+		if ((!rtt) || (link->status.latency * 1000llu < rtt)) {
+			rtt = link->status.latency * 1000llu;
+		}
+	}
+
+	return rtt;
+}
+
+static uint64_t _reliable_rto(struct knet_host *host, uint8_t retries)
+{
+	uint64_t rto = 2 * _reliable_rtt(host);
+
+	if (rto < KNET_RELIABLE_RTO_MIN) {
+		rto = KNET_RELIABLE_RTO_MIN;
+	}
+
+	while ((retries--) && (rto < KNET_RELIABLE_RTO_MAX)) {
+		rto = rto * 2;
+	}
+
+	if (rto > KNET_RELIABLE_RTO_MAX) {
+		rto = KNET_RELIABLE_RTO_MAX;
+	}
+
+	return rto;
+}
+
+static void _reliable_rx_ack(struct knet_reliable *rel, uint32_t *ack, uint32_t *sack)
+{
+	int i;
+
+	*ack = rel->rx_next;
+	*sack = 0;
+
+	for (i = 0; i < KNET_RELIABLE_SACK_BITS; i++) {
+		if (rel->rx_pckt[(rel->rx_next + 1 + i) % KNET_RELIABLE_WINDOW]) {
+			*sack |= (1U << i);
+		}
+	}
+}
+
+/*
+ * move tx_una over the packets we gave up on
+ */
+static void _reliable_tx_skip(struct knet_reliable *rel)
+{
+	while ((rel->tx_una != rel->tx_next) &&
+	       (!rel->tx_pckt[rel->tx_una % KNET_RELIABLE_WINDOW])) {
+		rel->tx_una++;
+	}
+}
+
+static int _reliable_retransmit(knet_handle_t knet_h, struct knet_host *host, struct knet_reliable_pckt *pckt)
+{
+	struct knet_mmsghdr msg[PCKT_FRAG_MAX];
+	struct iovec iov[PCKT_FRAG_MAX];
+	unsigned char *data = pckt->data;
+	int i;
+
+	memset(&msg, 0, sizeof(struct knet_mmsghdr) * pckt->frags);
+
+	for (i = 0; i < pckt->frags; i++) {
+		iov[i].iov_base = data;
+		iov[i].iov_len = pckt->frag_len[i];
+		data += pckt->frag_len[i];
+		msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &pckt->sent);
+	pckt->retries++;
+	knet_h->stats.tx_reliable_retransmits++;
+
+	return _dispatch_to_links(knet_h, host, &msg[0], pckt->frags, 0, -1);
+}
+
+static void _reliable_tx_ack(knet_handle_t knet_h, struct knet_host *host, struct knet_reliable *rel,
+			     uint32_t ack, uint32_t sack)
+{
+	struct knet_reliable_pckt *pckt;
+	struct timespec clock_now;
+	unsigned long long diff;
+	uint64_t rtt;
+	uint32_t seq;
+	int i, later = 0;
+
+	/*
+	 * only packets in flight can be acked
+	 */
+	if ((ack - rel->tx_una) > (rel->tx_next - rel->tx_una)) {
+		return;
+	}
+
+	while (rel->tx_una != ack) {
+		free(rel->tx_pckt[rel->tx_una % KNET_RELIABLE_WINDOW]);
+		rel->tx_pckt[rel->tx_una % KNET_RELIABLE_WINDOW] = NULL;
+		rel->tx_una++;
+	}
+	_reliable_tx_skip(rel);
+
+	if (!sack) {
+		return;
+	}
+
+	for (i = 0; i < KNET_RELIABLE_SACK_BITS; i++) {
+		seq = ack + 1 + i;
+		if ((seq - rel->tx_una) >= (rel->tx_next - rel->tx_una)) {
+			break;
+		}
+		pckt = rel->tx_pckt[seq % KNET_RELIABLE_WINDOW];
+		if ((pckt) && (sack & (1U << i))) {
+			pckt->sacked = 1;
+		}
+	}
+
+	/*
+	 * fast retransmit the holes with enough packets acked after them
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+	rtt = _reliable_rtt(host);
+
+	for (i = KNET_RELIABLE_SACK_BITS - 1; i >= -1; i--) {
+		seq = ack + 1 + i;
+		if ((seq - rel->tx_una) >= (rel->tx_next - rel->tx_una)) {
+			continue;
+		}
+		pckt = rel->tx_pckt[seq % KNET_RELIABLE_WINDOW];
+		if (!pckt) {
+			continue;
+		}
+		if (pckt->sacked) {
+			later++;
+			continue;
+		}
+		if (later < KNET_RELIABLE_DUPTHRESH) {
+			continue;
+		}
+		timespec_diff(pckt->sent, clock_now, &diff);
+		if (diff < rtt) {
+			continue;
+		}
+		_reliable_retransmit(knet_h, host, pckt);
+	}
+}
+
+int _reliable_tx_prepare(knet_handle_t knet_h, struct knet_host *host, int8_t channel, struct knet_header_reliable *hdr)
+{
+	struct knet_reliable *rel;
+	uint32_t ack = 0, sack = 0;
+	uint8_t flags = 0;
+
+	rel = _reliable_get(knet_h, host, channel);
+	if (!rel) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (rel->tx_next - rel->tx_una >= KNET_RELIABLE_WINDOW) {
+		log_debug(knet_h, KNET_SUB_TX, "Reliable channel %d window to host %u is full, dropping packet",
+			  channel, host->host_id);
+		knet_h->stats.tx_reliable_lost++;
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	/*
+	 * without data from the node there is nothing to ack, and any
+	 * value could be taken as an ack for packets still in flight
+	 */
+	if (rel->rx_synced) {
+		_reliable_rx_ack(rel, &ack, &sack);
+		rel->rx_ack_pending = 0;
+		flags |= KNET_RELIABLE_FLAG_ACK;
+	}
+
+	hdr->krh_epoch = htonl(knet_h->epoch);
+	hdr->krh_seq = htonl(rel->tx_next);
+	hdr->krh_una = htonl(rel->tx_una);
+	hdr->krh_ack = htonl(ack);
+	hdr->krh_sack = htonl(sack);
+	hdr->krh_flags = flags;
+
+	return 0;
+}
+
+int _reliable_tx_store(knet_handle_t knet_h, struct knet_host *host, int8_t channel, struct knet_mmsghdr *msg, int msgs)
+{
+	struct knet_reliable *rel = host->reliable[channel];
+	struct knet_reliable_pckt *pckt;
+	unsigned char *data;
+	size_t len = 0;
+	int i, j;
+
+	/*
+	 * the sequence number is used even if we can't keep the packet,
+	 * it will be skipped as if we gave up on it
+	 */
+	rel->tx_next++;
+	knet_h->reliable_in_flight = 1;
+
+	for (i = 0; i < msgs; i++) {
+		for (j = 0; j < (int)msg[i].msg_hdr.msg_iovlen; j++) {
+			len += msg[i].msg_hdr.msg_iov[j].iov_len;
+		}
+	}
+
+	pckt = malloc(sizeof(struct knet_reliable_pckt) + (msgs * sizeof(uint16_t)) + len);
+	if (!pckt) {
+		log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for reliable packet to host %u: %s",
+			host->host_id, strerror(errno));
+		knet_h->stats.tx_reliable_lost++;
+		return -1;
+	}
+
+	pckt->frag_len = (uint16_t *)(pckt + 1);
+	pckt->data = (unsigned char *)(pckt->frag_len + msgs);
+	pckt->frags = msgs;
+	pckt->retries = 0;
+	pckt->sacked = 0;
+	clock_gettime(CLOCK_MONOTONIC, &pckt->sent);
+
+	data = pckt->data;
+	for (i = 0; i < msgs; i++) {
+		pckt->frag_len[i] = 0;
+		for (j = 0; j < (int)msg[i].msg_hdr.msg_iovlen; j++) {
+			memmove(data, msg[i].msg_hdr.msg_iov[j].iov_base, msg[i].msg_hdr.msg_iov[j].iov_len);
+			data += msg[i].msg_hdr.msg_iov[j].iov_len;
+			pckt->frag_len[i] += msg[i].msg_hdr.msg_iov[j].iov_len;
+		}
+	}
+
+	rel->tx_pckt[(rel->tx_next - 1) % KNET_RELIABLE_WINDOW] = pckt;
+
+	return 0;
+}
+
+int _reliable_tx_blocked(knet_handle_t knet_h, struct knet_host *host, int8_t channel)
+{
+	struct knet_reliable *rel = host->reliable[channel];
+
+	return ((rel) && (rel->tx_next - rel->tx_una >= KNET_RELIABLE_WINDOW));
+}
+
+int _reliable_channel_blocked(knet_handle_t knet_h, int8_t channel)
+{
+	struct knet_host *host;
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		/*
+		 * data is not sent to unreachable hosts
+		 */
+		if (!host->status.reachable) {
+			continue;
+		}
+		if (_reliable_tx_blocked(knet_h, host, channel)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * returns 1 if the data has been consumed (written or dropped),
+ * 0 if the sock is full and we need to try again later
+ */
+static int _reliable_rx_write(knet_handle_t knet_h, struct knet_reliable *rel, int8_t channel,
+			      void *data, size_t len, int large)
+{
+	struct iovec iov;
+	ssize_t outlen;
+
+	/*
+	 * placeholder for a packet dropped after parsing
+	 */
+	if (channel < 0) {
+		return 1;
+	}
+
+	if ((large) || (knet_h->sockfd[channel].is_large)) {
+		return _large_rx_write(knet_h, rel->host, rel->channel, channel, data, len, large);
+	}
+
+	if (!knet_h->sockfd[channel].in_use) {
+		return 1;
+	}
+
+	iov.iov_base = data;
+	iov.iov_len = len;
+
+	outlen = writev(knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], &iov, 1);
+	if ((outlen < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		return 0;
+	}
+	if (outlen <= 0) {
+		knet_h->sock_notify_fn(knet_h->sock_notify_fn_private_data,
+				       knet_h->sockfd[channel].sockfd[0],
+				       channel,
+				       KNET_NOTIFY_RX,
+				       outlen,
+				       errno);
+	}
+
+	return 1;
+}
+
+/*
+ * deliver the packets held in order, moving over the ones the sender
+ * gave up on. Stops when the application sock is full, the TX thread
+ * timers try again later.
+ */
+static void _reliable_rx_flush(knet_handle_t knet_h, struct knet_reliable *rel)
+{
+	unsigned int slot = rel->rx_next % KNET_RELIABLE_WINDOW;
+
+	while (1) {
+		if (!rel->rx_pckt[slot]) {
+			if ((int32_t)(rel->rx_una - rel->rx_next) <= 0) {
+				return;
+			}
+			rel->rx_next++;
+			slot = rel->rx_next % KNET_RELIABLE_WINDOW;
+			continue;
+		}
+		if (!_reliable_rx_write(knet_h, rel, rel->rx_channel[slot], rel->rx_pckt[slot], rel->rx_len[slot],
+					rel->rx_large[slot])) {
+			knet_h->reliable_in_flight = 1;
+			return;
+		}
+		free(rel->rx_pckt[slot]);
+		rel->rx_pckt[slot] = NULL;
+		rel->rx_next++;
+		rel->rx_ack_pending = 1;
+		knet_h->reliable_ack_pending = 1;
+		slot = rel->rx_next % KNET_RELIABLE_WINDOW;
+	}
+}
+
+static void _reliable_rx_hold(knet_handle_t knet_h, struct knet_reliable *rel, uint32_t seq, int8_t channel,
+			      struct iovec *iov, int large)
+{
+	unsigned int slot = seq % KNET_RELIABLE_WINDOW;
+
+	free(rel->rx_pckt[slot]);
+	/*
+	 * a dropped packet has no data but still needs a slot
+	 */
+	rel->rx_pckt[slot] = malloc(iov->iov_len ? iov->iov_len : 1);
+	if (!rel->rx_pckt[slot]) {
+		/*
+		 * not acked, it will be retransmitted
+		 */
+		log_debug(knet_h, KNET_SUB_RX, "Unable to allocate memory for reliable packet %u", seq);
+		return;
+	}
+
+	if (iov->iov_len) {
+		memmove(rel->rx_pckt[slot], iov->iov_base, iov->iov_len);
+	}
+	rel->rx_len[slot] = iov->iov_len;
+	rel->rx_channel[slot] = channel;
+	rel->rx_large[slot] = large;
+}
+
+/*
+ * the sender gave up on the packets before una, deliver what we have
+ */
+static void _reliable_rx_skip(knet_handle_t knet_h, struct knet_host *host, struct knet_reliable *rel, uint32_t una)
+{
+	if ((int32_t)(una - rel->rx_una) > 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Host %u gave up on %u reliable packets",
+			  host->host_id, una - rel->rx_una);
+		rel->rx_una = una;
+	}
+
+	_reliable_rx_flush(knet_h, rel);
+}
+
+int _reliable_tx_timers(knet_handle_t knet_h)
+{
+	struct knet_host *host;
+	struct knet_reliable *rel;
+	struct knet_reliable_pckt *pckt;
+	struct timespec clock_now;
+	unsigned long long diff;
+	int8_t channel;
+	uint32_t seq;
+
+	if (!knet_h->reliable_in_flight) {
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+	timespec_diff(knet_h->reliable_timers_last, clock_now, &diff);
+	if (diff < KNET_RELIABLE_TIMER * 1000000llu) {
+		return KNET_RELIABLE_TIMER;
+	}
+	knet_h->reliable_timers_last = clock_now;
+	knet_h->reliable_in_flight = 0;
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+			rel = host->reliable[channel];
+			if (!rel) {
+				continue;
+			}
+
+			/*
+			 * data the application could not take yet
+			 */
+			if ((rel->rx_synced) &&
+			    ((rel->rx_pckt[rel->rx_next % KNET_RELIABLE_WINDOW]) ||
+			     ((int32_t)(rel->rx_una - rel->rx_next) > 0))) {
+				_reliable_rx_flush(knet_h, rel);
+			}
+
+			if (rel->tx_una == rel->tx_next) {
+				continue;
+			}
+			knet_h->reliable_in_flight = 1;
+
+			/*
+			 * keep the packets until the host comes back
+			 */
+			if (!host->status.reachable) {
+				continue;
+			}
+
+			for (seq = rel->tx_una; seq != rel->tx_next; seq++) {
+				pckt = rel->tx_pckt[seq % KNET_RELIABLE_WINDOW];
+				if ((!pckt) || (pckt->sacked)) {
+					continue;
+				}
+				timespec_diff(pckt->sent, clock_now, &diff);
+				if (diff < _reliable_rto(host, pckt->retries)) {
+					continue;
+				}
+				if (pckt->retries >= KNET_RELIABLE_RETRIES) {
+					log_debug(knet_h, KNET_SUB_TX, "Giving up on reliable packet %u to host %u channel %d",
+						  seq, host->host_id, channel);
+					knet_h->stats.tx_reliable_lost++;
+					free(pckt);
+					rel->tx_pckt[seq % KNET_RELIABLE_WINDOW] = NULL;
+					continue;
+				}
+				_reliable_retransmit(knet_h, host, pckt);
+			}
+			_reliable_tx_skip(rel);
+		}
+	}
+
+	if (!knet_h->reliable_in_flight) {
+		return -1;
+	}
+
+	return KNET_RELIABLE_TIMER;
+}
+
+/*
+ * strip the reliable header from a (defragmented) data packet and
+ * process the acks it carries.
+ * returns 0 if the packet has to be delivered, 1 if it's a duplicate,
+ * -1 on errors
+ */
+int _reliable_rx_parse(knet_handle_t knet_h, struct knet_host *host, struct knet_header *inbuf, ssize_t *len,
+		       struct knet_header_reliable *hdr)
+{
+	struct knet_reliable *rel;
+	int8_t channel = inbuf->khp_data_channel;
+	uint32_t seq;
+	int err = 0;
+
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX) ||
+	    (*len < (ssize_t)(KNET_HEADER_DATA_SIZE + sizeof(struct knet_header_reliable)))) {
+		log_debug(knet_h, KNET_SUB_RX, "Invalid reliable packet from host %u", host->host_id);
+		return -1;
+	}
+
+	memmove(hdr, inbuf->khp_data_userdata, sizeof(struct knet_header_reliable));
+	*len = *len - sizeof(struct knet_header_reliable);
+	memmove(inbuf->khp_data_userdata,
+		inbuf->khp_data_userdata + sizeof(struct knet_header_reliable),
+		*len - KNET_HEADER_DATA_SIZE);
+
+	hdr->krh_epoch = ntohl(hdr->krh_epoch);
+	hdr->krh_seq = ntohl(hdr->krh_seq);
+	hdr->krh_una = ntohl(hdr->krh_una);
+	hdr->krh_ack = ntohl(hdr->krh_ack);
+	hdr->krh_sack = ntohl(hdr->krh_sack);
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+		return -1;
+	}
+
+	rel = _reliable_get(knet_h, host, channel);
+	if (!rel) {
+		err = -1;
+		goto out_unlock;
+	}
+
+	if (hdr->krh_flags & KNET_RELIABLE_FLAG_ACK) {
+		_reliable_tx_ack(knet_h, host, rel, hdr->krh_ack, hdr->krh_sack);
+	}
+
+	if ((!rel->rx_synced) || (rel->rx_epoch != hdr->krh_epoch)) {
+		if (rel->rx_synced) {
+			log_debug(knet_h, KNET_SUB_RX, "Host %u restarted, resetting reliable channel %d",
+				  host->host_id, channel);
+		}
+		_reliable_rx_reset(rel);
+		rel->rx_synced = 1;
+		rel->rx_epoch = hdr->krh_epoch;
+		rel->rx_next = hdr->krh_una;
+		rel->rx_una = hdr->krh_una;
+	}
+
+	if ((int32_t)(hdr->krh_una - rel->rx_una) > 0) {
+		_reliable_rx_skip(knet_h, host, rel, hdr->krh_una);
+	}
+
+	rel->rx_ack_pending = 1;
+	knet_h->reliable_ack_pending = 1;
+
+	seq = hdr->krh_seq;
+
+	if (((int32_t)(seq - rel->rx_next) < 0) ||
+	    ((seq != rel->rx_next) && (rel->rx_pckt[seq % KNET_RELIABLE_WINDOW]))) {
+		knet_h->stats.rx_reliable_duplicates++;
+		err = 1;
+	} else if (seq - rel->rx_next >= KNET_RELIABLE_WINDOW) {
+		log_debug(knet_h, KNET_SUB_RX, "Reliable packet %u from host %u is out of window",
+			  seq, host->host_id);
+		err = 1;
+	}
+
+out_unlock:
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+	return err;
+}
+
+ssize_t _reliable_rx_deliver(knet_handle_t knet_h, struct knet_host *host, int8_t wire_channel,
+			     struct knet_header_reliable *hdr, int8_t channel, struct iovec *iov, int large)
+{
+	struct knet_reliable *rel;
+	unsigned int slot;
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+		return -1;
+	}
+
+	rel = host->reliable[wire_channel];
+	if ((!rel) || (!rel->rx_synced)) {
+		pthread_mutex_unlock(&knet_h->tx_mutex);
+		return -1;
+	}
+
+	if (hdr->krh_seq == rel->rx_next) {
+		slot = rel->rx_next % KNET_RELIABLE_WINDOW;
+		free(rel->rx_pckt[slot]);
+		rel->rx_pckt[slot] = NULL;
+
+		if (_reliable_rx_write(knet_h, rel, channel, iov->iov_base, iov->iov_len, large)) {
+			rel->rx_next++;
+			_reliable_rx_flush(knet_h, rel);
+		} else {
+			/*
+			 * the application is not reading, try again
+			 * from the TX thread timers
+			 */
+			_reliable_rx_hold(knet_h, rel, hdr->krh_seq, channel, iov, large);
+			knet_h->reliable_in_flight = 1;
+		}
+	} else {
+		_reliable_rx_hold(knet_h, rel, hdr->krh_seq, channel, iov, large);
+		knet_h->stats.rx_reliable_out_of_order++;
+	}
+
+	rel->rx_ack_pending = 1;
+	knet_h->reliable_ack_pending = 1;
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+
+	return iov->iov_len;
+}
+
+/*
+ * the packet passed _reliable_rx_parse but will not be delivered,
+ * it still has to use up its sequence number or rx_next never moves
+ * past it and everything behind it is held until the sender gives up
+ */
+void _reliable_rx_drop(knet_handle_t knet_h, struct knet_host *host, int8_t wire_channel,
+		       struct knet_header_reliable *hdr)
+{
+	struct iovec iov;
+
+	iov.iov_base = NULL;
+	iov.iov_len = 0;
+
+	_reliable_rx_deliver(knet_h, host, wire_channel, hdr, -1, &iov, 0);
+}
+
+void _reliable_parse_ack(knet_handle_t knet_h, struct knet_host *host, struct knet_header *inbuf, ssize_t len)
+{
+	struct knet_reliable *rel;
+	int8_t channel;
+
+	if (len < (ssize_t)KNET_HEADER_ACK_SIZE) {
+		return;
+	}
+
+	channel = inbuf->khp_ack_channel;
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX)) {
+		return;
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+		return;
+	}
+
+	rel = host->reliable[channel];
+	if (rel) {
+		_reliable_tx_ack(knet_h, host, rel, ntohl(inbuf->khp_ack_ack), ntohl(inbuf->khp_ack_sack));
+	}
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
+
+static int _reliable_send_ack(knet_handle_t knet_h, struct knet_host *host, int8_t channel, struct knet_reliable *rel)
+{
+	struct knet_link *link;
+	unsigned char *outbuf = (unsigned char *)knet_h->ackbuf;
+	ssize_t len, outlen = KNET_HEADER_ACK_SIZE;
+	uint32_t ack, sack;
+
+	link = _host_get_ctrl_link(host);
+	if (!link) {
+		return -1;
+	}
+
+	_reliable_rx_ack(rel, &ack, &sack);
+
+	knet_h->ackbuf->khp_ack_link = link->link_id;
+	knet_h->ackbuf->khp_ack_channel = channel;
+	knet_h->ackbuf->khp_ack_ack = htonl(ack);
+	knet_h->ackbuf->khp_ack_sack = htonl(sack);
+
+	if (knet_h->crypto_instance) {
+		if (crypto_encrypt_and_sign(knet_h,
+					    (const unsigned char *)knet_h->ackbuf,
+					    outlen,
+					    knet_h->ackbuf_crypt,
+					    &outlen) < 0) {
+			log_debug(knet_h, KNET_SUB_RX, "Unable to crypto ack packet");
+			return -1;
+		}
+		outbuf = knet_h->ackbuf_crypt;
+	}
+
+	len = transport_link_sendto_ctrl(knet_h, link, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (len != outlen) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to send ack packet to host %u: %s",
+			  host->host_id, strerror(errno));
+		return -1;
+	}
+
+	rel->rx_ack_pending = 0;
+
+	return 0;
+}
+
+void _reliable_send_acks(knet_handle_t knet_h)
+{
+	struct knet_host *host;
+	struct knet_reliable *rel;
+	int8_t channel;
+
+	if (!knet_h->reliable_ack_pending) {
+		return;
+	}
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+		return;
+	}
+
+	knet_h->reliable_ack_pending = 0;
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		if (host->host_id == knet_h->host_id) {
+			continue;
+		}
+		for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+			rel = host->reliable[channel];
+			if ((!rel) || (!rel->rx_ack_pending)) {
+				continue;
+			}
+			if (_reliable_send_ack(knet_h, host, channel, rel) < 0) {
+				knet_h->reliable_ack_pending = 1;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
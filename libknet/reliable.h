@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#ifndef __KNET_RELIABLE_H__
+#define __KNET_RELIABLE_H__
+
+#include "internals.h"
+#include "onwire.h"
+
+#define KNET_RELIABLE_WINDOW	256			/* packets in flight per node and channel */
+#define KNET_RELIABLE_SACK_BITS	32			/* sizeof(krh_sack) * 8 */
+#define KNET_RELIABLE_DUPTHRESH	3			/* later packets acked before a fast retransmit */
+#define KNET_RELIABLE_RTO_MIN	10000000llu		/* nsecs */
+#define KNET_RELIABLE_RTO_MAX	1000000000llu		/* nsecs */
+#define KNET_RELIABLE_RETRIES	10			/* retransmits before giving up on a packet */
+#define KNET_RELIABLE_TIMER	1			/* msecs between retransmit timers checks */
+
+/*
+ * a packet sent to a node and not acked yet, as it went on the wire
+ * (fragmented and encrypted). frag_len and the data follow the struct.
+ */
+
+struct knet_reliable_pckt {
+	struct timespec sent;
+	uint8_t retries;
+	uint8_t sacked;
+	uint8_t frags;
+	uint16_t *frag_len;
+	unsigned char *data;
+};
+
+struct knet_reliable {
+	struct knet_host *host;
+	int8_t channel;
+	/* data sent to the node */
+	uint32_t tx_next;		/* next sequence number */
+	uint32_t tx_una;		/* oldest packet not acked */
+	struct knet_reliable_pckt *tx_pckt[KNET_RELIABLE_WINDOW];
+	/* data received from the node */
+	int rx_synced;
+	uint32_t rx_epoch;
+	uint32_t rx_next;		/* next packet to deliver */
+	uint32_t rx_una;		/* the node gave up on the packets before it */
+	int rx_ack_pending;
+	unsigned char *rx_pckt[KNET_RELIABLE_WINDOW];	/* received out of order */
+	size_t rx_len[KNET_RELIABLE_WINDOW];
+	int8_t rx_channel[KNET_RELIABLE_WINDOW];	/* local channel after filtering */
+	uint8_t rx_large[KNET_RELIABLE_WINDOW];		/* fragment of a large message, see large.c */
+};
+
+void _reliable_free(struct knet_host *host);
+
+/*
+ * TX, all need tx_mutex
+ */
+int _reliable_tx_prepare(knet_handle_t knet_h, struct knet_host *host, int8_t channel, struct knet_header_reliable *hdr);
+int _reliable_tx_store(knet_handle_t knet_h, struct knet_host *host, int8_t channel, struct knet_mmsghdr *msg, int msgs);
+int _reliable_tx_blocked(knet_handle_t knet_h, struct knet_host *host, int8_t channel);
+int _reliable_channel_blocked(knet_handle_t knet_h, int8_t channel);
+int _reliable_tx_timers(knet_handle_t knet_h);
+
+/*
+ * RX
+ */
+int _reliable_rx_parse(knet_handle_t knet_h, struct knet_host *host, struct knet_header *inbuf, ssize_t *len,
+		       struct knet_header_reliable *hdr);
+ssize_t _reliable_rx_deliver(knet_handle_t knet_h, struct knet_host *host, int8_t wire_channel,
+			     struct knet_header_reliable *hdr, int8_t channel, struct iovec *iov, int large);
+void _reliable_rx_drop(knet_handle_t knet_h, struct knet_host *host, int8_t wire_channel,
+		       struct knet_header_reliable *hdr);
+void _reliable_parse_ack(knet_handle_t knet_h, struct knet_host *host, struct knet_header *inbuf, ssize_t len);
+void _reliable_send_acks(knet_handle_t knet_h);
+
+#endif
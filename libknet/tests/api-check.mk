@@ -18,6 +18,22 @@ api_checks		= \
 			  api_knet_handle_remove_datafd_test \
 			  api_knet_handle_get_channel_test \
 			  api_knet_handle_get_datafd_test \
+			  api_knet_handle_set_channel_bulk_test \
+			  api_knet_handle_get_channel_bulk_test \
+			  api_knet_handle_set_channel_reliable_test \
+			  api_knet_handle_get_channel_reliable_test \
+			  api_knet_handle_set_channel_unordered_test \
+			  api_knet_handle_get_channel_unordered_test \
+			  api_knet_handle_set_channel_large_test \
+			  api_knet_handle_get_channel_large_test \
+			  api_knet_handle_set_flow_control_test \
+			  api_knet_handle_get_flow_control_test \
+			  api_knet_handle_set_relay_test \
+			  api_knet_handle_get_relay_test \
+			  api_knet_handle_set_bcast_tree_test \
+			  api_knet_handle_get_bcast_tree_test \
+			  api_knet_handle_set_mcast_test \
+			  api_knet_handle_get_mcast_test \
 			  api_knet_handle_get_stats_test \
 			  api_knet_get_crypto_list_test \
 			  api_knet_get_compress_list_test \
@@ -27,10 +43,20 @@ api_checks		= \
 			  api_knet_get_transport_id_by_name_test \
 			  api_knet_handle_set_transport_reconnect_interval_test \
 			  api_knet_handle_get_transport_reconnect_interval_test \
+			  api_knet_handle_set_sockbuf_limits_test \
+			  api_knet_handle_get_sockbuf_limits_test \
+			  api_knet_handle_set_busy_poll_test \
+			  api_knet_handle_get_busy_poll_test \
 			  api_knet_recv_test \
 			  api_knet_send_test \
 			  api_knet_send_crypto_test \
 			  api_knet_send_compress_test \
+			  api_knet_send_large_test \
+			  api_knet_send_reliable_test \
+			  api_knet_send_fec_test \
+			  api_knet_send_sctp_test \
+			  api_knet_send_shm_test \
+			  api_knet_send_uring_test \
 			  api_knet_send_sync_test \
 			  api_knet_send_loopback_test \
 			  api_knet_handle_pmtud_setfreq_test \
@@ -46,6 +72,7 @@ api_checks		= \
 			  api_knet_host_set_policy_test \
 			  api_knet_host_get_policy_test \
 			  api_knet_host_get_status_test \
+			  api_knet_host_pmtud_get_test \
 			  api_knet_host_enable_status_change_notify_test \
 			  api_knet_log_get_subsystem_name_test \
 			  api_knet_log_get_subsystem_id_test \
@@ -68,6 +95,16 @@ api_checks		= \
 			  api_knet_link_get_enable_test \
 			  api_knet_link_get_link_list_test \
 			  api_knet_link_get_status_test \
+			  api_knet_link_get_cache_test \
+			  api_knet_link_set_cache_test \
+			  api_knet_link_get_latency_histogram_test \
+			  api_knet_link_clear_latency_histogram_test \
+			  api_knet_link_set_bandwidth_probe_test \
+			  api_knet_link_get_bandwidth_probe_test \
+			  api_knet_link_set_congestion_control_test \
+			  api_knet_link_get_congestion_control_test \
+			  api_knet_link_set_fec_test \
+			  api_knet_link_get_fec_test \
 			  api_knet_link_enable_status_change_notify_test \
 			  api_knet_handle_set_threads_timer_res_test \
 			  api_knet_handle_get_threads_timer_res_test
@@ -108,6 +145,54 @@ api_knet_handle_get_channel_test_SOURCES = api_knet_handle_get_channel.c \
 api_knet_handle_get_datafd_test_SOURCES = api_knet_handle_get_datafd.c \
 					  test-common.c
 
+api_knet_handle_set_channel_bulk_test_SOURCES = api_knet_handle_set_channel_bulk.c \
+						 test-common.c
+
+api_knet_handle_get_channel_bulk_test_SOURCES = api_knet_handle_get_channel_bulk.c \
+						 test-common.c
+
+api_knet_handle_set_channel_reliable_test_SOURCES = api_knet_handle_set_channel_reliable.c \
+						     test-common.c
+
+api_knet_handle_get_channel_reliable_test_SOURCES = api_knet_handle_get_channel_reliable.c \
+						     test-common.c
+
+api_knet_handle_set_channel_unordered_test_SOURCES = api_knet_handle_set_channel_unordered.c \
+						      test-common.c
+
+api_knet_handle_get_channel_unordered_test_SOURCES = api_knet_handle_get_channel_unordered.c \
+						      test-common.c
+
+api_knet_handle_set_channel_large_test_SOURCES = api_knet_handle_set_channel_large.c \
+						  test-common.c
+
+api_knet_handle_get_channel_large_test_SOURCES = api_knet_handle_get_channel_large.c \
+						  test-common.c
+
+api_knet_handle_set_flow_control_test_SOURCES = api_knet_handle_set_flow_control.c \
+						 test-common.c
+
+api_knet_handle_get_flow_control_test_SOURCES = api_knet_handle_get_flow_control.c \
+						 test-common.c
+
+api_knet_handle_set_relay_test_SOURCES = api_knet_handle_set_relay.c \
+					 test-common.c
+
+api_knet_handle_get_relay_test_SOURCES = api_knet_handle_get_relay.c \
+					 test-common.c
+
+api_knet_handle_set_bcast_tree_test_SOURCES = api_knet_handle_set_bcast_tree.c \
+					      test-common.c
+
+api_knet_handle_get_bcast_tree_test_SOURCES = api_knet_handle_get_bcast_tree.c \
+					      test-common.c
+
+api_knet_handle_set_mcast_test_SOURCES = api_knet_handle_set_mcast.c \
+					 test-common.c
+
+api_knet_handle_get_mcast_test_SOURCES = api_knet_handle_get_mcast.c \
+					 test-common.c
+
 api_knet_handle_get_stats_test_SOURCES = api_knet_handle_get_stats.c \
 					 test-common.c
 
@@ -135,6 +220,18 @@ api_knet_handle_set_transport_reconnect_interval_test_SOURCES = api_knet_handle_
 api_knet_handle_get_transport_reconnect_interval_test_SOURCES = api_knet_handle_get_transport_reconnect_interval.c \
 								test-common.c
 
+api_knet_handle_set_sockbuf_limits_test_SOURCES = api_knet_handle_set_sockbuf_limits.c \
+						  test-common.c
+
+api_knet_handle_get_sockbuf_limits_test_SOURCES = api_knet_handle_get_sockbuf_limits.c \
+						  test-common.c
+
+api_knet_handle_set_busy_poll_test_SOURCES = api_knet_handle_set_busy_poll.c \
+					     test-common.c
+
+api_knet_handle_get_busy_poll_test_SOURCES = api_knet_handle_get_busy_poll.c \
+					     test-common.c
+
 api_knet_recv_test_SOURCES = api_knet_recv.c \
 			     test-common.c
 
@@ -144,6 +241,24 @@ api_knet_send_test_SOURCES = api_knet_send.c \
 api_knet_send_compress_test_SOURCES = api_knet_send_compress.c \
 				      test-common.c
 
+api_knet_send_large_test_SOURCES = api_knet_send_large.c \
+				   test-common.c
+
+api_knet_send_reliable_test_SOURCES = api_knet_send_reliable.c \
+				      test-common.c
+
+api_knet_send_fec_test_SOURCES = api_knet_send_fec.c \
+				 test-common.c
+
+api_knet_send_sctp_test_SOURCES = api_knet_send_sctp.c \
+				  test-common.c
+
+api_knet_send_shm_test_SOURCES = api_knet_send_shm.c \
+				 test-common.c
+
+api_knet_send_uring_test_SOURCES = api_knet_send_uring.c \
+				   test-common.c
+
 api_knet_send_crypto_test_SOURCES = api_knet_send_crypto.c \
 				    test-common.c
 
@@ -192,6 +307,9 @@ api_knet_host_get_policy_test_SOURCES = api_knet_host_get_policy.c \
 api_knet_host_get_status_test_SOURCES = api_knet_host_get_status.c \
 					test-common.c
 
+api_knet_host_pmtud_get_test_SOURCES = api_knet_host_pmtud_get.c \
+				       test-common.c
+
 api_knet_host_enable_status_change_notify_test_SOURCES = api_knet_host_enable_status_change_notify.c \
 							 test-common.c
 
@@ -256,6 +374,36 @@ api_knet_link_get_link_list_test_SOURCES = api_knet_link_get_link_list.c \
 api_knet_link_get_status_test_SOURCES = api_knet_link_get_status.c \
 					test-common.c
 
+api_knet_link_get_cache_test_SOURCES = api_knet_link_get_cache.c \
+				       test-common.c
+
+api_knet_link_set_cache_test_SOURCES = api_knet_link_set_cache.c \
+				       test-common.c
+
+api_knet_link_get_latency_histogram_test_SOURCES = api_knet_link_get_latency_histogram.c \
+						   test-common.c
+
+api_knet_link_clear_latency_histogram_test_SOURCES = api_knet_link_clear_latency_histogram.c \
+						     test-common.c
+
+api_knet_link_set_bandwidth_probe_test_SOURCES = api_knet_link_set_bandwidth_probe.c \
+						 test-common.c
+
+api_knet_link_get_bandwidth_probe_test_SOURCES = api_knet_link_get_bandwidth_probe.c \
+						 test-common.c
+
+api_knet_link_set_congestion_control_test_SOURCES = api_knet_link_set_congestion_control.c \
+						    test-common.c
+
+api_knet_link_get_congestion_control_test_SOURCES = api_knet_link_get_congestion_control.c \
+						    test-common.c
+
+api_knet_link_set_fec_test_SOURCES = api_knet_link_set_fec.c \
+						    test-common.c
+
+api_knet_link_get_fec_test_SOURCES = api_knet_link_get_fec.c \
+						    test-common.c
+
 api_knet_link_enable_status_change_notify_test_SOURCES = api_knet_link_enable_status_change_notify.c \
 							 test-common.c
 
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	uint32_t usecs = 1;
+
+	printf("Test knet_handle_get_busy_poll with incorrect knet_h\n");
+
+	if ((!knet_handle_get_busy_poll(NULL, &usecs)) || (errno != EINVAL)) {
+		printf("knet_handle_get_busy_poll accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_handle_get_busy_poll with incorrect usecs\n");
+
+	if ((!knet_handle_get_busy_poll(knet_h, NULL)) || (errno != EINVAL)) {
+		printf("knet_handle_get_busy_poll accepted invalid usecs or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_get_busy_poll with correct values\n");
+
+	if (knet_handle_get_busy_poll(knet_h, &usecs) < 0) {
+		printf("knet_handle_get_busy_poll failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (usecs) {
+		printf("knet_handle_get_busy_poll returned busy polling enabled on a new handle\n");
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_busy_poll(knet_h, 50) < 0) {
+		printf("knet_handle_set_busy_poll failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((knet_handle_get_busy_poll(knet_h, &usecs) < 0) ||
+	    (usecs != 50)) {
+		printf("knet_handle_get_busy_poll failed to get correct values\n");
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
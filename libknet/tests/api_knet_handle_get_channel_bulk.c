@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libknet.h"
+
+#include "test-common.h"
+
+int main(int argc, char *argv[])
+{
+	test_channel_flag_get("knet_handle_get_channel_bulk",
+			      knet_handle_set_channel_bulk, knet_handle_get_channel_bulk);
+
+	return PASS;
+}
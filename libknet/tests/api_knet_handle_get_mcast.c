@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	struct sockaddr_storage src, mcast, get_src, get_mcast;
+	uint8_t enabled;
+
+	memset(&src, 0, sizeof(struct sockaddr_storage));
+	memset(&mcast, 0, sizeof(struct sockaddr_storage));
+
+	if (make_local_sockaddr(&src, 0) < 0) {
+		printf("Unable to convert src to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (knet_strtoaddr("239.192.0.1", "50000", &mcast, sizeof(struct sockaddr_storage)) < 0) {
+		printf("Unable to convert mcast to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_get_mcast incorrect knet_h\n");
+
+	if ((!knet_handle_get_mcast(NULL, 0, &get_src, &get_mcast, &enabled)) || (errno != EINVAL)) {
+		printf("knet_handle_get_mcast accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_handle_get_mcast with incorrect link_id\n");
+
+	if ((!knet_handle_get_mcast(knet_h, KNET_MAX_LINK, &get_src, &get_mcast, &enabled)) || (errno != EINVAL)) {
+		printf("knet_handle_get_mcast accepted invalid link_id or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_get_mcast with no enabled\n");
+
+	if ((!knet_handle_get_mcast(knet_h, 0, &get_src, &get_mcast, NULL)) || (errno != EINVAL)) {
+		printf("knet_handle_get_mcast accepted invalid enabled or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_get_mcast with no group\n");
+
+	if ((knet_handle_get_mcast(knet_h, 0, &get_src, &get_mcast, &enabled) < 0) || (enabled)) {
+		printf("knet_handle_get_mcast failed or returned a group: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (knet_handle_set_mcast(knet_h, 0, &src, &mcast) < 0) {
+		printf("knet_handle_set_mcast failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_get_mcast with group\n");
+
+	if ((knet_handle_get_mcast(knet_h, 0, &get_src, &get_mcast, &enabled) < 0) || (!enabled) ||
+	    (memcmp(&get_src, &src, sizeof(struct sockaddr_storage))) ||
+	    (memcmp(&get_mcast, &mcast, sizeof(struct sockaddr_storage)))) {
+		printf("knet_handle_get_mcast failed or returned incorrect group: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	uint32_t min_size = 1, max_size = 1;
+
+	printf("Test knet_handle_get_sockbuf_limits with incorrect knet_h\n");
+
+	if ((!knet_handle_get_sockbuf_limits(NULL, &min_size, &max_size)) || (errno != EINVAL)) {
+		printf("knet_handle_get_sockbuf_limits accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_handle_get_sockbuf_limits with incorrect min_size\n");
+
+	if ((!knet_handle_get_sockbuf_limits(knet_h, NULL, &max_size)) || (errno != EINVAL)) {
+		printf("knet_handle_get_sockbuf_limits accepted invalid min_size or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_get_sockbuf_limits with incorrect max_size\n");
+
+	if ((!knet_handle_get_sockbuf_limits(knet_h, &min_size, NULL)) || (errno != EINVAL)) {
+		printf("knet_handle_get_sockbuf_limits accepted invalid max_size or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_get_sockbuf_limits with correct values\n");
+
+	if (knet_handle_get_sockbuf_limits(knet_h, &min_size, &max_size) < 0) {
+		printf("knet_handle_get_sockbuf_limits failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if ((min_size) || (max_size)) {
+		printf("knet_handle_get_sockbuf_limits returned limits on a new handle\n");
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_sockbuf_limits(knet_h, 65536, 1048576) < 0) {
+		printf("knet_handle_set_sockbuf_limits failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((knet_handle_get_sockbuf_limits(knet_h, &min_size, &max_size) < 0) ||
+	    (min_size != 65536) || (max_size != 1048576)) {
+		printf("knet_handle_get_sockbuf_limits failed to get correct values\n");
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -119,6 +119,47 @@ static void test(void)
 
 	knet_handle_free(knet_h);
 	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_new hostid 1, unknown flags\n");
+
+	knet_h = knet_handle_new(1, logfds[1], KNET_LOG_DEBUG, KNET_HANDLE_FLAG_IO_URING << 1);
+
+	if ((knet_h) || (errno != EINVAL)) {
+		printf("knet_handle_new accepted unknown flags or returned incorrect errno: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_new hostid 1, io_uring\n");
+
+	knet_h = knet_handle_new(1, logfds[1], KNET_LOG_DEBUG, KNET_HANDLE_FLAG_IO_URING);
+
+#ifdef HAVE_IO_URING
+	if ((!knet_h) && (errno != ENOSYS) && (errno != EPERM)) {
+		printf("knet_handle_new failed to setup io_uring: %s\n", strerror(errno));
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+	if (!knet_h) {
+		printf("io_uring not available on this kernel: %s\n", strerror(errno));
+	}
+#else
+	if ((knet_h) || (errno != EOPNOTSUPP)) {
+		printf("knet_handle_new accepted io_uring without support or returned incorrect errno: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+#endif
+
+	if (knet_h) {
+		knet_handle_free(knet_h);
+	}
+	flush_logs(logfds[0], stdout);
 	close_logpipes(logfds);
 }
 
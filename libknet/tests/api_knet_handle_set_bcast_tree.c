@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+
+	printf("Test knet_handle_set_bcast_tree incorrect knet_h\n");
+
+	if ((!knet_handle_set_bcast_tree(NULL, 4)) || (errno != EINVAL)) {
+		printf("knet_handle_set_bcast_tree accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_handle_set_bcast_tree with fanout too small\n");
+
+	if ((!knet_handle_set_bcast_tree(knet_h, 1)) || (errno != EINVAL)) {
+		printf("knet_handle_set_bcast_tree accepted invalid fanout or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_bcast_tree with fanout too big\n");
+
+	if ((!knet_handle_set_bcast_tree(knet_h, 17)) || (errno != EINVAL)) {
+		printf("knet_handle_set_bcast_tree accepted invalid fanout or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_bcast_tree fanout 4\n");
+
+	if (knet_handle_set_bcast_tree(knet_h, 4) < 0) {
+		printf("knet_handle_set_bcast_tree failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((knet_h->bcast_tree != 4) || (!knet_h->treebuf_crypt[0])) {
+		printf("knet_handle_set_bcast_tree failed to set correct value\n");
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_bcast_tree disabled\n");
+
+	if (knet_handle_set_bcast_tree(knet_h, 0) < 0) {
+		printf("knet_handle_set_bcast_tree failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_h->bcast_tree != 0) {
+		printf("knet_handle_set_bcast_tree failed to set correct value\n");
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
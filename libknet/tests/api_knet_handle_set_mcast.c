@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	struct sockaddr_storage src, mcast, bad;
+
+	memset(&src, 0, sizeof(struct sockaddr_storage));
+	memset(&mcast, 0, sizeof(struct sockaddr_storage));
+	memset(&bad, 0, sizeof(struct sockaddr_storage));
+
+	if (make_local_sockaddr(&src, 0) < 0) {
+		printf("Unable to convert src to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (knet_strtoaddr("239.192.0.1", "50000", &mcast, sizeof(struct sockaddr_storage)) < 0) {
+		printf("Unable to convert mcast to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_set_mcast incorrect knet_h\n");
+
+	if ((!knet_handle_set_mcast(NULL, 0, &src, &mcast)) || (errno != EINVAL)) {
+		printf("knet_handle_set_mcast accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_handle_set_mcast with incorrect link_id\n");
+
+	if ((!knet_handle_set_mcast(knet_h, KNET_MAX_LINK, &src, &mcast)) || (errno != EINVAL)) {
+		printf("knet_handle_set_mcast accepted invalid link_id or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_mcast with no src_addr\n");
+
+	if ((!knet_handle_set_mcast(knet_h, 0, NULL, &mcast)) || (errno != EINVAL)) {
+		printf("knet_handle_set_mcast accepted invalid src_addr or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (knet_strtoaddr("192.168.0.1", "50000", &bad, sizeof(struct sockaddr_storage)) < 0) {
+		printf("Unable to convert bad to sockaddr: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_set_mcast with unicast group\n");
+
+	if ((!knet_handle_set_mcast(knet_h, 0, &src, &bad)) || (errno != EINVAL)) {
+		printf("knet_handle_set_mcast accepted unicast group or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (knet_strtoaddr("ff15::1", "50000", &bad, sizeof(struct sockaddr_storage)) < 0) {
+		printf("Unable to convert bad to sockaddr: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_set_mcast with mismatched address families\n");
+
+	if ((!knet_handle_set_mcast(knet_h, 0, &src, &bad)) || (errno != EINVAL)) {
+		printf("knet_handle_set_mcast accepted mismatched families or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_mcast with correct values\n");
+
+	if (knet_handle_set_mcast(knet_h, 0, &src, &mcast) < 0) {
+		printf("knet_handle_set_mcast failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_mcast with correct values again\n");
+
+	if (knet_handle_set_mcast(knet_h, 0, &src, &mcast) < 0) {
+		printf("knet_handle_set_mcast failed to replace the group: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_mcast leave group\n");
+
+	if (knet_handle_set_mcast(knet_h, 0, NULL, NULL) < 0) {
+		printf("knet_handle_set_mcast failed to leave the group: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "netutils.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	struct sockaddr_storage src, dst;
+	struct knet_link_status status;
+	int i;
+
+	if (make_local_sockaddr(&src, 0) < 0) {
+		printf("Unable to convert src to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (make_local_sockaddr(&dst, 1) < 0) {
+		printf("Unable to convert dst to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_set_sockbuf_limits with incorrect knet_h\n");
+
+	if ((!knet_handle_set_sockbuf_limits(NULL, 65536, 1048576)) || (errno != EINVAL)) {
+		printf("knet_handle_set_sockbuf_limits accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_handle_set_sockbuf_limits with min_size too small\n");
+
+	if ((!knet_handle_set_sockbuf_limits(knet_h, KNET_SOCKBUF_MIN_SIZE - 1, 1048576)) || (errno != EINVAL)) {
+		printf("knet_handle_set_sockbuf_limits accepted invalid min_size or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_sockbuf_limits with max_size too big\n");
+
+	if ((!knet_handle_set_sockbuf_limits(knet_h, 65536, KNET_SOCKBUF_MAX_SIZE + 1)) || (errno != EINVAL)) {
+		printf("knet_handle_set_sockbuf_limits accepted invalid max_size or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_sockbuf_limits with min_size above max_size\n");
+
+	if ((!knet_handle_set_sockbuf_limits(knet_h, 1048576, 65536)) || (errno != EINVAL)) {
+		printf("knet_handle_set_sockbuf_limits accepted min_size above max_size or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_sockbuf_limits with only max_size\n");
+
+	if ((!knet_handle_set_sockbuf_limits(knet_h, 0, 1048576)) || (errno != EINVAL)) {
+		printf("knet_handle_set_sockbuf_limits accepted no min_size or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_handle_set_sockbuf_limits with correct values\n");
+
+	if (knet_handle_set_sockbuf_limits(knet_h, 65536, 131072) < 0) {
+		printf("knet_handle_set_sockbuf_limits failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if ((knet_h->sockbuf_min != 65536) || (knet_h->sockbuf_max != 131072)) {
+		printf("knet_handle_set_sockbuf_limits failed to set correct values\n");
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_set_sockbuf_limits resizes link sockets\n");
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("Unable to add host_id 1: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &src, &dst, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_enable(knet_h, 1, 0, 1) < 0) {
+		printf("Unable to enable link: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * sockets are created with KNET_RING_RCVBUFF and checked
+	 * approx once a second
+	 */
+	for (i = 0; i < 10; i++) {
+		sleep(1);
+		memset(&status, 0, sizeof(struct knet_link_status));
+		if (knet_link_get_status(knet_h, 1, 0, &status, sizeof(struct knet_link_status)) < 0) {
+			printf("knet_link_get_status failed: %s\n", strerror(errno));
+			knet_link_set_enable(knet_h, 1, 0, 0);
+			knet_link_clear_config(knet_h, 1, 0);
+			knet_host_remove(knet_h, 1);
+			knet_handle_free(knet_h);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+		flush_logs(logfds[0], stdout);
+		if ((status.stats.sock_rcvbuf) && (status.stats.sock_rcvbuf <= 131072) &&
+		    (status.stats.sock_sndbuf) && (status.stats.sock_sndbuf <= 131072)) {
+			break;
+		}
+	}
+
+	if (i == 10) {
+		printf("Socket buffers not resized: rcvbuf %u sndbuf %u\n",
+		       status.stats.sock_rcvbuf, status.stats.sock_sndbuf);
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_handle_set_sockbuf_limits disable\n");
+
+	if ((knet_handle_set_sockbuf_limits(knet_h, 0, 0) < 0) ||
+	    (knet_h->sockbuf_min) || (knet_h->sockbuf_max)) {
+		printf("knet_handle_set_sockbuf_limits failed to disable resizing: %s\n", strerror(errno));
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_link_set_enable(knet_h, 1, 0, 0);
+	knet_link_clear_config(knet_h, 1, 0);
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "host.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	unsigned int data_mtu;
+
+	printf("Test knet_host_pmtud_get incorrect knet_h\n");
+
+	if ((!knet_host_pmtud_get(NULL, 1, &data_mtu)) || (errno != EINVAL)) {
+		printf("knet_host_pmtud_get accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_host_pmtud_get with unconfigured host_id\n");
+
+	if ((!knet_host_pmtud_get(knet_h, 1, &data_mtu)) || (errno != EINVAL)) {
+		printf("knet_host_pmtud_get accepted invalid host_id or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_host_pmtud_get with no data_mtu\n");
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("knet_host_add failed error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((!knet_host_pmtud_get(knet_h, 1, NULL)) || (errno != EINVAL)) {
+		printf("knet_host_pmtud_get accepted invalid data_mtu or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_host_pmtud_get with host without links\n");
+
+	if (knet_host_pmtud_get(knet_h, 1, &data_mtu) < 0) {
+		printf("knet_host_pmtud_get failed: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (data_mtu != knet_h->data_mtu) {
+		printf("knet_host_pmtud_get did not return the handle data MTU\n");
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_host_pmtud_get with host data MTU\n");
+
+	knet_h->host_index[1]->data_mtu = 8000;
+
+	if (knet_host_pmtud_get(knet_h, 1, &data_mtu) < 0) {
+		printf("knet_host_pmtud_get failed: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (data_mtu != 8000) {
+		printf("knet_host_pmtud_get returned incorrect data MTU: %u\n", data_mtu);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
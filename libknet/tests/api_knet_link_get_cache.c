@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "link.h"
+#include "netutils.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	struct sockaddr_storage src, dst;
+	struct knet_link_cache cache;
+
+	if (make_local_sockaddr(&src, 0) < 0) {
+		printf("Unable to convert src to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (make_local_sockaddr(&dst, 1) < 0) {
+		printf("Unable to convert dst to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	memset(&cache, 0, sizeof(struct knet_link_cache));
+
+	printf("Test knet_link_get_cache incorrect knet_h\n");
+
+	if ((!knet_link_get_cache(NULL, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_get_cache accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_link_get_cache with unconfigured host_id\n");
+
+	if ((!knet_link_get_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_get_cache accepted invalid host_id or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_cache with incorrect linkid\n");
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("Unable to add host_id 1: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((!knet_link_get_cache(knet_h, 1, KNET_MAX_LINK, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_get_cache accepted invalid linkid or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_cache with incorrect cache\n");
+
+	if ((!knet_link_get_cache(knet_h, 1, 0, NULL, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_get_cache accepted invalid cache or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_cache with unconfigured link\n");
+
+	if ((!knet_link_get_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_get_cache accepted unconfigured link or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &src, &dst, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_link_get_cache before PMTUd\n");
+
+	if (knet_link_get_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache)) < 0) {
+		printf("knet_link_get_cache failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((cache.size != sizeof(struct knet_link_cache)) || (cache.path_mtu) || (cache.latency)) {
+		printf("knet_link_get_cache returned incorrect values: size %zu path_mtu %u latency %llu\n", cache.size, cache.path_mtu, cache.latency);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_cache with restored values\n");
+
+	cache.path_mtu = 1500;
+	cache.latency = 1000;
+
+	if (knet_link_set_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache)) < 0) {
+		printf("knet_link_set_cache failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	memset(&cache, 0, sizeof(struct knet_link_cache));
+
+	if (knet_link_get_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache)) < 0) {
+		printf("knet_link_get_cache failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * latency is only reported once it has been measured
+	 */
+	if ((cache.path_mtu != 1500) || (cache.latency)) {
+		printf("knet_link_get_cache returned incorrect values: path_mtu %u latency %llu\n", cache.path_mtu, cache.latency);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_link_clear_config(knet_h, 1, 0);
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "link.h"
+#include "netutils.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	struct sockaddr_storage src, dst;
+	struct knet_link_latency_histogram histogram;
+
+	if (make_local_sockaddr(&src, 0) < 0) {
+		printf("Unable to convert src to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (make_local_sockaddr(&dst, 1) < 0) {
+		printf("Unable to convert dst to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	memset(&histogram, 0, sizeof(struct knet_link_latency_histogram));
+
+	printf("Test knet_link_get_latency_histogram incorrect knet_h\n");
+
+	if ((!knet_link_get_latency_histogram(NULL, 1, 0, &histogram, sizeof(struct knet_link_latency_histogram))) || (errno != EINVAL)) {
+		printf("knet_link_get_latency_histogram accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_link_get_latency_histogram with unconfigured host_id\n");
+
+	if ((!knet_link_get_latency_histogram(knet_h, 1, 0, &histogram, sizeof(struct knet_link_latency_histogram))) || (errno != EINVAL)) {
+		printf("knet_link_get_latency_histogram accepted invalid host_id or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_latency_histogram with incorrect linkid\n");
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("Unable to add host_id 1: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((!knet_link_get_latency_histogram(knet_h, 1, KNET_MAX_LINK, &histogram, sizeof(struct knet_link_latency_histogram))) || (errno != EINVAL)) {
+		printf("knet_link_get_latency_histogram accepted invalid linkid or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_latency_histogram with incorrect histogram\n");
+
+	if ((!knet_link_get_latency_histogram(knet_h, 1, 0, NULL, sizeof(struct knet_link_latency_histogram))) || (errno != EINVAL)) {
+		printf("knet_link_get_latency_histogram accepted invalid histogram or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_latency_histogram with unconfigured link\n");
+
+	if ((!knet_link_get_latency_histogram(knet_h, 1, 0, &histogram, sizeof(struct knet_link_latency_histogram))) || (errno != EINVAL)) {
+		printf("knet_link_get_latency_histogram accepted unconfigured link or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &src, &dst, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_link_get_latency_histogram with no samples\n");
+
+	if (knet_link_get_latency_histogram(knet_h, 1, 0, &histogram, sizeof(struct knet_link_latency_histogram)) < 0) {
+		printf("knet_link_get_latency_histogram failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((histogram.size != sizeof(struct knet_link_latency_histogram)) || (histogram.samples) || (histogram.p50) || (histogram.max)) {
+		printf("knet_link_get_latency_histogram returned incorrect values: size %zu samples %" PRIu64 " p50 %u max %u\n",
+		       histogram.size, histogram.samples, histogram.p50, histogram.max);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_get_latency_histogram percentiles\n");
+
+	/*
+	 * 99 samples of 100 usecs (bucket 36: 96-103 usecs)
+	 * and 1 sample of 1000 usecs (bucket 63: 960-1023 usecs)
+	 */
+	knet_h->host_index[1]->link[0].latency_histogram[36] = 99;
+	knet_h->host_index[1]->link[0].latency_histogram[63] = 1;
+
+	if (knet_link_get_latency_histogram(knet_h, 1, 0, &histogram, sizeof(struct knet_link_latency_histogram)) < 0) {
+		printf("knet_link_get_latency_histogram failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((histogram.samples != 100) ||
+	    (histogram.buckets[36] != 99) || (histogram.buckets[63] != 1) ||
+	    (histogram.p50 != 103) || (histogram.p90 != 103) || (histogram.p99 != 103) ||
+	    (histogram.p999 != 1023) || (histogram.max != 1023)) {
+		printf("knet_link_get_latency_histogram returned incorrect values: samples %" PRIu64 " p50 %u p90 %u p99 %u p999 %u max %u\n",
+		       histogram.samples, histogram.p50, histogram.p90, histogram.p99, histogram.p999, histogram.max);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_link_clear_config(knet_h, 1, 0);
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "link.h"
+#include "netutils.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	struct sockaddr_storage src, dst;
+	struct knet_link_cache cache;
+
+	if (make_local_sockaddr(&src, 0) < 0) {
+		printf("Unable to convert src to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (make_local_sockaddr(&dst, 1) < 0) {
+		printf("Unable to convert dst to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	memset(&cache, 0, sizeof(struct knet_link_cache));
+
+	printf("Test knet_link_set_cache incorrect knet_h\n");
+
+	if ((!knet_link_set_cache(NULL, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_set_cache accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	printf("Test knet_link_set_cache with unconfigured host_id\n");
+
+	if ((!knet_link_set_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_set_cache accepted invalid host_id or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_set_cache with incorrect linkid\n");
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("Unable to add host_id 1: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((!knet_link_set_cache(knet_h, 1, KNET_MAX_LINK, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_set_cache accepted invalid linkid or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_set_cache with incorrect cache\n");
+
+	if ((!knet_link_set_cache(knet_h, 1, 0, NULL, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_set_cache accepted invalid cache or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_set_cache with unconfigured link\n");
+
+	if ((!knet_link_set_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_set_cache accepted unconfigured link or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &src, &dst, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_link_set_cache with MTU out of range\n");
+
+	cache.path_mtu = 100;
+
+	if ((!knet_link_set_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_set_cache accepted invalid path_mtu or returned incorrect error: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	cache.path_mtu = 70000;
+
+	if ((!knet_link_set_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache))) || (errno != EINVAL)) {
+		printf("knet_link_set_cache accepted invalid path_mtu or returned incorrect error: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_set_cache with correct values\n");
+
+	cache.path_mtu = 9000;
+	cache.latency = 1000;
+
+	if (knet_link_set_cache(knet_h, 1, 0, &cache, sizeof(struct knet_link_cache)) < 0) {
+		printf("knet_link_set_cache failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((!knet_h->host_index[1]->link[0].has_valid_mtu) ||
+	    (knet_h->host_index[1]->link[0].status.mtu + knet_h->host_index[1]->link[0].status.proto_overhead != 9000) ||
+	    (knet_h->host_index[1]->link[0].status.latency != 1000)) {
+		printf("knet_link_set_cache did not restore the values: mtu %u overhead %u latency %llu\n",
+		       knet_h->host_index[1]->link[0].status.mtu,
+		       knet_h->host_index[1]->link[0].status.proto_overhead,
+		       knet_h->host_index[1]->link[0].status.latency);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_link_clear_config(knet_h, 1, 0);
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -249,7 +249,131 @@ static void test(void)
 
 	flush_logs(logfds[0], stdout);
 
+	if (knet_link_clear_config(knet_h, 1, 0) < 0) {
+		printf("Unable to clear link config: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_link_set_config with nocrypt flag on UDP\n");
+
+	if ((!knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &src, &dst, KNET_LINK_FLAG_NOCRYPT)) || (errno != EINVAL)) {
+		printf("knet_link_set_config accepted nocrypt on UDP or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_set_config with connected flag on loopback\n");
+
+	if ((!knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_LOOPBACK, &src, &dst, KNET_LINK_FLAG_CONNECTED)) || (errno != EINVAL)) {
+		printf("knet_link_set_config accepted connected flag on loopback or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_set_config UDP with connected flag\n");
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &src, &dst, KNET_LINK_FLAG_CONNECTED) < 0) {
+		printf("Unable to configure connected link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (!knet_h->host_index[1]->link[0].outsock_connected) {
+		printf("knet_link_set_config did not connect the link socket\n");
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_link_clear_config(knet_h, 1, 0);
+
+	printf("Test knet_link_set_config UDP with connected flag and dynamic dst_addr\n");
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &src, NULL, KNET_LINK_FLAG_CONNECTED) < 0) {
+		printf("Unable to configure dynamic link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_h->host_index[1]->link[0].outsock_connected) {
+		printf("knet_link_set_config connected the socket of a dynamic link\n");
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_link_clear_config(knet_h, 1, 0);
+
+#ifdef HAVE_SYS_EVENTFD_H
+	printf("Test knet_link_set_config SHM with dynamic dst_addr\n");
+
+	if ((!knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_SHM, &src, NULL, 0)) || (errno != EINVAL)) {
+		printf("knet_link_set_config accepted dynamic SHM link or returned incorrect error: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_link_set_config SHM with nocrypt flag\n");
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_SHM, &src, &dst, KNET_LINK_FLAG_NOCRYPT) < 0) {
+		printf("Unable to configure SHM link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((knet_h->host_index[1]->link[0].transport_type != KNET_TRANSPORT_SHM) ||
+	    (knet_h->host_index[1]->link[0].transport_connected)) {
+		printf("knet_link_set_config failed to set SHM configuration\n");
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
 	knet_link_clear_config(knet_h, 1, 0);
+#endif
 	knet_host_remove(knet_h, 1);
 	knet_handle_free(knet_h);
 	flush_logs(logfds[0], stdout);
@@ -248,7 +248,7 @@ static void test_sctp(void)
 	printf("Test knet_link_set_enable with incorrect values\n");
 
 	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_SCTP, &src, &dst, 0) < 0) {
-		int exit_status = errno == EPROTONOSUPPORT ? SKIP : FAIL;
+		int exit_status = ((errno == EPROTONOSUPPORT) && (!is_sctp_required())) ? SKIP : FAIL;
 		printf("Unable to configure link: %s\n", strerror(errno));
 		knet_host_remove(knet_h, 1);
 		knet_handle_free(knet_h);
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "onwire.h"
+#include "netutils.h"
+#include "test-common.h"
+
+/*
+ * the link goes through a proxy that loses the first data fragment
+ * of the first fragmented packet, the parity fragment has to bring it back
+ */
+static int private_data;
+static char send_buff[KNET_MAX_PACKET_SIZE];
+static char recv_buff[KNET_MAX_PACKET_SIZE];
+
+static int proxy_sock = -1;
+static int proxy_stop = 0;
+static int proxy_dropped = 0;
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static void *proxy_thread(void *data)
+{
+	struct pollfd pfd;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	struct knet_header *hdr;
+	unsigned char buf[KNET_MAX_PACKET_SIZE + KNET_HEADER_ALL_SIZE];
+	ssize_t len;
+
+	pfd.fd = proxy_sock;
+	pfd.events = POLLIN;
+
+	while (!proxy_stop) {
+		if (poll(&pfd, 1, 100) <= 0) {
+			continue;
+		}
+
+		fromlen = sizeof(from);
+		len = recvfrom(proxy_sock, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
+		if (len <= 0) {
+			continue;
+		}
+
+		hdr = (struct knet_header *)buf;
+		if ((!proxy_dropped) &&
+		    (len >= (ssize_t)KNET_HEADER_DATA_SIZE) &&
+		    (hdr->kh_type == KNET_HEADER_TYPE_DATA) &&
+		    (hdr->khp_data_frag_num > 1) &&
+		    (hdr->khp_data_frag_seq == 1) &&
+		    (!(hdr->khp_data_flags & KNET_DATA_FLAG_PARITY))) {
+			proxy_dropped = 1;
+			continue;
+		}
+
+		/*
+		 * knet is listening on the address that sent it
+		 */
+		sendto(proxy_sock, buf, len, MSG_DONTWAIT, (struct sockaddr *)&from, fromlen);
+	}
+
+	return NULL;
+}
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	int datafd = 0;
+	int8_t channel = 0;
+	struct knet_handle_stats stats;
+	ssize_t send_len = 0;
+	ssize_t recv_len = 0;
+	int savederrno;
+	size_t i;
+	pthread_t proxy;
+	struct sockaddr_storage lo, proxy_addr;
+
+	if (make_local_sockaddr(&lo, 0) < 0) {
+		printf("Unable to convert loopback to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (make_local_sockaddr(&proxy_addr, 1) < 0) {
+		printf("Unable to convert proxy to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	proxy_sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (proxy_sock < 0) {
+		printf("Unable to create proxy socket: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (bind(proxy_sock, (struct sockaddr *)&proxy_addr, sizeof(struct sockaddr_in)) < 0) {
+		printf("Unable to bind proxy socket: %s\n", strerror(errno));
+		close(proxy_sock);
+		exit(FAIL);
+	}
+
+	if (pthread_create(&proxy, NULL, proxy_thread, NULL)) {
+		printf("Unable to start proxy thread\n");
+		close(proxy_sock);
+		exit(FAIL);
+	}
+
+	for (i = 0; i < KNET_MAX_PACKET_SIZE; i++) {
+		send_buff[i] = (char)(i % 251);
+	}
+	memset(recv_buff, 0, sizeof(recv_buff));
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_send with forward error correction and a lost fragment\n");
+
+	if (knet_handle_enable_sock_notify(knet_h, &private_data, sock_notify) < 0) {
+		printf("knet_handle_enable_sock_notify failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	datafd = 0;
+	channel = -1;
+
+	if (knet_handle_add_datafd(knet_h, &datafd, &channel) < 0) {
+		printf("knet_handle_add_datafd failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("knet_host_add failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &lo, &proxy_addr, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_fec(knet_h, 1, 0, 1) < 0) {
+		printf("knet_link_set_fec failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_enable(knet_h, 1, 0, 1) < 0) {
+		printf("knet_link_set_enable failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_setfwd(knet_h, 1) < 0) {
+		printf("knet_handle_setfwd failed: %s\n", strerror(errno));
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (wait_for_host(knet_h, 1, 10, logfds[0], stdout) < 0) {
+		printf("timeout waiting for host to be reachable");
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	send_len = knet_send(knet_h, send_buff, KNET_MAX_PACKET_SIZE, channel);
+	if (send_len != KNET_MAX_PACKET_SIZE) {
+		printf("knet_send sent %zd bytes: %s\n", send_len, strerror(errno));
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (wait_for_packet(knet_h, 10, datafd)) {
+		printf("Error waiting for packet: %s\n", strerror(errno));
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	recv_len = knet_recv(knet_h, recv_buff, KNET_MAX_PACKET_SIZE, channel);
+	savederrno = errno;
+	if (recv_len != send_len) {
+		printf("knet_recv received %zd bytes: %s (errno: %d)\n", recv_len, strerror(errno), errno);
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		if ((is_helgrind()) && (recv_len == -1) && (savederrno == EAGAIN)) {
+			printf("helgrind exception. this is normal due to possible timeouts\n");
+			exit(PASS);
+		}
+		exit(FAIL);
+	}
+
+	if (memcmp(recv_buff, send_buff, KNET_MAX_PACKET_SIZE)) {
+		printf("recv and send buffers are different!\n");
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_get_stats(knet_h, &stats, sizeof(stats)) < 0) {
+		printf("knet_handle_get_stats failed: %s\n", strerror(errno));
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if ((!proxy_dropped) || (!stats.rx_fec_rebuilt)) {
+		printf("fragment was not rebuilt: dropped: %d, tx_fec_packets: %" PRIu64 ", rx_fec_rebuilt: %" PRIu64 "\n",
+		       proxy_dropped,
+		       stats.tx_fec_packets,
+		       stats.rx_fec_rebuilt);
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	knet_link_set_enable(knet_h, 1, 0, 0);
+	knet_link_clear_config(knet_h, 1, 0);
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+
+	proxy_stop = 1;
+	pthread_join(proxy, NULL);
+	close(proxy_sock);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
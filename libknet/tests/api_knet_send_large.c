@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "netutils.h"
+#include "test-common.h"
+
+/*
+ * the biggest message, the last fragment is shorter than the others
+ */
+#define LARGE_MSG_SIZE KNET_MAX_MESSAGE_SIZE
+#define LARGE_MSGS 2
+#define SMALL_MSG_SIZE 1024
+
+static int private_data;
+static char send_buff[LARGE_MSG_SIZE];
+static char recv_buff[LARGE_MSG_SIZE];
+
+struct sender {
+	knet_handle_t knet_h;
+	int8_t channel;
+	ssize_t err;
+	int savederrno;
+};
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+/*
+ * large channels must work with the default socket buffers, without
+ * SO_SNDBUFFORCE / SO_RCVBUFFORCE. Tests often run as root.
+ */
+static void drop_net_admin(void)
+{
+	struct __user_cap_header_struct hdr;
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+
+	memset(&hdr, 0, sizeof(hdr));
+	memset(data, 0, sizeof(data));
+	hdr.version = _LINUX_CAPABILITY_VERSION_3;
+
+	if (syscall(SYS_capget, &hdr, data) < 0) {
+		printf("Unable to get capabilities: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	data[CAP_TO_INDEX(CAP_NET_ADMIN)].effective &= ~CAP_TO_MASK(CAP_NET_ADMIN);
+	data[CAP_TO_INDEX(CAP_NET_ADMIN)].permitted &= ~CAP_TO_MASK(CAP_NET_ADMIN);
+	data[CAP_TO_INDEX(CAP_NET_ADMIN)].inheritable &= ~CAP_TO_MASK(CAP_NET_ADMIN);
+
+	if (syscall(SYS_capset, &hdr, data) < 0) {
+		printf("Unable to drop CAP_NET_ADMIN: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+}
+
+/*
+ * knet_send only returns once the whole message is in the datafd,
+ * that holds a few fragments at most. Somebody has to read them.
+ */
+static void *send_thread(void *arg)
+{
+	struct sender *sender = arg;
+	int i;
+
+	for (i = 0; i < LARGE_MSGS; i++) {
+		while ((sender->err = knet_send(sender->knet_h, send_buff, LARGE_MSG_SIZE, sender->channel)) < 0) {
+			if (errno != EAGAIN) {
+				sender->savederrno = errno;
+				return NULL;
+			}
+			usleep(1000);
+		}
+	}
+
+	return NULL;
+}
+
+static void test_cleanup(knet_handle_t knet_h, int logfds[2])
+{
+	knet_link_set_enable(knet_h, 1, 0, 0);
+	knet_link_clear_config(knet_h, 1, 0);
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+static void test(const char *model)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	int datafd = 0;
+	int8_t channel = 0;
+	struct knet_handle_stats stats;
+	struct knet_host *host;
+	struct sender sender;
+	pthread_t sender_thread;
+	ssize_t recv_len = 0;
+	int savederrno;
+	size_t i;
+	int msgs;
+	struct sockaddr_storage lo;
+	struct knet_handle_compress_cfg knet_handle_compress_cfg;
+
+	if (make_local_sockaddr(&lo, 0) < 0) {
+		printf("Unable to convert loopback to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	/*
+	 * compressible, but fragments in the wrong place or lost still show
+	 */
+	for (i = 0; i < LARGE_MSG_SIZE; i++) {
+		send_buff[i] = (char)(i % 251);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_send with a large message and %s compression\n", model);
+
+	memset(&knet_handle_compress_cfg, 0, sizeof(struct knet_handle_compress_cfg));
+	strncpy(knet_handle_compress_cfg.compress_model, model, sizeof(knet_handle_compress_cfg.compress_model) - 1);
+	knet_handle_compress_cfg.compress_level = 4;
+	knet_handle_compress_cfg.compress_threshold = 0;
+
+	if (knet_handle_compress(knet_h, &knet_handle_compress_cfg) < 0) {
+		printf("knet_handle_compress did not accept %s compress mode cfg\n", model);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_enable_sock_notify(knet_h, &private_data, sock_notify) < 0) {
+		printf("knet_handle_enable_sock_notify failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	datafd = 0;
+	channel = -1;
+
+	if (knet_handle_add_datafd(knet_h, &datafd, &channel) < 0) {
+		printf("knet_handle_add_datafd failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_send with more than one packet on a normal channel\n");
+
+	if ((knet_send(knet_h, send_buff, KNET_MAX_PACKET_SIZE + 1, channel) != -1) || (errno != EINVAL)) {
+		printf("knet_send accepted a large message on a normal channel or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * no fragment is lost on the way, the test checks every message
+	 */
+	if ((knet_handle_set_channel_large(knet_h, channel, 1) < 0) ||
+	    (knet_handle_set_channel_reliable(knet_h, channel, 1) < 0)) {
+		printf("Unable to mark the channel large and reliable: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_send with more than KNET_MAX_MESSAGE_SIZE on a large channel\n");
+
+	if ((knet_send(knet_h, send_buff, KNET_MAX_MESSAGE_SIZE + 1, channel) != -1) || (errno != EINVAL)) {
+		printf("knet_send accepted a message that is too big or returned incorrect error: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("knet_host_add failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &lo, &lo, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_enable(knet_h, 1, 0, 1) < 0) {
+		printf("knet_link_set_enable failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_setfwd(knet_h, 1) < 0) {
+		printf("knet_handle_setfwd failed: %s\n", strerror(errno));
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	if (wait_for_host(knet_h, 1, 10, logfds[0], stdout) < 0) {
+		printf("timeout waiting for host to be reachable");
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * fragments are only sent to nodes that announce them
+	 */
+	host = knet_h->host_index[1];
+	if (!(host->caps & KNET_CAP_LARGE)) {
+		printf("host did not announce KNET_CAP_LARGE: %x\n", host->caps);
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_send/knet_recv with a message that fits in one packet\n");
+
+	if (knet_send(knet_h, send_buff, SMALL_MSG_SIZE, channel) != SMALL_MSG_SIZE) {
+		printf("knet_send failed: %s\n", strerror(errno));
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	if (wait_for_packet(knet_h, 10, datafd)) {
+		printf("Error waiting for the small message: %s\n", strerror(errno));
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	recv_len = knet_recv(knet_h, recv_buff, sizeof(recv_buff), channel);
+	if ((recv_len != SMALL_MSG_SIZE) || (memcmp(recv_buff, send_buff, SMALL_MSG_SIZE))) {
+		printf("knet_recv received %zd bytes or different data: %s\n", recv_len, strerror(errno));
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	printf("Test knet_send/knet_recv with %d messages of %d bytes\n", LARGE_MSGS, LARGE_MSG_SIZE);
+
+	memset(&sender, 0, sizeof(sender));
+	sender.knet_h = knet_h;
+	sender.channel = channel;
+
+	if (pthread_create(&sender_thread, NULL, send_thread, &sender)) {
+		printf("Unable to start the sender thread\n");
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	msgs = 0;
+	while (msgs < LARGE_MSGS) {
+		if (wait_for_packet(knet_h, 10, datafd)) {
+			printf("Error waiting for message %d: %s\n", msgs, strerror(errno));
+			break;
+		}
+
+		memset(recv_buff, 0, sizeof(recv_buff));
+		recv_len = knet_recv(knet_h, recv_buff, sizeof(recv_buff), channel);
+		savederrno = errno;
+		if ((recv_len < 0) && (savederrno == EAGAIN)) {
+			continue;
+		}
+		if (recv_len != LARGE_MSG_SIZE) {
+			printf("knet_recv received %zd bytes: %s (errno: %d)\n", recv_len, strerror(savederrno), savederrno);
+			if ((is_helgrind()) && (recv_len == -1) && (savederrno == ETIMEDOUT)) {
+				printf("helgrind exception. this is normal due to possible timeouts\n");
+				pthread_join(sender_thread, NULL);
+				test_cleanup(knet_h, logfds);
+				exit(PASS);
+			}
+			break;
+		}
+
+		if (memcmp(recv_buff, send_buff, LARGE_MSG_SIZE)) {
+			printf("recv and send buffers are different for message %d!\n", msgs);
+			break;
+		}
+
+		msgs++;
+		flush_logs(logfds[0], stdout);
+	}
+
+	pthread_join(sender_thread, NULL);
+
+	if ((msgs != LARGE_MSGS) || (sender.err != LARGE_MSG_SIZE)) {
+		printf("knet_send returned %zd: %s\n", sender.err, strerror(sender.savederrno));
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_get_stats(knet_h, &stats, sizeof(stats)) < 0) {
+		printf("knet_handle_get_stats failed: %s\n", strerror(errno));
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * the small message is sent as any other packet
+	 */
+	if ((stats.tx_large_messages != LARGE_MSGS) || (stats.rx_large_messages != LARGE_MSGS)) {
+		printf("large messages were not counted: tx: %" PRIu64 ", rx: %" PRIu64 "\n",
+		       stats.tx_large_messages,
+		       stats.rx_large_messages);
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * every fragment has to go through compression for the test to
+	 * cover the large header with compressed data
+	 */
+	if ((strcmp(model, "none")) &&
+	    ((stats.tx_compressed_packets < 4) || (stats.rx_compressed_packets < 4))) {
+		printf("fragments were not compressed: tx_packets: %" PRIu64 ", rx_packets: %" PRIu64 "\n",
+		       stats.tx_compressed_packets,
+		       stats.rx_compressed_packets);
+		test_cleanup(knet_h, logfds);
+		exit(FAIL);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	test_cleanup(knet_h, logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	struct knet_compress_info compress_list[16];
+	size_t compress_list_entries;
+	size_t i;
+
+	memset(compress_list, 0, sizeof(compress_list));
+
+	drop_net_admin();
+
+	test("none");
+
+	if (knet_get_compress_list(compress_list, &compress_list_entries) < 0) {
+		printf("knet_get_compress_list failed: %s\n", strerror(errno));
+		return FAIL;
+	}
+
+	for (i=0; i < compress_list_entries; i++) {
+		test(compress_list[i].name);
+	}
+
+	return PASS;
+}
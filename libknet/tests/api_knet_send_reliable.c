@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "netutils.h"
+#include "test-common.h"
+
+/*
+ * the RX filter drops every DROP_EVERY message after the reliable
+ * layer accepted it, the messages around it have to be delivered
+ * in order without waiting for the sender to give up on it
+ */
+#define MSGS		200
+#define DROP_EVERY	7
+#define MSG_SIZE	1024
+
+static int private_data;
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static int dhost_filter(void *pvt_data,
+			const unsigned char *outdata,
+			ssize_t outdata_len,
+			uint8_t tx_rx,
+			knet_node_id_t this_host_id,
+			knet_node_id_t src_host_id,
+			int8_t *dst_channel,
+			knet_node_id_t *dst_host_ids,
+			size_t *dst_host_ids_entries)
+{
+	uint32_t id;
+
+	memmove(&id, outdata, sizeof(id));
+
+	dst_host_ids[0] = 1;
+	*dst_host_ids_entries = 1;
+
+	if ((tx_rx == KNET_NOTIFY_RX) && ((id % DROP_EVERY) == (DROP_EVERY - 1))) {
+		dst_host_ids[0] = 2;
+	}
+
+	return 0;
+}
+
+static void test(void)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	int datafd = 0;
+	int8_t channel = 0;
+	struct knet_handle_stats stats;
+	char send_buff[MSG_SIZE];
+	char recv_buff[MSG_SIZE];
+	ssize_t send_len = 0;
+	ssize_t recv_len = 0;
+	int savederrno;
+	uint32_t id, expected;
+	struct sockaddr_storage lo;
+
+	if (make_local_sockaddr(&lo, 0) < 0) {
+		printf("Unable to convert loopback to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	memset(send_buff, 0, sizeof(send_buff));
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test knet_send on a reliable channel with dropped messages\n");
+
+	if (knet_handle_enable_sock_notify(knet_h, &private_data, sock_notify) < 0) {
+		printf("knet_handle_enable_sock_notify failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_enable_filter(knet_h, NULL, dhost_filter) < 0) {
+		printf("knet_handle_enable_filter failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	datafd = 0;
+	channel = -1;
+
+	if (knet_handle_add_datafd(knet_h, &datafd, &channel) < 0) {
+		printf("knet_handle_add_datafd failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_channel_reliable(knet_h, channel, 1) < 0) {
+		printf("knet_handle_set_channel_reliable failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_host_add(knet_h, 1) < 0) {
+		printf("knet_host_add failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_config(knet_h, 1, 0, KNET_TRANSPORT_UDP, &lo, &lo, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_enable(knet_h, 1, 0, 1) < 0) {
+		printf("knet_link_set_enable failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_setfwd(knet_h, 1) < 0) {
+		printf("knet_handle_setfwd failed: %s\n", strerror(errno));
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (wait_for_host(knet_h, 1, 10, logfds[0], stdout) < 0) {
+		printf("timeout waiting for host to be reachable");
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * data is only sent reliably to nodes that advertise it
+	 */
+	if (!(knet_h->host_index[1]->caps & KNET_CAP_RELIABLE)) {
+		printf("host 1 doesn't advertise reliable channels\n");
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	for (id = 0; id < MSGS; id++) {
+		memmove(send_buff, &id, sizeof(id));
+		send_len = knet_send(knet_h, send_buff, MSG_SIZE, channel);
+		if (send_len != MSG_SIZE) {
+			printf("knet_send sent %zd bytes: %s\n", send_len, strerror(errno));
+			knet_link_set_enable(knet_h, 1, 0, 0);
+			knet_link_clear_config(knet_h, 1, 0);
+			knet_host_remove(knet_h, 1);
+			knet_handle_free(knet_h);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	for (expected = 0; expected < MSGS; expected++) {
+		if ((expected % DROP_EVERY) == (DROP_EVERY - 1)) {
+			continue;
+		}
+
+		if (wait_for_packet(knet_h, 1, datafd)) {
+			printf("Error waiting for message %u: %s\n", expected, strerror(errno));
+			knet_link_set_enable(knet_h, 1, 0, 0);
+			knet_link_clear_config(knet_h, 1, 0);
+			knet_host_remove(knet_h, 1);
+			knet_handle_free(knet_h);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+
+		recv_len = knet_recv(knet_h, recv_buff, MSG_SIZE, channel);
+		savederrno = errno;
+		if (recv_len != MSG_SIZE) {
+			printf("knet_recv received %zd bytes: %s (errno: %d)\n", recv_len, strerror(errno), errno);
+			knet_link_set_enable(knet_h, 1, 0, 0);
+			knet_link_clear_config(knet_h, 1, 0);
+			knet_host_remove(knet_h, 1);
+			knet_handle_free(knet_h);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			if ((is_helgrind()) && (recv_len == -1) && (savederrno == EAGAIN)) {
+				printf("helgrind exception. this is normal due to possible timeouts\n");
+				exit(PASS);
+			}
+			exit(FAIL);
+		}
+
+		memmove(&id, recv_buff, sizeof(id));
+		if (id != expected) {
+			printf("received message %u, expected %u\n", id, expected);
+			knet_link_set_enable(knet_h, 1, 0, 0);
+			knet_link_clear_config(knet_h, 1, 0);
+			knet_host_remove(knet_h, 1);
+			knet_handle_free(knet_h);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	if (knet_handle_get_stats(knet_h, &stats, sizeof(stats)) < 0) {
+		printf("knet_handle_get_stats failed: %s\n", strerror(errno));
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * dropped messages are acked by the receiver, the sender must not
+	 * retransmit them until it gives up
+	 */
+	if (stats.tx_reliable_lost) {
+		printf("sender gave up on %" PRIu64 " reliable packets\n", stats.tx_reliable_lost);
+		knet_link_set_enable(knet_h, 1, 0, 0);
+		knet_link_clear_config(knet_h, 1, 0);
+		knet_host_remove(knet_h, 1);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	knet_link_set_enable(knet_h, 1, 0, 0);
+	knet_link_clear_config(knet_h, 1, 0);
+	knet_host_remove(knet_h, 1);
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "netutils.h"
+#include "test-common.h"
+
+#ifdef HAVE_SYS_EVENTFD_H
+/*
+ * two handles in the same process, host 1 sends to host 2 over a shared
+ * memory link. The burst moves more data than the ring can hold, so
+ * the writer wraps around at least once. Messages go out in windows
+ * small enough to fit the datafd socket buffer, everything else is
+ * left to the ring.
+ * Then the same burst goes out with crypto configured on both handles
+ * and KNET_LINK_FLAG_NOCRYPT on both links, data must skip encryption.
+ */
+#define RING_SIZE	(4 * 1024 * 1024)
+#define MSG_SIZE	8000
+#define MSGS		((RING_SIZE / MSG_SIZE) * 3 / 2)
+#define WINDOW		16
+
+static int private_data;
+static int logfds[2];
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static void test_stop(knet_handle_t knet_h, knet_node_id_t peer)
+{
+	knet_link_set_enable(knet_h, peer, 0, 0);
+	knet_link_clear_config(knet_h, peer, 0);
+	knet_host_remove(knet_h, peer);
+	knet_handle_free(knet_h);
+}
+
+static knet_handle_t test_start(knet_node_id_t host_id, knet_node_id_t peer,
+				struct sockaddr_storage *src, struct sockaddr_storage *dst,
+				const char *crypto_model, uint64_t flags,
+				int *datafd, int8_t *channel)
+{
+	knet_handle_t knet_h;
+	struct knet_handle_crypto_cfg knet_handle_crypto_cfg;
+	int exit_status;
+
+	knet_h = knet_handle_new(host_id, logfds[1], KNET_LOG_DEBUG, 0);
+	if (!knet_h) {
+		printf("knet_handle_new failed: %s\n", strerror(errno));
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (crypto_model) {
+		memset(&knet_handle_crypto_cfg, 0, sizeof(struct knet_handle_crypto_cfg));
+		strncpy(knet_handle_crypto_cfg.crypto_model, crypto_model, sizeof(knet_handle_crypto_cfg.crypto_model) - 1);
+		strncpy(knet_handle_crypto_cfg.crypto_cipher_type, "aes128", sizeof(knet_handle_crypto_cfg.crypto_cipher_type) - 1);
+		strncpy(knet_handle_crypto_cfg.crypto_hash_type, "sha1", sizeof(knet_handle_crypto_cfg.crypto_hash_type) - 1);
+		knet_handle_crypto_cfg.private_key_len = 2000;
+
+		if (knet_handle_crypto(knet_h, &knet_handle_crypto_cfg)) {
+			printf("knet_handle_crypto failed with correct config: %s\n", strerror(errno));
+			knet_handle_free(knet_h);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+	}
+
+	if (knet_handle_enable_sock_notify(knet_h, &private_data, sock_notify) < 0) {
+		printf("knet_handle_enable_sock_notify failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	*datafd = 0;
+	*channel = -1;
+
+	if (knet_handle_add_datafd(knet_h, datafd, channel) < 0) {
+		printf("knet_handle_add_datafd failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_host_add(knet_h, peer) < 0) {
+		printf("knet_host_add failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_config(knet_h, peer, 0, KNET_TRANSPORT_SHM, src, dst, flags) < 0) {
+		exit_status = errno == EPROTONOSUPPORT ? SKIP : FAIL;
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, peer);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(exit_status);
+	}
+
+	if (knet_link_set_enable(knet_h, peer, 0, 1) < 0) {
+		printf("knet_link_set_enable failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, peer, 0);
+		knet_host_remove(knet_h, peer);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_setfwd(knet_h, 1) < 0) {
+		printf("knet_handle_setfwd failed: %s\n", strerror(errno));
+		test_stop(knet_h, peer);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	return knet_h;
+}
+
+static void test_burst(const char *crypto_model, uint64_t flags)
+{
+	knet_handle_t knet_h1, knet_h2;
+	int datafd1, datafd2;
+	int8_t channel1, channel2;
+	char send_buff[MSG_SIZE];
+	char recv_buff[MSG_SIZE];
+	ssize_t send_len = 0;
+	ssize_t recv_len = 0;
+	int savederrno;
+	uint32_t id, sent, expected;
+	size_t i;
+	struct knet_handle_stats stats;
+	uint64_t tx_crypt_packets;
+	struct knet_link_status link_status;
+	uint64_t rx_data_packets;
+	struct sockaddr_storage addr1, addr2;
+
+	if (make_local_sockaddr(&addr1, 0) < 0) {
+		printf("Unable to convert loopback to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (make_local_sockaddr(&addr2, 1) < 0) {
+		printf("Unable to convert loopback to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	knet_h1 = test_start(1, 2, &addr1, &addr2, crypto_model, flags, &datafd1, &channel1);
+	knet_h2 = test_start(2, 1, &addr2, &addr1, crypto_model, flags, &datafd2, &channel2);
+
+	if ((wait_for_host(knet_h1, 2, 10, logfds[0], stdout) < 0) ||
+	    (wait_for_host(knet_h2, 1, 10, logfds[0], stdout) < 0)) {
+		printf("timeout waiting for hosts to be reachable");
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_get_stats(knet_h1, &stats, sizeof(stats)) < 0) {
+		printf("knet_handle_get_stats failed: %s\n", strerror(errno));
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+	tx_crypt_packets = stats.tx_crypt_packets;
+
+	if (knet_link_get_status(knet_h2, 1, 0, &link_status, sizeof(link_status)) < 0) {
+		printf("knet_link_get_status failed: %s\n", strerror(errno));
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+	rx_data_packets = link_status.stats.rx_data_packets;
+
+	expected = 0;
+	for (sent = 0; sent < MSGS; sent += WINDOW) {
+		for (id = sent; id < sent + WINDOW; id++) {
+			for (i = 0; i < MSG_SIZE; i++) {
+				send_buff[i] = (char)((id + i) % 251);
+			}
+			send_len = knet_send(knet_h1, send_buff, MSG_SIZE, channel1);
+			if (send_len != MSG_SIZE) {
+				printf("knet_send sent %zd bytes: %s\n", send_len, strerror(errno));
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				exit(FAIL);
+			}
+		}
+
+		for (; expected < sent + WINDOW; expected++) {
+			if (wait_for_packet(knet_h2, 10, datafd2)) {
+				printf("Error waiting for message %u: %s\n", expected, strerror(errno));
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				exit(FAIL);
+			}
+
+			recv_len = knet_recv(knet_h2, recv_buff, MSG_SIZE, channel2);
+			savederrno = errno;
+			if (recv_len != MSG_SIZE) {
+				printf("knet_recv received %zd bytes: %s (errno: %d)\n", recv_len, strerror(errno), errno);
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				if ((is_helgrind()) && (recv_len == -1) && (savederrno == EAGAIN)) {
+					printf("helgrind exception. this is normal due to possible timeouts\n");
+					exit(PASS);
+				}
+				exit(FAIL);
+			}
+
+			/*
+			 * the ring is a single producer / single consumer queue,
+			 * wrapping around must not lose or reorder records
+			 */
+			for (i = 0; i < MSG_SIZE; i++) {
+				if (recv_buff[i] != (char)((expected + i) % 251)) {
+					printf("message %u was not received correctly at byte %zu\n", expected, i);
+					test_stop(knet_h1, 2);
+					test_stop(knet_h2, 1);
+					flush_logs(logfds[0], stdout);
+					close_logpipes(logfds);
+					exit(FAIL);
+				}
+			}
+		}
+
+		flush_logs(logfds[0], stdout);
+	}
+
+	if (knet_handle_get_stats(knet_h1, &stats, sizeof(stats)) < 0) {
+		printf("knet_handle_get_stats failed: %s\n", strerror(errno));
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * heartbeats are always encrypted, data sent in clear must
+	 * not show up in the crypto counters
+	 */
+	if ((crypto_model) && (flags & KNET_LINK_FLAG_NOCRYPT) &&
+	    (stats.tx_crypt_packets - tx_crypt_packets >= MSGS)) {
+		printf("%" PRIu64 " packets were encrypted over NOCRYPT links\n", stats.tx_crypt_packets - tx_crypt_packets);
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	/*
+	 * the receiver has to account the data to the SHM link
+	 */
+	if (knet_link_get_status(knet_h2, 1, 0, &link_status, sizeof(link_status)) < 0) {
+		printf("knet_link_get_status failed: %s\n", strerror(errno));
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (link_status.stats.rx_data_packets - rx_data_packets < MSGS) {
+		printf("link 0 received %" PRIu64 " data packets, expected at least %u\n",
+		       link_status.stats.rx_data_packets - rx_data_packets, MSGS);
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	test_stop(knet_h1, 2);
+	test_stop(knet_h2, 1);
+	flush_logs(logfds[0], stdout);
+}
+
+static void test(void)
+{
+	struct knet_crypto_info crypto_list[16];
+	size_t crypto_list_entries;
+
+	setup_logpipes(logfds);
+
+	printf("Test knet_send over SHM links wrapping the ring\n");
+
+	test_burst(NULL, 0);
+
+	memset(crypto_list, 0, sizeof(crypto_list));
+
+	if (knet_get_crypto_list(crypto_list, &crypto_list_entries) < 0) {
+		printf("knet_get_crypto_list failed: %s\n", strerror(errno));
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (crypto_list_entries == 0) {
+		printf("no crypto modules detected. Skipping NOCRYPT test\n");
+		close_logpipes(logfds);
+		return;
+	}
+
+	printf("Test knet_send over SHM links with %s and KNET_LINK_FLAG_NOCRYPT\n", crypto_list[0].name);
+
+	test_burst(crypto_list[0].name, KNET_LINK_FLAG_NOCRYPT);
+
+	close_logpipes(logfds);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	test();
+
+	return PASS;
+#else
+	printf("WARNING: SHM transport not builtin the library. Unable to test SHM links\n");
+	return SKIP;
+#endif
+}
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2016-2018 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "netutils.h"
+#include "test-common.h"
+
+#ifdef HAVE_IO_URING
+/*
+ * two handles in the same process, both driving their UDP links with
+ * io_uring, host 1 sends to host 2. The burst uses several times the
+ * provided buffers, so the multishot receive runs out of buffers and
+ * has to be armed again. Messages go out in windows small enough not
+ * to overflow the socket buffers.
+ * Then fragmented messages go through, each fragment takes a buffer.
+ */
+#define MSGS		1024
+#define MSG_SIZE	1024
+#define WINDOW		32
+#define BIG_MSGS	16
+#define BIG_MSG_SIZE	KNET_MAX_PACKET_SIZE
+
+static char big_send_buff[BIG_MSG_SIZE];
+static char big_recv_buff[BIG_MSG_SIZE];
+
+static int private_data;
+static int logfds[2];
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static void test_stop(knet_handle_t knet_h, knet_node_id_t peer)
+{
+	knet_link_set_enable(knet_h, peer, 0, 0);
+	knet_link_clear_config(knet_h, peer, 0);
+	knet_host_remove(knet_h, peer);
+	knet_handle_free(knet_h);
+}
+
+static knet_handle_t test_start(knet_node_id_t host_id, knet_node_id_t peer,
+				struct sockaddr_storage *src, struct sockaddr_storage *dst,
+				int *datafd, int8_t *channel)
+{
+	knet_handle_t knet_h;
+	int exit_status;
+
+	knet_h = knet_handle_new(host_id, logfds[1], KNET_LOG_DEBUG, KNET_HANDLE_FLAG_IO_URING);
+	if (!knet_h) {
+		/*
+		 * kernel too old, io_uring disabled by sysctl or filtered
+		 * by seccomp
+		 */
+		exit_status = ((errno == ENOSYS) || (errno == EPERM) ||
+			       (errno == EINVAL) || (errno == EOPNOTSUPP)) ? SKIP : FAIL;
+		printf("knet_handle_new failed: %s\n", strerror(errno));
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(exit_status);
+	}
+
+	if (knet_handle_enable_sock_notify(knet_h, &private_data, sock_notify) < 0) {
+		printf("knet_handle_enable_sock_notify failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	*datafd = 0;
+	*channel = -1;
+
+	if (knet_handle_add_datafd(knet_h, datafd, channel) < 0) {
+		printf("knet_handle_add_datafd failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_host_add(knet_h, peer) < 0) {
+		printf("knet_host_add failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_config(knet_h, peer, 0, KNET_TRANSPORT_UDP, src, dst, 0) < 0) {
+		printf("Unable to configure link: %s\n", strerror(errno));
+		knet_host_remove(knet_h, peer);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_link_set_enable(knet_h, peer, 0, 1) < 0) {
+		printf("knet_link_set_enable failed: %s\n", strerror(errno));
+		knet_link_clear_config(knet_h, peer, 0);
+		knet_host_remove(knet_h, peer);
+		knet_handle_free(knet_h);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	if (knet_handle_setfwd(knet_h, 1) < 0) {
+		printf("knet_handle_setfwd failed: %s\n", strerror(errno));
+		test_stop(knet_h, peer);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	return knet_h;
+}
+
+static void test(void)
+{
+	knet_handle_t knet_h1, knet_h2;
+	int datafd1, datafd2;
+	int8_t channel1, channel2;
+	char send_buff[MSG_SIZE];
+	char recv_buff[MSG_SIZE];
+	ssize_t send_len = 0;
+	ssize_t recv_len = 0;
+	int savederrno;
+	uint32_t id, sent, expected;
+	size_t i;
+	struct sockaddr_storage addr1, addr2;
+
+	if (make_local_sockaddr(&addr1, 0) < 0) {
+		printf("Unable to convert loopback to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	if (make_local_sockaddr(&addr2, 1) < 0) {
+		printf("Unable to convert loopback to sockaddr: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	memset(send_buff, 0, sizeof(send_buff));
+
+	setup_logpipes(logfds);
+
+	printf("Test knet_send over UDP links driven by io_uring\n");
+
+	knet_h1 = test_start(1, 2, &addr1, &addr2, &datafd1, &channel1);
+	knet_h2 = test_start(2, 1, &addr2, &addr1, &datafd2, &channel2);
+
+	if ((wait_for_host(knet_h1, 2, 10, logfds[0], stdout) < 0) ||
+	    (wait_for_host(knet_h2, 1, 10, logfds[0], stdout) < 0)) {
+		printf("timeout waiting for hosts to be reachable");
+		test_stop(knet_h1, 2);
+		test_stop(knet_h2, 1);
+		flush_logs(logfds[0], stdout);
+		close_logpipes(logfds);
+		exit(FAIL);
+	}
+
+	expected = 0;
+	for (sent = 0; sent < MSGS; sent += WINDOW) {
+		for (id = sent; id < sent + WINDOW; id++) {
+			memmove(send_buff, &id, sizeof(id));
+			send_len = knet_send(knet_h1, send_buff, MSG_SIZE, channel1);
+			if (send_len != MSG_SIZE) {
+				printf("knet_send sent %zd bytes: %s\n", send_len, strerror(errno));
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				exit(FAIL);
+			}
+		}
+
+		for (; expected < sent + WINDOW; expected++) {
+			if (wait_for_packet(knet_h2, 10, datafd2)) {
+				printf("Error waiting for message %u: %s\n", expected, strerror(errno));
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				exit(FAIL);
+			}
+
+			recv_len = knet_recv(knet_h2, recv_buff, MSG_SIZE, channel2);
+			savederrno = errno;
+			if (recv_len != MSG_SIZE) {
+				printf("knet_recv received %zd bytes: %s (errno: %d)\n", recv_len, strerror(errno), errno);
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				if ((is_helgrind()) && (recv_len == -1) && (savederrno == EAGAIN)) {
+					printf("helgrind exception. this is normal due to possible timeouts\n");
+					exit(PASS);
+				}
+				exit(FAIL);
+			}
+
+			memmove(&id, recv_buff, sizeof(id));
+			if (id != expected) {
+				printf("received message %u, expected %u\n", id, expected);
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				exit(FAIL);
+			}
+		}
+
+		flush_logs(logfds[0], stdout);
+	}
+
+	printf("Test fragmented knet_send over UDP links driven by io_uring\n");
+
+	/*
+	 * bigger than any data MTU, every message is fragmented
+	 */
+	for (id = 0; id < BIG_MSGS; id++) {
+		for (i = 0; i < BIG_MSG_SIZE; i++) {
+			big_send_buff[i] = (char)((id + i) % 251);
+		}
+		send_len = knet_send(knet_h1, big_send_buff, BIG_MSG_SIZE, channel1);
+		if (send_len != BIG_MSG_SIZE) {
+			printf("knet_send sent %zd bytes: %s\n", send_len, strerror(errno));
+			test_stop(knet_h1, 2);
+			test_stop(knet_h2, 1);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+
+		if (wait_for_packet(knet_h2, 10, datafd2)) {
+			printf("Error waiting for message %u: %s\n", id, strerror(errno));
+			test_stop(knet_h1, 2);
+			test_stop(knet_h2, 1);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+
+		recv_len = knet_recv(knet_h2, big_recv_buff, BIG_MSG_SIZE, channel2);
+		if (recv_len != BIG_MSG_SIZE) {
+			printf("knet_recv received %zd bytes: %s (errno: %d)\n", recv_len, strerror(errno), errno);
+			test_stop(knet_h1, 2);
+			test_stop(knet_h2, 1);
+			flush_logs(logfds[0], stdout);
+			close_logpipes(logfds);
+			exit(FAIL);
+		}
+
+		for (i = 0; i < BIG_MSG_SIZE; i++) {
+			if (big_recv_buff[i] != (char)((id + i) % 251)) {
+				printf("message %u was not reassembled correctly at byte %zu\n", id, i);
+				test_stop(knet_h1, 2);
+				test_stop(knet_h2, 1);
+				flush_logs(logfds[0], stdout);
+				close_logpipes(logfds);
+				exit(FAIL);
+			}
+		}
+
+		flush_logs(logfds[0], stdout);
+	}
+
+	test_stop(knet_h1, 2);
+	test_stop(knet_h2, 1);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+#ifdef HAVE_IO_URING
+	test();
+
+	return PASS;
+#else
+	printf("WARNING: io_uring support not builtin the library. Unable to test io_uring links\n");
+	return SKIP;
+#endif
+}
@@ -16,7 +16,13 @@
 #include <signal.h>
 #include <pthread.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <inttypes.h>
+#ifdef SO_ATTACH_FILTER
+#include <dirent.h>
+#include <linux/filter.h>
+#endif
 
 #include "libknet.h"
 
@@ -36,6 +42,19 @@ static int8_t channel = 0;
 static int globallistener = 0;
 static int continous = 0;
 static int show_stats = 0;
+static uint64_t link_flags = 0;
+static uint64_t handle_flags = 0;
+static uint32_t bw_probe_interval = 0;
+static uint32_t cc_target_delay = 0;
+static unsigned int flow_control = 0;
+static unsigned int relay = 0;
+static unsigned int bcast_tree = 0;
+static uint32_t busy_poll = 0;
+static char *mcastcfg = NULL;
+static unsigned int reliable = 0;
+static uint8_t fec_group = 0;
+static uint32_t max_pckt_size = KNET_MAX_PACKET_SIZE;
+static int pckt_batch = PCKT_FRAG_MAX;
 static struct sockaddr_storage allv4;
 static struct sockaddr_storage allv6;
 static int broadcast_test = 1;
@@ -53,18 +72,52 @@ static pthread_mutex_t shutdown_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define TEST_PING_AND_DATA 1
 #define TEST_PERF_BY_SIZE 2
 #define TEST_PERF_BY_TIME 3
+#define TEST_FAILOVER 4
+#define TEST_LATENCY 5
 
 static int test_type = TEST_PING;
 
 #define TEST_START 2
 #define TEST_STOP 4
 #define TEST_COMPLETE 6
+#define TEST_FAIL_LINKS 8
 
 #define ONE_GIGABYTE 1073741824
 
 static uint64_t perf_by_size_size = 1 * ONE_GIGABYTE;
 static uint64_t perf_by_time_secs = 10;
 
+#define FAILOVER_PCKT_SIZE 1024
+#define FAILOVER_PCKT_INTERVAL 100 /* usecs */
+#define FAILOVER_PING_INTERVAL 100 /* msecs */
+#define FAILOVER_PONG_TIMEOUT 500 /* msecs */
+
+#define LARGE_PCKT_BATCH 8 /* messages per batch with -M */
+
+#define LATENCY_PCKT_SIZE 64
+#define LATENCY_MAX_SAMPLES 1000000
+#define LATENCY_REPLY_TIMEOUT 1 /* seconds */
+
+/*
+ * with -M knet splits and rebuilds the messages, the data channel is
+ * used only through knet_send and knet_recv,
+ * see knet_handle_set_channel_large(3)
+ */
+static pthread_mutex_t large_tx_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * last reply received by the latency test sender, protected by latency_mutex
+ */
+static pthread_mutex_t latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t latency_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t latency_reply_seq = 0;
+static unsigned long long latency_reply_rtt = 0;
+
+static knet_node_id_t failover_hosts[KNET_MAX_HOST];
+static uint8_t failover_links[KNET_MAX_HOST];
+static int failover_socks[KNET_MAX_HOST];
+static size_t failover_entries = 0;
+
 struct node {
 	int nodeid;
 	int links;
@@ -82,7 +135,7 @@ static void print_help(void)
 	printf(" -z [implementation]:[level]:[threshold]   compress configuration. (default disabled)\n");
 	printf("                                           Example: -z zlib:5:100\n");
 	printf(" -p [active|passive|rr]                    (default: passive)\n");
-	printf(" -P [UDP|SCTP]                             (default: UDP) protocol (transport) to use for all links\n");
+	printf(" -P [UDP|SCTP|SHM]                         (default: UDP) protocol (transport) to use for all links\n");
 	printf(" -t [nodeid]                               This nodeid (required)\n");
 	printf(" -n [nodeid],[proto]/[link1_ip],[link2_..] Other nodes information (at least one required)\n");
 	printf("                                           Example: -t 1,192.168.8.1,SCTP/3ffe::8:1,UDP/172...\n");
@@ -92,7 +145,7 @@ static void print_help(void)
 	printf(" -o                                        enable baseport offset per nodeid\n");
 	printf(" -m                                        change PMTUd interval in seconds (default: 60)\n");
 	printf(" -w                                        dont wait for all nodes to be up before starting the test (default: wait)\n");
-	printf(" -T [ping|ping_data|perf-by-size|perf-by-time]\n");
+	printf(" -T [ping|ping_data|perf-by-size|perf-by-time|failover|latency]\n");
 	printf("                                           test type (default: ping)\n");
 	printf("                                           ping: will wait for all hosts to join the knet network, sleep 5 seconds and quit\n");
 	printf("                                           ping_data: will wait for all hosts to join the knet network, sends some data to all nodes and quit\n");
@@ -103,14 +156,45 @@ static void print_help(void)
 	printf("                                                         perform a series of benchmarks by transmitting a known\n");
 	printf("                                                         size of packets for a given amount of time (10 seconds)\n");
 	printf("                                                         and measuring the quantity of data transmitted, then quit\n");
+	printf("                                           failover: will wait for all hosts to join the knet network,\n");
+	printf("                                                     stream numbered packets for a given amount of time (10 seconds)\n");
+	printf("                                                     and drop all packets from each node on its active link half way\n");
+	printf("                                                     through, so that knet detects the failure and switches link.\n");
+	printf("                                                     Receivers report packets lost and the longest gap between\n");
+	printf("                                                     packets (time to switch link), then quit\n");
+	printf("                                                     (requires at least 2 UDP links per node and passive policy,\n");
+	printf("                                                     each link with its own local address)\n");
+	printf("                                           latency: will wait for all hosts to join the knet network,\n");
+	printf("                                                    send %d bytes packets one at a time for a given amount of time\n", LATENCY_PCKT_SIZE);
+	printf("                                                    (10 seconds), the other nodes send them back, and report\n");
+	printf("                                                    the round trip time distribution, then quit\n");
 	printf(" -s                                        nodeid that will generate traffic for benchmarks\n");
 	printf(" -S [size|seconds]                         when used in combination with -T perf-by-size it indicates how many GB of traffic to generate for the test. (default: 1GB)\n");
-	printf("                                           when used in combination with -T perf-by-time it indicates how many Seconds of traffic to generate for the test. (default: 10 seconds)\n");
+	printf("                                           when used in combination with -T perf-by-time or failover it indicates how many Seconds of traffic to generate for the test. (default: 10 seconds)\n");
 	printf(" -C                                        repeat the test continously (default: off)\n");
 	printf(" -X[XX]                                    show stats at the end of the run (default: 1)\n");
 	printf("                                           1: show handle stats, 2: show summary link stats\n");
 	printf("                                           3: show detailed link stats\n");
 	printf(" -a                                        enable machine parsable output (default: off).\n");
+	printf(" -k                                        enable kernel timestamping on links for latency measurement (default: off)\n");
+	printf(" -B [interval]                             enable bandwidth probes on links every interval ms (default: off)\n");
+	printf(" -L [usecs]                                enable congestion control on links with the given target delay\n");
+	printf("                                           and mark the data channel as bulk (default: off)\n");
+	printf(" -F                                        enable flow control between nodes (default: off)\n");
+	printf(" -R                                        make the data channel reliable (default: off)\n");
+	printf(" -e [group]                                send a parity fragment every group data fragments on links (default: off)\n");
+	printf(" -M                                        allow messages up to KNET_MAX_MESSAGE_SIZE on the data channel\n");
+	printf("                                           and test sizes up to that (default: off). Use it on all nodes.\n");
+	printf(" -r                                        relay data through other nodes when there are no links to a node\n");
+	printf("                                           (default: off). Use it on all nodes.\n");
+	printf(" -f [fanout]                               send broadcasts along a tree, each node passing them on\n");
+	printf("                                           to at most fanout nodes (default: off)\n");
+	printf(" -N                                        pass data in clear on SHM links, even with crypto (default: off)\n");
+	printf(" -g [group]                                send broadcasts to the IP multicast group on link 0, port is baseport\n");
+	printf("                                           (default: off). Use it on all nodes.\n");
+	printf(" -U                                        use io_uring for UDP links (default: off)\n");
+	printf(" -K                                        use a connected UDP socket for each static link (default: off)\n");
+	printf(" -y [usecs]                                busy poll links for usecs after receiving packets (default: off, experimental)\n");
 }
 
 static void parse_nodes(char *nodesinfo[MAX_NODES], int onidx, int port, struct node nodes[MAX_NODES], int *thisidx)
@@ -236,6 +320,8 @@ static void setup_knet(int argc, char *argv[])
 	struct sockaddr_in *so_in;
 	struct sockaddr_in6 *so_in6;
 	struct sockaddr_storage *src;
+	struct sockaddr_storage mcast;
+	char port_str[10];
 	int i, link_idx, allnodesup = 0;
 	int policy = KNET_LINK_POLICY_PASSIVE, policyfound = 0;
 	int protocol = KNET_TRANSPORT_UDP, protofound = 0;
@@ -247,7 +333,7 @@ static void setup_knet(int argc, char *argv[])
 
 	memset(nodes, 0, sizeof(nodes));
 
-	while ((rv = getopt(argc, argv, "aCT:S:s:ldom:wb:t:n:c:p:X::P:z:h")) != EOF) {
+	while ((rv = getopt(argc, argv, "aCkNUKFRMrf:g:B:L:e:T:S:s:ldom:wb:t:n:c:p:X::P:y:z:h")) != EOF) {
 		switch(rv) {
 			case 'h':
 				print_help();
@@ -307,8 +393,12 @@ static void setup_knet(int argc, char *argv[])
 					protocol = KNET_TRANSPORT_SCTP;
 					protofound = 1;
 				}
+				if (!strcmp(protostr, "SHM")) {
+					protocol = KNET_TRANSPORT_SHM;
+					protofound = 1;
+				}
 				if (!protofound) {
-					printf("Error: invalid protocol %s specified. -P accepts udp|sctp\n", policystr);
+					printf("Error: invalid protocol %s specified. -P accepts udp|sctp|shm\n", policystr);
 					exit(FAIL);
 				}
 				break;
@@ -386,6 +476,12 @@ static void setup_knet(int argc, char *argv[])
 				if (!strcmp("perf-by-time", optarg)) {
 					test_type = TEST_PERF_BY_TIME;
 				}
+				if (!strcmp("failover", optarg)) {
+					test_type = TEST_FAILOVER;
+				}
+				if (!strcmp("latency", optarg)) {
+					test_type = TEST_LATENCY;
+				}
 				break;
 			case 'S':
 				perf_by_size_size = (uint64_t)atoi(optarg) * ONE_GIGABYTE;
@@ -394,6 +490,49 @@ static void setup_knet(int argc, char *argv[])
 			case 'C':
 				continous = 1;
 				break;
+			case 'k':
+				link_flags |= KNET_LINK_FLAG_TIMESTAMP;
+				break;
+			case 'N':
+				link_flags |= KNET_LINK_FLAG_NOCRYPT;
+				break;
+			case 'U':
+				handle_flags |= KNET_HANDLE_FLAG_IO_URING;
+				break;
+			case 'K':
+				link_flags |= KNET_LINK_FLAG_CONNECTED;
+				break;
+			case 'y':
+				busy_poll = (uint32_t)atoi(optarg);
+				break;
+			case 'B':
+				bw_probe_interval = (uint32_t)atoi(optarg);
+				break;
+			case 'L':
+				cc_target_delay = (uint32_t)atoi(optarg);
+				break;
+			case 'F':
+				flow_control = 1;
+				break;
+			case 'R':
+				reliable = 1;
+				break;
+			case 'e':
+				fec_group = (uint8_t)atoi(optarg);
+				break;
+			case 'M':
+				max_pckt_size = KNET_MAX_MESSAGE_SIZE;
+				pckt_batch = LARGE_PCKT_BATCH;
+				break;
+			case 'r':
+				relay = 1;
+				break;
+			case 'f':
+				bcast_tree = (unsigned int)atoi(optarg);
+				break;
+			case 'g':
+				mcastcfg = optarg;
+				break;
 			case 'X':
 				if (optarg) {
 					show_stats = atoi(optarg);
@@ -442,14 +581,15 @@ static void setup_knet(int argc, char *argv[])
 		}
 	}
 
-	if (((test_type == TEST_PERF_BY_SIZE) || (test_type == TEST_PERF_BY_TIME)) && (senderid < 0)) {
+	if (((test_type == TEST_PERF_BY_SIZE) || (test_type == TEST_PERF_BY_TIME) ||
+	     (test_type == TEST_FAILOVER) || (test_type == TEST_LATENCY)) && (senderid < 0)) {
 		printf("Error: performance test requires -s to be set (for now)\n");
 		exit(FAIL);
 	}
 
 	logfd = start_logging(stdout);
 
-	knet_h = knet_handle_new(thisnodeid, logfd, debug, 0);
+	knet_h = knet_handle_new(thisnodeid, logfd, debug, handle_flags);
 	if (!knet_h) {
 		printf("Unable to knet_handle_new: %s\n", strerror(errno));
 		exit(FAIL);
@@ -502,6 +642,50 @@ static void setup_knet(int argc, char *argv[])
 		exit(FAIL);
 	}
 
+	if ((cc_target_delay) &&
+	    (knet_handle_set_channel_bulk(knet_h, channel, 1) < 0)) {
+		printf("knet_handle_set_channel_bulk failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_channel_reliable(knet_h, channel, reliable) < 0) {
+		printf("knet_handle_set_channel_reliable failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_channel_large(knet_h, channel, (max_pckt_size > KNET_MAX_PACKET_SIZE)) < 0) {
+		printf("knet_handle_set_channel_large failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_flow_control(knet_h, flow_control) < 0) {
+		printf("knet_handle_set_flow_control failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_relay(knet_h, relay) < 0) {
+		printf("knet_handle_set_relay failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		exit(FAIL);
+	}
+
+	if (knet_handle_set_bcast_tree(knet_h, bcast_tree) < 0) {
+		printf("knet_handle_set_bcast_tree failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		exit(FAIL);
+	}
+
+	if ((busy_poll) &&
+	    (knet_handle_set_busy_poll(knet_h, busy_poll) < 0)) {
+		printf("knet_handle_set_busy_poll failed: %s\n", strerror(errno));
+		knet_handle_free(knet_h);
+		exit(FAIL);
+	}
+
 	if (knet_handle_pmtud_setfreq(knet_h, pmtud_interval) < 0) {
 		printf("knet_handle_pmtud_setfreq failed: %s\n", strerror(errno));
 		knet_handle_free(knet_h);
@@ -562,7 +746,7 @@ static void setup_knet(int argc, char *argv[])
 			}
 			if (knet_link_set_config(knet_h, nodes[i].nodeid, link_idx,
 						 nodes[i].transport[link_idx], src,
-						 &nodes[i].address[link_idx], 0) < 0) {
+						 &nodes[i].address[link_idx], link_flags) < 0) {
 				printf("Unable to configure link: %s\n", strerror(errno));
 				exit(FAIL);
 			}
@@ -583,7 +767,17 @@ static void setup_knet(int argc, char *argv[])
 				printf("knet_link_set_enable failed: %s\n", strerror(errno));
 				exit(FAIL);
 			}
-			if (knet_link_set_ping_timers(knet_h, nodes[i].nodeid, link_idx, 1000, 10000, 2048) < 0) {
+			/*
+			 * the failover test measures how fast a dead link is
+			 * detected, use tighter timers than the other tests
+			 */
+			if (test_type == TEST_FAILOVER) {
+				rv = knet_link_set_ping_timers(knet_h, nodes[i].nodeid, link_idx,
+							       FAILOVER_PING_INTERVAL, FAILOVER_PONG_TIMEOUT, 2048);
+			} else {
+				rv = knet_link_set_ping_timers(knet_h, nodes[i].nodeid, link_idx, 1000, 10000, 2048);
+			}
+			if (rv < 0) {
 				printf("knet_link_set_ping_timers failed: %s\n", strerror(errno));
 				exit(FAIL);
 			}
@@ -591,6 +785,33 @@ static void setup_knet(int argc, char *argv[])
 				printf("knet_link_set_pong_count failed: %s\n", strerror(errno));
 				exit(FAIL);
 			}
+			if ((bw_probe_interval) &&
+			    (knet_link_set_bandwidth_probe(knet_h, nodes[i].nodeid, link_idx, bw_probe_interval, KNET_LINK_BW_PROBE_COUNT_DEFAULT) < 0)) {
+				printf("knet_link_set_bandwidth_probe failed: %s\n", strerror(errno));
+				exit(FAIL);
+			}
+			if ((cc_target_delay) &&
+			    (knet_link_set_congestion_control(knet_h, nodes[i].nodeid, link_idx, cc_target_delay) < 0)) {
+				printf("knet_link_set_congestion_control failed: %s\n", strerror(errno));
+				exit(FAIL);
+			}
+			if ((fec_group) &&
+			    (knet_link_set_fec(knet_h, nodes[i].nodeid, link_idx, fec_group) < 0)) {
+				printf("knet_link_set_fec failed: %s\n", strerror(errno));
+				exit(FAIL);
+			}
+		}
+	}
+
+	if (mcastcfg) {
+		snprintf(port_str, sizeof(port_str), "%d", port);
+		if (knet_strtoaddr(mcastcfg, port_str, &mcast, sizeof(struct sockaddr_storage)) < 0) {
+			printf("Unable to convert %s to sockaddress\n", mcastcfg);
+			exit(FAIL);
+		}
+		if (knet_handle_set_mcast(knet_h, 0, &nodes[thisidx].address[0], &mcast) < 0) {
+			printf("knet_handle_set_mcast failed: %s\n", strerror(errno));
+			exit(FAIL);
 		}
 	}
 
@@ -624,6 +845,271 @@ static void setup_knet(int argc, char *argv[])
 	}
 }
 
+/*
+ * the link a passive host sends data on: the connected link
+ * with the highest priority, the first one on a tie
+ */
+static int get_active_link(knet_node_id_t host_id, uint8_t *link_id)
+{
+	uint8_t link_ids[KNET_MAX_LINK];
+	size_t link_ids_entries, i;
+	struct knet_link_status link_status;
+	uint8_t priority;
+	int best_priority = -1;
+
+	if (knet_link_get_link_list(knet_h, host_id, link_ids, &link_ids_entries) < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < link_ids_entries; i++) {
+		if (knet_link_get_status(knet_h, host_id, link_ids[i], &link_status, sizeof(link_status)) < 0) {
+			continue;
+		}
+		if ((!link_status.enabled) || (!link_status.connected)) {
+			continue;
+		}
+		if (knet_link_get_priority(knet_h, host_id, link_ids[i], &priority) < 0) {
+			continue;
+		}
+		if (priority > best_priority) {
+			best_priority = priority;
+			*link_id = link_ids[i];
+		}
+	}
+
+	if (best_priority < 0) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifdef SO_ATTACH_FILTER
+/*
+ * the UDP socket knet uses for a link, found by its local address
+ */
+static int get_link_sock(const struct sockaddr_storage *src_addr)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int fd, type;
+	socklen_t optlen;
+	DIR *fds;
+	struct dirent *entry;
+
+	fds = opendir("/proc/self/fd");
+	if (!fds) {
+		return -1;
+	}
+
+	while ((entry = readdir(fds)) != NULL) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		fd = atoi(entry->d_name);
+		optlen = sizeof(type);
+		if ((getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &optlen) < 0) ||
+		    (type != SOCK_DGRAM)) {
+			continue;
+		}
+		addrlen = sizeof(addr);
+		memset(&addr, 0, sizeof(addr));
+		if (getsockname(fd, (struct sockaddr *)&addr, &addrlen) < 0) {
+			continue;
+		}
+		if (addr.ss_family != src_addr->ss_family) {
+			continue;
+		}
+		if ((addr.ss_family == AF_INET) &&
+		    (!memcmp(&((struct sockaddr_in *)&addr)->sin_addr,
+			     &((const struct sockaddr_in *)src_addr)->sin_addr, sizeof(struct in_addr))) &&
+		    (((struct sockaddr_in *)&addr)->sin_port == ((const struct sockaddr_in *)src_addr)->sin_port)) {
+			closedir(fds);
+			return fd;
+		}
+		if ((addr.ss_family == AF_INET6) &&
+		    (!memcmp(&((struct sockaddr_in6 *)&addr)->sin6_addr,
+			     &((const struct sockaddr_in6 *)src_addr)->sin6_addr, sizeof(struct in6_addr))) &&
+		    (((struct sockaddr_in6 *)&addr)->sin6_port == ((const struct sockaddr_in6 *)src_addr)->sin6_port)) {
+			closedir(fds);
+			return fd;
+		}
+	}
+
+	closedir(fds);
+	errno = ENOENT;
+	return -1;
+}
+
+/*
+ * drop everything the peer sends to the link socket, as if the path
+ * had died: heartbeats time out and knet has to fail over on its own
+ */
+static int block_link_peer(int sock, const struct sockaddr_storage *dst_addr)
+{
+	struct sock_filter filter[10];
+	struct sock_fprog prog;
+	const uint32_t *ip6;
+	int len = 0;
+
+	if (dst_addr->ss_family == AF_INET) {
+		filter[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12);
+		filter[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+			ntohl(((const struct sockaddr_in *)dst_addr)->sin_addr.s_addr), 0, 1);
+	} else {
+		ip6 = (const uint32_t *)&((const struct sockaddr_in6 *)dst_addr)->sin6_addr;
+		filter[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 8);
+		filter[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(ip6[0]), 0, 7);
+		filter[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12);
+		filter[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(ip6[1]), 0, 5);
+		filter[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 16);
+		filter[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(ip6[2]), 0, 3);
+		filter[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20);
+		filter[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(ip6[3]), 0, 1);
+	}
+	filter[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+	filter[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+	prog.len = len;
+	prog.filter = filter;
+
+	return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+static void unblock_link_peer(int sock)
+{
+	setsockopt(sock, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0);
+}
+#else
+static int get_link_sock(const struct sockaddr_storage *src_addr)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+static int block_link_peer(int sock, const struct sockaddr_storage *dst_addr)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+static void unblock_link_peer(int sock)
+{
+	return;
+}
+#endif
+
+/*
+ * host_id -1 fails the active link to every host
+ */
+static void fail_active_links(int host_id)
+{
+	knet_node_id_t host_list[KNET_MAX_HOST];
+	size_t num_hosts, i;
+	uint8_t link_id = 0, transport, dynamic;
+	uint64_t flags;
+	struct sockaddr_storage src_addr, dst_addr;
+	int sock;
+
+	failover_entries = 0;
+
+	if (knet_host_get_host_list(knet_h, host_list, &num_hosts) < 0) {
+		printf("[info]: unable to get host list: %s\n", strerror(errno));
+		return;
+	}
+
+	for (i = 0; i < num_hosts; i++) {
+		if ((host_list[i] == thisnodeid) ||
+		    ((host_id >= 0) && (host_list[i] != host_id))) {
+			continue;
+		}
+		if (get_active_link(host_list[i], &link_id) < 0) {
+			printf("[info]: host %u has no active link\n", host_list[i]);
+			continue;
+		}
+		if (knet_link_get_config(knet_h, host_list[i], link_id, &transport, &src_addr, &dst_addr, &dynamic, &flags) < 0) {
+			printf("[info]: unable to get link %u config: %s\n", link_id, strerror(errno));
+			continue;
+		}
+		if (transport != KNET_TRANSPORT_UDP) {
+			printf("[info]: link %u to host %u is not UDP, it can't be failed\n", link_id, host_list[i]);
+			continue;
+		}
+		sock = get_link_sock(&src_addr);
+		if (sock < 0) {
+			printf("[info]: unable to find link %u socket: %s\n", link_id, strerror(errno));
+			continue;
+		}
+		printf("[info]: dropping packets from host %u on link %u\n", host_list[i], link_id);
+		if (block_link_peer(sock, &dst_addr) < 0) {
+			printf("[info]: unable to drop packets: %s\n", strerror(errno));
+			continue;
+		}
+		failover_hosts[failover_entries] = host_list[i];
+		failover_links[failover_entries] = link_id;
+		failover_socks[failover_entries] = sock;
+		failover_entries++;
+	}
+}
+
+static void restore_failed_links(void)
+{
+	size_t i;
+
+	for (i = 0; i < failover_entries; i++) {
+		printf("[info]: restoring link %u to host %u\n", failover_links[i], failover_hosts[i]);
+		unblock_link_peer(failover_socks[i]);
+	}
+	failover_entries = 0;
+}
+
+/*
+ * with -M a message goes out whole, one at a time
+ */
+static ssize_t bench_send(const char *buf, size_t len)
+{
+	ssize_t err;
+
+	if (max_pckt_size <= KNET_MAX_PACKET_SIZE) {
+		return knet_send(knet_h, buf, len, channel);
+	}
+
+	pthread_mutex_lock(&large_tx_mutex);
+retry:
+	err = knet_send(knet_h, buf, len, channel);
+	if ((err < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		usleep(KNET_THREADS_TIMER_RES / 16);
+		goto retry;
+	}
+	pthread_mutex_unlock(&large_tx_mutex);
+
+	return err;
+}
+
+/*
+ * with -M knet_recv returns one whole message in msg[0]
+ */
+static int bench_recv(struct knet_mmsghdr *msg)
+{
+	ssize_t len;
+
+	if (max_pckt_size <= KNET_MAX_PACKET_SIZE) {
+		return _recvmmsg(datafd, &msg[0], pckt_batch, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+
+	len = knet_recv(knet_h, msg[0].msg_hdr.msg_iov->iov_base, msg[0].msg_hdr.msg_iov->iov_len, channel);
+	if (len < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			return 0;
+		}
+		return -1;
+	}
+	msg[0].msg_len = len;
+
+	return 1;
+}
+
 static void *_rx_thread(void *args)
 {
 	int rx_epoll;
@@ -639,16 +1125,22 @@ static void *_rx_thread(void *args)
 	uint64_t rx_pkts = 0;
 	uint64_t rx_bytes = 0;
 	unsigned int current_pckt_size = 0;
-
-	for (i = 0; i < PCKT_FRAG_MAX; i++) {
-		rx_buf[i] = malloc(KNET_MAX_PACKET_SIZE);
+	uint64_t rx_seq = 0, rx_expected_seq = 0, rx_lost = 0, rx_late = 0;
+	struct timespec rx_last, rx_now;
+	unsigned long long rx_gap = 0, rx_max_gap = 0;
+	struct timespec latency_sent;
+	unsigned int len;
+	char *data;
+
+	for (i = 0; i < pckt_batch; i++) {
+		rx_buf[i] = malloc(max_pckt_size);
 		if (!rx_buf[i]) {
 			printf("RXT: Unable to malloc!\nHALTING RX THREAD!\n");
 			return NULL;
 		}
-		memset(rx_buf[i], 0, KNET_MAX_PACKET_SIZE);
+		memset(rx_buf[i], 0, max_pckt_size);
 		iov_in[i].iov_base = (void *)rx_buf[i];
-		iov_in[i].iov_len = KNET_MAX_PACKET_SIZE;
+		iov_in[i].iov_len = max_pckt_size;
 		memset(&msg[i].msg_hdr, 0, sizeof(struct msghdr));
 		msg[i].msg_hdr.msg_name = &address[i];
 		msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
@@ -676,32 +1168,36 @@ static void *_rx_thread(void *args)
 
 	while (!bench_shutdown_in_progress) {
 		if (epoll_wait(rx_epoll, events, KNET_EPOLL_MAX_EVENTS, 1) >= 1) {
-			msg_recv = _recvmmsg(datafd, &msg[0], PCKT_FRAG_MAX, MSG_DONTWAIT | MSG_NOSIGNAL);
+			msg_recv = bench_recv(&msg[0]);
 			if (msg_recv < 0) {
 				printf("[info]: RXT: error from recvmmsg: %s\n", strerror(errno));
 			}
 			switch(test_type) {
 				case TEST_PING_AND_DATA:
 					for (i = 0; i < msg_recv; i++) {
-						if (msg[i].msg_len == 0) {
+						len = msg[i].msg_len;
+						data = msg[i].msg_hdr.msg_iov->iov_base;
+						if (len == 0) {
 							printf("[info]: RXT: received 0 bytes message?\n");
 						}
-						printf("[info]: received %u bytes message: %s\n", msg[i].msg_len, (char *)msg[i].msg_hdr.msg_iov->iov_base);
+						printf("[info]: received %u bytes message: %s\n", len, data);
 					}
 					break;
 				case TEST_PERF_BY_TIME:
 				case TEST_PERF_BY_SIZE:
 					for (i = 0; i < msg_recv; i++) {
-						if (msg[i].msg_len < 64) {
-							if (msg[i].msg_len == 0) {
+						len = msg[i].msg_len;
+						data = msg[i].msg_hdr.msg_iov->iov_base;
+						if (len < 64) {
+							if (len == 0) {
 								printf("[info]: RXT: received 0 bytes message?\n");
 							}
-							if (msg[i].msg_len == TEST_START) {
+							if (len == TEST_START) {
 								if (clock_gettime(CLOCK_MONOTONIC, &clock_start) != 0) {
 									printf("[info]: unable to get start time!\n");
 								}
 							}
-							if (msg[i].msg_len == TEST_STOP) {
+							if (len == TEST_STOP) {
 								double average_rx_mbytes;
 								double average_rx_pkts;
 								double time_diff_sec;
@@ -731,14 +1227,96 @@ static void *_rx_thread(void *args)
 								rx_bytes = 0;
 								current_pckt_size = 0;
 							}
-							if (msg[i].msg_len == TEST_COMPLETE) {
+							if (len == TEST_COMPLETE) {
+								wait_for_perf_rx = 1;
+							}
+							continue;
+						}
+						rx_pkts++;
+						rx_bytes = rx_bytes + len;
+						current_pckt_size = len;
+					}
+					break;
+				case TEST_FAILOVER:
+					for (i = 0; i < msg_recv; i++) {
+						len = msg[i].msg_len;
+						data = msg[i].msg_hdr.msg_iov->iov_base;
+						if (len < 64) {
+							if (len == TEST_START) {
+								rx_pkts = 0;
+								rx_lost = 0;
+								rx_late = 0;
+								rx_expected_seq = 0;
+								rx_max_gap = 0;
+							}
+							if ((len == TEST_FAIL_LINKS) && (thisnodeid != senderid)) {
+								fail_active_links(senderid);
+							}
+							if (len == TEST_STOP) {
+								if (thisnodeid != senderid) {
+									restore_failed_links();
+								}
+								if (!machine_output) {
+									printf("[failover] received: %" PRIu64 " lost: %" PRIu64 " out of order: %" PRIu64 " time to switch (longest rx gap): %llu usecs\n",
+									       rx_pkts, rx_lost, rx_late, rx_max_gap / 1000llu);
+								} else {
+									printf("[failover],%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%llu\n",
+									       rx_pkts, rx_lost, rx_late, rx_max_gap / 1000llu);
+								}
+							}
+							if (len == TEST_COMPLETE) {
 								wait_for_perf_rx = 1;
 							}
 							continue;
 						}
+						clock_gettime(CLOCK_MONOTONIC, &rx_now);
+						if (rx_pkts) {
+							timespec_diff(rx_last, rx_now, &rx_gap);
+							if (rx_gap > rx_max_gap) {
+								rx_max_gap = rx_gap;
+							}
+						}
+						rx_last = rx_now;
 						rx_pkts++;
-						rx_bytes = rx_bytes + msg[i].msg_len;
-						current_pckt_size = msg[i].msg_len;
+
+						memmove(&rx_seq, data, sizeof(rx_seq));
+						if (rx_seq < rx_expected_seq) {
+							rx_late++;
+							if (rx_lost) {
+								rx_lost--;
+							}
+							continue;
+						}
+						rx_lost = rx_lost + (rx_seq - rx_expected_seq);
+						rx_expected_seq = rx_seq + 1;
+					}
+					break;
+				case TEST_LATENCY:
+					for (i = 0; i < msg_recv; i++) {
+						len = msg[i].msg_len;
+						data = msg[i].msg_hdr.msg_iov->iov_base;
+						if (len < 64) {
+							if (len == TEST_COMPLETE) {
+								wait_for_perf_rx = 1;
+							}
+							continue;
+						}
+						if (senderid != thisnodeid) {
+							/*
+							 * send it back as is
+							 */
+							if (bench_send(data, len) != (ssize_t)len) {
+								printf("[info]: Error sending latency reply: %s\n", strerror(errno));
+							}
+							continue;
+						}
+						clock_gettime(CLOCK_MONOTONIC, &rx_now);
+						memmove(&latency_sent, data + sizeof(uint64_t), sizeof(latency_sent));
+						pthread_mutex_lock(&latency_mutex);
+						memmove(&latency_reply_seq, data, sizeof(latency_reply_seq));
+						timespec_diff(latency_sent, rx_now, &latency_reply_rtt);
+						pthread_cond_signal(&latency_cond);
+						pthread_mutex_unlock(&latency_mutex);
 					}
 					break;
 			}
@@ -776,7 +1354,7 @@ static void stop_rx_thread(void)
 		sleep(2);
 		pthread_cancel(rx_thread);
 		pthread_join(rx_thread, &retval);
-		for (i = 0; i < PCKT_FRAG_MAX; i ++) {
+		for (i = 0; i < pckt_batch; i ++) {
 			free(rx_buf[i]);
 		}
 	}
@@ -796,7 +1374,7 @@ static void send_ping_data(void)
 		len = strlen(buf);
 	}
 
-	if (knet_send(knet_h, buf, len, channel) != len) {
+	if (bench_send(buf, len) != len) {
 		printf("[info]: Error sending hello world: %s\n", strerror(errno));
 	}
 	sleep(1);
@@ -811,6 +1389,17 @@ static int send_messages(struct knet_mmsghdr *msg, int msgs_to_send)
 	prev_sent = 0;
 	progress = 1;
 
+	if (max_pckt_size > KNET_MAX_PACKET_SIZE) {
+		for (total_sent = 0; total_sent < msgs_to_send; total_sent++) {
+			if (bench_send(msg[total_sent].msg_hdr.msg_iov->iov_base,
+				       msg[total_sent].msg_hdr.msg_iov->iov_len) < 0) {
+				printf("[info]: Unable to send messages: %s\n", strerror(errno));
+				return -1;
+			}
+		}
+		return total_sent;
+	}
+
 retry:
 	errno = 0;
 	sent_msgs = _sendmmsg(datafd, &msg[0], msgs_to_send, MSG_NOSIGNAL);
@@ -848,13 +1437,13 @@ static int setup_send_buffers_common(struct knet_mmsghdr *msg, struct iovec *iov
 {
 	int i;
 
-	for (i = 0; i < PCKT_FRAG_MAX; i++) {
-		tx_buf[i] = malloc(KNET_MAX_PACKET_SIZE);
+	for (i = 0; i < pckt_batch; i++) {
+		tx_buf[i] = malloc(max_pckt_size);
 		if (!tx_buf[i]) {
 			printf("TXT: Unable to malloc!\n");
 			return -1;
 		}
-		memset(tx_buf[i], 0, KNET_MAX_PACKET_SIZE);
+		memset(tx_buf[i], 0, max_pckt_size);
 		iov_out[i].iov_base = (void *)tx_buf[i];
 		memset(&msg[i].msg_hdr, 0, sizeof(struct msghdr));
 		msg[i].msg_hdr.msg_iov = &iov_out[i];
@@ -877,8 +1466,8 @@ static void send_perf_data_by_size(void)
 
 	setup_send_buffers_common(msg, iov_out, tx_buf);
 
-	while (packetsize <= KNET_MAX_PACKET_SIZE) {
-		for (i = 0; i < PCKT_FRAG_MAX; i++) {
+	while (packetsize <= max_pckt_size) {
+		for (i = 0; i < pckt_batch; i++) {
 			iov_out[i].iov_len = packetsize;
 		}
 
@@ -886,11 +1475,11 @@ static void send_perf_data_by_size(void)
 		printf("[info]: testing with %u packet size. total bytes to transfer: %" PRIu64 " (%" PRIu64 " packets)\n", packetsize, perf_by_size_size, total_pkts_to_tx);
 
 		memset(ctrl_message, 0, sizeof(ctrl_message));
-		knet_send(knet_h, ctrl_message, TEST_START, channel);
+		bench_send(ctrl_message, TEST_START);
 
 		while (total_pkts_to_tx > 0) {
-			if (total_pkts_to_tx >= PCKT_FRAG_MAX) {
-				packets_to_send = PCKT_FRAG_MAX;
+			if (total_pkts_to_tx >= (uint64_t)pckt_batch) {
+				packets_to_send = pckt_batch;
 			} else {
 				packets_to_send = total_pkts_to_tx;
 			}
@@ -904,9 +1493,9 @@ static void send_perf_data_by_size(void)
 
 		sleep(2);
 
-		knet_send(knet_h, ctrl_message, TEST_STOP, channel);
+		bench_send(ctrl_message, TEST_STOP);
 
-		if (packetsize == KNET_MAX_PACKET_SIZE) {
+		if (packetsize == max_pckt_size) {
 			break;
 		}
 
@@ -916,14 +1505,14 @@ static void send_perf_data_by_size(void)
 		 */
 		packetsize *= 4;
 
-		if (packetsize > KNET_MAX_PACKET_SIZE) {
-			packetsize = KNET_MAX_PACKET_SIZE;
+		if (packetsize > max_pckt_size) {
+			packetsize = max_pckt_size;
 		}
 	}
 
-	knet_send(knet_h, ctrl_message, TEST_COMPLETE, channel);
+	bench_send(ctrl_message, TEST_COMPLETE);
 
-	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+	for (i = 0; i < pckt_batch; i++) {
 		free(tx_buf[i]);
 	}
 }
@@ -943,6 +1532,7 @@ static void display_stats(int level)
 {
 	struct knet_handle_stats handle_stats;
 	struct knet_link_status link_status;
+	struct knet_link_latency_histogram latency_histogram;
 	struct knet_link_stats total_link_stats;
 	knet_node_id_t host_list[KNET_MAX_HOST];
 	uint8_t link_list[KNET_MAX_LINK];
@@ -990,6 +1580,39 @@ static void display_stats(int level)
 			printf("[stat]:  rx_crypt_time_max: %" PRIu64 "\n", handle_stats.rx_crypt_time_max);
 			printf("\n");
 		}
+		if (reliable) {
+			printf("[stat]:  tx_reliable_retransmits: %" PRIu64 "\n", handle_stats.tx_reliable_retransmits);
+			printf("[stat]:  tx_reliable_lost: %" PRIu64 "\n", handle_stats.tx_reliable_lost);
+			printf("[stat]:  rx_reliable_duplicates: %" PRIu64 "\n", handle_stats.rx_reliable_duplicates);
+			printf("[stat]:  rx_reliable_out_of_order: %" PRIu64 "\n", handle_stats.rx_reliable_out_of_order);
+			printf("\n");
+		}
+		if (fec_group) {
+			printf("[stat]:  tx_fec_packets: %" PRIu64 "\n", handle_stats.tx_fec_packets);
+			printf("[stat]:  rx_fec_rebuilt: %" PRIu64 "\n", handle_stats.rx_fec_rebuilt);
+			printf("\n");
+		}
+		if (max_pckt_size > KNET_MAX_PACKET_SIZE) {
+			printf("[stat]:  tx_large_messages: %" PRIu64 "\n", handle_stats.tx_large_messages);
+			printf("[stat]:  rx_large_messages: %" PRIu64 "\n", handle_stats.rx_large_messages);
+			printf("\n");
+		}
+		if (relay) {
+			printf("[stat]:  tx_relayed_packets: %" PRIu64 "\n", handle_stats.tx_relayed_packets);
+			printf("[stat]:  rx_relayed_packets: %" PRIu64 "\n", handle_stats.rx_relayed_packets);
+			printf("[stat]:  rx_relay_forwarded: %" PRIu64 "\n", handle_stats.rx_relay_forwarded);
+			printf("\n");
+		}
+		if ((bcast_tree) || (handle_stats.rx_bcast_tree_forwarded)) {
+			printf("[stat]:  tx_bcast_tree_packets: %" PRIu64 "\n", handle_stats.tx_bcast_tree_packets);
+			printf("[stat]:  rx_bcast_tree_forwarded: %" PRIu64 "\n", handle_stats.rx_bcast_tree_forwarded);
+			printf("\n");
+		}
+		if (mcastcfg) {
+			printf("[stat]:  tx_mcast_packets: %" PRIu64 "\n", handle_stats.tx_mcast_packets);
+			printf("[stat]:  rx_mcast_packets: %" PRIu64 "\n", handle_stats.rx_mcast_packets);
+			printf("\n");
+		}
 	}
 	if (level < 2) {
 		return;
@@ -1052,6 +1675,7 @@ static void display_stats(int level)
 			total_link_stats.tx_pong_retries += link_status.stats.tx_pong_retries;
 			total_link_stats.tx_data_errors += link_status.stats.tx_data_errors;
 			total_link_stats.tx_data_retries += link_status.stats.tx_data_retries;
+			total_link_stats.tx_data_failovers += link_status.stats.tx_data_failovers;
 
 			total_link_stats.down_count += link_status.stats.down_count;
 			total_link_stats.up_count += link_status.stats.up_count;
@@ -1092,11 +1716,27 @@ static void display_stats(int level)
 				printf("[stat]:   tx_pong_retries:  %" PRIu32 "\n", link_status.stats.tx_pong_retries);
 				printf("[stat]:   tx_data_errors:   %" PRIu32 "\n", link_status.stats.tx_data_errors);
 				printf("[stat]:   tx_data_retries:  %" PRIu32 "\n", link_status.stats.tx_data_retries);
+				printf("[stat]:   tx_data_failovers: %" PRIu64 "\n", link_status.stats.tx_data_failovers);
 
 				printf("[stat]:   latency_min:      %" PRIu32 "\n", link_status.stats.latency_min);
 				printf("[stat]:   latency_max:      %" PRIu32 "\n", link_status.stats.latency_max);
 				printf("[stat]:   latency_ave:      %" PRIu32 "\n", link_status.stats.latency_ave);
 				printf("[stat]:   latency_samples:  %" PRIu32 "\n", link_status.stats.latency_samples);
+				printf("[stat]:   latency_jitter:   %" PRIu32 "\n", link_status.stats.latency_jitter);
+				printf("[stat]:   bw_capacity:      %" PRIu32 "\n", link_status.bw_capacity);
+				printf("[stat]:   bw_delivered:     %" PRIu32 "\n", link_status.bw_delivered);
+				printf("[stat]:   bw_available:     %" PRIu32 "\n", link_status.bw_available);
+				printf("[stat]:   cc_rate:          %" PRIu32 "\n", link_status.cc_rate);
+				printf("[stat]:   cc_queue_delay:   %" PRIu32 "\n", link_status.cc_queue_delay);
+				printf("[stat]:   rx_sock_drops:    %" PRIu32 "\n", link_status.stats.rx_sock_drops);
+				printf("[stat]:   sock_rcvbuf:      %" PRIu32 "\n", link_status.stats.sock_rcvbuf);
+				printf("[stat]:   sock_sndbuf:      %" PRIu32 "\n", link_status.stats.sock_sndbuf);
+				if (knet_link_get_latency_histogram(knet_h, host_list[j], link_list[i],
+								    &latency_histogram, sizeof(latency_histogram)) == 0) {
+					printf("[stat]:   latency_p50:      %" PRIu32 "\n", latency_histogram.p50);
+					printf("[stat]:   latency_p99:      %" PRIu32 "\n", latency_histogram.p99);
+					printf("[stat]:   latency_p999:     %" PRIu32 "\n", latency_histogram.p999);
+				}
 
 				printf("[stat]:   down_count:       %" PRIu32 "\n", link_status.stats.down_count);
 				printf("[stat]:   up_count:         %" PRIu32 "\n", link_status.stats.up_count);
@@ -1138,6 +1778,7 @@ static void display_stats(int level)
 	printf("[stat]: tx_pong_retries:  %" PRIu32 "\n", total_link_stats.tx_pong_retries);
 	printf("[stat]: tx_data_errors:   %" PRIu32 "\n", total_link_stats.tx_data_errors);
 	printf("[stat]: tx_data_retries:  %" PRIu32 "\n", total_link_stats.tx_data_retries);
+	printf("[stat]: tx_data_failovers: %" PRIu64 "\n", total_link_stats.tx_data_failovers);
 
 	printf("[stat]: down_count:       %" PRIu32 "\n", total_link_stats.down_count);
 	printf("[stat]: up_count:         %" PRIu32 "\n", total_link_stats.up_count);
@@ -1161,14 +1802,14 @@ static void send_perf_data_by_time(void)
 	memset(&clock_start, 0, sizeof(clock_start));
 	memset(&clock_end, 0, sizeof(clock_start));
 
-	while (packetsize <= KNET_MAX_PACKET_SIZE) {
-		for (i = 0; i < PCKT_FRAG_MAX; i++) {
+	while (packetsize <= max_pckt_size) {
+		for (i = 0; i < pckt_batch; i++) {
 			iov_out[i].iov_len = packetsize;
 		}
 		printf("[info]: testing with %u bytes packet size for %" PRIu64 " seconds.\n", packetsize, perf_by_time_secs);
 
 		memset(ctrl_message, 0, sizeof(ctrl_message));
-		knet_send(knet_h, ctrl_message, TEST_START, channel);
+		bench_send(ctrl_message, TEST_START);
 
 		if (clock_gettime(CLOCK_MONOTONIC, &clock_start) != 0) {
 			printf("[info]: unable to get start time!\n");
@@ -1177,7 +1818,7 @@ static void send_perf_data_by_time(void)
 		time_diff = 0;
 
 		while (time_diff < (perf_by_time_secs * 1000000000llu)) {
-			sent_msgs = send_messages(&msg[0], PCKT_FRAG_MAX);
+			sent_msgs = send_messages(&msg[0], pckt_batch);
 			if (sent_msgs < 0) {
 				printf("Something went wrong, aborting\n");
 				exit(FAIL);
@@ -1190,9 +1831,9 @@ static void send_perf_data_by_time(void)
 
 		sleep(2);
 
-		knet_send(knet_h, ctrl_message, TEST_STOP, channel);
+		bench_send(ctrl_message, TEST_STOP);
 
-		if (packetsize == KNET_MAX_PACKET_SIZE) {
+		if (packetsize == max_pckt_size) {
 			break;
 		}
 
@@ -1202,18 +1843,193 @@ static void send_perf_data_by_time(void)
 		 */
 		packetsize *= 4;
 
-		if (packetsize > KNET_MAX_PACKET_SIZE) {
-			packetsize = KNET_MAX_PACKET_SIZE;
+		if (packetsize > max_pckt_size) {
+			packetsize = max_pckt_size;
+		}
+	}
+
+	bench_send(ctrl_message, TEST_COMPLETE);
+
+	for (i = 0; i < pckt_batch; i++) {
+		free(tx_buf[i]);
+	}
+}
+
+static void send_failover_data(void)
+{
+	char *tx_buf[PCKT_FRAG_MAX];
+	struct knet_mmsghdr msg[PCKT_FRAG_MAX];
+	struct iovec iov_out[PCKT_FRAG_MAX];
+	char ctrl_message[16];
+	int i;
+	int links_failed = 0;
+	uint64_t seq = 0;
+	struct timespec clock_start, clock_end;
+	unsigned long long time_diff = 0;
+
+	setup_send_buffers_common(msg, iov_out, tx_buf);
+	iov_out[0].iov_len = FAILOVER_PCKT_SIZE;
+
+	printf("[info]: streaming %u bytes packets for %" PRIu64 " seconds, failing active links after %" PRIu64 " seconds.\n",
+	       FAILOVER_PCKT_SIZE, perf_by_time_secs, perf_by_time_secs / 2);
+
+	memset(ctrl_message, 0, sizeof(ctrl_message));
+	bench_send(ctrl_message, TEST_START);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &clock_start) != 0) {
+		printf("[info]: unable to get start time!\n");
+	}
+
+	while (time_diff < (perf_by_time_secs * 1000000000llu)) {
+		memmove(tx_buf[0], &seq, sizeof(seq));
+		if (send_messages(&msg[0], 1) < 0) {
+			printf("Something went wrong, aborting\n");
+			exit(FAIL);
 		}
+		seq++;
+
+		if ((!links_failed) &&
+		    (time_diff >= (perf_by_time_secs * 1000000000llu) / 2)) {
+			/*
+			 * the receivers drop our packets and we drop theirs,
+			 * the path is dead both ways
+			 */
+			bench_send(ctrl_message, TEST_FAIL_LINKS);
+			fail_active_links(-1);
+			links_failed = 1;
+		}
+
+		usleep(FAILOVER_PCKT_INTERVAL);
+
+		if (clock_gettime(CLOCK_MONOTONIC, &clock_end) != 0) {
+			printf("[info]: unable to get end time!\n");
+		}
+		timespec_diff(clock_start, clock_end, &time_diff);
 	}
 
-	knet_send(knet_h, ctrl_message, TEST_COMPLETE, channel);
+	sleep(2);
+
+	bench_send(ctrl_message, TEST_STOP);
 
-	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+	restore_failed_links();
+
+	bench_send(ctrl_message, TEST_COMPLETE);
+
+	for (i = 0; i < pckt_batch; i++) {
 		free(tx_buf[i]);
 	}
 }
 
+static int latency_compare(const void *aptr, const void *bptr)
+{
+	const unsigned long long *a = aptr;
+	const unsigned long long *b = bptr;
+
+	if (*a < *b) {
+		return -1;
+	}
+	if (*a > *b) {
+		return 1;
+	}
+	return 0;
+}
+
+static void send_latency_data(void)
+{
+	char tx_buf[LATENCY_PCKT_SIZE];
+	char ctrl_message[16];
+	unsigned long long *samples;
+	unsigned long long total = 0;
+	uint64_t seq = 0, count = 0, lost = 0;
+	struct timespec clock_start, clock_now, deadline;
+	unsigned long long time_diff = 0;
+	int err;
+
+	samples = malloc(LATENCY_MAX_SAMPLES * sizeof(unsigned long long));
+	if (!samples) {
+		printf("TXT: Unable to malloc!\n");
+		exit(FAIL);
+	}
+
+	memset(tx_buf, 0, sizeof(tx_buf));
+
+	printf("[info]: measuring round trip time of %u bytes packets for %" PRIu64 " seconds.\n",
+	       LATENCY_PCKT_SIZE, perf_by_time_secs);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &clock_start) != 0) {
+		printf("[info]: unable to get start time!\n");
+	}
+
+	while ((time_diff < (perf_by_time_secs * 1000000000llu)) && (count < LATENCY_MAX_SAMPLES)) {
+		seq++;
+		memmove(tx_buf, &seq, sizeof(seq));
+		clock_gettime(CLOCK_MONOTONIC, &clock_now);
+		memmove(tx_buf + sizeof(seq), &clock_now, sizeof(clock_now));
+
+		pthread_mutex_lock(&latency_mutex);
+		if (bench_send(tx_buf, LATENCY_PCKT_SIZE) != LATENCY_PCKT_SIZE) {
+			printf("[info]: Error sending latency packet: %s\n", strerror(errno));
+			pthread_mutex_unlock(&latency_mutex);
+			usleep(KNET_THREADS_TIMER_RES / 16);
+			continue;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += LATENCY_REPLY_TIMEOUT;
+		err = 0;
+		while ((latency_reply_seq != seq) && (err != ETIMEDOUT)) {
+			err = pthread_cond_timedwait(&latency_cond, &latency_mutex, &deadline);
+		}
+		if (latency_reply_seq == seq) {
+			samples[count] = latency_reply_rtt;
+			total += latency_reply_rtt;
+			count++;
+		} else {
+			lost++;
+		}
+		pthread_mutex_unlock(&latency_mutex);
+
+		if (clock_gettime(CLOCK_MONOTONIC, &clock_now) != 0) {
+			printf("[info]: unable to get end time!\n");
+		}
+		timespec_diff(clock_start, clock_now, &time_diff);
+	}
+
+	memset(ctrl_message, 0, sizeof(ctrl_message));
+	bench_send(ctrl_message, TEST_COMPLETE);
+
+	if (!count) {
+		printf("[latency] no replies received (lost: %" PRIu64 ")\n", lost);
+		free(samples);
+		return;
+	}
+
+	qsort(samples, count, sizeof(unsigned long long), latency_compare);
+
+	if (!machine_output) {
+		printf("[latency] round trip time (usecs) samples: %" PRIu64 " lost: %" PRIu64
+		       " min: %.1f avg: %.1f p50: %.1f p99: %.1f p999: %.1f max: %.1f\n",
+		       count, lost,
+		       (double)samples[0] / 1000,
+		       (double)total / count / 1000,
+		       (double)samples[count / 2] / 1000,
+		       (double)samples[(count * 99) / 100] / 1000,
+		       (double)samples[(count * 999) / 1000] / 1000,
+		       (double)samples[count - 1] / 1000);
+	} else {
+		printf("[latency],%" PRIu64 ",%" PRIu64 ",%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+		       count, lost,
+		       (double)samples[0] / 1000,
+		       (double)total / count / 1000,
+		       (double)samples[count / 2] / 1000,
+		       (double)samples[(count * 99) / 100] / 1000,
+		       (double)samples[(count * 999) / 1000] / 1000,
+		       (double)samples[count - 1] / 1000);
+	}
+
+	free(samples);
+}
+
 static void cleanup_all(void)
 {
 	if (pthread_mutex_lock(&shutdown_mutex)) {
@@ -1284,6 +2100,26 @@ restart:
 				}
 			}
 			break;
+		case TEST_FAILOVER:
+			if (senderid == thisnodeid) {
+				send_failover_data();
+			} else {
+				printf("[info]: waiting for failover rx thread to finish\n");
+				while(!wait_for_perf_rx) {
+					sleep(1);
+				}
+			}
+			break;
+		case TEST_LATENCY:
+			if (senderid == thisnodeid) {
+				send_latency_data();
+			} else {
+				printf("[info]: waiting for latency rx thread to finish\n");
+				while(!wait_for_perf_rx) {
+					sleep(1);
+				}
+			}
+			break;
 	}
 	if (continous) {
 		goto restart;
@@ -13,6 +13,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
@@ -178,6 +179,25 @@ int is_helgrind(void)
 	return 0;
 }
 
+/*
+ * hosts that are known to support SCTP set KNETSCTP=yes,
+ * so that the SCTP tests fail instead of being skipped
+ */
+int is_sctp_required(void)
+{
+	char *val;
+
+	val = getenv("KNETSCTP");
+
+	if (val) {
+		if (!strncmp(val, "yes", 3)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 void set_scheduler(int policy)
 {
 	struct sched_param sched_param;
@@ -515,3 +535,205 @@ try_again:
 
 	return -1;
 }
+
+static int channel_flag_private_data;
+
+static void channel_flag_sock_notify(void *pvt_data,
+				     int datafd,
+				     int8_t channel,
+				     uint8_t tx_rx,
+				     int error,
+				     int errorno)
+{
+	return;
+}
+
+static void channel_flag_fail(knet_handle_t knet_h, int logfds[2])
+{
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+	exit(FAIL);
+}
+
+/*
+ * add a datafd to knet_h, the channel it got is returned in channel
+ */
+static void channel_flag_add_datafd(knet_handle_t knet_h, int logfds[2], int *datafd, int8_t *channel)
+{
+	*datafd = 0;
+	*channel = -1;
+
+	if (knet_handle_add_datafd(knet_h, datafd, channel) < 0) {
+		printf("knet_handle_add_datafd failed: %s\n", strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+}
+
+/*
+ * the checks common to set and get, with an unconfigured handle
+ */
+static knet_handle_t channel_flag_start(const char *name, int logfds[2],
+					channel_flag_set_t set_flag, channel_flag_get_t get_flag)
+{
+	knet_handle_t knet_h;
+	int8_t channel;
+	unsigned int enabled;
+	int i;
+
+	printf("Test %s incorrect knet_h\n", name);
+
+	if (((set_flag) && ((!set_flag(NULL, 0, 1)) || (errno != EINVAL))) ||
+	    ((get_flag) && ((!get_flag(NULL, 0, &enabled)) || (errno != EINVAL)))) {
+		printf("%s accepted invalid knet_h or returned incorrect error: %s\n", name, strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h = knet_handle_start(logfds, KNET_LOG_DEBUG);
+
+	for (i = 0; i < 3; i++) {
+		switch (i) {
+			case 0:
+				printf("Test %s with invalid channel (< 0)\n", name);
+				channel = -1;
+				break;
+			case 1:
+				printf("Test %s with invalid channel (KNET_DATAFD_MAX)\n", name);
+				channel = KNET_DATAFD_MAX;
+				break;
+			default:
+				printf("Test %s with unconfigured channel\n", name);
+				channel = 10;
+				break;
+		}
+
+		if (((set_flag) && ((!set_flag(knet_h, channel, 1)) || (errno != EINVAL))) ||
+		    ((get_flag) && ((!get_flag(knet_h, channel, &enabled)) || (errno != EINVAL)))) {
+			printf("%s accepted invalid channel or returned incorrect error: %s\n", name, strerror(errno));
+			channel_flag_fail(knet_h, logfds);
+		}
+
+		flush_logs(logfds[0], stdout);
+	}
+
+	if (knet_handle_enable_sock_notify(knet_h, &channel_flag_private_data, channel_flag_sock_notify) < 0) {
+		printf("knet_handle_enable_sock_notify failed: %s\n", strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	return knet_h;
+}
+
+static void channel_flag_expect(const char *name, knet_handle_t knet_h, int logfds[2],
+				channel_flag_get_t get_flag, int8_t channel, unsigned int expected)
+{
+	unsigned int enabled = !expected;
+
+	if (get_flag(knet_h, channel, &enabled) < 0) {
+		printf("%s failed to get the flag: %s\n", name, strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	if (enabled != expected) {
+		printf("%s: flag is %u, expected %u\n", name, enabled, expected);
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	flush_logs(logfds[0], stdout);
+}
+
+void test_channel_flag_set(const char *name, channel_flag_set_t set_flag, channel_flag_get_t get_flag)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	int datafd;
+	int8_t channel;
+
+	knet_h = channel_flag_start(name, logfds, set_flag, NULL);
+
+	channel_flag_add_datafd(knet_h, logfds, &datafd, &channel);
+
+	printf("Test %s with invalid enabled\n", name);
+
+	if ((!set_flag(knet_h, channel, 2)) || (errno != EINVAL) ||
+	    (!set_flag(knet_h, channel, UINT_MAX)) || (errno != EINVAL)) {
+		printf("%s accepted invalid enabled or returned incorrect error: %s\n", name, strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	channel_flag_expect(name, knet_h, logfds, get_flag, channel, 0);
+
+	printf("Test %s with valid channel\n", name);
+
+	if (set_flag(knet_h, channel, 1) < 0) {
+		printf("%s failed: %s\n", name, strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	channel_flag_expect(name, knet_h, logfds, get_flag, channel, 1);
+
+	if (set_flag(knet_h, channel, 0) < 0) {
+		printf("%s failed: %s\n", name, strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	channel_flag_expect(name, knet_h, logfds, get_flag, channel, 0);
+
+	printf("Test %s flag is reset on datafd removal\n", name);
+
+	if (set_flag(knet_h, channel, 1) < 0) {
+		printf("%s failed: %s\n", name, strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	if (knet_handle_remove_datafd(knet_h, datafd) < 0) {
+		printf("knet_handle_remove_datafd failed: %s\n", strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	channel_flag_add_datafd(knet_h, logfds, &datafd, &channel);
+
+	channel_flag_expect(name, knet_h, logfds, get_flag, channel, 0);
+
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
+
+void test_channel_flag_get(const char *name, channel_flag_set_t set_flag, channel_flag_get_t get_flag)
+{
+	knet_handle_t knet_h;
+	int logfds[2];
+	int datafd;
+	int8_t channel;
+
+	knet_h = channel_flag_start(name, logfds, NULL, get_flag);
+
+	channel_flag_add_datafd(knet_h, logfds, &datafd, &channel);
+
+	printf("Test %s with incorrect enabled\n", name);
+
+	if ((!get_flag(knet_h, channel, NULL)) || (errno != EINVAL)) {
+		printf("%s accepted invalid enabled or returned incorrect error: %s\n", name, strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Test %s with valid channel\n", name);
+
+	channel_flag_expect(name, knet_h, logfds, get_flag, channel, 0);
+
+	if (set_flag(knet_h, channel, 1) < 0) {
+		printf("setting the flag failed: %s\n", strerror(errno));
+		channel_flag_fail(knet_h, logfds);
+	}
+
+	channel_flag_expect(name, knet_h, logfds, get_flag, channel, 1);
+
+	knet_handle_free(knet_h);
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+}
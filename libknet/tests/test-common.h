@@ -36,6 +36,7 @@ int execute_shell(const char *command, char **error_string);
 
 int is_memcheck(void);
 int is_helgrind(void);
+int is_sctp_required(void);
 
 void set_scheduler(int policy);
 
@@ -71,4 +72,14 @@ int make_local_sockaddr(struct sockaddr_storage *lo, uint16_t offset);
 int wait_for_host(knet_handle_t knet_h, uint16_t host_id, int seconds, int logfd, FILE *std);
 int wait_for_packet(knet_handle_t knet_h, int seconds, int datafd);
 
+/*
+ * per channel flags (knet_handle_set_channel_bulk(3) and friends) share
+ * the same API. Both exit(FAIL) on error.
+ */
+typedef int (*channel_flag_set_t)(knet_handle_t knet_h, const int8_t channel, unsigned int enabled);
+typedef int (*channel_flag_get_t)(knet_handle_t knet_h, const int8_t channel, unsigned int *enabled);
+
+void test_channel_flag_set(const char *name, channel_flag_set_t set_flag, channel_flag_get_t get_flag);
+void test_channel_flag_get(const char *name, channel_flag_set_t set_flag, channel_flag_get_t get_flag);
+
 #endif
@@ -16,9 +16,13 @@
 #include <time.h>
 
 #include "crypto.h"
+#include "host.h"
 #include "links.h"
 #include "logging.h"
+#include "relay.h"
 #include "transports.h"
+#include "transport_common.h"
+#include "transport_mcast.h"
 #include "threads_common.h"
 #include "threads_heartbeat.h"
 
@@ -35,11 +39,82 @@ static void _link_down(knet_handle_t knet_h, struct knet_host *dst_host, struct
 	}
 }
 
+/*
+ * bandwidth estimation
+ *
+ * every bw_probe_interval a train of bw_probe_count packets of the link
+ * MTU size is sent back to back on the link. The time between the first
+ * and the last packet of the train at the remote node is bound by the
+ * narrowest hop of the path (packet pair/train dispersion), the remote
+ * node turns it into a capacity estimate and reports it in the pongs
+ * together with the data rate it has received on the link
+ * (see threads_rx.c). Probes are never retransmitted or acknowledged,
+ * a train with lost or reordered packets is simply ignored.
+ */
+static void _handle_bwprobe(knet_handle_t knet_h, struct knet_link *dst_link, struct timespec clock_now)
+{
+	ssize_t len, outlen, probelen;
+	unsigned long long diff_probe;
+	unsigned char *outbuf;
+	uint8_t i;
+
+	if ((!dst_link->bw_probe_interval) ||
+	    (!dst_link->status.connected) ||
+	    (!dst_link->has_valid_mtu)) {
+		return;
+	}
+
+	timespec_diff(dst_link->bw_probe_last, clock_now, &diff_probe);
+	if (diff_probe < (dst_link->bw_probe_interval * 1000000llu)) {
+		return;
+	}
+	dst_link->bw_probe_last = clock_now;
+
+	probelen = KNET_HEADER_DATA_SIZE + dst_link->status.mtu;
+	if (probelen > KNET_PMTUD_SIZE_V6) {
+		probelen = KNET_PMTUD_SIZE_V6;
+	}
+
+	dst_link->bw_probe_id++;
+	knet_h->bwprobebuf->khp_bwprobe_link = dst_link->link_id;
+	knet_h->bwprobebuf->khp_bwprobe_id = htonl(dst_link->bw_probe_id);
+	knet_h->bwprobebuf->khp_bwprobe_count = dst_link->bw_probe_count;
+
+	for (i = 0; i < dst_link->bw_probe_count; i++) {
+		knet_h->bwprobebuf->khp_bwprobe_seq = i;
+		outbuf = (unsigned char *)knet_h->bwprobebuf;
+		outlen = probelen;
+
+		if (knet_h->crypto_instance) {
+			if (crypto_encrypt_and_sign(knet_h,
+						    (const unsigned char *)knet_h->bwprobebuf,
+						    probelen,
+						    knet_h->bwprobebuf_crypt,
+						    &outlen) < 0) {
+				log_debug(knet_h, KNET_SUB_HEARTBEAT, "Unable to crypto bandwidth probe packet");
+				return;
+			}
+			outbuf = knet_h->bwprobebuf_crypt;
+		}
+
+		len = transport_link_sendto(knet_h, dst_link, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (len != outlen) {
+			/*
+			 * the remote node will drop the incomplete train
+			 */
+			log_debug(knet_h, KNET_SUB_HEARTBEAT,
+				  "Unable to send bandwidth probe (sock: %d): %s",
+				  dst_link->outsock, strerror(errno));
+			return;
+		}
+	}
+}
+
 static void _handle_check_each(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, int timed)
 {
 	int err = 0, savederrno = 0;
 	int len;
-	ssize_t outlen = KNET_HEADER_PING_SIZE;
+	ssize_t outlen = KNET_HEADER_PING_EXT_SIZE;
 	struct timespec clock_now, pong_last;
 	unsigned long long diff_ping;
 	unsigned char *outbuf = (unsigned char *)knet_h->pingbuf;
@@ -62,6 +137,9 @@ static void _handle_check_each(knet_handle_t knet_h, struct knet_host *dst_host,
 	if ((diff_ping >= (dst_link->ping_interval * 1000llu)) || (!timed)) {
 		memmove(&knet_h->pingbuf->khp_ping_time[0], &clock_now, sizeof(struct timespec));
 		knet_h->pingbuf->khp_ping_link = dst_link->link_id;
+		if (_mcast_is_member(knet_h, dst_link->link_id)) {
+			knet_h->pingbuf->khp_ping_link |= KNET_PING_LINK_MCAST;
+		}
 		if (pthread_mutex_lock(&knet_h->tx_seq_num_mutex)) {
 			log_debug(knet_h, KNET_SUB_HEARTBEAT, "Unable to get seq mutex lock");
 			return;
@@ -85,9 +163,10 @@ static void _handle_check_each(knet_handle_t knet_h, struct knet_host *dst_host,
 		}
 
 retry:
-		len = sendto(dst_link->outsock, outbuf, outlen,
-			MSG_DONTWAIT | MSG_NOSIGNAL, (struct sockaddr *) &dst_link->dst_addr,
-			sizeof(struct sockaddr_storage));
+		if (dst_link->flags & KNET_LINK_FLAG_TIMESTAMP) {
+			clock_gettime(CLOCK_MONOTONIC, &dst_link->ping_sent);
+		}
+		len = transport_link_sendto_ctrl(knet_h, dst_link, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
 		savederrno = errno;
 
 		dst_link->ping_last = clock_now;
@@ -114,9 +193,18 @@ retry:
 			}
 		} else {
 			dst_link->last_ping_size = outlen;
+			/*
+			 * the pong will tell us if the data sent so far made it
+			 */
+			dst_link->pmtud_tx_data_check = dst_link->pmtud_tx_data_max;
+			dst_link->pmtud_tx_data_max = 0;
 		}
 	}
 
+	if (timed) {
+		_handle_bwprobe(knet_h, dst_link, clock_now);
+	}
+
 	timespec_diff(pong_last, clock_now, &diff_ping);
 	if ((pong_last.tv_nsec) && 
 	    (diff_ping >= (dst_link->pong_timeout_adj * 1000llu))) {
@@ -181,6 +269,28 @@ static void _adjust_pong_timeouts(knet_handle_t knet_h)
 	pthread_mutex_unlock(&knet_h->backoff_mutex);
 }
 
+static void _update_sockbufs(knet_handle_t knet_h)
+{
+	struct knet_host *dst_host;
+	struct knet_link *dst_link;
+	int link_idx;
+
+	knet_h->sockbuf_pass++;
+
+	for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
+		for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+			dst_link = &dst_host->link[link_idx];
+
+			if ((dst_link->status.enabled != 1) ||
+			    ((dst_link->transport_type != KNET_TRANSPORT_UDP) &&
+			     (dst_link->transport_type != KNET_TRANSPORT_SCTP)))
+				continue;
+
+			_sockbuf_update(knet_h, dst_link);
+		}
+	}
+}
+
 void *_handle_heartbt_thread(void *data)
 {
 	knet_handle_t knet_h = (knet_handle_t) data;
@@ -192,6 +302,17 @@ void *_handle_heartbt_thread(void *data)
 	knet_h->pingbuf->kh_version = KNET_HEADER_VERSION;
 	knet_h->pingbuf->kh_type = KNET_HEADER_TYPE_PING;
 	knet_h->pingbuf->kh_node = htons(knet_h->host_id);
+	((struct knet_header_ping_ext *)knet_h->pingbuf->khp_ping_ext)->kpe_caps = htonl(KNET_CAPS);
+
+	/* preparing bandwidth probe buffer */
+	knet_h->bwprobebuf->kh_version = KNET_HEADER_VERSION;
+	knet_h->bwprobebuf->kh_type = KNET_HEADER_TYPE_BWPROBE;
+	knet_h->bwprobebuf->kh_node = htons(knet_h->host_id);
+
+	/* preparing flow control credit buffer */
+	knet_h->creditbuf->kh_version = KNET_HEADER_VERSION;
+	knet_h->creditbuf->kh_type = KNET_HEADER_TYPE_CREDIT;
+	knet_h->creditbuf->kh_node = htons(knet_h->host_id);
 
 	while (!shutdown_in_progress(knet_h)) {
 		usleep(knet_h->threads_timer_res);
@@ -202,16 +323,20 @@ void *_handle_heartbt_thread(void *data)
 		}
 
 		/*
-		 *  _adjust_pong_timeouts should execute approx once a second.
+		 *  _adjust_pong_timeouts, _relay_update and _update_sockbufs
+		 *  should execute approx once a second.
 		 */
 		if ((i % (1000000 / knet_h->threads_timer_res)) == 0) {
 			_adjust_pong_timeouts(knet_h);
+			_relay_update(knet_h);
+			_update_sockbufs(knet_h);
 			i = 1;
 		} else {
 			i++;
 		}
 
 		_send_pings(knet_h, 1);
+		_host_fc_send_credits(knet_h);
 
 		pthread_rwlock_unlock(&knet_h->global_rwlock);
 	}
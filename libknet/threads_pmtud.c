@@ -22,148 +22,159 @@
 #include "threads_common.h"
 #include "threads_pmtud.h"
 
-static int _handle_check_link_pmtud(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link)
-{
-	int err, ret, savederrno, mutex_retry_limit, failsafe, use_kernel_mtu, warn_once;
-	uint32_t kernel_mtu; /* record kernel_mtu from EMSGSIZE */
-	size_t onwire_len;   /* current packet onwire size */
-	size_t overhead_len; /* onwire packet overhead (protocol based) */
-	size_t max_mtu_len;  /* max mtu for protocol */
-	size_t data_len;     /* how much data we can send in the packet
-			      * generally would be onwire_len - overhead_len
-			      * needs to be adjusted for crypto
-			      */
-	size_t pad_len;	     /* crypto packet pad size, needs to move into crypto.c callbacks */
-	ssize_t len;	     /* len of what we were able to sendto onwire */
+/*
+ * PMTUd probes every link that needs it at the same time.
+ * In each round up to KNET_PMTUD_PROBES probes of different sizes
+ * are sent to each link, then we wait once for all the replies.
+ * The other node echoes back the probe onwire size, that is unique
+ * within a link round and is used as probe id.
+ * Each round narrows [last_good_mtu, last_bad_mtu] for all links,
+ * and costs roughly one RTT (or pong_timeout if packets are lost)
+ * independently of how many links we are probing.
+ */
 
-	struct timespec ts;
-	unsigned long long pong_timeout_adj_tmp;
-	unsigned char *outbuf = (unsigned char *)knet_h->pmtudbuf;
+/*
+ * Once a link MTU is known, PMTUd doesn't blindly search again every
+ * pmtud_interval (see RFC8899 for the general idea):
+ *
+ * - the kernel (EMSGSIZE) or the network (ICMP frag needed / packet too big)
+ *   telling us that a packet to a link destination is bigger than the path
+ *   MTU triggers an immediate run for that link only, using the reported
+ *   value as upper bound (_pmtud_link_too_big).
+ * - every pong reports the biggest data packet received on the link.
+ *   If the big data packets we send keep going missing, the path is
+ *   a black hole for that size and the link is searched again from scratch.
+ *   If they arrive, the current MTU is validated by real traffic
+ *   (_pmtud_link_validate).
+ * - a validated link is only probed upwards at the next interval, looking
+ *   for an MTU increase.
+ */
 
-	warn_once = 0;
+/*
+ * how many pongs in a row have to report missing big data packets
+ * before we declare the path a black hole for the current MTU
+ */
+#define KNET_PMTUD_BLACKHOLE_PONGS 3
 
-	mutex_retry_limit = 0;
-	failsafe = 0;
-	pad_len = 0;
+/*
+ * how many rounds a probe size has to go unacked before we take it
+ * as too big. A lost probe alone is not a reason to cap the link MTU,
+ * only EMSGSIZE and ICMP lower last_bad_mtu right away.
+ */
+#define KNET_PMTUD_LOST_PROBES 3
 
-	dst_link->last_bad_mtu = 0;
+/*
+ * To bisect from 576 to 128000 one probe at a time doesn't take more than
+ * 18/19 steps. Multiple probes per round converge a lot faster, anything
+ * above this limit means MTU is changing during discovery.
+ */
+#define KNET_PMTUD_MAX_ROUNDS 30
 
-	knet_h->pmtudbuf->khp_pmtud_link = dst_link->link_id;
+#define KNET_PMTUD_PROBE_SENT    0
+#define KNET_PMTUD_PROBE_TOO_BIG 1
+#define KNET_PMTUD_PROBE_SKIPPED 2
+#define KNET_PMTUD_PROBE_FAILED  3
 
-	switch (dst_link->dst_addr.ss_family) {
-		case AF_INET6:
-			max_mtu_len = KNET_PMTUD_SIZE_V6;
-			overhead_len = KNET_PMTUD_OVERHEAD_V6 + dst_link->proto_overhead;
-			dst_link->last_good_mtu = dst_link->last_ping_size + overhead_len;
-			break;
-		case AF_INET:
-			max_mtu_len = KNET_PMTUD_SIZE_V4;
-			overhead_len = KNET_PMTUD_OVERHEAD_V4 + dst_link->proto_overhead;
-			dst_link->last_good_mtu = dst_link->last_ping_size + overhead_len;
-			break;
-		default:
-			log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD aborted, unknown protocol");
-			return -1;
-			break;
-	}
-
-	/*
-	 * discovery starts from the top because kernel will
-	 * refuse to send packets > current iface mtu.
-	 * this saves us some time and network bw.
-	 */ 
-	onwire_len = max_mtu_len;
+/*
+ * build the probe for a requested onwire size.
+ * With crypto, packet sizes are constrained by block size and crypto
+ * headers, so the probe can be smaller than requested.
+ * Returns the real probe onwire size, 0 on error.
+ */
+static size_t _pmtud_build_probe(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link,
+				 size_t onwire_len, size_t *data_len, unsigned char **outbuf)
+{
+	size_t overhead_len = dst_link->pmtud_overhead;
+	size_t max_mtu_len = dst_link->pmtud_max_mtu;
+	size_t pad_len = 0;	/* crypto packet pad size, needs to move into crypto.c callbacks */
 
-restart:
+	*outbuf = (unsigned char *)knet_h->pmtudbuf;
+	*data_len = onwire_len - overhead_len;
 
-	/*
-	 * prevent a race when interface mtu is changed _exactly_ during
-	 * the discovery process and it's complex to detect. Easier
-	 * to wait the next loop.
-	 * 30 is not an arbitrary value. To bisect from 576 to 128000 doesn't
-	 * take more than 18/19 steps.
-	 */
+	knet_h->pmtudbuf->khp_pmtud_link = dst_link->link_id;
 
-	if (failsafe == 30) {
-		log_err(knet_h, KNET_SUB_PMTUD,
-			"Aborting PMTUD process: Too many attempts. MTU might have changed during discovery.");
-		return -1;
-	} else {
-		failsafe++;
+	if (!knet_h->crypto_instance) {
+		knet_h->pmtudbuf->khp_pmtud_size = onwire_len;
+		return onwire_len;
 	}
 
-	data_len = onwire_len - overhead_len;
-
-	if (knet_h->crypto_instance) {
-
-		if (knet_h->sec_block_size) {
-			pad_len = knet_h->sec_block_size - (data_len % knet_h->sec_block_size);
-			if (pad_len == knet_h->sec_block_size) {
-				pad_len = 0;
-			}
-			data_len = data_len + pad_len;
+	if (knet_h->sec_block_size) {
+		pad_len = knet_h->sec_block_size - (*data_len % knet_h->sec_block_size);
+		if (pad_len == knet_h->sec_block_size) {
+			pad_len = 0;
 		}
+		*data_len = *data_len + pad_len;
+	}
 
-		data_len = data_len + (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size);
-
-		if (knet_h->sec_block_size) {
-			while (data_len + overhead_len >= max_mtu_len) {
-				data_len = data_len - knet_h->sec_block_size;
-			}
-		}
+	*data_len = *data_len + (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size);
 
-		if (dst_link->last_bad_mtu) {
-			while (data_len + overhead_len >= dst_link->last_bad_mtu) {
-				data_len = data_len - (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size);
-			}
+	if (knet_h->sec_block_size) {
+		while (*data_len + overhead_len >= max_mtu_len) {
+			*data_len = *data_len - knet_h->sec_block_size;
 		}
+	}
 
-		if (data_len < (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size) + 1) {
-			log_debug(knet_h, KNET_SUB_PMTUD, "Aborting PMTUD process: link mtu smaller than crypto header detected (link might have been disconnected)");
-			return -1;
+	if (dst_link->last_bad_mtu) {
+		while (*data_len + overhead_len >= dst_link->last_bad_mtu) {
+			*data_len = *data_len - (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size);
 		}
+	}
 
-		onwire_len = data_len + overhead_len;
-		knet_h->pmtudbuf->khp_pmtud_size = onwire_len;
-
-		if (crypto_encrypt_and_sign(knet_h,
-					    (const unsigned char *)knet_h->pmtudbuf,
-					    data_len - (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size),
-					    knet_h->pmtudbuf_crypt,
-					    (ssize_t *)&data_len) < 0) {
-			log_debug(knet_h, KNET_SUB_PMTUD, "Unable to crypto pmtud packet");
-			return -1;
-		}
+	if (*data_len < (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size) + 1) {
+		log_debug(knet_h, KNET_SUB_PMTUD, "Aborting PMTUD process: link mtu smaller than crypto header detected (link might have been disconnected)");
+		return 0;
+	}
 
-		outbuf = knet_h->pmtudbuf_crypt;
-		knet_h->stats_extra.tx_crypt_pmtu_packets++;
+	onwire_len = *data_len + overhead_len;
+	knet_h->pmtudbuf->khp_pmtud_size = onwire_len;
 
-	} else {
+	if (crypto_encrypt_and_sign(knet_h,
+				    (const unsigned char *)knet_h->pmtudbuf,
+				    *data_len - (knet_h->sec_hash_size + knet_h->sec_salt_size + knet_h->sec_block_size),
+				    knet_h->pmtudbuf_crypt,
+				    (ssize_t *)data_len) < 0) {
+		log_debug(knet_h, KNET_SUB_PMTUD, "Unable to crypto pmtud packet");
+		return 0;
+	}
 
-		knet_h->pmtudbuf->khp_pmtud_size = onwire_len;
+	*outbuf = knet_h->pmtudbuf_crypt;
+	knet_h->stats_extra.tx_crypt_pmtu_packets++;
 
-	}
+	return onwire_len;
+}
 
-	/* link has gone down, aborting pmtud */
-	if (dst_link->status.connected != 1) {
-		log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD detected host (%u) link (%u) has been disconnected", dst_host->host_id, dst_link->link_id);
-		return -1;
-	}
+/*
+ * send one probe and register it as in flight.
+ * must be called with pmtud_mutex held.
+ * Returns one of the KNET_PMTUD_PROBE_ defines above, -1 on error.
+ */
+static int _pmtud_send_probe(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, size_t onwire_len)
+{
+	int err, savederrno, use_kernel_mtu;
+	uint32_t kernel_mtu; /* record kernel_mtu from EMSGSIZE */
+	size_t data_len;     /* how much data we can send in the packet
+			      * generally would be onwire_len - overhead_len
+			      * needs to be adjusted for crypto
+			      */
+	ssize_t len;	     /* len of what we were able to sendto onwire */
+	unsigned char *outbuf;
+	uint8_t i;
 
-	if (dst_link->transport_connected != 1) {
-		log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD detected host (%u) link (%u) has been disconnected", dst_host->host_id, dst_link->link_id);
+	onwire_len = _pmtud_build_probe(knet_h, dst_host, dst_link, onwire_len, &data_len, &outbuf);
+	if (!onwire_len) {
 		return -1;
 	}
 
-	if (pthread_mutex_lock(&knet_h->pmtud_mutex) != 0) {
-		log_debug(knet_h, KNET_SUB_PMTUD, "Unable to get mutex lock");
-		return -1;
+	/*
+	 * with crypto different sizes can end up in the same probe
+	 */
+	if (onwire_len <= dst_link->last_good_mtu) {
+		return KNET_PMTUD_PROBE_SKIPPED;
 	}
-
-	if (knet_h->pmtud_abort) {
-		pthread_mutex_unlock(&knet_h->pmtud_mutex);
-		errno = EDEADLK;
-		return -1;
+	for (i = 0; i < dst_link->pmtud_probes; i++) {
+		if (dst_link->pmtud_probe_size[i] == onwire_len) {
+			return KNET_PMTUD_PROBE_SKIPPED;
+		}
 	}
 
 	savederrno = pthread_mutex_lock(&knet_h->tx_mutex);
@@ -172,9 +183,8 @@ restart:
 		return -1;
 	}
 retry:
-	len = sendto(dst_link->outsock, outbuf, data_len,
-			MSG_DONTWAIT | MSG_NOSIGNAL, (struct sockaddr *) &dst_link->dst_addr,
-			sizeof(struct sockaddr_storage));
+	len = transport_link_sendto(knet_h, dst_link, outbuf, data_len,
+				    MSG_DONTWAIT | MSG_NOSIGNAL);
 	savederrno = errno;
 
 	/*
@@ -198,7 +208,6 @@ retry:
 		case -1: /* unrecoverable error */
 			log_debug(knet_h, KNET_SUB_PMTUD, "Unable to send pmtu packet (sendto): %d %s", savederrno, strerror(savederrno));
 			pthread_mutex_unlock(&knet_h->tx_mutex);
-			pthread_mutex_unlock(&knet_h->pmtud_mutex);
 			dst_link->status.stats.tx_pmtu_errors++;
 			return -1;
 		case 0: /* ignore error and continue */
@@ -220,162 +229,406 @@ retry:
 			 * set to 0 previously and we can trust its value now.
 			 */
 			if (use_kernel_mtu) {
-				use_kernel_mtu = 0;
 				if (pthread_mutex_lock(&knet_h->kmtu_mutex) == 0) {
 					kernel_mtu = knet_h->kernel_mtu;
 					pthread_mutex_unlock(&knet_h->kmtu_mutex);
 				}
 			}
-			if (kernel_mtu > 0) {
-				dst_link->last_bad_mtu = kernel_mtu + 1;
-			} else {
+			if ((kernel_mtu > 0) && (kernel_mtu < onwire_len)) {
+				onwire_len = kernel_mtu + 1;
+			}
+			if ((!dst_link->last_bad_mtu) || (onwire_len < dst_link->last_bad_mtu)) {
 				dst_link->last_bad_mtu = onwire_len;
 			}
-		} else {
-			log_debug(knet_h, KNET_SUB_PMTUD, "Unable to send pmtu packet len: %zu err: %s", onwire_len, strerror(savederrno));
+			return KNET_PMTUD_PROBE_TOO_BIG;
 		}
+		log_debug(knet_h, KNET_SUB_PMTUD, "Unable to send pmtu packet len: %zu err: %s", onwire_len, strerror(savederrno));
+		return KNET_PMTUD_PROBE_FAILED;
+	}
 
+	dst_link->pmtud_probe_size[dst_link->pmtud_probes] = onwire_len;
+	dst_link->pmtud_probe_acked[dst_link->pmtud_probes] = 0;
+	dst_link->pmtud_probes++;
+	knet_h->pmtud_outstanding++;
+
+	dst_link->status.stats.tx_pmtu_packets++;
+	dst_link->status.stats.tx_pmtu_bytes += data_len;
+
+	return KNET_PMTUD_PROBE_SENT;
+}
+
+/*
+ * spread the probes between last_good_mtu and last_bad_mtu.
+ * The biggest probe always goes right below last_bad_mtu, since the path MTU
+ * generally matches the one the kernel reports for the interface.
+ * A size lost in the previous rounds (pmtud_lost_mtu) is retried as the
+ * biggest probe, so that the search goes on below it in the meantime.
+ * The first probe starts from the top because kernel will refuse to send
+ * packets > current iface mtu and report the iface mtu back to us.
+ * This saves us some time and network bw.
+ * must be called with pmtud_mutex held.
+ * Returns the number of probes that could not be sent, -1 on error.
+ */
+static int _pmtud_send_probes(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link)
+{
+	size_t lo, hi, span, onwire_len;
+	unsigned int i, probes;
+	int ret, replan = 0, failed = 0;
+
+	dst_link->pmtud_probes = 0;
+
+replan:
+	lo = dst_link->last_good_mtu;
+	if (dst_link->last_bad_mtu) {
+		hi = dst_link->last_bad_mtu;
 	} else {
-		dst_link->last_sent_mtu = onwire_len;
-		dst_link->last_recv_mtu = 0;
-		dst_link->status.stats.tx_pmtu_packets++;
-		dst_link->status.stats.tx_pmtu_bytes += data_len;
+		hi = dst_link->pmtud_max_mtu + 1;
+	}
+	if ((dst_link->pmtud_lost_mtu) && (dst_link->pmtud_lost_mtu < hi)) {
+		hi = dst_link->pmtud_lost_mtu + 1;
+	}
 
-		if (clock_gettime(CLOCK_REALTIME, &ts) < 0) {
-			log_debug(knet_h, KNET_SUB_PMTUD, "Unable to get current time: %s", strerror(errno));
-			pthread_mutex_unlock(&knet_h->pmtud_mutex);
-			return -1;
-		}
+	if (hi <= lo + 1) {
+		return failed;
+	}
+
+	span = hi - lo - 1;
+	probes = KNET_PMTUD_PROBES - dst_link->pmtud_probes;
+	if (span < probes) {
+		probes = span;
+	}
+
+	for (i = 0; i < probes; i++) {
+		onwire_len = hi - 1 - ((span * i) / probes);
 
 		/*
-		 * set PMTUd reply timeout to match pong_timeout on a given link
-		 *
-		 * math: internally pong_timeout is expressed in microseconds, while
-		 *       the public API exports milliseconds. So careful with the 0's here.
-		 * the loop is necessary because we are grabbing the current time just above
-		 * and add values to it that could overflow into seconds.
-		 */ 
-
-		if (pthread_mutex_lock(&knet_h->backoff_mutex)) {
-			log_debug(knet_h, KNET_SUB_PMTUD, "Unable to get backoff_mutex");
-			pthread_mutex_unlock(&knet_h->pmtud_mutex);
-			return -1;
+		 * out of replans, last_bad_mtu might be below
+		 * the probes planned with the old boundaries
+		 */
+		if ((dst_link->last_bad_mtu) && (onwire_len >= dst_link->last_bad_mtu)) {
+			continue;
 		}
 
-		if (knet_h->crypto_instance) {
-			/*
-			 * crypto, under pressure, is a royal PITA
-			 */
-			pong_timeout_adj_tmp = dst_link->pong_timeout_adj * 2;
-		} else {
-			pong_timeout_adj_tmp = dst_link->pong_timeout_adj;
+		ret = _pmtud_send_probe(knet_h, dst_host, dst_link, onwire_len);
+		switch(ret) {
+			case -1:
+				return -1;
+				break;
+			case KNET_PMTUD_PROBE_TOO_BIG:
+				/*
+				 * last_bad_mtu has been lowered, no point sending
+				 * the rest of the probes with the old boundaries
+				 */
+				if (replan < 2) {
+					replan++;
+					goto replan;
+				}
+				break;
+			case KNET_PMTUD_PROBE_FAILED:
+				failed++;
+				break;
+			default:
+				break;
 		}
+	}
+
+	return failed;
+}
+
+/*
+ * must be called with pmtud_mutex held
+ */
+static void _pmtud_check_probes(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link)
+{
+	uint32_t acked_max = 0, unacked_min = 0;
+	uint8_t i;
 
-		ts.tv_sec += pong_timeout_adj_tmp / 1000000;
-		ts.tv_nsec += (((pong_timeout_adj_tmp) % 1000000) * 1000);
-		while (ts.tv_nsec > 1000000000) {
-			ts.tv_sec += 1;
-			ts.tv_nsec -= 1000000000;
+	for (i = 0; i < dst_link->pmtud_probes; i++) {
+		if ((dst_link->pmtud_probe_acked[i]) &&
+		    (dst_link->pmtud_probe_size[i] > acked_max)) {
+			acked_max = dst_link->pmtud_probe_size[i];
 		}
+	}
 
-		pthread_mutex_unlock(&knet_h->backoff_mutex);
+	/*
+	 * probes smaller than an acked one might have just been lost
+	 */
+	for (i = 0; i < dst_link->pmtud_probes; i++) {
+		if ((!dst_link->pmtud_probe_acked[i]) &&
+		    (dst_link->pmtud_probe_size[i] > acked_max) &&
+		    ((!unacked_min) || (dst_link->pmtud_probe_size[i] < unacked_min))) {
+			unacked_min = dst_link->pmtud_probe_size[i];
+		}
+	}
 
-		knet_h->pmtud_waiting = 1;
+	if ((!acked_max) && (!dst_link->pmtud_warned)) {
+		log_warn(knet_h, KNET_SUB_PMTUD,
+				"possible MTU misconfiguration detected. "
+				"kernel is reporting MTU: %u bytes for "
+				"host %u link %u but the other node is "
+				"not acknowledging packets of this size. ",
+				dst_link->pmtud_probe_size[0],
+				dst_host->host_id,
+				dst_link->link_id);
+		log_warn(knet_h, KNET_SUB_PMTUD,
+				"This can be caused by this node interface MTU "
+				"too big or a network device that does not "
+				"support or has been misconfigured to manage MTU "
+				"of this size, or packet loss. knet will continue "
+				"to run but performances might be affected.");
+		dst_link->pmtud_warned = 1;
+	}
 
-		ret = pthread_cond_timedwait(&knet_h->pmtud_cond, &knet_h->pmtud_mutex, &ts);
+	if (acked_max > dst_link->last_good_mtu) {
+		dst_link->last_good_mtu = acked_max;
+	}
 
-		knet_h->pmtud_waiting = 0;
+	/*
+	 * a lost probe might just have been unlucky, it is only taken as
+	 * too big once it (or a smaller size) keeps getting lost
+	 */
+	if ((dst_link->pmtud_lost_mtu) && (acked_max >= dst_link->pmtud_lost_mtu)) {
+		dst_link->pmtud_lost_mtu = 0;
+		dst_link->pmtud_lost = 0;
+	}
 
-		if (knet_h->pmtud_abort) {
-			pthread_mutex_unlock(&knet_h->pmtud_mutex);
-			errno = EDEADLK;
-			return -1;
+	if (unacked_min) {
+		if ((!dst_link->pmtud_lost_mtu) || (unacked_min < dst_link->pmtud_lost_mtu)) {
+			dst_link->pmtud_lost_mtu = unacked_min;
+			dst_link->pmtud_lost = 1;
+		} else {
+			dst_link->pmtud_lost++;
 		}
+	}
 
-		if (shutdown_in_progress(knet_h)) {
-			pthread_mutex_unlock(&knet_h->pmtud_mutex);
-			log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD aborted. shutdown in progress");
-			return -1;
+	if ((dst_link->pmtud_lost_mtu) && (dst_link->pmtud_lost >= KNET_PMTUD_LOST_PROBES)) {
+		if ((!dst_link->last_bad_mtu) || (dst_link->pmtud_lost_mtu < dst_link->last_bad_mtu)) {
+			dst_link->last_bad_mtu = dst_link->pmtud_lost_mtu;
 		}
+		dst_link->pmtud_lost_mtu = 0;
+		dst_link->pmtud_lost = 0;
+	}
 
-		if (ret) {
-			if (ret == ETIMEDOUT) {
-				if (!warn_once) {
-					log_warn(knet_h, KNET_SUB_PMTUD,
-							"possible MTU misconfiguration detected. "
-							"kernel is reporting MTU: %u bytes for "
-							"host %u link %u but the other node is "
-							"not acknowledging packets of this size. ",
-							dst_link->last_sent_mtu,
-							dst_host->host_id,
-							dst_link->link_id);
-					log_warn(knet_h, KNET_SUB_PMTUD,
-							"This can be caused by this node interface MTU "
-							"too big or a network device that does not "
-							"support or has been misconfigured to manage MTU "
-							"of this size, or packet loss. knet will continue "
-							"to run but performances might be affected.");
-					warn_once = 1;
-				}
-			} else {
-				pthread_mutex_unlock(&knet_h->pmtud_mutex);
-				if (mutex_retry_limit == 3) {
-					log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD aborted, unable to get mutex lock");
-					return -1;
-				}
-				mutex_retry_limit++;
-				goto restart;
-			}
+	dst_link->pmtud_probes = 0;
+}
+
+static int _pmtud_link_found(knet_handle_t knet_h, struct knet_link *dst_link)
+{
+	if (knet_h->sec_block_size) {
+		if ((dst_link->last_good_mtu + knet_h->sec_block_size >= dst_link->pmtud_max_mtu) ||
+		    ((dst_link->last_bad_mtu) && (dst_link->last_bad_mtu <= (dst_link->last_good_mtu + knet_h->sec_block_size)))) {
+			return 1;
+		}
+	} else {
+		if ((dst_link->last_good_mtu == dst_link->pmtud_max_mtu) ||
+		    ((dst_link->last_bad_mtu) && (dst_link->last_bad_mtu == (dst_link->last_good_mtu + 1)))) {
+			return 1;
 		}
+	}
 
-		if ((dst_link->last_recv_mtu != onwire_len) || (ret)) {
-			dst_link->last_bad_mtu = onwire_len;
-		} else {
-			int found_mtu = 0;
+	return 0;
+}
 
-			if (knet_h->sec_block_size) {
-				if ((onwire_len + knet_h->sec_block_size >= max_mtu_len) ||
-				   ((dst_link->last_bad_mtu) && (dst_link->last_bad_mtu <= (onwire_len + knet_h->sec_block_size)))) {
-					found_mtu = 1;
-				}
-			} else {
-				if ((onwire_len == max_mtu_len) ||
-				    ((dst_link->last_bad_mtu) && (dst_link->last_bad_mtu == (onwire_len + 1))) ||
-				     (dst_link->last_bad_mtu == dst_link->last_good_mtu)) {
-					found_mtu = 1;
-				}
+static void _pmtud_link_fail(knet_handle_t knet_h, struct knet_link *dst_link, unsigned int *pending)
+{
+	dst_link->pmtud_state = KNET_PMTUD_FAILED;
+	dst_link->pmtud_probes = 0;
+	(*pending)--;
+}
+
+/*
+ * one PMTUd round across all links being probed.
+ * Returns -1 and errno EDEADLK if the run has to be rescheduled.
+ */
+static int _pmtud_run_round(knet_handle_t knet_h, unsigned int *pending)
+{
+	struct knet_host *dst_host;
+	struct knet_link *dst_link;
+	int link_idx, ret = 0, failed;
+	struct timespec ts;
+	unsigned long long pong_timeout_adj_tmp, timeout = 0;
+
+	if (pthread_mutex_lock(&knet_h->pmtud_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_PMTUD, "Unable to get mutex lock");
+		return 0;
+	}
+
+	if (knet_h->pmtud_abort) {
+		pthread_mutex_unlock(&knet_h->pmtud_mutex);
+		errno = EDEADLK;
+		return -1;
+	}
+
+	knet_h->pmtud_outstanding = 0;
+
+	for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
+		for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+			dst_link = &dst_host->link[link_idx];
+
+			if (dst_link->pmtud_state != KNET_PMTUD_RUNNING) {
+				continue;
+			}
+
+			/* link has gone down, aborting pmtud */
+			if ((dst_link->status.connected != 1) ||
+			    (dst_link->transport_connected != 1)) {
+				log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD detected host (%u) link (%u) has been disconnected", dst_host->host_id, dst_link->link_id);
+				_pmtud_link_fail(knet_h, dst_link, pending);
+				continue;
+			}
+
+			if (_pmtud_link_found(knet_h, dst_link)) {
+				dst_link->pmtud_state = KNET_PMTUD_DONE;
+				(*pending)--;
+				continue;
+			}
+
+			failed = _pmtud_send_probes(knet_h, dst_host, dst_link);
+			if (failed < 0) {
+				_pmtud_link_fail(knet_h, dst_link, pending);
+				continue;
+			}
+
+			/*
+			 * there is no probe size left between good and bad
+			 */
+			if ((!dst_link->pmtud_probes) && (!failed)) {
+				dst_link->pmtud_state = KNET_PMTUD_DONE;
+				(*pending)--;
+				continue;
 			}
 
-			if (found_mtu) {
+			/*
+			 * set PMTUd reply timeout to match pong_timeout on a given link
+			 * (the longest one of all the links in this round)
+			 */
+			if (pthread_mutex_lock(&knet_h->backoff_mutex)) {
+				log_debug(knet_h, KNET_SUB_PMTUD, "Unable to get backoff_mutex");
+				_pmtud_link_fail(knet_h, dst_link, pending);
+				continue;
+			}
+
+			if (knet_h->crypto_instance) {
 				/*
-				 * account for IP overhead, knet headers and crypto in PMTU calculation
+				 * crypto, under pressure, is a royal PITA
 				 */
-				dst_link->status.mtu = onwire_len - dst_link->status.proto_overhead;
-				pthread_mutex_unlock(&knet_h->pmtud_mutex);
-				return 0;
+				pong_timeout_adj_tmp = dst_link->pong_timeout_adj * 2;
+			} else {
+				pong_timeout_adj_tmp = dst_link->pong_timeout_adj;
 			}
 
-			dst_link->last_good_mtu = onwire_len;
+			pthread_mutex_unlock(&knet_h->backoff_mutex);
+
+			if (pong_timeout_adj_tmp > timeout) {
+				timeout = pong_timeout_adj_tmp;
+			}
 		}
 	}
 
-	if (kernel_mtu) {
-		onwire_len = kernel_mtu;
-	} else {
-		onwire_len = (dst_link->last_good_mtu + dst_link->last_bad_mtu) / 2;
+	if (!knet_h->pmtud_outstanding) {
+		goto out_unlock;
+	}
+
+	if (clock_gettime(CLOCK_REALTIME, &ts) < 0) {
+		log_debug(knet_h, KNET_SUB_PMTUD, "Unable to get current time: %s", strerror(errno));
+		goto out_check;
+	}
+
+	/*
+	 * math: internally pong_timeout is expressed in microseconds, while
+	 *       the public API exports milliseconds. So careful with the 0's here.
+	 * the loop is necessary because we are grabbing the current time just above
+	 * and add values to it that could overflow into seconds.
+	 */
+	ts.tv_sec += timeout / 1000000;
+	ts.tv_nsec += (((timeout) % 1000000) * 1000);
+	while (ts.tv_nsec > 1000000000) {
+		ts.tv_sec += 1;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	knet_h->pmtud_waiting = 1;
+
+	while ((knet_h->pmtud_outstanding) && (!knet_h->pmtud_abort)) {
+		if (pthread_cond_timedwait(&knet_h->pmtud_cond, &knet_h->pmtud_mutex, &ts)) {
+			break;
+		}
+	}
+
+	knet_h->pmtud_waiting = 0;
+
+	if (knet_h->pmtud_abort) {
+		pthread_mutex_unlock(&knet_h->pmtud_mutex);
+		errno = EDEADLK;
+		return -1;
+	}
+
+	if (shutdown_in_progress(knet_h)) {
+		pthread_mutex_unlock(&knet_h->pmtud_mutex);
+		log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD aborted. shutdown in progress");
+		errno = EDEADLK;
+		return -1;
 	}
 
+out_check:
+	for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
+		for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+			dst_link = &dst_host->link[link_idx];
+
+			if ((dst_link->pmtud_state != KNET_PMTUD_RUNNING) ||
+			    (!dst_link->pmtud_probes)) {
+				continue;
+			}
+
+			_pmtud_check_probes(knet_h, dst_host, dst_link);
+		}
+	}
+
+out_unlock:
+	knet_h->pmtud_outstanding = 0;
 	pthread_mutex_unlock(&knet_h->pmtud_mutex);
+	return ret;
+}
+
+/*
+ * IP, transport, knet and crypto overheads for the link
+ */
+static int _pmtud_link_overhead(knet_handle_t knet_h, struct knet_link *dst_link)
+{
+	switch (dst_link->dst_addr.ss_family) {
+		case AF_INET6:
+			dst_link->status.proto_overhead = KNET_PMTUD_OVERHEAD_V6 + dst_link->proto_overhead + KNET_HEADER_ALL_SIZE + knet_h->sec_header_size;
+			dst_link->pmtud_max_mtu = KNET_PMTUD_SIZE_V6;
+			dst_link->pmtud_overhead = KNET_PMTUD_OVERHEAD_V6 + dst_link->proto_overhead;
+			break;
+		case AF_INET:
+			dst_link->status.proto_overhead = KNET_PMTUD_OVERHEAD_V4 + dst_link->proto_overhead + KNET_HEADER_ALL_SIZE + knet_h->sec_header_size;
+			dst_link->pmtud_max_mtu = KNET_PMTUD_SIZE_V4;
+			dst_link->pmtud_overhead = KNET_PMTUD_OVERHEAD_V4 + dst_link->proto_overhead;
+			break;
+		default:
+			return -1;
+			break;
+	}
 
-	goto restart;
+	return 0;
 }
 
-static int _handle_check_pmtud(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, unsigned int *min_mtu, int force_run)
+/*
+ * check if the link is due for PMTUd and prepare it for the run.
+ * Returns 1 if the link needs to be probed.
+ */
+static int _pmtud_link_start(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, int force_run)
 {
-	uint8_t saved_valid_pmtud;
-	unsigned int saved_pmtud;
 	struct timespec clock_now;
 	unsigned long long diff_pmtud, interval;
+	uint64_t request;
+	uint32_t hint;
+	int upward = 0;
+
+	if (__atomic_load_n(&dst_link->pmtud_request, __ATOMIC_ACQUIRE) & KNET_PMTUD_REQUEST) {
+		force_run = 1;
+	}
 
 	if (!force_run) {
 		interval = knet_h->pmtud_interval * 1000000000llu; /* nanoseconds */
@@ -388,36 +641,86 @@ static int _handle_check_pmtud(knet_handle_t knet_h, struct knet_host *dst_host,
 		timespec_diff(dst_link->pmtud_last, clock_now, &diff_pmtud);
 
 		if (diff_pmtud < interval) {
-			*min_mtu = dst_link->status.mtu;
-			return dst_link->has_valid_mtu;
+			return 0;
 		}
 	}
 
-	switch (dst_link->dst_addr.ss_family) {
-		case AF_INET6:
-			dst_link->status.proto_overhead = KNET_PMTUD_OVERHEAD_V6 + dst_link->proto_overhead + KNET_HEADER_ALL_SIZE + knet_h->sec_header_size;
-			break;
-		case AF_INET:
-			dst_link->status.proto_overhead = KNET_PMTUD_OVERHEAD_V4 + dst_link->proto_overhead + KNET_HEADER_ALL_SIZE + knet_h->sec_header_size;
-			break;
+	if (_pmtud_link_overhead(knet_h, dst_link) < 0) {
+		log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD aborted, unknown protocol");
+		dst_link->has_valid_mtu = 0;
+		return 0;
 	}
 
-	saved_pmtud = dst_link->status.mtu;
-	saved_valid_pmtud = dst_link->has_valid_mtu;
+	/*
+	 * the hint is only meaningful for a forced run. The request is
+	 * taken with its hint in one go, so that a new event during
+	 * the run is not lost or paired with a stale hint
+	 */
+	hint = 0;
+	request = __atomic_exchange_n(&dst_link->pmtud_request, 0, __ATOMIC_ACQ_REL);
+	if (request & KNET_PMTUD_REQUEST) {
+		force_run = 1;
+		hint = (uint32_t)request;
+	}
 
-	log_debug(knet_h, KNET_SUB_PMTUD, "Starting PMTUD for host: %u link: %u", dst_host->host_id, dst_link->link_id);
+	if ((!force_run) && (dst_link->has_valid_mtu) && (dst_link->pmtud_validated) &&
+	    (dst_link->last_good_mtu > dst_link->last_ping_size + dst_link->pmtud_overhead)) {
+		upward = 1;
+	}
 
-	errno = 0;
-	if (_handle_check_link_pmtud(knet_h, dst_host, dst_link) < 0) {
-		if (errno == EDEADLK) {
-			log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD for host: %u link: %u has been rescheduled", dst_host->host_id, dst_link->link_id);
-			dst_link->status.mtu = saved_pmtud;
-			dst_link->has_valid_mtu = saved_valid_pmtud;
-			errno = EDEADLK;
-			return dst_link->has_valid_mtu;
-		}
+	dst_link->pmtud_saved_mtu = dst_link->status.mtu;
+	dst_link->pmtud_saved_valid_mtu = dst_link->has_valid_mtu;
+	dst_link->pmtud_warned = 0;
+	dst_link->pmtud_probes = 0;
+	dst_link->pmtud_validated = 0;
+	dst_link->pmtud_blackhole = 0;
+	if (!upward) {
+		dst_link->last_good_mtu = dst_link->last_ping_size + dst_link->pmtud_overhead;
+	}
+	dst_link->last_bad_mtu = 0;
+	dst_link->pmtud_lost_mtu = 0;
+	dst_link->pmtud_lost = 0;
+	if (hint > dst_link->last_good_mtu) {
+		dst_link->last_bad_mtu = hint + 1;
+	}
+	dst_link->pmtud_state = KNET_PMTUD_RUNNING;
+
+	if (upward) {
+		log_debug(knet_h, KNET_SUB_PMTUD, "Starting PMTUD for host: %u link: %u (probing above %u)",
+			  dst_host->host_id, dst_link->link_id, dst_link->last_good_mtu);
+	} else if (hint) {
+		log_debug(knet_h, KNET_SUB_PMTUD, "Starting PMTUD for host: %u link: %u (reported MTU: %u)",
+			  dst_host->host_id, dst_link->link_id, hint);
+	} else {
+		log_debug(knet_h, KNET_SUB_PMTUD, "Starting PMTUD for host: %u link: %u", dst_host->host_id, dst_link->link_id);
+	}
+
+	return 1;
+}
+
+/*
+ * PMTUd has been interrupted by a config change, restore
+ * previous values and try again at the next run
+ */
+static void _pmtud_link_reschedule(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link)
+{
+	log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD for host: %u link: %u has been rescheduled", dst_host->host_id, dst_link->link_id);
+	dst_link->status.mtu = dst_link->pmtud_saved_mtu;
+	dst_link->has_valid_mtu = dst_link->pmtud_saved_valid_mtu;
+	dst_link->pmtud_state = KNET_PMTUD_IDLE;
+}
+
+static void _pmtud_link_finish(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link)
+{
+	struct timespec clock_now;
+
+	if (dst_link->pmtud_state == KNET_PMTUD_FAILED) {
 		dst_link->has_valid_mtu = 0;
 	} else {
+		/*
+		 * account for IP overhead, knet headers and crypto in PMTU calculation
+		 */
+		dst_link->status.mtu = dst_link->last_good_mtu - dst_link->status.proto_overhead;
 		dst_link->has_valid_mtu = 1;
 		switch (dst_link->dst_addr.ss_family) {
 			case AF_INET6:
@@ -440,32 +743,148 @@ static int _handle_check_pmtud(knet_handle_t knet_h, struct knet_host *dst_host,
 				break;
 		}
 		if (dst_link->has_valid_mtu) {
-			if ((saved_pmtud) && (saved_pmtud != dst_link->status.mtu)) {
+			if ((dst_link->pmtud_saved_mtu) && (dst_link->pmtud_saved_mtu != dst_link->status.mtu)) {
 				log_info(knet_h, KNET_SUB_PMTUD, "PMTUD link change for host: %u link: %u from %u to %u",
-					 dst_host->host_id, dst_link->link_id, saved_pmtud, dst_link->status.mtu);
+					 dst_host->host_id, dst_link->link_id, dst_link->pmtud_saved_mtu, dst_link->status.mtu);
 			}
 			log_debug(knet_h, KNET_SUB_PMTUD, "PMTUD completed for host: %u link: %u current link mtu: %u",
 				  dst_host->host_id, dst_link->link_id, dst_link->status.mtu);
-			if (dst_link->status.mtu < *min_mtu) {
-				*min_mtu = dst_link->status.mtu;
-			}
 
 			/*
-			 * set pmtud_last, if we can, after we are done with the PMTUd process
-			 * because it can take a very long time.
+			 * set pmtud_last after we are done with the PMTUd process
 			 */
-			dst_link->pmtud_last = clock_now;
 			if (!clock_gettime(CLOCK_MONOTONIC, &clock_now)) {
 				dst_link->pmtud_last = clock_now;
 			}
 		}
 	}
 
-	if (saved_valid_pmtud != dst_link->has_valid_mtu) {
-		_host_dstcache_update_sync(knet_h, dst_host);
+	dst_link->pmtud_state = KNET_PMTUD_IDLE;
+
+	/*
+	 * the host data MTU depends on the MTU of its active links.
+	 * We only hold the global read lock here, let the dst link
+	 * handler thread update the host under the write lock
+	 */
+	if ((dst_link->pmtud_saved_valid_mtu != dst_link->has_valid_mtu) ||
+	    ((dst_link->has_valid_mtu) && (dst_link->pmtud_saved_mtu != dst_link->status.mtu))) {
+		_host_dstcache_update_async(knet_h, dst_host);
+	}
+}
+
+/*
+ * restore a path MTU known from a previous run (see knet_link_set_cache).
+ * The value is trusted until data or ICMP errors prove it wrong,
+ * a full PMTUd run happens at the next pmtud_interval.
+ * must be called with global write lock held.
+ */
+int _pmtud_link_restore(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, uint32_t path_mtu)
+{
+	struct timespec clock_now;
+	uint32_t min_mtu;
+
+	if (_pmtud_link_overhead(knet_h, dst_link) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (dst_link->dst_addr.ss_family == AF_INET6) {
+		min_mtu = KNET_PMTUD_MIN_MTU_V6;
+	} else {
+		min_mtu = KNET_PMTUD_MIN_MTU_V4;
+	}
+
+	if ((path_mtu < min_mtu) ||
+	    (path_mtu > dst_link->pmtud_max_mtu) ||
+	    (path_mtu <= dst_link->status.proto_overhead)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (clock_gettime(CLOCK_MONOTONIC, &clock_now) != 0) {
+		return -1;
+	}
+
+	dst_link->last_good_mtu = path_mtu;
+	dst_link->last_bad_mtu = 0;
+	dst_link->status.mtu = path_mtu - dst_link->status.proto_overhead;
+	dst_link->has_valid_mtu = 1;
+	dst_link->pmtud_validated = 0;
+	dst_link->pmtud_blackhole = 0;
+	dst_link->pmtud_last = clock_now;
+
+	log_debug(knet_h, KNET_SUB_PMTUD, "Restored MTU for host: %u link: %u current link mtu: %u",
+		  dst_host->host_id, dst_link->link_id, dst_link->status.mtu);
+
+	_host_dstcache_update_sync(knet_h, dst_host);
+
+	return 0;
+}
+
+/*
+ * the kernel or the network reported that packets bigger than mtu
+ * (onwire, IP headers included) can't reach the link destination.
+ * This can be called from any thread, holding any lock.
+ * PMTUd own probes above the current link MTU also trigger this,
+ * so only act if the current link MTU doesn't fit anymore.
+ */
+void _pmtud_link_too_big(knet_handle_t knet_h, struct knet_link *dst_link, uint32_t mtu)
+{
+	uint64_t request;
+
+	if ((!dst_link->has_valid_mtu) ||
+	    (dst_link->pmtud_state != KNET_PMTUD_IDLE) ||
+	    (!mtu) ||
+	    (mtu >= dst_link->status.mtu + dst_link->status.proto_overhead)) {
+		return;
+	}
+
+	/*
+	 * keep a pending request if it already has a smaller hint
+	 * or no hint at all (black hole, probe from the top)
+	 */
+	request = __atomic_load_n(&dst_link->pmtud_request, __ATOMIC_ACQUIRE);
+	do {
+		if ((request & KNET_PMTUD_REQUEST) &&
+		    ((!(uint32_t)request) || ((uint32_t)request <= mtu))) {
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&dst_link->pmtud_request, &request, KNET_PMTUD_REQUEST | mtu,
+					      0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	log_debug(knet_h, KNET_SUB_PMTUD, "Path MTU for link %u reported as %u (current %u), requesting PMTUD rerun",
+		  dst_link->link_id, mtu, dst_link->status.mtu + dst_link->status.proto_overhead);
+}
+
+/*
+ * called for every pong.
+ * rx_data_max is the biggest data packet the other node received on this
+ * link since its previous pong. It has to match what we sent before the ping.
+ */
+void _pmtud_link_validate(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, uint32_t rx_data_max)
+{
+	uint32_t tx_data_check = dst_link->pmtud_tx_data_check;
+
+	if ((!tx_data_check) || (!dst_link->has_valid_mtu)) {
+		return;
+	}
+
+	dst_link->pmtud_tx_data_check = 0;
+
+	if (rx_data_max >= tx_data_check) {
+		dst_link->pmtud_validated = 1;
+		dst_link->pmtud_blackhole = 0;
+		return;
 	}
 
-	return dst_link->has_valid_mtu;
+	dst_link->pmtud_validated = 0;
+	dst_link->pmtud_blackhole++;
+
+	if (dst_link->pmtud_blackhole == KNET_PMTUD_BLACKHOLE_PONGS) {
+		log_info(knet_h, KNET_SUB_PMTUD, "Data packets of %u bytes are not reaching host: %u link: %u, requesting PMTUD rerun",
+			 tx_data_check, dst_host->host_id, dst_link->link_id);
+		__atomic_store_n(&dst_link->pmtud_request, KNET_PMTUD_REQUEST, __ATOMIC_RELEASE);
+	}
 }
 
 void *_handle_pmtud_link_thread(void *data)
@@ -474,9 +893,9 @@ void *_handle_pmtud_link_thread(void *data)
 	struct knet_host *dst_host;
 	struct knet_link *dst_link;
 	int link_idx;
-	unsigned int min_mtu, have_mtu;
+	unsigned int have_mtu;
 	unsigned int lower_mtu;
-	int link_has_mtu;
+	unsigned int pending, rounds;
 	int force_run = 0;
 
 	set_thread_status(knet_h, KNET_THREAD_PMTUD, KNET_THREAD_STARTED);
@@ -510,14 +929,16 @@ void *_handle_pmtud_link_thread(void *data)
 			continue;
 		}
 
-		lower_mtu = KNET_PMTUD_SIZE_V4;
-		min_mtu = KNET_PMTUD_SIZE_V4 - KNET_HEADER_ALL_SIZE - knet_h->sec_header_size;
+		lower_mtu = KNET_PMTUD_SIZE_V4 - KNET_HEADER_ALL_SIZE - knet_h->sec_header_size;
 		have_mtu = 0;
+		pending = 0;
 
 		for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
 			for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
 				dst_link = &dst_host->link[link_idx];
 
+				dst_link->pmtud_state = KNET_PMTUD_IDLE;
+
 				if ((dst_link->status.enabled != 1) ||
 				    (dst_link->status.connected != 1) ||
 				    (dst_host->link[link_idx].transport_type == KNET_TRANSPORT_LOOPBACK) ||
@@ -526,16 +947,55 @@ void *_handle_pmtud_link_thread(void *data)
 				     (dst_link->status.dynconnected != 1)))
 					continue;
 
-				link_has_mtu = _handle_check_pmtud(knet_h, dst_host, dst_link, &min_mtu, force_run);
-				if (errno == EDEADLK) {
-					goto out_unlock;
+				if (_pmtud_link_start(knet_h, dst_host, dst_link, force_run)) {
+					pending++;
 				}
-				if (link_has_mtu) {
-					have_mtu = 1;
-					if (min_mtu < lower_mtu) {
-						lower_mtu = min_mtu;
+			}
+		}
+
+		rounds = 0;
+		while (pending) {
+			if (rounds == KNET_PMTUD_MAX_ROUNDS) {
+				log_err(knet_h, KNET_SUB_PMTUD,
+					"Aborting PMTUD process: Too many attempts. MTU might have changed during discovery.");
+				break;
+			}
+			rounds++;
+
+			if (_pmtud_run_round(knet_h, &pending) < 0) {
+				for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
+					for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+						dst_link = &dst_host->link[link_idx];
+						if (dst_link->pmtud_state != KNET_PMTUD_IDLE) {
+							_pmtud_link_reschedule(knet_h, dst_host, dst_link);
+						}
 					}
 				}
+				goto out_unlock;
+			}
+		}
+
+		for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
+			for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+				dst_link = &dst_host->link[link_idx];
+
+				if (dst_link->pmtud_state == KNET_PMTUD_RUNNING) {
+					dst_link->pmtud_state = KNET_PMTUD_FAILED;
+				}
+				if (dst_link->pmtud_state != KNET_PMTUD_IDLE) {
+					_pmtud_link_finish(knet_h, dst_host, dst_link);
+				}
+
+				if ((dst_link->status.enabled != 1) ||
+				    (dst_link->status.connected != 1) ||
+				    (dst_host->link[link_idx].transport_type == KNET_TRANSPORT_LOOPBACK) ||
+				    (!dst_link->has_valid_mtu))
+					continue;
+
+				have_mtu = 1;
+				if (dst_link->status.mtu < lower_mtu) {
+					lower_mtu = dst_link->status.mtu;
+				}
 			}
 		}
 
@@ -10,6 +10,9 @@
 #ifndef __KNET_THREADS_PMTUD_H__
 #define __KNET_THREADS_PMTUD_H__
 
+int _pmtud_link_restore(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, uint32_t path_mtu);
+void _pmtud_link_too_big(knet_handle_t knet_h, struct knet_link *dst_link, uint32_t mtu);
+void _pmtud_link_validate(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, uint32_t rx_data_max);
 void *_handle_pmtud_link_thread(void *data);
 
 #endif
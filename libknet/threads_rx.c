@@ -10,28 +10,44 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/uio.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "compat.h"
 #include "compress.h"
 #include "crypto.h"
 #include "host.h"
+#include "large.h"
 #include "links.h"
 #include "logging.h"
+#include "reliable.h"
+#include "relay.h"
 #include "transports.h"
 #include "transport_common.h"
+#include "transport_mcast.h"
+#include "transport_shm.h"
 #include "threads_common.h"
 #include "threads_heartbeat.h"
+#include "threads_pmtud.h"
 #include "threads_rx.h"
+#include "tree.h"
+#include "uring.h"
 #include "netutils.h"
 
 /*
  * RECV
  */
 
+/*
+ * room for ancillary data: kernel timestamps (KNET_LINK_FLAG_TIMESTAMP)
+ * and SCTP sndrcvinfo
+ */
+#define KNET_RX_CMSG_SIZE 256
+
 /*
  *  return 1 if a > b
  *  return -1 if b > a
@@ -83,16 +99,20 @@ static int find_pckt_defrag_buf(knet_handle_t knet_h, struct knet_header *inbuf)
 	 * check if it's been reclaimed/seen before using the defrag circular
 	 * buffer. If the pckt has been seen before, the buffer expired (ETIME)
 	 * and there is no point to try to defrag it again.
+	 * Reliable packets are the exception, they are retransmitted
+	 * with the same seq_num.
 	 */
-	if (!_seq_num_lookup(src_host, inbuf->khp_data_seq_num, 1, 0)) {
-		errno = ETIME;
-		return -1;
-	}
+	if (!(inbuf->khp_data_flags & KNET_DATA_FLAG_RELIABLE)) {
+		if (!_seq_num_lookup(src_host, inbuf->khp_data_seq_num, 1, 0)) {
+			errno = ETIME;
+			return -1;
+		}
 
-	/*
-	 * register the pckt as seen
-	 */
-	_seq_num_set(src_host, inbuf->khp_data_seq_num, 1);
+		/*
+		 * register the pckt as seen
+		 */
+		_seq_num_set(src_host, inbuf->khp_data_seq_num, 1);
+	}
 
 	/*
 	 * see if there is a free buffer
@@ -120,14 +140,194 @@ static int find_pckt_defrag_buf(knet_handle_t knet_h, struct knet_header *inbuf)
 	return oldest;
 }
 
+/*
+ * where a data fragment is (or will be) in the defrag buffer
+ */
+static unsigned char *_defrag_frag(struct knet_host_defrag_buf *defrag_buf, uint8_t frag_seq, uint8_t frag_num)
+{
+	if ((frag_seq == frag_num) && (defrag_buf->last_first)) {
+		return (unsigned char *)defrag_buf->buf + (sizeof(defrag_buf->buf) - defrag_buf->last_frag_size);
+	}
+	return (unsigned char *)defrag_buf->buf + ((frag_seq - 1) * defrag_buf->frag_size);
+}
+
+static void _defrag_store(struct knet_host_defrag_buf *defrag_buf, uint8_t frag_seq, uint8_t frag_num,
+			  unsigned char *data, ssize_t len)
+{
+	/*
+	 *  we need to handle the last packet with gloves due to its different size
+	 */
+
+	if (frag_seq == frag_num) {
+		defrag_buf->last_frag_size = len;
+
+		/*
+		 * in the event when the last packet arrives first,
+		 * we still don't know the offset vs the other fragments (based on MTU),
+		 * so we store the fragment at the end of the buffer where it's safe
+		 * and take a copy of the len so that we can restore its offset later.
+		 * remember we can't use the local MTU for this calculation because pMTU
+		 * can be asymettric between the same hosts.
+		 */
+		if (!defrag_buf->frag_size) {
+			defrag_buf->last_first = 1;
+			memmove(defrag_buf->buf + (sizeof(defrag_buf->buf) - len),
+			       data,
+			       len);
+		}
+	} else {
+		defrag_buf->frag_size = len;
+	}
+
+	memmove(defrag_buf->buf + ((frag_seq - 1) * defrag_buf->frag_size),
+	       data, len);
+
+	defrag_buf->frag_recv++;
+	defrag_buf->frag_map[frag_seq] = 1;
+}
+
+/*
+ * keep a parity fragment. Parity fragments are as long as a full data
+ * fragment, that tells us the fragment size even before the data arrives
+ */
+static int _defrag_store_parity(knet_handle_t knet_h, struct knet_host_defrag_buf *defrag_buf,
+				struct knet_header *inbuf, ssize_t len)
+{
+	struct knet_header_fec *fec = (struct knet_header_fec *)inbuf->khp_data_userdata;
+	uint8_t first = inbuf->khp_data_frag_seq;
+	size_t fec_buf_size;
+	unsigned char *fec_buf;
+
+	len = len - KNET_HEADER_FEC_SIZE;
+
+	if ((len <= 0) || (!first) || (!fec->kfh_frags) ||
+	    (first + fec->kfh_frags - 1 > inbuf->khp_data_frag_num) ||
+	    (first + fec->kfh_frags > PCKT_FRAG_MAX) ||
+	    ((defrag_buf->frag_size) && (defrag_buf->frag_size != len)) ||
+	    (inbuf->khp_data_frag_num * len > (ssize_t)sizeof(defrag_buf->buf) + len)) {
+		log_debug(knet_h, KNET_SUB_RX, "Invalid parity fragment");
+		return -1;
+	}
+
+	if (defrag_buf->fec_map[first - 1]) {
+		return -1;
+	}
+
+	fec_buf_size = inbuf->khp_data_frag_num * len;
+	if (defrag_buf->fec_buf_size < fec_buf_size) {
+		fec_buf = realloc(defrag_buf->fec_buf, fec_buf_size);
+		if (!fec_buf) {
+			log_debug(knet_h, KNET_SUB_RX, "Unable to allocate memory for parity fragment");
+			return -1;
+		}
+		defrag_buf->fec_buf = fec_buf;
+		defrag_buf->fec_buf_size = fec_buf_size;
+	}
+
+	if (!defrag_buf->frag_size) {
+		defrag_buf->frag_size = len;
+	}
+
+	memmove(defrag_buf->fec_buf + ((first - 1) * len), fec->kfh_parity, len);
+	defrag_buf->fec_map[first - 1] = 1;
+	defrag_buf->fec_recv++;
+	defrag_buf->fec_frags[first - 1] = fec->kfh_frags;
+	defrag_buf->fec_len[first - 1] = ntohs(fec->kfh_len);
+
+	return 0;
+}
+
+/*
+ * rebuild the data fragment missing from the parity group
+ * that frag_seq belongs to, if there is only one
+ */
+static void _defrag_rebuild(knet_handle_t knet_h, struct knet_host_defrag_buf *defrag_buf,
+			    uint8_t frag_seq, uint8_t frag_num)
+{
+	unsigned char *parity, *data;
+	uint8_t first, missing = 0;
+	uint16_t len;
+	int frag, i;
+
+	if (!defrag_buf->fec_recv) {
+		return;
+	}
+
+	/*
+	 * find the group, there can't be more than PCKT_FRAG_MAX fragments in it
+	 */
+	for (first = frag_seq; first > 0; first--) {
+		if ((defrag_buf->fec_map[first - 1]) &&
+		    (first + defrag_buf->fec_frags[first - 1] > frag_seq)) {
+			break;
+		}
+	}
+	if ((!first) || (defrag_buf->fec_map[first - 1] != 1)) {
+		return;
+	}
+
+	for (frag = first; frag < first + defrag_buf->fec_frags[first - 1]; frag++) {
+		if (!defrag_buf->frag_map[frag]) {
+			if (missing) {
+				return;
+			}
+			missing = frag;
+		}
+	}
+	if (!missing) {
+		return;
+	}
+
+	/*
+	 * XOR the data we have into the parity, what is left is the missing fragment
+	 */
+	parity = defrag_buf->fec_buf + ((first - 1) * defrag_buf->frag_size);
+	len = defrag_buf->fec_len[first - 1];
+
+	for (frag = first; frag < first + defrag_buf->fec_frags[first - 1]; frag++) {
+		if (frag == missing) {
+			continue;
+		}
+		data = _defrag_frag(defrag_buf, frag, frag_num);
+		if (frag == frag_num) {
+			for (i = 0; i < defrag_buf->last_frag_size; i++) {
+				parity[i] ^= data[i];
+			}
+			len ^= defrag_buf->last_frag_size;
+		} else {
+			for (i = 0; i < defrag_buf->frag_size; i++) {
+				parity[i] ^= data[i];
+			}
+			len ^= defrag_buf->frag_size;
+		}
+	}
+
+	defrag_buf->fec_map[first - 1] = 2;
+
+	if ((!len) || (len > defrag_buf->frag_size) ||
+	    ((missing != frag_num) && (len != defrag_buf->frag_size))) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to rebuild fragment %u, invalid length %u", missing, len);
+		return;
+	}
+
+	_defrag_store(defrag_buf, missing, frag_num, parity, len);
+	knet_h->stats.rx_fec_rebuilt++;
+}
+
 static int pckt_defrag(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t *len)
 {
 	struct knet_host_defrag_buf *defrag_buf;
 	int defrag_buf_idx;
+	unsigned char *fec_buf;
+	size_t fec_buf_size;
 
 	defrag_buf_idx = find_pckt_defrag_buf(knet_h, inbuf);
 	if (defrag_buf_idx < 0) {
-		if (errno == ETIME) {
+		/*
+		 * parity usually arrives after the packet has been rebuilt
+		 */
+		if ((errno == ETIME) &&
+		    (!(inbuf->khp_data_flags & KNET_DATA_FLAG_PARITY))) {
 			log_debug(knet_h, KNET_SUB_RX, "Defrag buffer expired");
 		}
 		return 1;
@@ -139,7 +339,11 @@ static int pckt_defrag(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t
 	 * if the buf is not is use, then make sure it's clean
 	 */
 	if (!defrag_buf->in_use) {
+		fec_buf = defrag_buf->fec_buf;
+		fec_buf_size = defrag_buf->fec_buf_size;
 		memset(defrag_buf, 0, sizeof(struct knet_host_defrag_buf));
+		defrag_buf->fec_buf = fec_buf;
+		defrag_buf->fec_buf_size = fec_buf_size;
 		defrag_buf->in_use = 1;
 		defrag_buf->pckt_seq = inbuf->khp_data_seq_num;
 	}
@@ -149,47 +353,28 @@ static int pckt_defrag(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t
 	 */
 	clock_gettime(CLOCK_MONOTONIC, &defrag_buf->last_update);
 
-	/*
-	 * check if we already received this fragment
-	 */
-	if (defrag_buf->frag_map[inbuf->khp_data_frag_seq]) {
-		/*
-		 * if we have received this fragment and we didn't clear the buffer
-		 * it means that we don't have all fragments yet
-		 */
-		return 1;
-	}
-
-	/*
-	 *  we need to handle the last packet with gloves due to its different size
-	 */
-
-	if (inbuf->khp_data_frag_seq == inbuf->khp_data_frag_num) {
-		defrag_buf->last_frag_size = *len;
-
+	if (inbuf->khp_data_flags & KNET_DATA_FLAG_PARITY) {
+		if (_defrag_store_parity(knet_h, defrag_buf, inbuf, *len) < 0) {
+			return 1;
+		}
+		_defrag_rebuild(knet_h, defrag_buf, inbuf->khp_data_frag_seq, inbuf->khp_data_frag_num);
+		inbuf->khp_data_flags &= ~KNET_DATA_FLAG_PARITY;
+	} else {
 		/*
-		 * in the event when the last packet arrives first,
-		 * we still don't know the offset vs the other fragments (based on MTU),
-		 * so we store the fragment at the end of the buffer where it's safe
-		 * and take a copy of the len so that we can restore its offset later.
-		 * remember we can't use the local MTU for this calculation because pMTU
-		 * can be asymettric between the same hosts.
+		 * check if we already received this fragment
 		 */
-		if (!defrag_buf->frag_size) {
-			defrag_buf->last_first = 1;
-			memmove(defrag_buf->buf + (KNET_MAX_PACKET_SIZE - *len),
-			       inbuf->khp_data_userdata,
-			       *len);
+		if (defrag_buf->frag_map[inbuf->khp_data_frag_seq]) {
+			/*
+			 * if we have received this fragment and we didn't clear the buffer
+			 * it means that we don't have all fragments yet
+			 */
+			return 1;
 		}
-	} else {
-		defrag_buf->frag_size = *len;
-	}
 
-	memmove(defrag_buf->buf + ((inbuf->khp_data_frag_seq - 1) * defrag_buf->frag_size),
-	       inbuf->khp_data_userdata, *len);
-
-	defrag_buf->frag_recv++;
-	defrag_buf->frag_map[inbuf->khp_data_frag_seq] = 1;
+		_defrag_store(defrag_buf, inbuf->khp_data_frag_seq, inbuf->khp_data_frag_num,
+			      inbuf->khp_data_userdata, *len);
+		_defrag_rebuild(knet_h, defrag_buf, inbuf->khp_data_frag_seq, inbuf->khp_data_frag_num);
+	}
 
 	/*
 	 * check if we received all the fragments
@@ -201,7 +386,7 @@ static int pckt_defrag(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t
 
 		if (defrag_buf->last_first) {
 			memmove(defrag_buf->buf + ((inbuf->khp_data_frag_num - 1) * defrag_buf->frag_size),
-			        defrag_buf->buf + (KNET_MAX_PACKET_SIZE - defrag_buf->last_frag_size),
+			        defrag_buf->buf + (sizeof(defrag_buf->buf) - defrag_buf->last_frag_size),
 				defrag_buf->last_frag_size);
 		}
 
@@ -226,67 +411,429 @@ static int pckt_defrag(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t
 	return 1;
 }
 
-static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg)
+/*
+ * data packets don't carry the link id, find the link
+ * from the packet source address instead
+ */
+static int _src_link_match(const struct knet_link *link, const struct sockaddr_storage *pckt_src)
+{
+	if ((!link->configured) ||
+	    (link->dst_addr.ss_family != pckt_src->ss_family)) {
+		return 0;
+	}
+
+	switch (pckt_src->ss_family) {
+		case AF_INET:
+			return ((((const struct sockaddr_in *)pckt_src)->sin_port == ((const struct sockaddr_in *)&link->dst_addr)->sin_port) &&
+				(((const struct sockaddr_in *)pckt_src)->sin_addr.s_addr == ((const struct sockaddr_in *)&link->dst_addr)->sin_addr.s_addr));
+		case AF_INET6:
+			return ((((const struct sockaddr_in6 *)pckt_src)->sin6_port == ((const struct sockaddr_in6 *)&link->dst_addr)->sin6_port) &&
+				(!memcmp(&((const struct sockaddr_in6 *)pckt_src)->sin6_addr, &((const struct sockaddr_in6 *)&link->dst_addr)->sin6_addr, sizeof(struct in6_addr))));
+	}
+
+	return 0;
+}
+
+static struct knet_link *_find_src_link(struct knet_host *src_host, const struct sockaddr_storage *pckt_src)
+{
+	struct knet_link *link;
+	int link_idx;
+
+	/*
+	 * data usually keeps coming from the same link
+	 */
+	if ((src_host->rx_src_link) &&
+	    (_src_link_match(src_host->rx_src_link, pckt_src))) {
+		return src_host->rx_src_link;
+	}
+
+	for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+		link = &src_host->link[link_idx];
+
+		if (_src_link_match(link, pckt_src)) {
+			src_host->rx_src_link = link;
+			return link;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * multicast and shared memory links know which link the data came on
+ */
+static struct knet_link *_data_src_link(knet_handle_t knet_h, int sockfd, struct knet_host *src_host,
+					const struct knet_mmsghdr *msg)
+{
+	switch (knet_h->knet_transport_fd_tracker[sockfd].transport) {
+		case KNET_TRANSPORT_MCAST:
+			return _mcast_src_link(knet_h, sockfd, src_host);
+		case KNET_TRANSPORT_SHM:
+			return _shm_src_link(knet_h, sockfd, src_host);
+	}
+
+	return _find_src_link(src_host, msg->msg_hdr.msg_name);
+}
+
+/*
+ * with KNET_LINK_FLAG_TIMESTAMP the kernel stamps the pong as soon as
+ * it is received. Remove from the sample the time the pong spent queued
+ * on the socket and waiting for the RX thread, and the time spent
+ * building and encrypting the ping before it was handed to the kernel.
+ * Kernel timestamps are CLOCK_REALTIME, so only the short rx delay is
+ * measured on that clock and the sample itself stays monotonic.
+ * Keep the thread level sample if anything does not add up.
+ */
+static void _pong_latency_adjust(struct knet_link *src_link, const struct knet_mmsghdr *msg,
+				 struct timespec recvtime, unsigned long long *latency_last)
+{
+	struct timespec rx_stamp, clock_now;
+	unsigned long long rx_delay, tx_delay = 0;
+
+	if (_transport_rx_timestamp(&msg->msg_hdr, &rx_stamp) < 0) {
+		return;
+	}
+
+	if (clock_gettime(CLOCK_REALTIME, &clock_now) != 0) {
+		return;
+	}
+
+	/*
+	 * realtime clock has been stepped backward
+	 */
+	if (timecmp(rx_stamp, clock_now) > 0) {
+		return;
+	}
+
+	timespec_diff(rx_stamp, clock_now, &rx_delay);
+
+	/*
+	 * ping_sent is only valid for the last ping sent
+	 */
+	if ((timecmp(recvtime, src_link->ping_last) == 0) &&
+	    (timecmp(src_link->ping_sent, recvtime) >= 0)) {
+		timespec_diff(recvtime, src_link->ping_sent, &tx_delay);
+	}
+
+	if (rx_delay + tx_delay >= *latency_last) {
+		return;
+	}
+
+	*latency_last -= rx_delay + tx_delay;
+}
+
+/*
+ * bandwidth estimation, see threads_heartbeat.c
+ *
+ * the dispersion of a probe train is only meaningful with kernel
+ * timestamps: the RX thread can pick up the whole train in one batch.
+ * Timestamps are enabled on the socket on demand.
+ */
+static void _bwprobe_add_sample(struct knet_link *src_link, uint32_t sample)
+{
+	uint32_t sorted[KNET_LINK_BW_SAMPLES];
+	int i, j, samples = 0;
+
+	src_link->bw_rx_samples[src_link->bw_rx_sample_idx] = sample;
+	src_link->bw_rx_sample_idx = (src_link->bw_rx_sample_idx + 1) % KNET_LINK_BW_SAMPLES;
+
+	/*
+	 * the median filters out trains compressed or stretched
+	 * by other traffic
+	 */
+	for (i = 0; i < KNET_LINK_BW_SAMPLES; i++) {
+		if (!src_link->bw_rx_samples[i]) {
+			continue;
+		}
+		for (j = samples; (j > 0) && (sorted[j - 1] > src_link->bw_rx_samples[i]); j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = src_link->bw_rx_samples[i];
+		samples++;
+	}
+
+	src_link->bw_rx_estimate = sorted[samples / 2];
+}
+
+static void _parse_bwprobe(knet_handle_t knet_h, int sockfd, struct knet_link *src_link,
+			   const struct knet_mmsghdr *msg, struct knet_header *inbuf, ssize_t wire_len)
+{
+	struct timespec rx_stamp;
+	unsigned long long dispersion;
+	uint64_t sample;
+
+	if (_transport_rx_timestamp(&msg->msg_hdr, &rx_stamp) < 0) {
+		if (!src_link->bw_rx_tstamp_tried) {
+			src_link->bw_rx_tstamp_tried = 1;
+			_configure_rx_timestamping(knet_h, sockfd, "bandwidth probe");
+		}
+		src_link->bw_rx_probe_seq = 0;
+		return;
+	}
+
+	if (inbuf->khp_bwprobe_seq == 0) {
+		src_link->bw_rx_probe_id = ntohl(inbuf->khp_bwprobe_id);
+		src_link->bw_rx_probe_seq = 1;
+		src_link->bw_rx_probe_bytes = 0;
+		src_link->bw_rx_probe_first = rx_stamp;
+		return;
+	}
+
+	/*
+	 * lost or reordered packet, drop the train
+	 */
+	if ((ntohl(inbuf->khp_bwprobe_id) != src_link->bw_rx_probe_id) ||
+	    (inbuf->khp_bwprobe_seq != src_link->bw_rx_probe_seq)) {
+		src_link->bw_rx_probe_seq = 0;
+		return;
+	}
+
+	src_link->bw_rx_probe_bytes += wire_len;
+	src_link->bw_rx_probe_seq++;
+
+	if (src_link->bw_rx_probe_seq < inbuf->khp_bwprobe_count) {
+		return;
+	}
+
+	src_link->bw_rx_probe_seq = 0;
+
+	if (timecmp(rx_stamp, src_link->bw_rx_probe_first) <= 0) {
+		return;
+	}
+
+	timespec_diff(src_link->bw_rx_probe_first, rx_stamp, &dispersion);
+
+	/* kbit/s */
+	sample = (src_link->bw_rx_probe_bytes * 8llu * 1000000llu) / dispersion;
+	if (!sample) {
+		return;
+	}
+	if (sample > UINT32_MAX) {
+		sample = UINT32_MAX;
+	}
+
+	_bwprobe_add_sample(src_link, sample);
+}
+
+/*
+ * data rate received on the link since the last pong in kbit/s
+ */
+static uint32_t _bw_rx_rate(struct knet_link *src_link)
+{
+	struct timespec clock_now;
+	unsigned long long elapsed;
+	uint64_t rate = 0;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &clock_now) != 0) {
+		return 0;
+	}
+
+	if (((src_link->bw_rx_rate_last.tv_sec) || (src_link->bw_rx_rate_last.tv_nsec)) &&
+	    (src_link->status.stats.rx_data_bytes >= src_link->bw_rx_rate_bytes)) {
+		timespec_diff(src_link->bw_rx_rate_last, clock_now, &elapsed);
+		if (elapsed) {
+			rate = ((src_link->status.stats.rx_data_bytes - src_link->bw_rx_rate_bytes) * 8llu * 1000000llu) / elapsed;
+		}
+	}
+
+	src_link->bw_rx_rate_last = clock_now;
+	src_link->bw_rx_rate_bytes = src_link->status.stats.rx_data_bytes;
+
+	if (rate > UINT32_MAX) {
+		rate = UINT32_MAX;
+	}
+
+	return rate;
+}
+
+/*
+ * len is the size of the (decrypted) knet packet,
+ * wire_len is the size of the packet as it was received
+ */
+static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg,
+				   struct knet_header *inbuf, ssize_t len, ssize_t wire_len, uint64_t crypt_time);
+
+/*
+ * relayed and tree packets are data on the link they come from,
+ * PMTUd checks it gets through
+ */
+static void _update_wrapped_link_stats(knet_handle_t knet_h, int sockfd, struct knet_host *src_host,
+				       const struct knet_mmsghdr *msg, ssize_t len, ssize_t wire_len)
+{
+	struct knet_link *src_link;
+
+	src_link = _data_src_link(knet_h, sockfd, src_host, msg);
+	if (src_link) {
+		src_link->status.stats.rx_data_packets++;
+		src_link->status.stats.rx_data_bytes += len;
+		if (wire_len > (ssize_t)src_link->pmtud_rx_data_max) {
+			src_link->pmtud_rx_data_max = wire_len;
+		}
+	}
+}
+
+/*
+ * only data packets come with a different version, see onwire.h
+ */
+static int _header_version_valid(struct knet_header *inbuf)
+{
+	if (inbuf->kh_version == KNET_HEADER_VERSION) {
+		return 1;
+	}
+
+	return ((inbuf->kh_version == KNET_HEADER_VERSION_LARGE) &&
+		(inbuf->kh_type == KNET_HEADER_TYPE_DATA));
+}
+
+/*
+ * packets sent through relays (see relay.c) are either passed on
+ * or unwrapped and parsed as if they came from the source node
+ */
+static void _parse_relay(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg,
+			 struct knet_host *src_host, struct knet_header *inbuf, ssize_t len,
+			 ssize_t wire_len, uint64_t crypt_time)
+{
+	struct knet_header *relayed = (struct knet_header *)inbuf->khp_relay_data;
+	ssize_t relayed_len = len - KNET_HEADER_RELAY_SIZE;
+	ssize_t outlen;
+
+	_update_wrapped_link_stats(knet_h, sockfd, src_host, msg, len, wire_len);
+
+	if (!knet_h->relay) {
+		return;
+	}
+
+	if (len < (ssize_t)(KNET_HEADER_RELAY_SIZE + KNET_HEADER_SIZE + 1)) {
+		log_debug(knet_h, KNET_SUB_RX, "Relayed packet is too short: %ld", (long)len);
+		return;
+	}
+
+	if (ntohs(inbuf->khp_relay_dst_node) != knet_h->host_id) {
+		_relay_forward(knet_h, inbuf, len);
+		return;
+	}
+
+	/*
+	 * the decrypt buffer is free once the batch has been prepared
+	 */
+	if (knet_h->crypto_instance) {
+		if (crypto_authenticate_and_decrypt(knet_h,
+						    (unsigned char *)relayed,
+						    relayed_len,
+						    knet_h->recv_from_links_buf_decrypt,
+						    &outlen) < 0) {
+			log_debug(knet_h, KNET_SUB_RX, "Unable to decrypt/auth relayed packet");
+			return;
+		}
+		relayed = (struct knet_header *)knet_h->recv_from_links_buf_decrypt;
+		relayed_len = outlen;
+	} else {
+		/*
+		 * defrag and decompress need a full buffer in front of them
+		 */
+		memmove(inbuf, relayed, relayed_len);
+		relayed = inbuf;
+	}
+
+	if ((relayed_len < (ssize_t)KNET_HEADER_DATA_SIZE) ||
+	    (!_header_version_valid(relayed)) ||
+	    ((relayed->kh_type != KNET_HEADER_TYPE_DATA) &&
+	     (relayed->kh_type != KNET_HEADER_TYPE_HOST_INFO) &&
+	     (relayed->kh_type != KNET_HEADER_TYPE_TREE))) {
+		log_debug(knet_h, KNET_SUB_RX, "Invalid relayed packet from host %u", src_host->host_id);
+		return;
+	}
+
+	knet_h->stats.rx_relayed_packets++;
+
+	_parse_recv_from_links(knet_h, sockfd, msg, relayed, relayed_len, wire_len, crypt_time);
+}
+
+/*
+ * broadcasts along the tree (see tree.c) are passed on to the
+ * rest of the range first, then delivered like any other data
+ */
+static void _parse_tree(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg,
+			struct knet_host *src_host, struct knet_header *inbuf, ssize_t len,
+			ssize_t wire_len, uint64_t crypt_time)
+{
+	struct knet_header *data = (struct knet_header *)inbuf->khp_tree_data;
+	ssize_t data_len = len - KNET_HEADER_TREE_SIZE;
+	unsigned char *decrypt_buf = knet_h->recv_from_links_buf_decrypt;
+	ssize_t outlen;
+
+	_update_wrapped_link_stats(knet_h, sockfd, src_host, msg, len, wire_len);
+
+	if (len < (ssize_t)(KNET_HEADER_TREE_SIZE + KNET_HEADER_SIZE + 1)) {
+		log_debug(knet_h, KNET_SUB_RX, "Broadcast tree packet is too short: %ld", (long)len);
+		return;
+	}
+
+	if (ntohs(inbuf->khp_tree_src_node) == knet_h->host_id) {
+		return;
+	}
+
+	_tree_forward(knet_h, inbuf, len);
+
+	/*
+	 * the packet came through a relay if it's in the decrypt buffer,
+	 * the crypt buffer is free again once it has been passed on
+	 */
+	if (knet_h->crypto_instance) {
+		if ((unsigned char *)inbuf == knet_h->recv_from_links_buf_decrypt) {
+			decrypt_buf = knet_h->recv_from_links_buf_crypt;
+		}
+		if (crypto_authenticate_and_decrypt(knet_h,
+						    (unsigned char *)data,
+						    data_len,
+						    decrypt_buf,
+						    &outlen) < 0) {
+			log_debug(knet_h, KNET_SUB_RX, "Unable to decrypt/auth broadcast tree packet");
+			return;
+		}
+		data = (struct knet_header *)decrypt_buf;
+		data_len = outlen;
+	} else {
+		memmove(inbuf, data, data_len);
+		data = inbuf;
+	}
+
+	if ((data_len < (ssize_t)KNET_HEADER_DATA_SIZE) ||
+	    (data->kh_version != KNET_HEADER_VERSION) ||
+	    (data->kh_type != KNET_HEADER_TYPE_DATA)) {
+		log_debug(knet_h, KNET_SUB_RX, "Invalid broadcast tree packet from host %u", src_host->host_id);
+		return;
+	}
+
+	_parse_recv_from_links(knet_h, sockfd, msg, data, data_len, wire_len, crypt_time);
+}
+
+static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg,
+				   struct knet_header *inbuf, ssize_t len, ssize_t wire_len, uint64_t crypt_time)
 {
 	int err = 0, savederrno = 0;
 	ssize_t outlen;
 	struct knet_host *src_host;
 	struct knet_link *src_link;
 	unsigned long long latency_last;
+	long long jitter_delta;
 	knet_node_id_t dst_host_ids[KNET_MAX_HOST];
 	size_t dst_host_ids_entries = 0;
 	int bcast = 1;
-	int was_decrypted = 0;
-	uint64_t crypt_time = 0;
 	struct timespec recvtime;
-	struct knet_header *inbuf = msg->msg_hdr.msg_iov->iov_base;
-	unsigned char *outbuf = (unsigned char *)msg->msg_hdr.msg_iov->iov_base;
-	ssize_t len = msg->msg_len;
+	unsigned char *outbuf = (unsigned char *)inbuf;
+	struct knet_header_ping_ext *ping_ext = (struct knet_header_ping_ext *)inbuf->khp_ping_ext;
 	struct knet_hostinfo *knet_hostinfo;
 	struct iovec iov_out[1];
 	int8_t channel;
 	struct sockaddr_storage pckt_src;
 	seq_num_t recv_seq_num;
 	int wipe_bufs = 0;
-
-	if (knet_h->crypto_instance) {
-		struct timespec start_time;
-		struct timespec end_time;
-
-
-		clock_gettime(CLOCK_MONOTONIC, &start_time);
-		if (crypto_authenticate_and_decrypt(knet_h,
-						    (unsigned char *)inbuf,
-						    len,
-						    knet_h->recv_from_links_buf_decrypt,
-						    &outlen) < 0) {
-			log_debug(knet_h, KNET_SUB_RX, "Unable to decrypt/auth packet");
-			return;
-		}
-		clock_gettime(CLOCK_MONOTONIC, &end_time);
-		timespec_diff(start_time, end_time, &crypt_time);
-
-		if (crypt_time < knet_h->stats.rx_crypt_time_min) {
-			knet_h->stats.rx_crypt_time_min = crypt_time;
-		}
-		if (crypt_time > knet_h->stats.rx_crypt_time_max) {
-			knet_h->stats.rx_crypt_time_max = crypt_time;
-		}
-
-		len = outlen;
-		inbuf = (struct knet_header *)knet_h->recv_from_links_buf_decrypt;
-		was_decrypted++;
-	}
-
-	if (len < (ssize_t)(KNET_HEADER_SIZE + 1)) {
-		log_debug(knet_h, KNET_SUB_RX, "Packet is too short: %ld", (long)len);
-		return;
-	}
-
-	if (inbuf->kh_version != KNET_HEADER_VERSION) {
-		log_debug(knet_h, KNET_SUB_RX, "Packet version does not match");
-		return;
-	}
+	int i;
+	int reliable;
+	struct knet_header_reliable reliable_hdr;
+	size_t large_data = 0;
+	int large_first = 0;
 
 	inbuf->kh_node = ntohs(inbuf->kh_node);
 	src_host = knet_h->host_index[inbuf->kh_node];
@@ -295,11 +842,22 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 		return;
 	}
 
+	/*
+	 * multicast loops back to the local machine, see transport_mcast.c
+	 */
+	if ((src_host->host_id == knet_h->host_id) &&
+	    (knet_h->knet_transport_fd_tracker[sockfd].transport == KNET_TRANSPORT_MCAST)) {
+		return;
+	}
+
 	src_link = NULL;
 
-	src_link = src_host->link +
-		(inbuf->khp_ping_link % KNET_MAX_LINK);
 	if ((inbuf->kh_type & KNET_HEADER_TYPE_PMSK) != 0) {
+		/*
+		 * khp_ping_link and khp_pmtud_link share the same offset
+		 */
+		src_link = src_host->link +
+			((inbuf->khp_ping_link & ~KNET_PING_LINK_MCAST) % KNET_MAX_LINK);
 		if (src_link->dynamic == KNET_LINK_DYNIP) {
 			/*
 			 * cpyaddrport will only copy address and port of the incoming
@@ -349,13 +907,28 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 		channel = inbuf->khp_data_channel;
 		src_host->got_data = 1;
 
+		if (knet_h->knet_transport_fd_tracker[sockfd].transport == KNET_TRANSPORT_MCAST) {
+			knet_h->stats.rx_mcast_packets++;
+		}
+		src_link = _data_src_link(knet_h, sockfd, src_host, msg);
 		if (src_link) {
 			src_link->status.stats.rx_data_packets++;
 			src_link->status.stats.rx_data_bytes += len;
+			if (wire_len > (ssize_t)src_link->pmtud_rx_data_max) {
+				src_link->pmtud_rx_data_max = wire_len;
+			}
 		}
 
-		if (!_seq_num_lookup(src_host, inbuf->khp_data_seq_num, 0, 0)) {
-			if (src_host->link_handler_policy != KNET_LINK_POLICY_ACTIVE) {
+		/*
+		 * retransmitted reliable packets reuse their seq_num, duplicates
+		 * are filtered by the reliable channel sequence numbers instead
+		 */
+		reliable = ((inbuf->kh_type == KNET_HEADER_TYPE_DATA) &&
+			    (inbuf->khp_data_flags & KNET_DATA_FLAG_RELIABLE));
+
+		if ((!reliable) && (!_seq_num_lookup(src_host, inbuf->khp_data_seq_num, 0, 0))) {
+			if ((src_host->link_handler_policy != KNET_LINK_POLICY_ACTIVE) &&
+			    (!(inbuf->khp_data_flags & KNET_DATA_FLAG_PARITY))) {
 				log_debug(knet_h, KNET_SUB_RX, "Packet has already been delivered");
 			}
 			return;
@@ -375,6 +948,11 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 			len = len + KNET_HEADER_DATA_SIZE;
 		}
 
+		if ((reliable) &&
+		    (_reliable_rx_parse(knet_h, src_host, inbuf, &len, &reliable_hdr))) {
+			return;
+		}
+
 		if (inbuf->khp_data_compress) {
 			ssize_t decmp_outlen = KNET_DATABUFSIZE_COMPRESS;
 			struct timespec start_time;
@@ -412,13 +990,13 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 				knet_h->stats.rx_failed_to_decompress++;
 				log_warn(knet_h, KNET_SUB_COMPRESS, "Unable to decompress packet (%d): %s",
 					 err, strerror(errno));
-				return;
+				goto drop_data;
 			}
 		}
 
 		if (inbuf->kh_type == KNET_HEADER_TYPE_DATA) {
 			if (knet_h->enabled != 1) /* data forward is disabled */
-				break;
+				goto drop_data;
 
 			/* Only update the crypto overhead for data packets. Mainly to be
 			   consistent with TX */
@@ -427,14 +1005,30 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 				 crypt_time) / (knet_h->stats.rx_crypt_packets+1);
 			knet_h->stats.rx_crypt_packets++;
 
-			if (knet_h->dst_host_filter_fn) {
+			/*
+			 * the other fragments of a large message follow
+			 * the first one, see large.c
+			 */
+			if (inbuf->kh_version == KNET_HEADER_VERSION_LARGE) {
+				struct knet_header_large *large_hdr = (struct knet_header_large *)inbuf->khp_data_userdata;
+
+				if (len - KNET_HEADER_DATA_SIZE < (ssize_t)KNET_HEADER_LARGE_SIZE) {
+					log_debug(knet_h, KNET_SUB_RX, "Large message fragment is too short");
+					goto drop_data;
+				}
+				large_data = KNET_HEADER_LARGE_SIZE;
+				large_first = (large_hdr->klh_frag_seq == 0);
+			}
+
+			if ((knet_h->dst_host_filter_fn) &&
+			    ((!large_data) || (large_first))) {
 				size_t host_idx;
 				int found = 0;
 
 				bcast = knet_h->dst_host_filter_fn(
 						knet_h->dst_host_filter_fn_private_data,
-						(const unsigned char *)inbuf->khp_data_userdata,
-						len - KNET_HEADER_DATA_SIZE,
+						(const unsigned char *)inbuf->khp_data_userdata + large_data,
+						len - KNET_HEADER_DATA_SIZE - large_data,
 						KNET_NOTIFY_RX,
 						knet_h->host_id,
 						inbuf->kh_node,
@@ -443,19 +1037,19 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 						&dst_host_ids_entries);
 				if (bcast < 0) {
 					log_debug(knet_h, KNET_SUB_RX, "Error from dst_host_filter_fn: %d", bcast);
-					return;
+					goto drop_data;
 				}
 
 				if ((!bcast) && (!dst_host_ids_entries)) {
 					log_debug(knet_h, KNET_SUB_RX, "Message is unicast but no dst_host_ids_entries");
-					return;
+					goto drop_data;
 				}
 
 				/* check if we are dst for this packet */
 				if (!bcast) {
 					if (dst_host_ids_entries > KNET_MAX_HOST) {
 						log_debug(knet_h, KNET_SUB_RX, "dst_host_filter_fn returned too many destinations");
-						return;
+						goto drop_data;
 					}
 					for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
 						if (dst_host_ids[host_idx] == knet_h->host_id) {
@@ -465,7 +1059,7 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 					}
 					if (!found) {
 						log_debug(knet_h, KNET_SUB_RX, "Packet is not for us");
-						return;
+						goto drop_data;
 					}
 				}
 			}
@@ -476,13 +1070,40 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 				log_debug(knet_h, KNET_SUB_RX,
 					  "received packet for channel %d but there is no local sock connected",
 					  channel);
-				return;
+				goto drop_data;
 			}
 
 			memset(iov_out, 0, sizeof(iov_out));
 			iov_out[0].iov_base = (void *) inbuf->khp_data_userdata;
 			iov_out[0].iov_len = len - KNET_HEADER_DATA_SIZE;
 
+			_host_fc_rx_data(knet_h, src_host, channel, iov_out[0].iov_len - large_data);
+
+			if (reliable) {
+				_reliable_rx_deliver(knet_h, src_host, inbuf->khp_data_channel,
+						     &reliable_hdr, channel, &iov_out[0], (large_data != 0));
+				return;
+			}
+
+			/*
+			 * large channels get every message with a large header,
+			 * the other ones never see it
+			 */
+			if ((large_data) || (knet_h->sockfd[channel].is_large)) {
+				if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+					log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+					return;
+				}
+				if (!_large_rx_write(knet_h, src_host, inbuf->khp_data_channel, channel,
+						     iov_out[0].iov_base, iov_out[0].iov_len, (large_data != 0))) {
+					log_debug(knet_h, KNET_SUB_RX, "Channel %d is full, dropping large message from host %u",
+						  channel, src_host->host_id);
+				}
+				pthread_mutex_unlock(&knet_h->tx_mutex);
+				_seq_num_set(src_host, inbuf->khp_data_seq_num, 0);
+				return;
+			}
+
 			outlen = writev(knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], iov_out, 1);
 			if (outlen <= 0) {
 				knet_h->sock_notify_fn(knet_h->sock_notify_fn_private_data,
@@ -510,6 +1131,7 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 				case KNET_HOSTINFO_TYPE_LINK_UP_DOWN:
 					break;
 				case KNET_HOSTINFO_TYPE_LINK_TABLE:
+					_relay_parse_table(knet_h, src_host, knet_hostinfo, len - KNET_HEADER_DATA_SIZE);
 					break;
 				default:
 					log_warn(knet_h, KNET_SUB_RX, "Receiving unknown host info message from host %u", src_host->host_id);
@@ -517,14 +1139,35 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 			}
 		}
 		break;
+	case KNET_HEADER_TYPE_RELAY:
+		_parse_relay(knet_h, sockfd, msg, src_host, inbuf, len, wire_len, crypt_time);
+		break;
+	case KNET_HEADER_TYPE_TREE:
+		_parse_tree(knet_h, sockfd, msg, src_host, inbuf, len, wire_len, crypt_time);
+		break;
 	case KNET_HEADER_TYPE_PING:
-		outlen = KNET_HEADER_PING_SIZE;
+		outlen = KNET_HEADER_PING_EXT_SIZE;
 		inbuf->kh_type = KNET_HEADER_TYPE_PONG;
 		inbuf->kh_node = htons(knet_h->host_id);
 		recv_seq_num = ntohs(inbuf->khp_ping_seq_num);
 		src_link->status.stats.rx_ping_packets++;
 		src_link->status.stats.rx_ping_bytes += len;
 
+		src_link->remote_mcast = (inbuf->khp_ping_link & KNET_PING_LINK_MCAST) ? 1 : 0;
+		inbuf->khp_ping_link &= ~KNET_PING_LINK_MCAST;
+
+		if (len >= (ssize_t)KNET_HEADER_PING_EXT_SIZE) {
+			src_host->caps = ntohl(ping_ext->kpe_caps);
+		} else {
+			src_host->caps = 0;
+		}
+
+		ping_ext->kpe_caps = htonl(KNET_CAPS);
+		ping_ext->kpe_rx_data_max = htonl(src_link->pmtud_rx_data_max);
+		src_link->pmtud_rx_data_max = 0;
+		ping_ext->kpe_rx_bw = htonl(src_link->bw_rx_estimate);
+		ping_ext->kpe_rx_rate = htonl(_bw_rx_rate(src_link));
+
 		wipe_bufs = 0;
 
 		if (!inbuf->khp_ping_timed) {
@@ -578,9 +1221,7 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 		}
 
 retry_pong:
-		len = sendto(src_link->outsock, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL,
-				(struct sockaddr *) &src_link->dst_addr,
-				sizeof(struct sockaddr_storage));
+		len = transport_link_sendto_ctrl(knet_h, src_link, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
 		savederrno = errno;
 		if (len != outlen) {
 			err = transport_tx_sock_error(knet_h, src_link->transport_type, src_link->outsock, len, savederrno);
@@ -613,6 +1254,10 @@ retry_pong:
 		timespec_diff(recvtime,
 				src_link->status.pong_last, &latency_last);
 
+		if (src_link->flags & KNET_LINK_FLAG_TIMESTAMP) {
+			_pong_latency_adjust(src_link, msg, recvtime, &latency_last);
+		}
+
 		src_link->status.latency =
 			((src_link->status.latency * src_link->latency_exp) +
 			((latency_last / 1000llu) *
@@ -642,8 +1287,51 @@ retry_pong:
 		src_link->status.stats.latency_ave =
 			(src_link->status.stats.latency_ave * src_link->status.stats.latency_samples +
 			 src_link->status.latency) / (src_link->status.stats.latency_samples+1);
+
+		/*
+		 * jitter as in RFC3550 6.4.1, J += (|D| - J) / 16
+		 */
+		latency_last = latency_last / 1000llu;
+		if (src_link->status.stats.latency_samples) {
+			jitter_delta = (long long)latency_last - (long long)src_link->latency_last;
+			if (jitter_delta < 0) {
+				jitter_delta = -jitter_delta;
+			}
+			src_link->status.stats.latency_jitter =
+				(long long)src_link->status.stats.latency_jitter +
+				(jitter_delta - (long long)src_link->status.stats.latency_jitter) / 16;
+		}
+		src_link->latency_last = latency_last;
+		_link_latency_histogram_add(src_link, latency_last);
 		src_link->status.stats.latency_samples++;
 
+		/*
+		 * older nodes don't report their features or the data they received
+		 */
+		if (len >= (ssize_t)KNET_HEADER_PING_EXT_SIZE) {
+			src_host->caps = ntohl(ping_ext->kpe_caps);
+			_pmtud_link_validate(knet_h, src_host, src_link, ntohl(ping_ext->kpe_rx_data_max));
+
+			src_link->status.bw_delivered = ntohl(ping_ext->kpe_rx_rate);
+			if ((src_link->bw_probe_interval) && (ping_ext->kpe_rx_bw)) {
+				/*
+				 * what has been delivered is a lower bound of the capacity
+				 */
+				src_link->status.bw_capacity = ntohl(ping_ext->kpe_rx_bw);
+				if (src_link->status.bw_capacity < src_link->status.bw_delivered) {
+					src_link->status.bw_capacity = src_link->status.bw_delivered;
+				}
+				src_link->status.bw_available = src_link->status.bw_capacity - src_link->status.bw_delivered;
+			} else {
+				src_link->status.bw_capacity = 0;
+				src_link->status.bw_available = 0;
+			}
+		}
+
+		if (src_link->cc_target_delay) {
+			_link_cc_update(src_link, latency_last);
+		}
+
 		break;
 	case KNET_HEADER_TYPE_PMTUD:
 		src_link->status.stats.rx_pmtu_packets++;
@@ -671,9 +1359,7 @@ retry_pong:
 			goto out_pmtud;
 		}
 retry_pmtud:
-		len = sendto(src_link->outsock, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL,
-				(struct sockaddr *) &src_link->dst_addr,
-				sizeof(struct sockaddr_storage));
+		len = transport_link_sendto_ctrl(knet_h, src_link, outbuf, outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
 		savederrno = errno;
 		if (len != outlen) {
 			err = transport_tx_sock_error(knet_h, src_link->transport_type, src_link->outsock, len, savederrno);
@@ -706,18 +1392,197 @@ out_pmtud:
 			log_debug(knet_h, KNET_SUB_RX, "Unable to get mutex lock");
 			break;
 		}
-		src_link->last_recv_mtu = inbuf->khp_pmtud_size;
-		pthread_cond_signal(&knet_h->pmtud_cond);
+		/*
+		 * the probe size is echoed back and identifies the probe
+		 */
+		for (i = 0; i < src_link->pmtud_probes; i++) {
+			if ((src_link->pmtud_probe_size[i] == inbuf->khp_pmtud_size) &&
+			    (!src_link->pmtud_probe_acked[i])) {
+				src_link->pmtud_probe_acked[i] = 1;
+				if (knet_h->pmtud_outstanding) {
+					knet_h->pmtud_outstanding--;
+				}
+				break;
+			}
+		}
+		if (!knet_h->pmtud_outstanding) {
+			pthread_cond_signal(&knet_h->pmtud_cond);
+		}
 		pthread_mutex_unlock(&knet_h->pmtud_mutex);
 		break;
+	case KNET_HEADER_TYPE_BWPROBE:
+		_parse_bwprobe(knet_h, sockfd, src_link, msg, inbuf, wire_len);
+		break;
+	case KNET_HEADER_TYPE_CREDIT:
+		_host_fc_parse_credit(knet_h, src_host, inbuf, len);
+		break;
+	case KNET_HEADER_TYPE_ACK:
+		_reliable_parse_ack(knet_h, src_host, inbuf, len);
+		break;
 	default:
 		return;
 	}
+	return;
+
+drop_data:
+	/*
+	 * a reliable packet that is not delivered still uses up its
+	 * sequence number, or the packets after it would wait forever
+	 */
+	if (reliable) {
+		_reliable_rx_drop(knet_h, src_host, inbuf->khp_data_channel, &reliable_hdr);
+	}
+}
+
+/*
+ * first pass over a packet: decrypt and validate the header.
+ * Control packets (PMSK) are parsed immediately so that pongs and
+ * PMTUd replies are not delayed by the data received in the same batch.
+ * Data packets are left (decrypted) in the rx buffer for the second pass,
+ * together with the pings that can reset the seq_num buffers, that must
+ * stay in order with the data.
+ *
+ * returns 1 if the packet needs to be parsed in the second pass, 0 otherwise.
+ */
+
+static int _ping_resets_seq_num(struct knet_header *inbuf, ssize_t len)
+{
+	if ((inbuf->kh_type != KNET_HEADER_TYPE_PING) ||
+	    (len < (ssize_t)KNET_HEADER_PING_SIZE)) {
+		return 0;
+	}
+
+	return ((!inbuf->khp_ping_timed) || (!inbuf->khp_ping_seq_num));
+}
+
+static int _prepare_recv_from_links(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, uint64_t *crypt_time)
+{
+	struct knet_header *inbuf = msg->msg_hdr.msg_iov->iov_base;
+	ssize_t len = msg->msg_len;
+	ssize_t outlen;
+	int crypted = 0;
+
+	*crypt_time = 0;
+
+	/*
+	 * the SHM transport only accepts packets in clear
+	 * on links with KNET_LINK_FLAG_NOCRYPT
+	 */
+	if ((knet_h->crypto_instance) &&
+	    (!((knet_h->knet_transport_fd_tracker[sockfd].transport == KNET_TRANSPORT_SHM) &&
+	       (msg->msg_hdr.msg_flags & KNET_SHM_MSG_PLAIN)))) {
+		struct timespec start_time;
+		struct timespec end_time;
+
+		clock_gettime(CLOCK_MONOTONIC, &start_time);
+		if (crypto_authenticate_and_decrypt(knet_h,
+						    (unsigned char *)inbuf,
+						    len,
+						    knet_h->recv_from_links_buf_decrypt,
+						    &outlen) < 0) {
+			log_debug(knet_h, KNET_SUB_RX, "Unable to decrypt/auth packet");
+			return 0;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end_time);
+		timespec_diff(start_time, end_time, crypt_time);
+
+		if (*crypt_time < knet_h->stats.rx_crypt_time_min) {
+			knet_h->stats.rx_crypt_time_min = *crypt_time;
+		}
+		if (*crypt_time > knet_h->stats.rx_crypt_time_max) {
+			knet_h->stats.rx_crypt_time_max = *crypt_time;
+		}
+
+		len = outlen;
+		inbuf = (struct knet_header *)knet_h->recv_from_links_buf_decrypt;
+		crypted = 1;
+	}
+
+	if (len < (ssize_t)(KNET_HEADER_SIZE + 1)) {
+		log_debug(knet_h, KNET_SUB_RX, "Packet is too short: %ld", (long)len);
+		return 0;
+	}
+
+	if (!_header_version_valid(inbuf)) {
+		log_debug(knet_h, KNET_SUB_RX, "Packet version does not match");
+		return 0;
+	}
+
+	if (((inbuf->kh_type & KNET_HEADER_TYPE_PMSK) != 0) &&
+	    (!_ping_resets_seq_num(inbuf, len))) {
+		_parse_recv_from_links(knet_h, sockfd, msg, inbuf, len, msg->msg_len, *crypt_time);
+		return 0;
+	}
+
+	/*
+	 * decrypted packets are always smaller than what we received,
+	 * move them back in place of the crypted packet
+	 */
+	if (crypted) {
+		memmove(msg->msg_hdr.msg_iov->iov_base, inbuf, len);
+		msg->msg_len = len;
+	}
+
+	return 1;
+}
+
+/*
+ * hand a batch of packets received on sockfd to the transport and
+ * the data path, needs global read lock
+ */
+static void _process_recv_from_links(knet_handle_t knet_h, int sockfd, int transport, struct knet_mmsghdr *msg, int msg_recv)
+{
+	int i, msg_count;
+	uint8_t is_data[PCKT_RX_BUFS];
+	uint64_t crypt_time[PCKT_RX_BUFS];
+	ssize_t wire_len[PCKT_RX_BUFS];
+	uint32_t drops;
+
+	/*
+	 * once the kernel dropped packets on the socket, every packet
+	 * carries the counter (SO_RXQ_OVFL), the last one is up to date
+	 */
+	if ((msg_recv > 0) &&
+	    (_transport_rx_drops(&msg[msg_recv - 1].msg_hdr, &drops) == 0)) {
+		knet_h->knet_transport_fd_tracker[sockfd].rx_drops = drops;
+	}
+
+	/*
+	 * one call per batch, the transport sorts data from its own
+	 * protocol packets and can stop the batch on errors
+	 */
+	msg_count = transport_rx_is_data(knet_h, transport, sockfd, msg, msg_recv, is_data);
+	if (msg_count < msg_recv) {
+		log_debug(knet_h, KNET_SUB_RX, "Transport stopped the packet process loop at %d/%d", msg_count, msg_recv);
+	}
+
+	for (i = 0; i < msg_count; i++) {
+		if (is_data[i]) {
+			wire_len[i] = msg[i].msg_len;
+			is_data[i] = _prepare_recv_from_links(knet_h, sockfd, &msg[i], &crypt_time[i]);
+		}
+	}
+
+	/*
+	 * most control packets have been handled above, now deliver the data
+	 */
+	for (i = 0; i < msg_count; i++) {
+		if (is_data[i]) {
+			_parse_recv_from_links(knet_h, sockfd, &msg[i],
+					       msg[i].msg_hdr.msg_iov->iov_base,
+					       msg[i].msg_len, wire_len[i], crypt_time[i]);
+		}
+	}
+
+	/*
+	 * acks for reliable channels that were not piggybacked
+	 */
+	_reliable_send_acks(knet_h);
 }
 
 static void _handle_recv_from_links(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg)
 {
-	int err, savederrno;
+	int savederrno;
 	int i, msg_recv, transport;
 
 	if (pthread_rwlock_rdlock(&knet_h->global_rwlock) != 0) {
@@ -738,13 +1603,15 @@ static void _handle_recv_from_links(knet_handle_t knet_h, int sockfd, struct kne
 	/*
 	 * reset msg_namelen to buffer size because after recvmmsg
 	 * each msg_namelen will contain sizeof sockaddr_in or sockaddr_in6
+	 * and the same goes for msg_controllen
 	 */
 
 	for (i = 0; i < PCKT_RX_BUFS; i++) {
 		msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		msg[i].msg_hdr.msg_controllen = KNET_RX_CMSG_SIZE;
 	}
 
-	msg_recv = _recvmmsg(sockfd, &msg[0], PCKT_RX_BUFS, MSG_DONTWAIT | MSG_NOSIGNAL);
+	msg_recv = transport_recvmmsg(knet_h, transport, sockfd, &msg[0], PCKT_RX_BUFS, MSG_DONTWAIT | MSG_NOSIGNAL);
 	savederrno = errno;
 
 	/*
@@ -776,48 +1643,117 @@ static void _handle_recv_from_links(knet_handle_t knet_h, int sockfd, struct kne
 		goto exit_unlock;
 	}
 
-	for (i = 0; i < msg_recv; i++) {
-		err = transport_rx_is_data(knet_h, transport, sockfd, &msg[i]);
+	_process_recv_from_links(knet_h, sockfd, transport, msg, msg_recv);
 
-		/*
-		 * TODO: make this section silent once we are confident
-		 *       all protocols packet handlers are good
-		 */
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+}
 
-		switch(err) {
-			case -1: /* on error */
-				log_debug(knet_h, KNET_SUB_RX, "Transport reported error parsing packet");
-				goto exit_unlock;
-				break;
-			case 0: /* packet is not data and we should continue the packet process loop */
-				log_debug(knet_h, KNET_SUB_RX, "Transport reported no data, continue");
-				break;
-			case 1: /* packet is not data and we should STOP the packet process loop */
-				log_debug(knet_h, KNET_SUB_RX, "Transport reported no data, stop");
-				goto exit_unlock;
-				break;
-			case 2: /* packet is data and should be parsed as such */
-				_parse_recv_from_links(knet_h, sockfd, &msg[i]);
-				break;
+#ifdef HAVE_IO_URING
+/*
+ * the kernel already received into the io_uring buffers,
+ * reap them in per socket batches
+ */
+static void _handle_recv_from_uring(knet_handle_t knet_h, struct knet_mmsghdr *msg)
+{
+	int savederrno;
+	int i, sockfd, msg_recv, transport;
+
+	if (pthread_rwlock_rdlock(&knet_h->global_rwlock) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get global read lock");
+		return;
+	}
+
+	while (1) {
+		for (i = 0; i < PCKT_RX_BUFS; i++) {
+			msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+			msg[i].msg_hdr.msg_controllen = KNET_RX_CMSG_SIZE;
+		}
+
+		msg_recv = uring_recv_msgs(knet_h, &sockfd, &msg[0], PCKT_RX_BUFS);
+		savederrno = errno;
+
+		if (msg_recv == 0) {
+			break;
+		}
+
+		if (_is_valid_fd(knet_h, sockfd) < 1) {
+			goto next_batch;
+		}
+
+		transport = knet_h->knet_transport_fd_tracker[sockfd].transport;
+
+		if (msg_recv < 0) {
+			transport_rx_sock_error(knet_h, transport, sockfd, msg_recv, savederrno);
+			/*
+			 * with epoll the next wakeup would find the socket empty and
+			 * report EAGAIN, that is when transports drain the error queue.
+			 * The multishot request doesn't wake us up for that.
+			 */
+			if (savederrno != EAGAIN) {
+				transport_rx_sock_error(knet_h, transport, sockfd, -1, EAGAIN);
+			}
+			goto next_batch;
+		}
+
+		_process_recv_from_links(knet_h, sockfd, transport, msg, msg_recv);
+
+next_batch:
+		for (i = 0; i < msg_recv; i++) {
+			msg[i].msg_hdr.msg_iov->iov_base = knet_h->recv_from_links_buf[i];
 		}
+		uring_recv_done(knet_h);
 	}
 
-exit_unlock:
+	uring_recv_done(knet_h);
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+}
+#endif
+
+/*
+ * a node has been told that a channel sock is full, reopen the window
+ * as soon as the application reads instead of at the next credit refresh
+ */
+static void _recheck_fc_credits(knet_handle_t knet_h)
+{
+	if (pthread_rwlock_rdlock(&knet_h->global_rwlock) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get global read lock");
+		return;
+	}
+
+	_host_fc_send_credits(knet_h);
+
 	pthread_rwlock_unlock(&knet_h->global_rwlock);
 }
 
 void *_handle_recv_from_links_thread(void *data)
 {
-	int i, nev;
+	int i, nev, timeout;
+	int spinning = 0;
+	uint32_t busy_poll;
+	struct timespec spin_start, spin_now, fc_last, fc_now;
+	unsigned long long spin_time, fc_time;
 	knet_handle_t knet_h = (knet_handle_t) data;
 	struct epoll_event events[KNET_EPOLL_MAX_EVENTS];
 	struct sockaddr_storage address[PCKT_RX_BUFS];
 	struct knet_mmsghdr msg[PCKT_RX_BUFS];
 	struct iovec iov_in[PCKT_RX_BUFS];
+	union {
+		char buf[KNET_RX_CMSG_SIZE];
+		struct cmsghdr align;
+	} control[PCKT_RX_BUFS];
 
 	set_thread_status(knet_h, KNET_THREAD_RX, KNET_THREAD_STARTED);
 
+	/* preparing reliable channels ack buffer */
+	knet_h->ackbuf->kh_version = KNET_HEADER_VERSION;
+	knet_h->ackbuf->kh_type = KNET_HEADER_TYPE_ACK;
+	knet_h->ackbuf->kh_node = htons(knet_h->host_id);
+
 	memset(&msg, 0, sizeof(msg));
+	memset(&spin_start, 0, sizeof(spin_start));
+	memset(&fc_last, 0, sizeof(fc_last));
 
 	for (i = 0; i < PCKT_RX_BUFS; i++) {
 		iov_in[i].iov_base = (void *)knet_h->recv_from_links_buf[i];
@@ -829,19 +1765,66 @@ void *_handle_recv_from_links_thread(void *data)
 		msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
 		msg[i].msg_hdr.msg_iov = &iov_in[i];
 		msg[i].msg_hdr.msg_iovlen = 1;
+		msg[i].msg_hdr.msg_control = control[i].buf;
+		msg[i].msg_hdr.msg_controllen = KNET_RX_CMSG_SIZE;
 	}
 
 	while (!shutdown_in_progress(knet_h)) {
-		nev = epoll_wait(knet_h->recv_from_links_epollfd, events, KNET_EPOLL_MAX_EVENTS, knet_h->threads_timer_res / 1000);
+		/*
+		 * with busy polling, keep checking the links without sleeping
+		 * for busy_poll usecs after the last packet (see knet_handle_set_busy_poll)
+		 */
+		busy_poll = knet_h->busy_poll;
+		if (spinning) {
+			timeout = 0;
+		} else if ((knet_h->flow_control) && (knet_h->fc_rx_closed)) {
+			timeout = KNET_FC_RECHECK;
+		} else {
+			timeout = knet_h->threads_timer_res / 1000;
+		}
+		nev = epoll_wait(knet_h->recv_from_links_epollfd, events, KNET_EPOLL_MAX_EVENTS, timeout);
+
+		if ((knet_h->flow_control) && (knet_h->fc_rx_closed)) {
+			clock_gettime(CLOCK_MONOTONIC, &fc_now);
+			timespec_diff(fc_last, fc_now, &fc_time);
+			if (fc_time >= KNET_FC_RECHECK * 1000000llu) {
+				_recheck_fc_credits(knet_h);
+				fc_last = fc_now;
+			}
+		}
 
 		/*
 		 * we use timeout to detect if thread is shutting down
 		 */
 		if (nev == 0) {
+			if (spinning) {
+				clock_gettime(CLOCK_MONOTONIC, &spin_now);
+				timespec_diff(spin_start, spin_now, &spin_time);
+				if (spin_time >= busy_poll * 1000llu) {
+					spinning = 0;
+				} else {
+					/*
+					 * don't starve the threads that produce
+					 * the traffic we are waiting for
+					 */
+					sched_yield();
+				}
+			}
 			continue;
 		}
 
+		if ((nev > 0) && (busy_poll)) {
+			clock_gettime(CLOCK_MONOTONIC, &spin_start);
+			spinning = 1;
+		}
+
 		for (i = 0; i < nev; i++) {
+#ifdef HAVE_IO_URING
+			if ((knet_h->uring) && (events[i].data.fd == uring_rx_fd(knet_h))) {
+				_handle_recv_from_uring(knet_h, msg);
+				continue;
+			}
+#endif
 			_handle_recv_from_links(knet_h, events[i].data.fd, msg);
 		}
 	}
@@ -20,26 +20,200 @@
 #include "compress.h"
 #include "crypto.h"
 #include "host.h"
-#include "link.h"
+#include "large.h"
+#include "links.h"
 #include "logging.h"
+#include "reliable.h"
+#include "relay.h"
 #include "transports.h"
 #include "transport_common.h"
+#include "transport_mcast.h"
+#include "transport_shm.h"
 #include "threads_common.h"
 #include "threads_heartbeat.h"
 #include "threads_tx.h"
+#include "tree.h"
 #include "netutils.h"
 
 /*
  * SEND
  */
 
-static int _dispatch_to_links(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_mmsghdr *msg, int msgs_to_send)
+/*
+ * failover fast path for passive mode.
+ * Return the first usable link from the precomputed backup list
+ * that has not been tried yet in this dispatch (tried_links is a bitmask
+ * of link_ids), or NULL if there is none. Only link status is read here,
+ * the dst cache will catch up on its own once the dst_link_handler thread runs.
+ */
+
+static struct knet_link *_get_failover_link(struct knet_host *dst_host, uint32_t *tried_links)
 {
-	int link_idx, msg_idx, sent_msgs, prev_sent, progress;
+	int i;
+	struct knet_link *link;
+
+	for (i = 0; i < dst_host->backup_link_entries; i++) {
+		link = &dst_host->link[dst_host->backup_links[i]];
+		if (*tried_links & (1U << link->link_id)) {
+			continue;
+		}
+		if ((link->status.enabled == 1) &&
+		    (link->status.connected == 1) &&
+		    (link->has_valid_mtu == 1)) {
+			*tried_links |= (1U << link->link_id);
+			return link;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * bulk channels pacing.
+ * A channel that has to wait for link tokens is removed from the TX
+ * epoll set until paced_until, so that the application gets backpressure
+ * and other channels are not delayed.
+ */
+static void _pace_channel(knet_handle_t knet_h, int8_t channel, uint64_t wait)
+{
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+	struct timespec paced_until;
+
+	clock_gettime(CLOCK_MONOTONIC, &paced_until);
+	paced_until.tv_sec += wait / 1000000llu;
+	paced_until.tv_nsec += (wait % 1000000llu) * 1000llu;
+	if (paced_until.tv_nsec >= 1000000000) {
+		paced_until.tv_sec++;
+		paced_until.tv_nsec -= 1000000000;
+	}
+
+	if ((paced_until.tv_sec > sock->paced_until.tv_sec) ||
+	    ((paced_until.tv_sec == sock->paced_until.tv_sec) &&
+	     (paced_until.tv_nsec > sock->paced_until.tv_nsec))) {
+		sock->paced_until = paced_until;
+	}
+}
+
+static void _pause_paced_channel(knet_handle_t knet_h, int8_t channel)
+{
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+	struct epoll_event ev;
+	struct timespec clock_now;
+	int sockfd = sock->sockfd[sock->is_created];
+
+	if ((!sock->in_use) || (sock->has_error) || (sock->is_paced)) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+	if ((!sock->fc_blocked) &&
+	    ((clock_now.tv_sec > sock->paced_until.tv_sec) ||
+	    ((clock_now.tv_sec == sock->paced_until.tv_sec) &&
+	     (clock_now.tv_nsec >= sock->paced_until.tv_nsec)))) {
+		return;
+	}
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.data.fd = sockfd;
+
+	if (epoll_ctl(knet_h->send_to_links_epollfd, EPOLL_CTL_MOD, sockfd, &ev)) {
+		log_debug(knet_h, KNET_SUB_TX, "Unable to pause datafd %d: %s",
+			  sock->sockfd[0], strerror(errno));
+		return;
+	}
+
+	sock->is_paced = 1;
+	knet_h->tx_paced_channels++;
+}
+
+/*
+ * put back paced channels whose time has come.
+ * Return the epoll timeout (msecs) to use to resume the others.
+ */
+static int _resume_paced_channels(knet_handle_t knet_h)
+{
+	struct knet_sock *sock;
+	struct epoll_event ev;
+	struct timespec clock_now;
+	unsigned long long diff;
+	int channel, sockfd;
+	int timeout = knet_h->threads_timer_res / 1000;
+
+	clock_gettime(CLOCK_MONOTONIC, &clock_now);
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		sock = &knet_h->sockfd[channel];
+
+		if (!sock->is_paced) {
+			continue;
+		}
+
+		if (!sock->in_use) {
+			sock->is_paced = 0;
+			knet_h->tx_paced_channels--;
+			continue;
+		}
+
+		/*
+		 * flow control, the remote node will send credits
+		 * as soon as the application reads some data
+		 */
+		if (sock->fc_blocked) {
+			if ((_host_fc_channel_blocked(knet_h, sock->fc_channel)) ||
+			    (_reliable_channel_blocked(knet_h, sock->fc_channel))) {
+				if (KNET_FC_RECHECK < timeout) {
+					timeout = KNET_FC_RECHECK;
+				}
+				continue;
+			}
+			sock->fc_blocked = 0;
+		}
+
+		if ((clock_now.tv_sec < sock->paced_until.tv_sec) ||
+		    ((clock_now.tv_sec == sock->paced_until.tv_sec) &&
+		     (clock_now.tv_nsec < sock->paced_until.tv_nsec))) {
+			timespec_diff(clock_now, sock->paced_until, &diff);
+			if ((int)((diff + 999999llu) / 1000000llu) < timeout) {
+				timeout = (diff + 999999llu) / 1000000llu;
+			}
+			continue;
+		}
+
+		sockfd = sock->sockfd[sock->is_created];
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.fd = sockfd;
+
+		if (epoll_ctl(knet_h->send_to_links_epollfd, EPOLL_CTL_MOD, sockfd, &ev)) {
+			log_err(knet_h, KNET_SUB_TX, "Unable to resume datafd %d: %s",
+				sock->sockfd[0], strerror(errno));
+		}
+		sock->is_paced = 0;
+		knet_h->tx_paced_channels--;
+	}
+
+	return timeout;
+}
+
+int _dispatch_to_links(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_mmsghdr *msg, int msgs_to_send, int fec_msgs, int8_t channel)
+{
+	int link_idx, msg_idx, sent_msgs, prev_sent, progress, link_msgs;
 	int err = 0, savederrno = 0;
+	int bulk = ((channel >= 0) && (channel < KNET_DATAFD_MAX) && (knet_h->sockfd[channel].is_bulk));
 	unsigned int i;
 	struct knet_mmsghdr *cur;
-	struct knet_link *cur_link;
+	struct knet_link *cur_link, *failover_link;
+	size_t msg_len, link_bytes;
+	uint64_t wait;
+	uint32_t tried_links;
+
+	/*
+	 * no links to the host, the dst cache made it reachable through
+	 * other nodes. Parity fragments are not relayed.
+	 */
+	if ((!dst_host->active_link_entries) && (dst_host->relay_active)) {
+		return _relay_send(knet_h, dst_host, msg, msgs_to_send - fec_msgs, channel);
+	}
 
 	for (link_idx = 0; link_idx < dst_host->active_link_entries; link_idx++) {
 		sent_msgs = 0;
@@ -47,34 +221,98 @@ static int _dispatch_to_links(knet_handle_t knet_h, struct knet_host *dst_host,
 		progress = 1;
 
 		cur_link = &dst_host->link[dst_host->active_links[link_idx]];
+		tried_links = (1U << cur_link->link_id);
 
 		if (cur_link->transport_type == KNET_TRANSPORT_LOOPBACK) {
 			continue;
 		}
 
-		msg_idx = 0;
-		while (msg_idx < msgs_to_send) {
-			msg[msg_idx].msg_hdr.msg_name = &cur_link->dst_addr;
+		/*
+		 * the link might have gone down after the dst cache has been
+		 * calculated. Don't keep sending to it.
+		 */
+		if ((cur_link->status.enabled != 1) ||
+		    (cur_link->status.connected != 1)) {
+			if (dst_host->link_handler_policy != KNET_LINK_POLICY_PASSIVE) {
+				continue;
+			}
+			failover_link = _get_failover_link(dst_host, &tried_links);
+			if (failover_link) {
+				cur_link->status.stats.tx_data_failovers++;
+				cur_link = failover_link;
+			}
+		}
 
+send_link:
+		/*
+		 * parity fragments are at the end, only for links that want them
+		 */
+		link_msgs = msgs_to_send;
+		if (!cur_link->fec_group) {
+			link_msgs = msgs_to_send - fec_msgs;
+		}
+		if (prev_sent >= link_msgs) {
+			continue;
+		}
+
+		msg_idx = prev_sent;
+		link_bytes = 0;
+		while (msg_idx < link_msgs) {
+			if (cur_link->outsock_connected) {
+				msg[msg_idx].msg_hdr.msg_name = NULL;
+				msg[msg_idx].msg_hdr.msg_namelen = 0;
+			} else {
+				msg[msg_idx].msg_hdr.msg_name = &cur_link->dst_addr;
+				msg[msg_idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+			}
+			msg[msg_idx].msg_hdr.msg_control = NULL;
+			msg[msg_idx].msg_hdr.msg_controllen = 0;
+
+			msg_len = 0;
 			/* Cast for Linux/BSD compatibility */
 			for (i=0; i<(unsigned int)msg[msg_idx].msg_hdr.msg_iovlen; i++) {
-				cur_link->status.stats.tx_data_bytes += msg[msg_idx].msg_hdr.msg_iov[i].iov_len;
+				msg_len += msg[msg_idx].msg_hdr.msg_iov[i].iov_len;
 			}
+			cur_link->status.stats.tx_data_bytes += msg_len;
 			cur_link->status.stats.tx_data_packets++;
+			link_bytes += msg_len;
+			if (msg_len > cur_link->pmtud_tx_data_max) {
+				cur_link->pmtud_tx_data_max = msg_len;
+			}
 			msg_idx++;
 		}
 
+		transport_link_tx_channel(knet_h, cur_link, &msg[prev_sent], link_msgs - prev_sent, channel);
+
 retry:
 		cur = &msg[prev_sent];
 
-		sent_msgs = _sendmmsg(dst_host->link[dst_host->active_links[link_idx]].outsock,
-				      &cur[0], msgs_to_send - prev_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+		sent_msgs = transport_link_sendmmsg(knet_h, cur_link,
+						    &cur[0], link_msgs - prev_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
 		savederrno = errno;
 
-		err = transport_tx_sock_error(knet_h, dst_host->link[dst_host->active_links[link_idx]].transport_type, dst_host->link[dst_host->active_links[link_idx]].outsock, sent_msgs, savederrno);
+		err = transport_tx_sock_error(knet_h, cur_link->transport_type, cur_link->outsock, sent_msgs, savederrno);
 		switch(err) {
 			case -1: /* unrecoverable error */
 				cur_link->status.stats.tx_data_errors++;
+				/*
+				 * in passive mode try the next link right away
+				 * instead of dropping the whole batch. Each link is
+				 * tried once, the batch is dropped when all failed.
+				 */
+				if (dst_host->link_handler_policy == KNET_LINK_POLICY_PASSIVE) {
+					failover_link = _get_failover_link(dst_host, &tried_links);
+					if (failover_link) {
+						cur_link->status.stats.tx_data_failovers++;
+						cur_link = failover_link;
+						if (sent_msgs > 0) {
+							prev_sent = prev_sent + sent_msgs;
+						}
+						err = 0;
+						progress = 1;
+						goto send_link;
+					}
+				}
 				goto out_unlock;
 				break;
 			case 0: /* ignore error and continue */
@@ -87,7 +325,7 @@ retry:
 
 		prev_sent = prev_sent + sent_msgs;
 
-		if ((sent_msgs >= 0) && (prev_sent < msgs_to_send)) {
+		if ((sent_msgs >= 0) && (prev_sent < link_msgs)) {
 			if ((sent_msgs) || (progress)) {
 				if (sent_msgs) {
 					progress = 1;
@@ -98,9 +336,9 @@ retry:
 				log_debug(knet_h, KNET_SUB_TX, "Unable to send all (%d/%d) data packets to host %s (%u) link %s:%s (%u)",
 					  sent_msgs, msg_idx,
 					  dst_host->name, dst_host->host_id,
-					  dst_host->link[dst_host->active_links[link_idx]].status.dst_ipaddr,
-					  dst_host->link[dst_host->active_links[link_idx]].status.dst_port,
-					  dst_host->link[dst_host->active_links[link_idx]].link_id);
+					  cur_link->status.dst_ipaddr,
+					  cur_link->status.dst_port,
+					  cur_link->link_id);
 #endif
 				goto retry;
 			}
@@ -111,6 +349,13 @@ retry:
 			}
 		}
 
+		if ((bulk) && (cur_link->cc_target_delay)) {
+			wait = _link_cc_pace(cur_link, link_bytes);
+			if (wait) {
+				_pace_channel(knet_h, channel, wait);
+			}
+		}
+
 		if ((dst_host->link_handler_policy == KNET_LINK_POLICY_RR) &&
 		    (dst_host->active_link_entries > 1)) {
 			uint8_t cur_link_id = dst_host->active_links[0];
@@ -127,7 +372,128 @@ out_unlock:
 	return err;
 }
 
-static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t channel, int is_sync)
+/*
+ * 1 if all the destination hosts support the KNET_CAP_* in cap
+ */
+static int _hosts_have_cap(knet_handle_t knet_h, knet_node_id_t *dst_host_ids, size_t dst_host_ids_entries, uint32_t cap)
+{
+	size_t host_idx;
+
+	for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+		if ((knet_h->host_index[dst_host_ids[host_idx]]->caps & cap) != cap) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * smallest FEC group of the links used to reach the host, 0 if none wants it
+ * or the host would take parity fragments for data
+ */
+static uint8_t _host_fec_group(struct knet_host *host)
+{
+	struct knet_link *link;
+	uint8_t group = 0;
+	int i;
+
+	if (!(host->caps & KNET_CAP_FEC)) {
+		return 0;
+	}
+
+	for (i = 0; i < host->active_link_entries; i++) {
+		link = &host->link[host->active_links[i]];
+		if ((link->fec_group) &&
+		    ((!group) || (link->fec_group < group))) {
+			group = link->fec_group;
+		}
+	}
+
+	return group;
+}
+
+/*
+ * build the parity fragments of inbuf, one every group data fragments
+ * of frag_size bytes, in msg. Returns the number of fragments or -1
+ * if they can't be encrypted
+ */
+static int _fec_build(knet_handle_t knet_h, struct knet_header *inbuf, size_t inlen, size_t frag_size,
+		      uint8_t group, struct knet_mmsghdr *msg, struct iovec *iov)
+{
+	unsigned char *buf = knet_h->send_to_links_buf_fec;
+	unsigned char *buf_crypt = knet_h->send_to_links_buf_fec_crypt;
+	struct knet_header *outbuf;
+	struct knet_header_fec *fec;
+	unsigned char *data;
+	uint16_t len_xor;
+	size_t len, i;
+	ssize_t outlen;
+	int first, frag, msgs = 0;
+
+	for (first = 1; first <= inbuf->khp_data_frag_num; first += group) {
+		outbuf = (struct knet_header *)buf;
+		memmove(outbuf, inbuf, KNET_HEADER_DATA_SIZE);
+		outbuf->khp_data_flags |= KNET_DATA_FLAG_PARITY;
+		outbuf->khp_data_frag_seq = first;
+
+		fec = (struct knet_header_fec *)outbuf->khp_data_userdata;
+		fec->kfh_frags = 0;
+		fec->kfh_pad = 0;
+		memset(fec->kfh_parity, 0, frag_size);
+		len_xor = 0;
+
+		for (frag = first; (frag < first + group) && (frag <= inbuf->khp_data_frag_num); frag++) {
+			data = inbuf->khp_data_userdata + ((frag - 1) * frag_size);
+			if (frag == inbuf->khp_data_frag_num) {
+				len = inlen - ((frag - 1) * frag_size);
+			} else {
+				len = frag_size;
+			}
+			for (i = 0; i < len; i++) {
+				fec->kfh_parity[i] ^= data[i];
+			}
+			len_xor ^= len;
+			fec->kfh_frags++;
+		}
+		fec->kfh_len = htons(len_xor);
+
+		len = KNET_HEADER_DATA_SIZE + KNET_HEADER_FEC_SIZE + frag_size;
+		buf += len;
+
+		iov[msgs].iov_base = outbuf;
+		iov[msgs].iov_len = len;
+
+		if (knet_h->crypto_instance) {
+			if (crypto_encrypt_and_sign(knet_h,
+						    (const unsigned char *)outbuf, len,
+						    buf_crypt, &outlen) < 0) {
+				log_debug(knet_h, KNET_SUB_TX, "Unable to encrypt parity fragment");
+				return -1;
+			}
+			iov[msgs].iov_base = buf_crypt;
+			iov[msgs].iov_len = outlen;
+			buf_crypt += outlen;
+		}
+
+		memset(&msg[msgs], 0, sizeof(struct knet_mmsghdr));
+		msg[msgs].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		msg[msgs].msg_hdr.msg_iov = &iov[msgs];
+		msg[msgs].msg_hdr.msg_iovlen = 1;
+		msgs++;
+	}
+
+	knet_h->stats.tx_fec_packets += msgs;
+
+	return msgs;
+}
+
+/*
+ * large is the sock of a large channel, inbuf holds a fragment
+ * checked by _large_tx_check
+ */
+static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t channel, int is_sync,
+				 struct knet_sock *large)
 {
 	size_t outlen, frag_len;
 	struct knet_host *dst_host;
@@ -140,23 +506,48 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 	struct iovec iov_out[PCKT_FRAG_MAX][2];
 	int iovcnt_out = 2;
 	uint8_t frag_idx;
-	unsigned int temp_data_mtu;
+	unsigned int temp_data_mtu, sent_data_mtu, frag_mtu;
 	size_t host_idx;
-	int send_mcast = 0;
 	struct knet_header *inbuf;
 	int savederrno = 0;
 	int err = 0;
 	seq_num_t tx_seq_num;
 	struct knet_mmsghdr msg[PCKT_FRAG_MAX];
+	struct iovec iov_fec[PCKT_FRAG_MAX];
 	int msgs_to_send, msg_idx;
+	int fec_msgs;
+	uint8_t fec_group;
 	unsigned int i;
 	int j;
 	int send_local = 0;
 	int data_compressed = 0;
 	size_t uncrypted_frag_size;
+	int8_t sock_channel = channel; /* the filter can change channel */
+	size_t data_len = inlen; /* before compression */
+	const unsigned char *msg_data;
+	size_t msg_len;
+	int reliable = 0;
+	size_t rel_host_idx = 0;
+	int blocked;
+	int tree = 0, tree_sent = 0;
+	int mcast = 0, mcast_link;
+	int plain;
+	uint8_t mcast_sent[KNET_MAX_LINK];
 
 	inbuf = knet_h->recv_from_sock_buf;
 
+	/*
+	 * filters see the data of the fragment
+	 */
+	if (large) {
+		msg_data = inbuf->khp_data_userdata + KNET_HEADER_LARGE_SIZE;
+		msg_len = inlen - KNET_HEADER_LARGE_SIZE;
+		data_len = msg_len;
+	} else {
+		msg_data = inbuf->khp_data_userdata;
+		msg_len = inlen;
+	}
+
 	if ((knet_h->enabled != 1) &&
 	    (inbuf->kh_type != KNET_HEADER_TYPE_HOST_INFO)) { /* data forward is disabled */
 		log_debug(knet_h, KNET_SUB_TX, "Received data packet but forwarding is disabled");
@@ -171,11 +562,19 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 	 */
 	switch(inbuf->kh_type) {
 		case KNET_HEADER_TYPE_DATA:
-			if (knet_h->dst_host_filter_fn) {
+			if ((large) && (large->large_seq)) {
+				bcast = large->large_bcast;
+				channel = large->large_channel;
+				if (!bcast) {
+					memmove(dst_host_ids_temp, large->large_dst,
+						large->large_dst_entries * sizeof(knet_node_id_t));
+					dst_host_ids_entries_temp = large->large_dst_entries;
+				}
+			} else if (knet_h->dst_host_filter_fn) {
 				bcast = knet_h->dst_host_filter_fn(
 						knet_h->dst_host_filter_fn_private_data,
-						(const unsigned char *)inbuf->khp_data_userdata,
-						inlen,
+						msg_data,
+						msg_len,
 						KNET_NOTIFY_TX,
 						knet_h->host_id,
 						knet_h->host_id,
@@ -205,6 +604,14 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 				}
 			}
 
+			if ((large) && (!large->large_seq) &&
+			    (_large_tx_filter(knet_h, large, bcast, channel,
+					      dst_host_ids_temp, dst_host_ids_entries_temp) < 0)) {
+				savederrno = ENOMEM;
+				err = -1;
+				goto out_unlock;
+			}
+
 			/* Send to localhost if appropriate and enabled */
 			if (knet_h->has_loop_link) {
 				send_local = 0;
@@ -218,7 +625,7 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 					}
 				}
 				if (send_local) {
-					const unsigned char *buf = inbuf->khp_data_userdata;
+					const unsigned char *buf = (const unsigned char *)inbuf->khp_data_userdata;
 					ssize_t buflen = inlen;
 					struct knet_link *local_link;
 
@@ -231,7 +638,7 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 						local_link->status.stats.tx_data_errors++;
 					}
 					if (err > 0 && err < buflen) {
-						log_debug(knet_h, KNET_SUB_TRANSP_LOOPBACK, "send local incomplete=%d bytes of %zu\n", err, inlen);
+						log_debug(knet_h, KNET_SUB_TRANSP_LOOPBACK, "send local incomplete=%d bytes of %zu\n", err, msg_len);
 						local_link->status.stats.tx_data_retries++;
 						buf += err;
 						buflen -= err;
@@ -240,7 +647,7 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 					}
 					if (err == buflen) {
 						local_link->status.stats.tx_data_packets++;
-						local_link->status.stats.tx_data_bytes += inlen;
+						local_link->status.stats.tx_data_bytes += msg_len;
 					}
 				}
 			}
@@ -300,16 +707,16 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 			goto out_unlock;
 		}
 	} else {
-		send_mcast = 0;
+		dst_host_ids_entries = 0;
 		for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
 			if (!(dst_host->host_id == knet_h->host_id &&
 			      knet_h->has_loop_link) &&
 			    dst_host->status.reachable) {
-				send_mcast = 1;
-				break;
+				dst_host_ids[dst_host_ids_entries] = dst_host->host_id;
+				dst_host_ids_entries++;
 			}
 		}
-		if (!send_mcast) {
+		if (!dst_host_ids_entries) {
 			savederrno = EHOSTDOWN;
 			err = -1;
 			goto out_unlock;
@@ -327,13 +734,62 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 			  KNET_PMTUD_MIN_MTU_V4);
 		temp_data_mtu = KNET_PMTUD_MIN_MTU_V4;
 	} else {
-		/*
-		 * take a copy of the mtu to avoid value changing under
-		 * our feet while we are sending a fragmented pckt
-		 */
 		temp_data_mtu = knet_h->data_mtu;
 	}
 
+	/*
+	 * each host is fragmented for the smallest of the links used
+	 * to reach it. Take a copy of the mtu to avoid value changing under
+	 * our feet while we are sending a fragmented pckt
+	 */
+	for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+		dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+		if (dst_host->data_mtu) {
+			dst_host->tx_data_mtu = dst_host->data_mtu;
+		} else {
+			dst_host->tx_data_mtu = temp_data_mtu;
+		}
+	}
+
+	/*
+	 * fragments of large messages say where they belong, and only go
+	 * to the nodes that know about them. The header is compressed with
+	 * the data, RX looks at it only after decompressing.
+	 * Messages that fit in one fragment go out as any other packet.
+	 */
+	if ((large) && (large->large_frag_num > 1)) {
+		struct knet_header_large *large_hdr = (struct knet_header_large *)inbuf->khp_data_userdata;
+
+		large_hdr->klh_msg_id = htonl(large_hdr->klh_msg_id);
+		large_hdr->klh_len = htonl(large_hdr->klh_len);
+		large_hdr->klh_frag_num = htonl(large_hdr->klh_frag_num);
+		large_hdr->klh_frag_seq = htonl(large_hdr->klh_frag_seq);
+
+		if (!_hosts_have_cap(knet_h, dst_host_ids, dst_host_ids_entries, KNET_CAP_LARGE)) {
+			host_idx = dst_host_ids_entries;
+			dst_host_ids_entries = 0;
+			for (i = 0; i < host_idx; i++) {
+				dst_host = knet_h->host_index[dst_host_ids[i]];
+				if (dst_host->caps & KNET_CAP_LARGE) {
+					dst_host_ids[dst_host_ids_entries] = dst_host_ids[i];
+					dst_host_ids_entries++;
+				} else if (!large->large_seq) {
+					log_debug(knet_h, KNET_SUB_TX, "Host %u does not support large messages, not sending message %u",
+						  dst_host->host_id, large->large_id);
+				}
+			}
+			if (!dst_host_ids_entries) {
+				savederrno = EHOSTDOWN;
+				err = -1;
+				goto out_unlock;
+			}
+		}
+	} else if (large) {
+		inlen -= KNET_HEADER_LARGE_SIZE;
+		memmove(inbuf->khp_data_userdata, inbuf->khp_data_userdata + KNET_HEADER_LARGE_SIZE, inlen);
+		large = NULL;
+	}
+
 	/*
 	 * compress data
 	 */
@@ -383,15 +839,83 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 	}
 
 	/*
-	 * prepare the outgoing buffers
+	 * reliable channels get a header with per destination sequence
+	 * numbers in front of the data, filled for each host below.
+	 * Older nodes would deliver the header as data, they get the
+	 * packet as on any other channel.
 	 */
+	if ((inbuf->kh_type == KNET_HEADER_TYPE_DATA) &&
+	    (knet_h->sockfd[sock_channel].is_reliable) &&
+	    (channel >= 0) && (channel < KNET_DATAFD_MAX) &&
+	    (_hosts_have_cap(knet_h, dst_host_ids, dst_host_ids_entries, KNET_CAP_RELIABLE))) {
+		memmove(inbuf->khp_data_userdata + sizeof(struct knet_header_reliable),
+			inbuf->khp_data_userdata, inlen);
+		inlen += sizeof(struct knet_header_reliable);
+		reliable = 1;
+	}
 
-	frag_len = inlen;
-	frag_idx = 0;
+	/*
+	 * broadcasts go once to the multicast group of the hosts that
+	 * listen to one (see transport_mcast.c), fragmented for the
+	 * smallest data MTU among them
+	 */
+	if ((bcast) && (!reliable) && (!large) &&
+	    (inbuf->kh_type == KNET_HEADER_TYPE_DATA)) {
+		temp_data_mtu = 0;
+		for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+			dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+			dst_host->tx_mcast_link = _mcast_host_link(knet_h, dst_host);
+			if (dst_host->tx_mcast_link < 0) {
+				continue;
+			}
+			if ((!temp_data_mtu) || (dst_host->tx_data_mtu < temp_data_mtu)) {
+				temp_data_mtu = dst_host->tx_data_mtu;
+			}
+		}
+		if (temp_data_mtu) {
+			for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+				dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+				if (dst_host->tx_mcast_link >= 0) {
+					dst_host->tx_data_mtu = temp_data_mtu;
+				}
+			}
+			memset(mcast_sent, 0, sizeof(mcast_sent));
+			mcast = 1;
+		}
+	}
+
+	/*
+	 * broadcasts to more nodes than the fanout go along the tree
+	 * (see tree.c), fragmented once for the smallest data MTU
+	 */
+	if ((bcast) && (!reliable) && (!mcast) && (!large) &&
+	    (inbuf->kh_type == KNET_HEADER_TYPE_DATA) &&
+	    (knet_h->bcast_tree) && (dst_host_ids_entries > knet_h->bcast_tree)) {
+		temp_data_mtu = 0;
+		for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+			dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+			if ((!temp_data_mtu) || (dst_host->tx_data_mtu < temp_data_mtu)) {
+				temp_data_mtu = dst_host->tx_data_mtu;
+			}
+		}
+		temp_data_mtu = _tree_data_mtu(knet_h, temp_data_mtu);
+		if (temp_data_mtu) {
+			for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+				dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+				dst_host->tx_data_mtu = temp_data_mtu;
+			}
+			tree = 1;
+		}
+	}
+
+	/*
+	 * prepare the outgoing buffers
+	 */
 
 	inbuf->khp_data_bcast = bcast;
-	inbuf->khp_data_frag_num = ceil((float)inlen / temp_data_mtu);
 	inbuf->khp_data_channel = channel;
+	inbuf->khp_data_flags = reliable ? KNET_DATA_FLAG_RELIABLE : 0;
+	inbuf->kh_version = large ? KNET_HEADER_VERSION_LARGE : KNET_HEADER_VERSION;
 	if (data_compressed) {
 		inbuf->khp_data_compress = knet_h->compress_model;
 	} else {
@@ -433,6 +957,98 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 		_send_pings(knet_h, 0);
 	}
 
+	/*
+	 * hosts sharing the same data MTU get the same fragments,
+	 * start from the smallest MTU
+	 */
+	sent_data_mtu = 0;
+	err = 0;
+
+next_data_mtu:
+	temp_data_mtu = 0;
+	if (reliable) {
+		/*
+		 * one host at a time, each one has its own sequence numbers
+		 */
+		while (rel_host_idx < dst_host_ids_entries) {
+			dst_host = knet_h->host_index[dst_host_ids[rel_host_idx]];
+			if (!_reliable_tx_prepare(knet_h, dst_host, channel,
+						  (struct knet_header_reliable *)inbuf->khp_data_userdata)) {
+				temp_data_mtu = dst_host->tx_data_mtu;
+				break;
+			}
+			rel_host_idx++;
+		}
+	} else {
+		for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+			dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+			if ((dst_host->tx_data_mtu > sent_data_mtu) &&
+			    ((!temp_data_mtu) || (dst_host->tx_data_mtu < temp_data_mtu))) {
+				temp_data_mtu = dst_host->tx_data_mtu;
+			}
+		}
+	}
+
+	if (!temp_data_mtu) {
+		goto out_unlock;
+	}
+
+	frag_len = inlen;
+	frag_idx = 0;
+	frag_mtu = temp_data_mtu;
+	fec_msgs = 0;
+
+	inbuf->khp_data_frag_num = ceil((float)inlen / temp_data_mtu);
+
+	/*
+	 * forward error correction across the fragments, with the smallest
+	 * group any of the links to these hosts asked for. Parity fragments
+	 * need room for their header, so fragment a bit smaller.
+	 * Nodes along the broadcast tree don't pass them on.
+	 */
+	fec_group = 0;
+	if ((inbuf->khp_data_frag_num > 1) && (!tree)) {
+		if (reliable) {
+			fec_group = _host_fec_group(dst_host);
+		} else {
+			for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+				dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+				if (dst_host->tx_data_mtu != temp_data_mtu) {
+					continue;
+				}
+				i = _host_fec_group(dst_host);
+				if ((i) && ((!fec_group) || (i < fec_group))) {
+					fec_group = i;
+				}
+			}
+		}
+	}
+	if (fec_group) {
+		frag_mtu = temp_data_mtu - KNET_HEADER_FEC_SIZE;
+		inbuf->khp_data_frag_num = ceil((float)inlen / frag_mtu);
+		while (inbuf->khp_data_frag_num + ceil((float)inbuf->khp_data_frag_num / fec_group) > PCKT_FRAG_MAX) {
+			fec_group++;
+		}
+	}
+
+	/*
+	 * hosts only reached through shared memory links that don't
+	 * need crypto get the data in clear (see transport_shm.c)
+	 */
+	plain = 0;
+	if ((knet_h->crypto_instance) && (!reliable) && (!tree) && (!mcast) && (!fec_group) &&
+	    (inbuf->kh_type == KNET_HEADER_TYPE_DATA)) {
+		plain = 1;
+		for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+			dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+			if ((dst_host->tx_data_mtu == temp_data_mtu) &&
+			    (!_shm_host_plain(knet_h, dst_host))) {
+				plain = 0;
+				break;
+			}
+		}
+	}
+
 	if (inbuf->khp_data_frag_num > 1) {
 		while (frag_idx < inbuf->khp_data_frag_num) {
 			/*
@@ -440,13 +1056,13 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 			 */
 			iov_out[frag_idx][0].iov_base = (void *)knet_h->send_to_links_buf[frag_idx];
 			iov_out[frag_idx][0].iov_len = KNET_HEADER_DATA_SIZE;
-			iov_out[frag_idx][1].iov_base = inbuf->khp_data_userdata + (temp_data_mtu * frag_idx);
+			iov_out[frag_idx][1].iov_base = inbuf->khp_data_userdata + (frag_mtu * frag_idx);
 
 			/*
 			 * set the len
 			 */
-			if (frag_len > temp_data_mtu) {
-				iov_out[frag_idx][1].iov_len = temp_data_mtu;
+			if (frag_len > frag_mtu) {
+				iov_out[frag_idx][1].iov_len = frag_mtu;
 			} else {
 				iov_out[frag_idx][1].iov_len = frag_len;
 			}
@@ -454,14 +1070,16 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 			/*
 			 * copy the frag info on all buffers
 			 */
+			knet_h->send_to_links_buf[frag_idx]->kh_version = inbuf->kh_version;
 			knet_h->send_to_links_buf[frag_idx]->kh_type = inbuf->kh_type;
 			knet_h->send_to_links_buf[frag_idx]->khp_data_seq_num = inbuf->khp_data_seq_num;
 			knet_h->send_to_links_buf[frag_idx]->khp_data_frag_num = inbuf->khp_data_frag_num;
 			knet_h->send_to_links_buf[frag_idx]->khp_data_bcast = inbuf->khp_data_bcast;
 			knet_h->send_to_links_buf[frag_idx]->khp_data_channel = inbuf->khp_data_channel;
 			knet_h->send_to_links_buf[frag_idx]->khp_data_compress = inbuf->khp_data_compress;
+			knet_h->send_to_links_buf[frag_idx]->khp_data_flags = inbuf->khp_data_flags;
 
-			frag_len = frag_len - temp_data_mtu;
+			frag_len = frag_len - frag_mtu;
 			frag_idx++;
 		}
 		iovcnt_out = 2;
@@ -471,7 +1089,7 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 		iovcnt_out = 1;
 	}
 
-	if (knet_h->crypto_instance) {
+	if ((knet_h->crypto_instance) && (!plain)) {
 		struct timespec start_time;
 		struct timespec end_time;
 		uint64_t crypt_time;
@@ -526,31 +1144,87 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 		msg[msg_idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
 		msg[msg_idx].msg_hdr.msg_iov = &iov_out[msg_idx][0];
 		msg[msg_idx].msg_hdr.msg_iovlen = iovcnt_out;
+		if (plain) {
+			msg[msg_idx].msg_hdr.msg_flags = KNET_SHM_MSG_PLAIN;
+		}
 		msg_idx++;
 	}
 
-	if (!bcast) {
-		for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
-			dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+	if (fec_group) {
+		fec_msgs = _fec_build(knet_h, inbuf, inlen, frag_mtu, fec_group, &msg[msgs_to_send], iov_fec);
+		if (fec_msgs < 0) {
+			savederrno = ECHILD;
+			err = -1;
+			goto out_unlock;
+		}
+		msgs_to_send += fec_msgs;
+	}
 
-			err = _dispatch_to_links(knet_h, dst_host, &msg[0], msgs_to_send);
-			savederrno = errno;
-			if (err) {
-				goto out_unlock;
+	for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
+		dst_host = knet_h->host_index[dst_host_ids[host_idx]];
+		if (reliable) {
+			if (host_idx != rel_host_idx) {
+				continue;
 			}
+			/*
+			 * keep it before sending, if sending fails
+			 * it will be retransmitted
+			 */
+			_reliable_tx_store(knet_h, dst_host, channel, &msg[0], msgs_to_send - fec_msgs);
+		} else if (dst_host->tx_data_mtu != temp_data_mtu) {
+			continue;
 		}
-	} else {
-		for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
-			if (dst_host->status.reachable) {
-				err = _dispatch_to_links(knet_h, dst_host, &msg[0], msgs_to_send);
-				savederrno = errno;
-				if (err) {
-					goto out_unlock;
-				}
+
+		if ((mcast) && (dst_host->tx_mcast_link >= 0)) {
+			/*
+			 * parity is set up per host (see _host_fec_group),
+			 * the group only gets the data fragments
+			 */
+			mcast_link = dst_host->tx_mcast_link;
+			if (!mcast_sent[mcast_link]) {
+				err = _mcast_send(knet_h, mcast_link, &msg[0], msgs_to_send - fec_msgs);
+				mcast_sent[mcast_link] = 1;
+			} else {
+				err = 0;
+			}
+		} else if ((tree) && (dst_host->host_id != knet_h->host_id)) {
+			if (!tree_sent) {
+				err = _tree_send(knet_h, knet_h->host_id,
+						 knet_h->host_id + 1, knet_h->host_id - 1,
+						 knet_h->bcast_tree, &msg[0], msgs_to_send, sock_channel,
+						 knet_h->treebuf_crypt);
+				tree_sent = 1;
+			} else {
+				err = 0;
+			}
+		} else {
+			err = _dispatch_to_links(knet_h, dst_host, &msg[0], msgs_to_send, fec_msgs, sock_channel);
+		}
+		savederrno = errno;
+		if (err) {
+			goto out_unlock;
+		}
+
+		if ((inbuf->kh_type == KNET_HEADER_TYPE_DATA) &&
+		    (channel >= 0) && (channel < KNET_DATAFD_MAX)) {
+			blocked = _host_fc_tx_data(knet_h, dst_host, channel, data_len);
+			if ((reliable) && (_reliable_tx_blocked(knet_h, dst_host, channel))) {
+				blocked = 1;
+			}
+			if (blocked) {
+				knet_h->sockfd[sock_channel].fc_blocked = 1;
+				knet_h->sockfd[sock_channel].fc_channel = channel;
 			}
 		}
 	}
 
+	if (reliable) {
+		rel_host_idx++;
+	} else {
+		sent_data_mtu = temp_data_mtu;
+	}
+	goto next_data_mtu;
+
 out_unlock:
 	errno = savederrno;
 	return err;
@@ -598,7 +1272,8 @@ int knet_send_sync(knet_handle_t knet_h, const char *buff, const size_t buff_len
 		return -1;
 	}
 
-	if (!knet_h->sockfd[channel].in_use) {
+	if ((!knet_h->sockfd[channel].in_use) ||
+	    (knet_h->sockfd[channel].is_large)) {
 		savederrno = EINVAL;
 		err = -1;
 		goto out;
@@ -612,9 +1287,17 @@ int knet_send_sync(knet_handle_t knet_h, const char *buff, const size_t buff_len
 		goto out;
 	}
 
+	if ((_host_fc_channel_blocked(knet_h, channel)) ||
+	    ((knet_h->sockfd[channel].is_reliable) && (_reliable_channel_blocked(knet_h, channel)))) {
+		pthread_mutex_unlock(&knet_h->tx_mutex);
+		savederrno = EAGAIN;
+		err = -1;
+		goto out;
+	}
+
 	knet_h->recv_from_sock_buf->kh_type = KNET_HEADER_TYPE_DATA;
 	memmove(knet_h->recv_from_sock_buf->khp_data_userdata, buff, buff_len);
-	err = _parse_recv_from_sock(knet_h, buff_len, channel, 1);
+	err = _parse_recv_from_sock(knet_h, buff_len, channel, 1, NULL);
 	savederrno = errno;
 
 	pthread_mutex_unlock(&knet_h->tx_mutex);
@@ -630,10 +1313,14 @@ static void _handle_send_to_links(knet_handle_t knet_h, struct msghdr *msg, int
 {
 	ssize_t inlen = 0;
 	int savederrno = 0, docallback = 0;
+	struct knet_sock *sock = NULL;
 
 	if ((channel >= 0) &&
-	    (channel < KNET_DATAFD_MAX) &&
-	    (!knet_h->sockfd[channel].is_socket)) {
+	    (channel < KNET_DATAFD_MAX)) {
+		sock = &knet_h->sockfd[channel];
+	}
+
+	if ((sock) && (!sock->is_socket)) {
 		inlen = readv(sockfd, msg->msg_iov, 1);
 	} else {
 		inlen = recvmsg(sockfd, msg, MSG_DONTWAIT | MSG_NOSIGNAL);
@@ -656,9 +1343,15 @@ static void _handle_send_to_links(knet_handle_t knet_h, struct msghdr *msg, int
 		} else {
 			knet_h->sockfd[channel].has_error = 1;
 		}
+	} else if ((sock) && (sock->is_large)) {
+		knet_h->recv_from_sock_buf->kh_type = type;
+		if (!_large_tx_check(knet_h, channel, inlen)) {
+			_large_tx_done(knet_h, channel,
+				       _parse_recv_from_sock(knet_h, inlen, channel, 0, sock));
+		}
 	} else {
 		knet_h->recv_from_sock_buf->kh_type = type;
-		_parse_recv_from_sock(knet_h, inlen, channel, 0);
+		_parse_recv_from_sock(knet_h, inlen, channel, 0, NULL);
 	}
 
 	if (docallback) {
@@ -674,8 +1367,8 @@ static void _handle_send_to_links(knet_handle_t knet_h, struct msghdr *msg, int
 void *_handle_send_to_links_thread(void *data)
 {
 	knet_handle_t knet_h = (knet_handle_t) data;
-	struct epoll_event events[KNET_EPOLL_MAX_EVENTS];
-	int i, nev, type;
+	struct epoll_event events[KNET_EPOLL_MAX_EVENTS + 1];
+	int i, nev, type, timeout, reliable_timeout;
 	int8_t channel;
 	struct iovec iov_in;
 	struct msghdr msg;
@@ -703,13 +1396,16 @@ void *_handle_send_to_links_thread(void *data)
 		knet_h->send_to_links_buf[i]->kh_node = htons(knet_h->host_id);
 	}
 
+	timeout = knet_h->threads_timer_res / 1000;
+
 	while (!shutdown_in_progress(knet_h)) {
-		nev = epoll_wait(knet_h->send_to_links_epollfd, events, KNET_EPOLL_MAX_EVENTS + 1, knet_h->threads_timer_res / 1000);
+		nev = epoll_wait(knet_h->send_to_links_epollfd, events, KNET_EPOLL_MAX_EVENTS + 1, timeout);
 
 		/*
 		 * we use timeout to detect if thread is shutting down
+		 * or to resume paced bulk channels
 		 */
-		if (nev == 0) {
+		if ((nev == 0) && (timeout == (int)(knet_h->threads_timer_res / 1000))) {
 			continue;
 		}
 
@@ -740,8 +1436,31 @@ void *_handle_send_to_links_thread(void *data)
 				continue;
 			}
 			_handle_send_to_links(knet_h, &msg, events[i].data.fd, channel, type);
+			if ((channel >= 0) &&
+			    ((knet_h->sockfd[channel].is_bulk) || (knet_h->sockfd[channel].fc_blocked))) {
+				_pause_paced_channel(knet_h, channel);
+			}
 			pthread_mutex_unlock(&knet_h->tx_mutex);
 		}
+		/*
+		 * timers are only needed by paced channels and reliable
+		 * data waiting for acks
+		 */
+		timeout = knet_h->threads_timer_res / 1000;
+		if ((knet_h->tx_paced_channels) || (knet_h->reliable_in_flight)) {
+			if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+				log_debug(knet_h, KNET_SUB_TX, "Unable to get mutex lock");
+			} else {
+				if (knet_h->tx_paced_channels) {
+					timeout = _resume_paced_channels(knet_h);
+				}
+				reliable_timeout = _reliable_tx_timers(knet_h);
+				if ((reliable_timeout >= 0) && (reliable_timeout < timeout)) {
+					timeout = reliable_timeout;
+				}
+				pthread_mutex_unlock(&knet_h->tx_mutex);
+			}
+		}
 		pthread_rwlock_unlock(&knet_h->global_rwlock);
 	}
 
@@ -11,5 +11,6 @@
 #define __KNET_THREADS_TX_H__
 
 void *_handle_send_to_links_thread(void *data);
+int _dispatch_to_links(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_mmsghdr *msg, int msgs_to_send, int fec_msgs, int8_t channel);
 
 #endif
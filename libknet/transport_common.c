@@ -16,6 +16,10 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#ifdef KNET_LINUX
+#include <linux/net_tstamp.h>
+#include <linux/sock_diag.h>
+#endif
 
 #include "libknet.h"
 #include "compat.h"
@@ -71,6 +75,152 @@ int _sendmmsg(int sockfd, struct knet_mmsghdr *msgvec, unsigned int vlen, unsign
 	return ((i > 0) ? (int)i : err);
 }
 
+/*
+ * control packets (ping/pong/pmtud replies) share the socket
+ * with bulk data. On UDP we mark them per packet with SO_PRIORITY
+ * TC_PRIO_INTERACTIVE (6), so that the qdisc dequeues them ahead of
+ * data, and with IPTOS_LOWDELAY for the network in between.
+ * Kernels that don't accept SO_PRIORITY as cmsg (EINVAL) fall back
+ * to TOS only, that the kernel also maps to TC_PRIO_INTERACTIVE.
+ * Other transports, or platforms without per packet TOS, use plain sendto.
+ * SCTP sends control on stream 0, see transport_sctp.c.
+ */
+
+#if defined(KNET_LINUX) && defined(IP_TOS) && defined(IPTOS_LOWDELAY) && defined(IPV6_TCLASS)
+static int ctrl_cmsg_priority = 1;
+#endif
+
+ssize_t _sendto_ctrl(struct knet_link *link, const void *buf, size_t len, int flags)
+{
+#if defined(KNET_LINUX) && defined(IP_TOS) && defined(IPTOS_LOWDELAY) && defined(IPV6_TCLASS)
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(int)) * 2];
+		struct cmsghdr align;
+	} control;
+	int tos = IPTOS_LOWDELAY;
+	int prio = 6; /* TC_PRIO_INTERACTIVE */
+	ssize_t err;
+
+	if (link->transport_type != KNET_TRANSPORT_UDP) {
+		goto out_sendto;
+	}
+
+retry:
+	memset(&msg, 0, sizeof(struct msghdr));
+	memset(&control, 0, sizeof(control));
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+
+	if (!link->outsock_connected) {
+		msg.msg_name = &link->dst_addr;
+		msg.msg_namelen = sizeof(struct sockaddr_storage);
+	}
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int));
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (link->dst_addr.ss_family == AF_INET6) {
+		cmsg->cmsg_level = IPPROTO_IPV6;
+		cmsg->cmsg_type = IPV6_TCLASS;
+	} else {
+		cmsg->cmsg_level = IPPROTO_IP;
+		cmsg->cmsg_type = IP_TOS;
+	}
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memmove(CMSG_DATA(cmsg), &tos, sizeof(int));
+
+	if (ctrl_cmsg_priority) {
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_NXTHDR(&msg, cmsg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SO_PRIORITY;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memmove(CMSG_DATA(cmsg), &prio, sizeof(int));
+	}
+
+	err = sendmsg(link->outsock, &msg, flags);
+	if ((err < 0) && (errno == EINVAL) && (ctrl_cmsg_priority)) {
+		ctrl_cmsg_priority = 0;
+		goto retry;
+	}
+	return err;
+
+out_sendto:
+#endif
+	if (link->outsock_connected) {
+		return send(link->outsock, buf, len, flags);
+	}
+	return sendto(link->outsock, buf, len, flags,
+		      (struct sockaddr *) &link->dst_addr,
+		      sizeof(struct sockaddr_storage));
+}
+
+/*
+ * get the kernel receive timestamp (CLOCK_REALTIME) of a packet
+ * received on a socket with KNET_LINK_FLAG_TIMESTAMP.
+ * returns 0 on success, -1 if the packet has no timestamp.
+ */
+int _transport_rx_timestamp(const struct msghdr *msg, struct timespec *ts)
+{
+#if defined(KNET_LINUX) && defined(SO_TIMESTAMPING)
+	struct msghdr *mhdr = (struct msghdr *)msg;
+	struct cmsghdr *cmsg;
+	struct timespec stamps[3];
+
+	for (cmsg = CMSG_FIRSTHDR(mhdr); cmsg != NULL; cmsg = CMSG_NXTHDR(mhdr, cmsg)) {
+		if ((cmsg->cmsg_level != SOL_SOCKET) ||
+		    (cmsg->cmsg_type != SO_TIMESTAMPING) ||
+		    (cmsg->cmsg_len < CMSG_LEN(sizeof(stamps)))) {
+			continue;
+		}
+		/*
+		 * stamps[0] is the software timestamp, hardware
+		 * timestamps are in the NIC clock domain and not used
+		 */
+		memmove(stamps, CMSG_DATA(cmsg), sizeof(stamps));
+		if ((stamps[0].tv_sec) || (stamps[0].tv_nsec)) {
+			*ts = stamps[0];
+			return 0;
+		}
+	}
+#endif
+	return -1;
+}
+
+/*
+ * get the number of packets the kernel dropped so far on the socket
+ * the packet was received from (SO_RXQ_OVFL). The counter is only
+ * attached to packets once the first drop happened.
+ * returns 0 on success, -1 if the packet has no counter.
+ */
+int _transport_rx_drops(const struct msghdr *msg, uint32_t *drops)
+{
+#ifdef SO_RXQ_OVFL
+	struct msghdr *mhdr = (struct msghdr *)msg;
+	struct cmsghdr *cmsg;
+
+	if (!mhdr->msg_controllen) {
+		return -1;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(mhdr); cmsg != NULL; cmsg = CMSG_NXTHDR(mhdr, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_SOCKET) &&
+		    (cmsg->cmsg_type == SO_RXQ_OVFL) &&
+		    (cmsg->cmsg_len >= CMSG_LEN(sizeof(uint32_t)))) {
+			memmove(drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+			return 0;
+		}
+	}
+#endif
+	return -1;
+}
+
 /* Assume neither of these constants can ever be zero */
 #ifndef SO_RCVBUFFORCE
 #define SO_RCVBUFFORCE 0
@@ -146,6 +296,214 @@ static int _configure_sockbuf(knet_handle_t knet_h, int sock, int option, int fo
 	return 0;
 }
 
+/*
+ * socket buffer sizing, see knet_handle_set_sockbuf_limits
+ */
+#define KNET_SOCKBUF_HIGH_USAGE 75	/* percent of the buffer in use to grow */
+#define KNET_SOCKBUF_LOW_USAGE 10	/* percent of the buffer in use to shrink... */
+#define KNET_SOCKBUF_QUIET_PASSES 60	/* ...for this many passes in a row */
+
+/*
+ * get the buffer size as set by SO_RCVBUF/SO_SNDBUF and how much
+ * of it is in use in percent (0 if the platform can't tell)
+ */
+static int _get_sockbuf_usage(int sock, int option, int *size, int *usage)
+{
+	socklen_t value_len = sizeof(int);
+#if defined(KNET_LINUX) && defined(SO_MEMINFO)
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t meminfo_len = sizeof(meminfo);
+	uint32_t alloc, limit;
+#endif
+
+	*usage = 0;
+
+	if (getsockopt(sock, SOL_SOCKET, option, size, &value_len) < 0) {
+		return -1;
+	}
+
+#ifdef KNET_LINUX
+	/*
+	 * the kernel doubles the requested size to account for
+	 * its own overhead and reports it back doubled
+	 */
+	*size = *size / 2;
+#ifdef SO_MEMINFO
+	if ((getsockopt(sock, SOL_SOCKET, SO_MEMINFO, meminfo, &meminfo_len) == 0) &&
+	    (meminfo_len >= (SK_MEMINFO_WMEM_ALLOC + 1) * sizeof(uint32_t))) {
+		if (option == SO_RCVBUF) {
+			alloc = meminfo[SK_MEMINFO_RMEM_ALLOC];
+			limit = meminfo[SK_MEMINFO_RCVBUF];
+		} else {
+			alloc = meminfo[SK_MEMINFO_WMEM_ALLOC];
+			limit = meminfo[SK_MEMINFO_SNDBUF];
+		}
+		if (limit) {
+			*usage = (int)(((uint64_t)alloc * 100) / limit);
+		}
+	}
+#endif
+#endif
+
+	return 0;
+}
+
+/*
+ * double the buffer when the kernel dropped packets or it is almost full,
+ * halve it after KNET_SOCKBUF_QUIET_PASSES with little in use,
+ * always within the handle limits
+ */
+static void _adjust_sockbuf(knet_handle_t knet_h, int sock, int option, int force,
+			    int size, int usage, uint32_t drops, uint8_t *quiet)
+{
+	int target = size;
+	int new_size, new_usage;
+
+	if ((drops) || (usage >= KNET_SOCKBUF_HIGH_USAGE)) {
+		target = size * 2;
+		*quiet = 0;
+	} else if (usage < KNET_SOCKBUF_LOW_USAGE) {
+		if (++(*quiet) >= KNET_SOCKBUF_QUIET_PASSES) {
+			target = size / 2;
+			*quiet = 0;
+		}
+	} else {
+		*quiet = 0;
+	}
+
+	if (target < (int)knet_h->sockbuf_min) {
+		target = knet_h->sockbuf_min;
+	}
+	if (target > (int)knet_h->sockbuf_max) {
+		target = knet_h->sockbuf_max;
+	}
+	if (target == size) {
+		return;
+	}
+
+	if (setsockopt(sock, SOL_SOCKET, option, &target, sizeof(target)) < 0) {
+		log_debug(knet_h, KNET_SUB_TRANSPORT, "Unable to resize socket %d buffer via option %d: %s",
+			  sock, option, strerror(errno));
+		return;
+	}
+
+	if ((force) && (knet_h->flags & KNET_HANDLE_FLAG_PRIVILEGED) &&
+	    (_get_sockbuf_usage(sock, option, &new_size, &new_usage) == 0) &&
+	    (new_size < target)) {
+		if (setsockopt(sock, SOL_SOCKET, force, &target, sizeof(target)) < 0) {
+			log_debug(knet_h, KNET_SUB_TRANSPORT, "Unable to resize socket %d buffer via force option %d: %s",
+				  sock, force, strerror(errno));
+		}
+	}
+
+	if ((_get_sockbuf_usage(sock, option, &new_size, &new_usage) == 0) &&
+	    (new_size != size)) {
+		log_debug(knet_h, KNET_SUB_TRANSPORT, "Socket %d buffer (option %d) resized from %d to %d (drops: %u usage: %d%%)",
+			  sock, option, size, new_size, drops, usage);
+	}
+}
+
+/*
+ * called approx once a second for each enabled link by the heartbeat thread,
+ * with knet_h->sockbuf_pass bumped at every round. Links can share the same
+ * socket, only the first link of a round resizes it, all of them report
+ * its drops and sizes in their stats.
+ */
+void _sockbuf_update(knet_handle_t knet_h, struct knet_link *kn_link)
+{
+	struct knet_fd_trackers *tracker;
+	uint32_t drops, new_drops;
+	int rcvbuf, sndbuf, rx_usage, tx_usage;
+	int owner;
+
+	if ((kn_link->outsock < 0) || (kn_link->outsock >= KNET_MAX_FDS)) {
+		return;
+	}
+
+	tracker = &knet_h->knet_transport_fd_tracker[kn_link->outsock];
+	if (tracker->transport == KNET_MAX_TRANSPORTS) {
+		return;
+	}
+
+	if ((_get_sockbuf_usage(kn_link->outsock, SO_RCVBUF, &rcvbuf, &rx_usage) < 0) ||
+	    (_get_sockbuf_usage(kn_link->outsock, SO_SNDBUF, &sndbuf, &tx_usage) < 0)) {
+		return;
+	}
+
+	drops = tracker->rx_drops;
+	kn_link->status.stats.rx_sock_drops = drops;
+	kn_link->status.stats.sock_rcvbuf = rcvbuf;
+	kn_link->status.stats.sock_sndbuf = sndbuf;
+
+	/*
+	 * the counter is reset when the fd is reused by a new socket
+	 */
+	new_drops = 0;
+	if (drops > kn_link->sockbuf_drops) {
+		new_drops = drops - kn_link->sockbuf_drops;
+	}
+	kn_link->sockbuf_drops = drops;
+
+	owner = (tracker->sockbuf_pass != knet_h->sockbuf_pass);
+	tracker->sockbuf_pass = knet_h->sockbuf_pass;
+
+	if ((!owner) || (!knet_h->sockbuf_max)) {
+		return;
+	}
+
+	_adjust_sockbuf(knet_h, kn_link->outsock, SO_RCVBUF, SO_RCVBUFFORCE,
+			rcvbuf, rx_usage, new_drops, &kn_link->sockbuf_rx_quiet);
+	_adjust_sockbuf(knet_h, kn_link->outsock, SO_SNDBUF, SO_SNDBUFFORCE,
+			sndbuf, tx_usage, 0, &kn_link->sockbuf_tx_quiet);
+}
+
+/*
+ * ask the kernel to timestamp received packets,
+ * see _transport_rx_timestamp below
+ */
+int _configure_rx_timestamping(knet_handle_t knet_h, int sock, const char *type)
+{
+#if defined(KNET_LINUX) && defined(SO_TIMESTAMPING)
+	int value = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+	if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &value, sizeof(value)) < 0) {
+		log_warn(knet_h, KNET_SUB_TRANSPORT, "Unable to set %s timestamping: %s",
+			 type, strerror(errno));
+		return -1;
+	}
+	log_debug(knet_h, KNET_SUB_TRANSPORT, "SO_TIMESTAMPING enabled on socket: %i", sock);
+	return 0;
+#else
+	log_debug(knet_h, KNET_SUB_TRANSPORT, "SO_TIMESTAMPING not available in this build/platform");
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+/*
+ * let the kernel busy poll the NIC queue of the socket,
+ * see knet_handle_set_busy_poll. Not fatal, the RX thread
+ * spins in userspace regardless.
+ */
+void _configure_busy_poll(knet_handle_t knet_h, int sock, const char *type)
+{
+#if defined(KNET_LINUX) && defined(SO_BUSY_POLL)
+	int value = knet_h->busy_poll;
+
+	if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) < 0) {
+		log_debug(knet_h, KNET_SUB_TRANSPORT, "Unable to set %s SO_BUSY_POLL on socket %d: %s",
+			  type, sock, strerror(errno));
+	}
+#ifdef SO_PREFER_BUSY_POLL
+	value = (knet_h->busy_poll > 0);
+	if (setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, sizeof(value)) < 0) {
+		log_debug(knet_h, KNET_SUB_TRANSPORT, "Unable to set %s SO_PREFER_BUSY_POLL on socket %d: %s",
+			  type, sock, strerror(errno));
+	}
+#endif
+#endif
+}
+
 int _configure_common_socket(knet_handle_t knet_h, int sock, uint64_t flags, const char *type)
 {
 	int err = 0, savederrno = 0;
@@ -183,6 +541,17 @@ int _configure_common_socket(knet_handle_t knet_h, int sock, uint64_t flags, con
 		goto exit_error;
 	}
 
+#ifdef SO_RXQ_OVFL
+	/*
+	 * not fatal, only used for stats and socket buffer sizing
+	 */
+	value = 1;
+	if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &value, sizeof(value)) < 0) {
+		log_debug(knet_h, KNET_SUB_TRANSPORT, "Unable to set %s SO_RXQ_OVFL: %s",
+			  type, strerror(errno));
+	}
+#endif
+
 	if (flags & KNET_LINK_FLAG_TRAFFICHIPRIO) {
 #ifdef KNET_LINUX
 #ifdef SO_PRIORITY
@@ -214,6 +583,17 @@ int _configure_common_socket(knet_handle_t knet_h, int sock, uint64_t flags, con
 #endif
 	}
 
+	if (flags & KNET_LINK_FLAG_TIMESTAMP) {
+		/*
+		 * not fatal, latency is then measured by the threads
+		 */
+		_configure_rx_timestamping(knet_h, sock, type);
+	}
+
+	if (knet_h->busy_poll) {
+		_configure_busy_poll(knet_h, sock, type);
+	}
+
 exit_error:
 	errno = savederrno;
 	return err;
@@ -431,6 +811,10 @@ int _set_fd_tracker(knet_handle_t knet_h, int sockfd, uint8_t transport, uint8_t
 		return -1;
 	}
 
+	if (knet_h->knet_transport_fd_tracker[sockfd].transport != transport) {
+		knet_h->knet_transport_fd_tracker[sockfd].sockbuf_pass = 0;
+		knet_h->knet_transport_fd_tracker[sockfd].rx_drops = 0;
+	}
 	knet_h->knet_transport_fd_tracker[sockfd].transport = transport;
 	knet_h->knet_transport_fd_tracker[sockfd].data_type = data_type;
 	knet_h->knet_transport_fd_tracker[sockfd].data = data;
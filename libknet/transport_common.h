@@ -21,4 +21,13 @@ int _is_valid_fd(knet_handle_t knet_h, int sockfd);
 int _sendmmsg(int sockfd, struct knet_mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 int _recvmmsg(int sockfd, struct knet_mmsghdr *msgvec, unsigned int vlen, unsigned int flags);
 
+ssize_t _sendto_ctrl(struct knet_link *link, const void *buf, size_t len, int flags);
+
+int _configure_rx_timestamping(knet_handle_t knet_h, int sock, const char *type);
+void _configure_busy_poll(knet_handle_t knet_h, int sock, const char *type);
+int _transport_rx_timestamp(const struct msghdr *msg, struct timespec *ts);
+int _transport_rx_drops(const struct msghdr *msg, uint32_t *drops);
+
+void _sockbuf_update(knet_handle_t knet_h, struct knet_link *kn_link);
+
 #endif
@@ -64,9 +64,10 @@ int loopback_transport_tx_sock_error(knet_handle_t knet_h, int sockfd, int recv_
 	return 0;
 }
 
-int loopback_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg)
+int loopback_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data)
 {
-	return 0;
+	memset(is_data, 0, msg_recv);
+	return msg_recv;
 }
 
 int loopback_transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link)
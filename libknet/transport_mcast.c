@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+
+#include "libknet.h"
+#include "compat.h"
+#include "host.h"
+#include "link.h"
+#include "logging.h"
+#include "common.h"
+#include "netutils.h"
+#include "transport_common.h"
+#include "transport_mcast.h"
+#include "transports.h"
+#include "threads_common.h"
+
+/*
+ * IP multicast
+ *
+ * Each link id can have a multicast group, with one socket bound to the
+ * group address and port that joins the group on the interface of the
+ * local address. Nodes that listen to the group of a link id say so in
+ * the pings they send on that link (KNET_PING_LINK_MCAST), and broadcast
+ * data packets for them go once to the group instead of once per node
+ * on their links (see _parse_recv_from_sock). Everything else, unicast,
+ * pings, PMTUd and so on, keeps using the links.
+ *
+ * Packets received from the group are parsed like the ones received on
+ * links and deduplicated with the usual seq_num. Multicast loops back
+ * to the local machine so that several nodes can share it, our own
+ * packets are dropped by the RX thread.
+ *
+ * Groups are not links, KNET_TRANSPORT_MCAST can't be used with
+ * knet_link_set_config.
+ */
+
+typedef struct mcast_link_info {
+	struct sockaddr_storage local_address;
+	struct sockaddr_storage mcast_address;
+	uint8_t link_id;
+	int socket_fd;
+	int on_epoll;
+} mcast_link_info_t;
+
+typedef struct mcast_handle_info {
+	mcast_link_info_t *links[KNET_MAX_LINK];
+	uint8_t links_entries;
+} mcast_handle_info_t;
+
+int mcast_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_link)
+{
+	log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Multicast groups can't be used as links, see knet_handle_set_mcast");
+	errno = EINVAL;
+	return -1;
+}
+
+int mcast_transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_link)
+{
+	return 0;
+}
+
+static void mcast_link_free(knet_handle_t knet_h, mcast_link_info_t *info)
+{
+	struct epoll_event ev;
+
+	if (info->on_epoll) {
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.fd = info->socket_fd;
+		if (epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_DEL, info->socket_fd, &ev) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to remove multicast socket from epoll pool: %s",
+				strerror(errno));
+		}
+		_set_fd_tracker(knet_h, info->socket_fd, KNET_MAX_TRANSPORTS, 0, NULL);
+	}
+
+	if (info->socket_fd >= 0) {
+		close(info->socket_fd);
+	}
+
+	free(info);
+}
+
+int mcast_transport_free(knet_handle_t knet_h)
+{
+	mcast_handle_info_t *handle_info;
+	uint8_t link_id;
+
+	if (!knet_h->transports[KNET_TRANSPORT_MCAST]) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	handle_info = knet_h->transports[KNET_TRANSPORT_MCAST];
+
+	for (link_id = 0; link_id < KNET_MAX_LINK; link_id++) {
+		if (handle_info->links[link_id]) {
+			mcast_link_free(knet_h, handle_info->links[link_id]);
+		}
+	}
+
+	free(handle_info);
+
+	knet_h->transports[KNET_TRANSPORT_MCAST] = NULL;
+
+	return 0;
+}
+
+int mcast_transport_init(knet_handle_t knet_h)
+{
+	mcast_handle_info_t *handle_info;
+
+	if (knet_h->transports[KNET_TRANSPORT_MCAST]) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	handle_info = malloc(sizeof(mcast_handle_info_t));
+	if (!handle_info) {
+		return -1;
+	}
+
+	memset(handle_info, 0, sizeof(mcast_handle_info_t));
+
+	knet_h->transports[KNET_TRANSPORT_MCAST] = handle_info;
+
+	return 0;
+}
+
+int mcast_transport_rx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno)
+{
+	return 0;
+}
+
+int mcast_transport_tx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno)
+{
+	if (recv_err < 0) {
+		if ((recv_errno == ENOBUFS) || (recv_errno == EAGAIN)) {
+#ifdef DEBUG
+			log_debug(knet_h, KNET_SUB_TRANSP_MCAST, "Sock: %d is overloaded. Slowing TX down", sockfd);
+#endif
+			usleep(knet_h->threads_timer_res / 16);
+			return 1;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+int mcast_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data)
+{
+	int i;
+
+	for (i = 0; i < msg_recv; i++) {
+		is_data[i] = (msg[i].msg_len != 0);
+	}
+
+	return msg_recv;
+}
+
+int mcast_transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link)
+{
+	return 0;
+}
+
+/*
+ * index of the interface that has addr, 0 if none
+ */
+static unsigned int mcast_ifindex(const struct sockaddr_storage *addr)
+{
+	struct ifaddrs *ifaddrs, *ifa;
+	unsigned int ifindex = 0;
+
+	if (getifaddrs(&ifaddrs) < 0) {
+		return 0;
+	}
+
+	for (ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
+		if ((!ifa->ifa_addr) || (ifa->ifa_addr->sa_family != AF_INET6)) {
+			continue;
+		}
+		if (!memcmp(&((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr,
+			    &((const struct sockaddr_in6 *)addr)->sin6_addr,
+			    sizeof(struct in6_addr))) {
+			ifindex = if_nametoindex(ifa->ifa_name);
+			break;
+		}
+	}
+
+	freeifaddrs(ifaddrs);
+	return ifindex;
+}
+
+static int mcast_join(knet_handle_t knet_h, int sock,
+		      struct sockaddr_storage *src_addr, struct sockaddr_storage *mcast_addr)
+{
+	struct ip_mreq mreq;
+	struct ipv6_mreq mreq6;
+	unsigned int ifindex;
+	int value;
+
+	value = 1;
+	if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value)) < 0) {
+		log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set REUSEADDR on multicast socket: %s",
+			strerror(errno));
+		return -1;
+	}
+
+	if (mcast_addr->ss_family == AF_INET) {
+		memset(&mreq, 0, sizeof(struct ip_mreq));
+		mreq.imr_multiaddr = ((struct sockaddr_in *)mcast_addr)->sin_addr;
+		mreq.imr_interface = ((struct sockaddr_in *)src_addr)->sin_addr;
+		if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to join multicast group: %s",
+				strerror(errno));
+			return -1;
+		}
+		if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &mreq.imr_interface, sizeof(struct in_addr)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set multicast interface: %s",
+				strerror(errno));
+			return -1;
+		}
+		value = 1;
+		if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &value, sizeof(value)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set multicast TTL: %s",
+				strerror(errno));
+			return -1;
+		}
+		value = 1;
+		if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &value, sizeof(value)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set multicast loop: %s",
+				strerror(errno));
+			return -1;
+		}
+	} else {
+		ifindex = mcast_ifindex(src_addr);
+		memset(&mreq6, 0, sizeof(struct ipv6_mreq));
+		mreq6.ipv6mr_multiaddr = ((struct sockaddr_in6 *)mcast_addr)->sin6_addr;
+		mreq6.ipv6mr_interface = ifindex;
+		if (setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6, sizeof(mreq6)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to join multicast group: %s",
+				strerror(errno));
+			return -1;
+		}
+		if (setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &ifindex, sizeof(ifindex)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set multicast interface: %s",
+				strerror(errno));
+			return -1;
+		}
+		value = 1;
+		if (setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &value, sizeof(value)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set multicast hops: %s",
+				strerror(errno));
+			return -1;
+		}
+		value = 1;
+		if (setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &value, sizeof(value)) < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set multicast loop: %s",
+				strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int _mcast_set_config(knet_handle_t knet_h, uint8_t link_id,
+		      struct sockaddr_storage *src_addr, struct sockaddr_storage *mcast_addr)
+{
+	int err = 0, savederrno = 0;
+	struct epoll_event ev;
+	mcast_link_info_t *info;
+	mcast_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_MCAST];
+
+	if (handle_info->links[link_id]) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	info = malloc(sizeof(mcast_link_info_t));
+	if (!info) {
+		return -1;
+	}
+	memset(info, 0, sizeof(mcast_link_info_t));
+
+	info->socket_fd = socket(mcast_addr->ss_family, SOCK_DGRAM, 0);
+	if (info->socket_fd < 0) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to create multicast socket: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	if (_configure_transport_socket(knet_h, info->socket_fd, mcast_addr, 0, "MCAST") < 0) {
+		savederrno = errno;
+		err = -1;
+		goto exit_error;
+	}
+
+	if (mcast_join(knet_h, info->socket_fd, src_addr, mcast_addr) < 0) {
+		savederrno = errno;
+		err = -1;
+		goto exit_error;
+	}
+
+	if (bind(info->socket_fd, (struct sockaddr *)mcast_addr, sockaddr_len(mcast_addr))) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to bind multicast socket: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.fd = info->socket_fd;
+
+	if (epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_ADD, info->socket_fd, &ev)) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to add multicast socket to epoll pool: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	info->on_epoll = 1;
+
+	if (_set_fd_tracker(knet_h, info->socket_fd, KNET_TRANSPORT_MCAST, 0, info) < 0) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to set fd tracker: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	memmove(&info->local_address, src_addr, sizeof(struct sockaddr_storage));
+	memmove(&info->mcast_address, mcast_addr, sizeof(struct sockaddr_storage));
+	info->link_id = link_id;
+
+	handle_info->links[link_id] = info;
+	handle_info->links_entries++;
+
+exit_error:
+	if (err) {
+		mcast_link_free(knet_h, info);
+	}
+	errno = savederrno;
+	return err;
+}
+
+int _mcast_clear_config(knet_handle_t knet_h, uint8_t link_id)
+{
+	mcast_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_MCAST];
+
+	if (!handle_info->links[link_id]) {
+		errno = 0;
+		return 0;
+	}
+
+	mcast_link_free(knet_h, handle_info->links[link_id]);
+	handle_info->links[link_id] = NULL;
+	handle_info->links_entries--;
+
+	errno = 0;
+	return 0;
+}
+
+int _mcast_get_config(knet_handle_t knet_h, uint8_t link_id,
+		      struct sockaddr_storage *src_addr, struct sockaddr_storage *mcast_addr)
+{
+	mcast_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_MCAST];
+
+	if (!handle_info->links[link_id]) {
+		return 0;
+	}
+
+	memmove(src_addr, &handle_info->links[link_id]->local_address, sizeof(struct sockaddr_storage));
+	memmove(mcast_addr, &handle_info->links[link_id]->mcast_address, sizeof(struct sockaddr_storage));
+
+	return 1;
+}
+
+int _mcast_is_member(knet_handle_t knet_h, uint8_t link_id)
+{
+	mcast_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_MCAST];
+
+	return ((handle_info) && (handle_info->links[link_id]));
+}
+
+int _mcast_host_link(knet_handle_t knet_h, struct knet_host *host)
+{
+	mcast_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_MCAST];
+	struct knet_link *link;
+	uint8_t link_id;
+
+	if ((!handle_info) || (!handle_info->links_entries)) {
+		return -1;
+	}
+
+	for (link_id = 0; link_id < KNET_MAX_LINK; link_id++) {
+		link = &host->link[link_id];
+		if ((handle_info->links[link_id]) &&
+		    (link->remote_mcast) &&
+		    (link->status.enabled == 1) &&
+		    (link->status.connected == 1)) {
+			return link_id;
+		}
+	}
+
+	return -1;
+}
+
+struct knet_link *_mcast_src_link(knet_handle_t knet_h, int sockfd, struct knet_host *src_host)
+{
+	mcast_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
+
+	if (!info) {
+		return NULL;
+	}
+
+	return &src_host->link[info->link_id];
+}
+
+int _mcast_send(knet_handle_t knet_h, uint8_t link_id, struct knet_mmsghdr *msg, int msgs_to_send)
+{
+	mcast_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_MCAST];
+	mcast_link_info_t *info = handle_info->links[link_id];
+	int msg_idx, sent_msgs, prev_sent = 0, err = 0, savederrno = 0;
+
+	for (msg_idx = 0; msg_idx < msgs_to_send; msg_idx++) {
+		msg[msg_idx].msg_hdr.msg_name = &info->mcast_address;
+		msg[msg_idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+	}
+
+	while (prev_sent < msgs_to_send) {
+		sent_msgs = _sendmmsg(info->socket_fd, &msg[prev_sent], msgs_to_send - prev_sent,
+				      MSG_DONTWAIT | MSG_NOSIGNAL);
+		savederrno = errno;
+
+		err = transport_tx_sock_error(knet_h, KNET_TRANSPORT_MCAST, info->socket_fd, sent_msgs, savederrno);
+		if (err < 0) {
+			log_debug(knet_h, KNET_SUB_TRANSP_MCAST, "Unable to send to multicast group of link %u: %s",
+				  link_id, strerror(savederrno));
+			goto out;
+		}
+		if (err > 0) {
+			err = 0;
+			continue;
+		}
+
+		prev_sent += sent_msgs;
+	}
+
+	knet_h->stats.tx_mcast_packets += msgs_to_send;
+	savederrno = 0;
+
+out:
+	errno = savederrno;
+	return err;
+}
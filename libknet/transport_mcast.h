@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include "internals.h"
+
+#ifndef __KNET_TRANSPORT_MCAST_H__
+#define __KNET_TRANSPORT_MCAST_H__
+
+#define KNET_PMTUD_MCAST_OVERHEAD 8
+
+int mcast_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_link);
+int mcast_transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_link);
+int mcast_transport_free(knet_handle_t knet_h);
+int mcast_transport_init(knet_handle_t knet_h);
+int mcast_transport_rx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno);
+int mcast_transport_tx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno);
+int mcast_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data);
+int mcast_transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link);
+
+/*
+ * set/clear the group of a link id, in global write lock context
+ */
+int _mcast_set_config(knet_handle_t knet_h, uint8_t link_id,
+		      struct sockaddr_storage *src_addr, struct sockaddr_storage *mcast_addr);
+int _mcast_clear_config(knet_handle_t knet_h, uint8_t link_id);
+int _mcast_get_config(knet_handle_t knet_h, uint8_t link_id,
+		      struct sockaddr_storage *src_addr, struct sockaddr_storage *mcast_addr);
+
+/*
+ * we listen to the group of link_id
+ */
+int _mcast_is_member(knet_handle_t knet_h, uint8_t link_id);
+
+/*
+ * link id whose group reaches host, -1 if none
+ */
+int _mcast_host_link(knet_handle_t knet_h, struct knet_host *host);
+
+/*
+ * link of src_host a packet received on a group socket belongs to
+ */
+struct knet_link *_mcast_src_link(knet_handle_t knet_h, int sockfd, struct knet_host *src_host);
+
+/*
+ * needs tx_mutex
+ */
+int _mcast_send(knet_handle_t knet_h, uint8_t link_id, struct knet_mmsghdr *msg, int msgs_to_send);
+
+#endif
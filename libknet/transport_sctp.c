@@ -28,6 +28,24 @@
 #include <netinet/sctp.h>
 #include "transport_sctp.h"
 
+/*
+ * data channels are sent on their own stream, so that a lost
+ * chunk of one channel does not hold back the others.
+ * Stream 0 carries the knet internal packets (and the data
+ * channels when the association has a single stream).
+ */
+#define SCTP_STREAMS (KNET_DATAFD_MAX + 1)
+
+/*
+ * SCTP_SNDRCV is deprecated, but SCTP_SNDINFO is not available
+ * on older kernels. The cmsgs are built once at init and only
+ * read from the TX path.
+ */
+typedef union {
+	char buf[CMSG_SPACE(sizeof(struct sctp_sndrcvinfo))];
+	struct cmsghdr align;
+} sctp_sndrcv_cmsg_t;
+
 typedef struct sctp_handle_info {
 	struct knet_list_head listen_links_list;
 	struct knet_list_head connect_links_list;
@@ -39,6 +57,7 @@ typedef struct sctp_handle_info {
 	pthread_t listen_thread;
 	socklen_t event_subscribe_kernel_size;
 	char *event_subscribe_buffer;
+	sctp_sndrcv_cmsg_t sndrcv[SCTP_STREAMS][2]; /* [stream][unordered] */
 } sctp_handle_info_t;
 
 /*
@@ -78,6 +97,7 @@ typedef struct sctp_connect_link_info {
 	int on_connected_epoll;
 	int on_rx_epoll;
 	int close_sock;
+	uint16_t ostreams; /* outbound streams negotiated by the association */
 } sctp_connect_link_info_t;
 
 /*
@@ -147,11 +167,47 @@ static int _enable_sctp_notifications(knet_handle_t knet_h, int sock, const char
 	return err;
 }
 
+/*
+ * control packets go out on stream 0, data on streams 1..ostreams-1.
+ * With the priority stream scheduler (lower value is served first)
+ * pings and pongs don't queue behind the data of the association.
+ * Best effort: kernels without the scheduler keep round robin.
+ */
+static void _prioritize_ctrl_stream(knet_handle_t knet_h, int sock, uint16_t ostreams)
+{
+#if defined(SCTP_STREAM_SCHEDULER) && defined(SCTP_STREAM_SCHEDULER_VALUE)
+	struct sctp_assoc_value sched;
+	struct sctp_stream_value stream;
+	uint16_t i;
+
+	memset(&sched, 0, sizeof(struct sctp_assoc_value));
+	sched.assoc_value = SCTP_SS_PRIO;
+	if (setsockopt(sock, IPPROTO_SCTP, SCTP_STREAM_SCHEDULER, &sched, sizeof(sched)) < 0) {
+		log_debug(knet_h, KNET_SUB_TRANSP_SCTP, "Unable to set priority stream scheduler on socket %d: %s",
+			  sock, strerror(errno));
+		return;
+	}
+
+	for (i = 1; i < ostreams; i++) {
+		memset(&stream, 0, sizeof(struct sctp_stream_value));
+		stream.stream_id = i;
+		stream.stream_value = 1;
+		if (setsockopt(sock, IPPROTO_SCTP, SCTP_STREAM_SCHEDULER_VALUE, &stream, sizeof(stream)) < 0) {
+			log_debug(knet_h, KNET_SUB_TRANSP_SCTP, "Unable to lower priority of stream %u on socket %d: %s",
+				  i, sock, strerror(errno));
+			return;
+		}
+	}
+#endif
+	return;
+}
+
 static int _configure_sctp_socket(knet_handle_t knet_h, int sock, struct sockaddr_storage *address, uint64_t flags, const char *type)
 {
 	int err = 0, savederrno = 0;
 	int value;
 	int level;
+	struct sctp_initmsg initmsg;
 
 #ifdef SOL_SCTP
 	level = SOL_SCTP;
@@ -174,6 +230,17 @@ static int _configure_sctp_socket(knet_handle_t knet_h, int sock, struct sockadd
 		goto exit_error;
 	}
 
+	memset(&initmsg, 0, sizeof(struct sctp_initmsg));
+	initmsg.sinit_num_ostreams = SCTP_STREAMS;
+	initmsg.sinit_max_instreams = SCTP_STREAMS;
+	if (setsockopt(sock, level, SCTP_INITMSG, &initmsg, sizeof(initmsg)) < 0) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSPORT, "Unable to set sctp streams: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
 	if (_enable_sctp_notifications(knet_h, sock, type) < 0) {
 		savederrno = errno;
 		err = -1;
@@ -253,6 +320,7 @@ static int _create_connect_socket(knet_handle_t knet_h, struct knet_link *kn_lin
 
 	info->connect_sock = connect_sock;
 	info->close_sock = 0;
+	info->ostreams = 1;
 	if (_reconnect_socket(knet_h, kn_link) < 0) {
 		savederrno = errno;
 		err = -1;
@@ -411,76 +479,13 @@ int sctp_transport_rx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err,
 	return 0;
 }
 
-/*
- * NOTE: sctp_transport_rx_is_data is called with global rdlock
- *       delegate any FD error management to sctp_transport_rx_sock_error
- *       and keep this code to parsing incoming data only
- */
-int sctp_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg)
+static void _sctp_handle_notification(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg)
 {
 	size_t i;
 	struct iovec *iov = msg->msg_hdr.msg_iov;
 	size_t iovlen = msg->msg_hdr.msg_iovlen;
 	struct sctp_assoc_change *sac;
 	union sctp_notification  *snp;
-	sctp_accepted_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
-
-	if (!(msg->msg_hdr.msg_flags & MSG_NOTIFICATION)) {
-		if (msg->msg_len == 0) {
-			log_debug(knet_h, KNET_SUB_TRANSP_SCTP, "received 0 bytes len packet: %d", sockfd);
-			/*
-			 * NOTE: with event notification enabled, we receive error twice:
-			 *       1) from the event notification
-			 *       2) followed by a 0 byte msg_len
-			 *
-			 * This is generally not a problem if not for causing extra
-			 * handling for the same issue. Should we drop notifications
-			 * and keep the code generic (handle all errors via msg_len = 0)
-			 * or keep the duplication as safety measure, or drop msg_len = 0
-			 * handling (what about sockets without events enabled?)
-			 */
-			sctp_transport_rx_sock_error(knet_h, sockfd, 1, 0);
-			return 1;
-		}
-		/*
-		 * missing MSG_EOR has to be treated as a short read
-		 * from the socket and we need to fill in the mread buf
-		 * while we wait for MSG_EOR
-		 */
-		if (!(msg->msg_hdr.msg_flags & MSG_EOR)) {
-			/*
-			 * copy the incoming data into mread_buf + mread_len (incremental)
-			 * and increase mread_len
-			 */
-			memmove(info->mread_buf + info->mread_len, iov->iov_base, msg->msg_len);
-			info->mread_len = info->mread_len + msg->msg_len;
-			return 0;
-		}
-		/*
-		 * got EOR.
-		 * if mread_len is > 0 we are completing a packet from short reads
-		 * complete reassembling the packet in mread_buf, copy it back in the iov
-		 * and set the iov/msg len numbers (size) correctly
-		 */
-		if (info->mread_len) {
-			/*
-			 * add last fragment to mread_buf
-			 */
-			memmove(info->mread_buf + info->mread_len, iov->iov_base, msg->msg_len);
-			info->mread_len = info->mread_len + msg->msg_len;
-			/*
-			 * move all back into the iovec
-			 */
-			memmove(iov->iov_base, info->mread_buf, info->mread_len);
-			msg->msg_len = info->mread_len;
-			info->mread_len = 0;
-		}
-		return 2;
-	}
-
-	if (!(msg->msg_hdr.msg_flags & MSG_EOR)) {
-		return 1;
-	}
 
 	for (i=0; i< iovlen; i++) {
 		snp = iov[i].iov_base;
@@ -512,7 +517,120 @@ int sctp_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsg
 				break;
 		}
 	}
-	return 0;
+}
+
+/*
+ * NOTE: sctp_transport_tx_channel is called with global rdlock
+ *       all msgs of the batch belong to the same channel
+ */
+void sctp_transport_tx_channel(knet_handle_t knet_h, struct knet_link *kn_link, struct knet_mmsghdr *msg, unsigned int vlen, int8_t channel)
+{
+	sctp_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_SCTP];
+	sctp_connect_link_info_t *info = kn_link->transport_link;
+	unsigned int i;
+	int stream, unordered;
+
+	if ((channel < 0) || (channel >= KNET_DATAFD_MAX) || (info->ostreams < 2)) {
+		return;
+	}
+
+	stream = (channel % (info->ostreams - 1)) + 1;
+	unordered = (knet_h->sockfd[channel].is_unordered != 0);
+
+	for (i = 0; i < vlen; i++) {
+		msg[i].msg_hdr.msg_control = handle_info->sndrcv[stream][unordered].buf;
+		msg[i].msg_hdr.msg_controllen = sizeof(handle_info->sndrcv[stream][unordered].buf);
+	}
+}
+
+/*
+ * NOTE: sctp_transport_rx_is_data is called with global rdlock
+ *       delegate any FD error management to sctp_transport_rx_sock_error
+ *       and keep this code to parsing incoming data only
+ */
+int sctp_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data)
+{
+	int i;
+	int first = -1;
+	struct iovec *iov;
+	sctp_accepted_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
+
+	for (i = 0; i < msg_recv; i++) {
+		is_data[i] = 0;
+		iov = msg[i].msg_hdr.msg_iov;
+
+		if (msg[i].msg_hdr.msg_flags & MSG_NOTIFICATION) {
+			if (!(msg[i].msg_hdr.msg_flags & MSG_EOR)) {
+				break;
+			}
+			_sctp_handle_notification(knet_h, sockfd, &msg[i]);
+			continue;
+		}
+
+		if (msg[i].msg_len == 0) {
+			log_debug(knet_h, KNET_SUB_TRANSP_SCTP, "received 0 bytes len packet: %d", sockfd);
+			/*
+			 * NOTE: with event notification enabled, we receive error twice:
+			 *       1) from the event notification
+			 *       2) followed by a 0 byte msg_len
+			 *
+			 * This is generally not a problem if not for causing extra
+			 * handling for the same issue. Should we drop notifications
+			 * and keep the code generic (handle all errors via msg_len = 0)
+			 * or keep the duplication as safety measure, or drop msg_len = 0
+			 * handling (what about sockets without events enabled?)
+			 */
+			sctp_transport_rx_sock_error(knet_h, sockfd, 1, 0);
+			break;
+		}
+
+		/*
+		 * a missing MSG_EOR is a short read from the socket.
+		 * Packets that started in a previous batch are completed
+		 * in mread_buf, the ones that start in this batch are
+		 * completed in place in the buffer of their first read
+		 * and moved to mread_buf only if the batch ends before MSG_EOR.
+		 */
+		if (info->mread_len) {
+			memmove(info->mread_buf + info->mread_len, iov->iov_base, msg[i].msg_len);
+			info->mread_len = info->mread_len + msg[i].msg_len;
+			if (msg[i].msg_hdr.msg_flags & MSG_EOR) {
+				/*
+				 * move all back into the iovec
+				 */
+				memmove(iov->iov_base, info->mread_buf, info->mread_len);
+				msg[i].msg_len = info->mread_len;
+				info->mread_len = 0;
+				is_data[i] = 1;
+			}
+			continue;
+		}
+
+		if (first >= 0) {
+			memmove((char *)msg[first].msg_hdr.msg_iov->iov_base + msg[first].msg_len,
+				iov->iov_base, msg[i].msg_len);
+			msg[first].msg_len = msg[first].msg_len + msg[i].msg_len;
+			if (msg[i].msg_hdr.msg_flags & MSG_EOR) {
+				is_data[first] = 1;
+				first = -1;
+			}
+			continue;
+		}
+
+		if (!(msg[i].msg_hdr.msg_flags & MSG_EOR)) {
+			first = i;
+			continue;
+		}
+
+		is_data[i] = 1;
+	}
+
+	if (first >= 0) {
+		memmove(info->mread_buf, msg[first].msg_hdr.msg_iov->iov_base, msg[first].msg_len);
+		info->mread_len = msg[first].msg_len;
+	}
+
+	return i;
 }
 
 /*
@@ -528,6 +646,7 @@ static void _handle_connected_sctp(knet_handle_t knet_h, int connect_sock)
 	int err;
 	struct epoll_event ev;
 	unsigned int status, len = sizeof(status);
+	struct sctp_status sstatus;
 	sctp_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_SCTP];
 	sctp_connect_link_info_t *info = knet_h->knet_transport_fd_tracker[connect_sock].data;
 	struct knet_link *kn_link = info->link;
@@ -576,6 +695,23 @@ static void _handle_connected_sctp(knet_handle_t knet_h, int connect_sock)
 	}
 	info->on_connected_epoll = 0;
 
+	/*
+	 * the peer can accept fewer streams than we asked for
+	 */
+	memset(&sstatus, 0, sizeof(struct sctp_status));
+	len = sizeof(sstatus);
+	if (getsockopt(connect_sock, IPPROTO_SCTP, SCTP_STATUS, &sstatus, &len) < 0) {
+		log_warn(knet_h, KNET_SUB_TRANSP_SCTP, "Unable to get streams of socket %d, using only stream 0: %s",
+			 connect_sock, strerror(errno));
+		info->ostreams = 1;
+	} else {
+		info->ostreams = sstatus.sstat_outstrms;
+		log_debug(knet_h, KNET_SUB_TRANSP_SCTP, "SCTP socket %d has %u outbound streams",
+			  connect_sock, info->ostreams);
+	}
+
+	_prioritize_ctrl_stream(knet_h, connect_sock, info->ostreams);
+
 	kn_link->transport_connected = 1;
 	kn_link->outsock = info->connect_sock;
 
@@ -1368,6 +1504,27 @@ static int _sctp_subscribe_init(knet_handle_t knet_h)
 	return 0;
 }
 
+static void _sctp_sndrcv_init(sctp_handle_info_t *handle_info)
+{
+	struct cmsghdr *cmsg;
+	struct sctp_sndrcvinfo *sinfo;
+	int stream, unordered;
+
+	for (stream = 0; stream < SCTP_STREAMS; stream++) {
+		for (unordered = 0; unordered < 2; unordered++) {
+			cmsg = &handle_info->sndrcv[stream][unordered].align;
+			cmsg->cmsg_level = IPPROTO_SCTP;
+			cmsg->cmsg_type = SCTP_SNDRCV;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(struct sctp_sndrcvinfo));
+			sinfo = (struct sctp_sndrcvinfo *)CMSG_DATA(cmsg);
+			sinfo->sinfo_stream = stream;
+			if (unordered) {
+				sinfo->sinfo_flags = SCTP_UNORDERED;
+			}
+		}
+	}
+}
+
 int sctp_transport_init(knet_handle_t knet_h)
 {
 	int err = 0, savederrno = 0;
@@ -1388,6 +1545,8 @@ int sctp_transport_init(knet_handle_t knet_h)
 
 	knet_h->transports[KNET_TRANSPORT_SCTP] = handle_info;
 
+	_sctp_sndrcv_init(handle_info);
+
 	savederrno = _sctp_subscribe_init(knet_h);
 	if (savederrno) {
 		err = -1;
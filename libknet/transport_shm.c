@@ -0,0 +1,909 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include "libknet.h"
+#include "compat.h"
+#include "host.h"
+#include "links.h"
+#include "logging.h"
+#include "common.h"
+#include "transports.h"
+#include "transport_common.h"
+#include "transport_shm.h"
+#include "threads_common.h"
+
+/*
+ * shared memory transport
+ *
+ * Each direction of a link is a single producer, single consumer ring
+ * in a POSIX shared memory segment. The receiver creates the segment
+ * for the packets it gets, named after the sender and receiver
+ * addresses, and an eventfd that sits in the RX epoll. The sender
+ * copies the packets in the ring and writes the eventfd only when the
+ * ring was empty, the receiver copies them out from the RX thread and
+ * wakes itself up again if it could not drain the ring in one go.
+ *
+ * The eventfds are passed once over an abstract unix socket bound to
+ * the name of the segment: each end sends its eventfd when the link is
+ * configured, and replies to the other end when it doesn't have its
+ * eventfd yet. A restarted end creates a new segment and sends a new
+ * eventfd, the other end then maps the new ring.
+ *
+ * Segments are created 0600 and only segments and eventfds from the
+ * same user are accepted.
+ */
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+
+#define KNET_SHM_RING_SIZE	(4 * 1024 * 1024)
+#define KNET_SHM_RING_MAGIC	0x4b4e5352
+#define KNET_SHM_HELLO_MAGIC	0x4b4e5348
+#define KNET_SHM_REC_WRAP	0xffffffff
+#define KNET_SHM_NAME_LEN	96
+
+#define SHM_FD_RING 0
+#define SHM_FD_CTRL 1
+
+typedef struct shm_ring {
+	uint32_t magic;
+	uint32_t size;
+	uint64_t head __attribute__((aligned(64)));	/* written by the sender */
+	uint64_t tail __attribute__((aligned(64)));	/* written by the receiver */
+	unsigned char data[] __attribute__((aligned(64)));
+} shm_ring_t;
+
+typedef struct shm_rec {
+	uint32_t len;
+	uint32_t flags;
+} shm_rec_t;
+
+#define shm_rec_len(len) ((sizeof(shm_rec_t) + (len) + 7) & ~((size_t)7))
+
+typedef struct shm_hello {
+	uint32_t magic;
+	uint8_t reply;
+} shm_hello_t;
+
+typedef struct shm_handle_info {
+	struct knet_list_head links_list;
+} shm_handle_info_t;
+
+typedef struct shm_link_info {
+	struct knet_list_head list;
+	struct knet_link *link;
+	char rx_name[KNET_SHM_NAME_LEN];
+	char tx_name[KNET_SHM_NAME_LEN];
+	shm_ring_t *rx_ring;
+	int rx_efd;
+	int ctrl_fd;
+	int rx_efd_on_epoll;
+	int ctrl_fd_on_epoll;
+	pthread_mutex_t tx_mutex;	/* protects tx_ring and tx_efd */
+	shm_ring_t *tx_ring;
+	int tx_efd;
+} shm_link_info_t;
+
+/*
+ * "/knet-shm-<sender>-<receiver>" with address and port in hex
+ */
+static int shm_name(const struct sockaddr_storage *sender, const struct sockaddr_storage *receiver,
+		    char *name, size_t name_len)
+{
+	const struct sockaddr_storage *ss[2] = { sender, receiver };
+	const unsigned char *addr;
+	size_t addr_len, i, j, pos;
+	uint16_t port;
+
+	pos = snprintf(name, name_len, "/knet-shm");
+
+	for (i = 0; i < 2; i++) {
+		switch (ss[i]->ss_family) {
+			case AF_INET:
+				addr = (const unsigned char *)&((const struct sockaddr_in *)ss[i])->sin_addr;
+				addr_len = sizeof(struct in_addr);
+				port = ntohs(((const struct sockaddr_in *)ss[i])->sin_port);
+				break;
+			case AF_INET6:
+				addr = (const unsigned char *)&((const struct sockaddr_in6 *)ss[i])->sin6_addr;
+				addr_len = sizeof(struct in6_addr);
+				port = ntohs(((const struct sockaddr_in6 *)ss[i])->sin6_port);
+				break;
+			default:
+				errno = EINVAL;
+				return -1;
+				break;
+		}
+		pos += snprintf(name + pos, name_len - pos, "-");
+		for (j = 0; j < addr_len; j++) {
+			pos += snprintf(name + pos, name_len - pos, "%02x", addr[j]);
+		}
+		pos += snprintf(name + pos, name_len - pos, "-%04x", port);
+	}
+
+	return 0;
+}
+
+static socklen_t shm_sockaddr(const char *name, struct sockaddr_un *addr)
+{
+	size_t len = strlen(name);
+
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	/*
+	 * abstract namespace, sun_path[0] stays 0
+	 */
+	memmove(&addr->sun_path[1], name, len);
+
+	return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+static shm_ring_t *shm_ring_create(knet_handle_t knet_h, const char *name)
+{
+	shm_ring_t *ring;
+	int fd, savederrno;
+
+	/*
+	 * a previous instance might not have cleaned up, and a sender could
+	 * still have that ring mapped. Always start from a new segment.
+	 */
+	shm_unlink(name);
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to create ring %s: %s",
+			name, strerror(savederrno));
+		errno = savederrno;
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(shm_ring_t) + KNET_SHM_RING_SIZE) < 0) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to size ring %s: %s",
+			name, strerror(savederrno));
+		close(fd);
+		shm_unlink(name);
+		errno = savederrno;
+		return NULL;
+	}
+
+	ring = mmap(NULL, sizeof(shm_ring_t) + KNET_SHM_RING_SIZE,
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	savederrno = errno;
+	close(fd);
+	if (ring == MAP_FAILED) {
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to map ring %s: %s",
+			name, strerror(savederrno));
+		shm_unlink(name);
+		errno = savederrno;
+		return NULL;
+	}
+
+	ring->size = KNET_SHM_RING_SIZE;
+	ring->head = 0;
+	ring->tail = 0;
+	__atomic_store_n(&ring->magic, KNET_SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+	return ring;
+}
+
+static shm_ring_t *shm_ring_open(knet_handle_t knet_h, const char *name)
+{
+	shm_ring_t *ring;
+	struct stat st;
+	int fd, savederrno;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		savederrno = errno;
+		log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Unable to open ring %s: %s",
+			  name, strerror(savederrno));
+		errno = savederrno;
+		return NULL;
+	}
+
+	if ((fstat(fd, &st) < 0) ||
+	    (st.st_uid != geteuid()) ||
+	    (st.st_size != sizeof(shm_ring_t) + KNET_SHM_RING_SIZE)) {
+		log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Ring %s does not belong to us", name);
+		close(fd);
+		errno = EPERM;
+		return NULL;
+	}
+
+	ring = mmap(NULL, sizeof(shm_ring_t) + KNET_SHM_RING_SIZE,
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	savederrno = errno;
+	close(fd);
+	if (ring == MAP_FAILED) {
+		log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Unable to map ring %s: %s",
+			  name, strerror(savederrno));
+		errno = savederrno;
+		return NULL;
+	}
+
+	if ((__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != KNET_SHM_RING_MAGIC) ||
+	    (ring->size != KNET_SHM_RING_SIZE)) {
+		log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Ring %s is not initialized", name);
+		munmap(ring, sizeof(shm_ring_t) + KNET_SHM_RING_SIZE);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return ring;
+}
+
+static void shm_ring_close(shm_ring_t *ring)
+{
+	if (ring) {
+		munmap(ring, sizeof(shm_ring_t) + KNET_SHM_RING_SIZE);
+	}
+}
+
+/*
+ * send our eventfd to the other end
+ */
+static int shm_send_hello(knet_handle_t knet_h, shm_link_info_t *info, uint8_t reply)
+{
+	struct sockaddr_un addr;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	shm_hello_t hello;
+
+	memset(&hello, 0, sizeof(shm_hello_t));
+	hello.magic = KNET_SHM_HELLO_MAGIC;
+	hello.reply = reply;
+
+	iov.iov_base = &hello;
+	iov.iov_len = sizeof(shm_hello_t);
+
+	memset(&msg, 0, sizeof(struct msghdr));
+	memset(&control, 0, sizeof(control));
+	msg.msg_name = &addr;
+	msg.msg_namelen = shm_sockaddr(info->tx_name, &addr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memmove(CMSG_DATA(cmsg), &info->rx_efd, sizeof(int));
+
+	if (sendmsg(info->ctrl_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+		/*
+		 * normal until the other end is configured
+		 */
+		log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Unable to reach %s: %s",
+			  info->tx_name, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * the other end sent its eventfd, map its ring
+ */
+static void shm_read_hello(knet_handle_t knet_h, shm_link_info_t *info)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct ucred))];
+		struct cmsghdr align;
+	} control;
+	struct ucred cred;
+	shm_hello_t hello;
+	shm_ring_t *ring, *old_ring;
+	int efd = -1, old_efd, cred_ok = 0;
+	ssize_t len;
+
+	iov.iov_base = &hello;
+	iov.iov_len = sizeof(shm_hello_t);
+
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	len = recvmsg(info->ctrl_fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (len < 0) {
+		return;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET) {
+			continue;
+		}
+		if ((cmsg->cmsg_type == SCM_RIGHTS) &&
+		    (cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+			memmove(&efd, CMSG_DATA(cmsg), sizeof(int));
+		}
+		if ((cmsg->cmsg_type == SCM_CREDENTIALS) &&
+		    (cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred)))) {
+			memmove(&cred, CMSG_DATA(cmsg), sizeof(struct ucred));
+			cred_ok = (cred.uid == geteuid());
+		}
+	}
+
+	if ((len != sizeof(shm_hello_t)) || (hello.magic != KNET_SHM_HELLO_MAGIC) ||
+	    (efd < 0) || (!cred_ok)) {
+		log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Discarding invalid hello on %s", info->rx_name);
+		if (efd >= 0) {
+			close(efd);
+		}
+		return;
+	}
+
+	ring = shm_ring_open(knet_h, info->tx_name);
+	if (!ring) {
+		close(efd);
+		return;
+	}
+
+	if (pthread_mutex_lock(&info->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Unable to get SHM TX mutex");
+		shm_ring_close(ring);
+		close(efd);
+		return;
+	}
+	old_ring = info->tx_ring;
+	old_efd = info->tx_efd;
+	info->tx_ring = ring;
+	info->tx_efd = efd;
+	info->link->transport_connected = 1;
+	pthread_mutex_unlock(&info->tx_mutex);
+
+	shm_ring_close(old_ring);
+	if (old_efd >= 0) {
+		close(old_efd);
+	}
+
+	log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Connected to %s", info->tx_name);
+
+	if (hello.reply) {
+		shm_send_hello(knet_h, info, 0);
+	}
+}
+
+static void shm_link_free(knet_handle_t knet_h, shm_link_info_t *info)
+{
+	struct epoll_event ev;
+
+	if (info->rx_efd_on_epoll) {
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.fd = info->rx_efd;
+		epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_DEL, info->rx_efd, &ev);
+		_set_fd_tracker(knet_h, info->rx_efd, KNET_MAX_TRANSPORTS, 0, NULL);
+	}
+	if (info->ctrl_fd_on_epoll) {
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.fd = info->ctrl_fd;
+		epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_DEL, info->ctrl_fd, &ev);
+		_set_fd_tracker(knet_h, info->ctrl_fd, KNET_MAX_TRANSPORTS, 0, NULL);
+	}
+	if (info->ctrl_fd >= 0) {
+		close(info->ctrl_fd);
+	}
+	if (info->rx_efd >= 0) {
+		close(info->rx_efd);
+	}
+	if (info->tx_efd >= 0) {
+		close(info->tx_efd);
+	}
+	if (info->rx_ring) {
+		shm_ring_close(info->rx_ring);
+		shm_unlink(info->rx_name);
+	}
+	shm_ring_close(info->tx_ring);
+	pthread_mutex_destroy(&info->tx_mutex);
+	free(info);
+}
+
+static int shm_add_fd(knet_handle_t knet_h, shm_link_info_t *info, int fd, uint8_t data_type)
+{
+	struct epoll_event ev;
+	int savederrno;
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	if (epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_ADD, fd, &ev)) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to add SHM fd to epoll pool: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	if (data_type == SHM_FD_RING) {
+		info->rx_efd_on_epoll = 1;
+	} else {
+		info->ctrl_fd_on_epoll = 1;
+	}
+
+	if (_set_fd_tracker(knet_h, fd, KNET_TRANSPORT_SHM, data_type, info) < 0) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to set fd tracker: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	return 0;
+}
+
+int shm_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_link)
+{
+	int err = 0, savederrno = 0, value = 1;
+	struct sockaddr_un addr;
+	socklen_t addrlen;
+	shm_link_info_t *info;
+	shm_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_SHM];
+
+	if (kn_link->dynamic != KNET_LINK_STATIC) {
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "SHM links need a destination address");
+		errno = EINVAL;
+		return -1;
+	}
+
+	info = malloc(sizeof(shm_link_info_t));
+	if (!info) {
+		return -1;
+	}
+	memset(info, 0, sizeof(shm_link_info_t));
+	info->link = kn_link;
+	info->rx_efd = -1;
+	info->ctrl_fd = -1;
+	info->tx_efd = -1;
+
+	savederrno = pthread_mutex_init(&info->tx_mutex, NULL);
+	if (savederrno) {
+		free(info);
+		errno = savederrno;
+		return -1;
+	}
+
+	if ((shm_name(&kn_link->dst_addr, &kn_link->src_addr, info->rx_name, KNET_SHM_NAME_LEN) < 0) ||
+	    (shm_name(&kn_link->src_addr, &kn_link->dst_addr, info->tx_name, KNET_SHM_NAME_LEN) < 0)) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to name SHM rings: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	info->rx_ring = shm_ring_create(knet_h, info->rx_name);
+	if (!info->rx_ring) {
+		savederrno = errno;
+		err = -1;
+		goto exit_error;
+	}
+
+	info->rx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (info->rx_efd < 0) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to create eventfd: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	info->ctrl_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (info->ctrl_fd < 0) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to create control socket: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	if ((_fdset_cloexec(info->ctrl_fd)) || (_fdset_nonblock(info->ctrl_fd))) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to set control socket options: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	if (setsockopt(info->ctrl_fd, SOL_SOCKET, SO_PASSCRED, &value, sizeof(value)) < 0) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to set SO_PASSCRED: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	addrlen = shm_sockaddr(info->rx_name, &addr);
+	if (bind(info->ctrl_fd, (struct sockaddr *)&addr, addrlen) < 0) {
+		savederrno = errno;
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Unable to bind control socket: %s",
+			strerror(savederrno));
+		goto exit_error;
+	}
+
+	if ((shm_add_fd(knet_h, info, info->rx_efd, SHM_FD_RING) < 0) ||
+	    (shm_add_fd(knet_h, info, info->ctrl_fd, SHM_FD_CTRL) < 0)) {
+		savederrno = errno;
+		err = -1;
+		goto exit_error;
+	}
+
+	kn_link->outsock = info->rx_efd;
+	kn_link->transport_link = info;
+	knet_list_add(&info->list, &handle_info->links_list);
+
+	shm_send_hello(knet_h, info, 1);
+
+exit_error:
+	if (err) {
+		shm_link_free(knet_h, info);
+	}
+	errno = savederrno;
+	return err;
+}
+
+int shm_transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_link)
+{
+	shm_link_info_t *info = kn_link->transport_link;
+
+	if (!info) {
+		errno = 0;
+		return 0;
+	}
+
+	knet_list_del(&info->list);
+	shm_link_free(knet_h, info);
+	kn_link->transport_link = NULL;
+
+	errno = 0;
+	return 0;
+}
+
+int shm_transport_free(knet_handle_t knet_h)
+{
+	shm_handle_info_t *handle_info;
+
+	if (!knet_h->transports[KNET_TRANSPORT_SHM]) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	handle_info = knet_h->transports[KNET_TRANSPORT_SHM];
+
+	if (!knet_list_empty(&handle_info->links_list)) {
+		log_err(knet_h, KNET_SUB_TRANSP_SHM, "Internal error. handle list is not empty");
+		return -1;
+	}
+
+	free(handle_info);
+
+	knet_h->transports[KNET_TRANSPORT_SHM] = NULL;
+
+	return 0;
+}
+
+int shm_transport_init(knet_handle_t knet_h)
+{
+	shm_handle_info_t *handle_info;
+
+	if (knet_h->transports[KNET_TRANSPORT_SHM]) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	handle_info = malloc(sizeof(shm_handle_info_t));
+	if (!handle_info) {
+		return -1;
+	}
+
+	memset(handle_info, 0, sizeof(shm_handle_info_t));
+
+	knet_h->transports[KNET_TRANSPORT_SHM] = handle_info;
+
+	knet_list_init(&handle_info->links_list);
+
+	return 0;
+}
+
+int shm_transport_rx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno)
+{
+	/*
+	 * empty ring or control message
+	 */
+	return 0;
+}
+
+int shm_transport_tx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno)
+{
+	if (recv_err < 0) {
+		if (recv_errno == EAGAIN) {
+#ifdef DEBUG
+			log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Ring of sock: %d is full. Slowing TX down", sockfd);
+#endif
+			usleep(knet_h->threads_timer_res / 16);
+			return 1;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+int shm_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data)
+{
+	memset(is_data, 1, msg_recv);
+	return msg_recv;
+}
+
+int shm_transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link)
+{
+	return 0;
+}
+
+int shm_transport_tx_msgs(knet_handle_t knet_h, struct knet_link *kn_link, struct knet_mmsghdr *msg, unsigned int vlen)
+{
+	shm_link_info_t *info = kn_link->transport_link;
+	shm_ring_t *ring;
+	shm_rec_t *rec;
+	unsigned char *dst;
+	uint64_t head, start, tail;
+	size_t size, pos, pad, len, rec_len;
+	unsigned int i, j;
+
+	if ((!info) || (pthread_mutex_lock(&info->tx_mutex) != 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ring = info->tx_ring;
+	if (!ring) {
+		pthread_mutex_unlock(&info->tx_mutex);
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	size = KNET_SHM_RING_SIZE;
+	start = head = ring->head;
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < vlen; i++) {
+		len = 0;
+		/* Cast for Linux/BSD compatibility */
+		for (j = 0; j < (unsigned int)msg[i].msg_hdr.msg_iovlen; j++) {
+			len += msg[i].msg_hdr.msg_iov[j].iov_len;
+		}
+		rec_len = shm_rec_len(len);
+
+		/*
+		 * records don't wrap, skip the end of the ring if needed
+		 */
+		pos = head % size;
+		pad = (pos + rec_len > size) ? size - pos : 0;
+
+		if (size - (head - tail) < pad + rec_len) {
+			tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+			if (size - (head - tail) < pad + rec_len) {
+				break;
+			}
+		}
+
+		if (pad) {
+			rec = (shm_rec_t *)&ring->data[pos];
+			rec->len = KNET_SHM_REC_WRAP;
+			head += pad;
+			pos = 0;
+		}
+
+		rec = (shm_rec_t *)&ring->data[pos];
+		rec->len = len;
+		rec->flags = msg[i].msg_hdr.msg_flags & KNET_SHM_MSG_PLAIN;
+		dst = (unsigned char *)(rec + 1);
+		for (j = 0; j < (unsigned int)msg[i].msg_hdr.msg_iovlen; j++) {
+			memmove(dst, msg[i].msg_hdr.msg_iov[j].iov_base, msg[i].msg_hdr.msg_iov[j].iov_len);
+			dst += msg[i].msg_hdr.msg_iov[j].iov_len;
+		}
+		head += rec_len;
+	}
+
+	if (head != start) {
+		__atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+		/*
+		 * the receiver was done with everything before us and might be
+		 * sleeping, if it was not, it checks head again after moving tail
+		 */
+		if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == start) {
+			if (eventfd_write(info->tx_efd, 1) < 0) {
+				log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Unable to wake up %s: %s",
+					  info->tx_name, strerror(errno));
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&info->tx_mutex);
+
+	if (!i) {
+		/*
+		 * nobody is reading the ring, drop like the network would
+		 */
+		if (!kn_link->status.connected) {
+			errno = 0;
+			return vlen;
+		}
+		errno = EAGAIN;
+		return -1;
+	}
+
+	errno = 0;
+	return i;
+}
+
+int shm_transport_rx_msgs(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, unsigned int vlen)
+{
+	shm_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
+	shm_ring_t *ring;
+	shm_rec_t *rec;
+	eventfd_t value;
+	uint64_t head, tail;
+	size_t size, pos, rec_len;
+	uint32_t len, flags;
+	unsigned int i = 0;
+
+	if (!info) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (knet_h->knet_transport_fd_tracker[sockfd].data_type == SHM_FD_CTRL) {
+		shm_read_hello(knet_h, info);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	ring = info->rx_ring;
+	size = KNET_SHM_RING_SIZE;
+
+	eventfd_read(info->rx_efd, &value);
+
+	tail = ring->tail;
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	while ((i < vlen) && (tail != head)) {
+		pos = tail % size;
+		rec = (shm_rec_t *)&ring->data[pos];
+
+		/*
+		 * the ring is shared with the other process, read the record
+		 * header once and only trust the values we checked
+		 */
+		len = __atomic_load_n(&rec->len, __ATOMIC_RELAXED);
+		flags = __atomic_load_n(&rec->flags, __ATOMIC_RELAXED);
+
+		if (len == KNET_SHM_REC_WRAP) {
+			tail += size - pos;
+			continue;
+		}
+
+		rec_len = shm_rec_len(len);
+		if ((pos + rec_len > size) || (rec_len > head - tail)) {
+			log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Ring %s is corrupted, dropping its content", info->rx_name);
+			tail = head;
+			break;
+		}
+
+		if ((len > msg[i].msg_hdr.msg_iov->iov_len) ||
+		    ((flags & KNET_SHM_MSG_PLAIN) && (!(info->link->flags & KNET_LINK_FLAG_NOCRYPT)))) {
+			log_debug(knet_h, KNET_SUB_TRANSP_SHM, "Discarding packet from %s", info->rx_name);
+			tail += rec_len;
+			continue;
+		}
+
+		memmove(msg[i].msg_hdr.msg_iov->iov_base, rec + 1, len);
+		msg[i].msg_len = len;
+		memmove(msg[i].msg_hdr.msg_name, &info->link->dst_addr, sizeof(struct sockaddr_storage));
+		msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		msg[i].msg_hdr.msg_controllen = 0;
+		msg[i].msg_hdr.msg_flags = flags & KNET_SHM_MSG_PLAIN;
+		tail += rec_len;
+		i++;
+	}
+
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+
+	/*
+	 * the sender doesn't wake us up while the ring is not empty
+	 */
+	if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != tail) {
+		eventfd_write(info->rx_efd, 1);
+	}
+
+	if (!i) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	errno = 0;
+	return i;
+}
+
+int _shm_host_plain(knet_handle_t knet_h, struct knet_host *host)
+{
+	struct knet_link *link;
+	int link_idx, connected = 0;
+
+	for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+		link = &host->link[link_idx];
+		if ((!link->configured) || (!link->status.enabled)) {
+			continue;
+		}
+		if ((link->transport_type != KNET_TRANSPORT_SHM) ||
+		    (!(link->flags & KNET_LINK_FLAG_NOCRYPT))) {
+			return 0;
+		}
+		if (link->status.connected) {
+			connected = 1;
+		}
+	}
+
+	return connected;
+}
+
+struct knet_link *_shm_src_link(knet_handle_t knet_h, int sockfd, struct knet_host *src_host)
+{
+	shm_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
+
+	if ((!info) || (info->link != &src_host->link[info->link->link_id])) {
+		return NULL;
+	}
+
+	return info->link;
+}
+
+#else
+
+int _shm_host_plain(knet_handle_t knet_h, struct knet_host *host)
+{
+	return 0;
+}
+
+struct knet_link *_shm_src_link(knet_handle_t knet_h, int sockfd, struct knet_host *src_host)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include "internals.h"
+
+#ifndef __KNET_TRANSPORT_SHM_H__
+#define __KNET_TRANSPORT_SHM_H__
+
+/*
+ * record header in the ring
+ */
+#define KNET_PMTUD_SHM_OVERHEAD 8
+
+/*
+ * msg_flags of packets that are not encrypted
+ * (see KNET_LINK_FLAG_NOCRYPT), only meaningful on SHM links
+ */
+#define KNET_SHM_MSG_PLAIN 0x40000000
+
+#ifdef HAVE_SYS_EVENTFD_H
+
+int shm_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_link);
+int shm_transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_link);
+int shm_transport_free(knet_handle_t knet_h);
+int shm_transport_init(knet_handle_t knet_h);
+int shm_transport_rx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno);
+int shm_transport_tx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno);
+int shm_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data);
+int shm_transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link);
+int shm_transport_tx_msgs(knet_handle_t knet_h, struct knet_link *kn_link, struct knet_mmsghdr *msg, unsigned int vlen);
+int shm_transport_rx_msgs(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, unsigned int vlen);
+
+#endif
+
+/*
+ * host is only reached through SHM links with KNET_LINK_FLAG_NOCRYPT
+ */
+int _shm_host_plain(knet_handle_t knet_h, struct knet_host *host);
+
+/*
+ * link of src_host the data read from sockfd came on, NULL if none
+ */
+struct knet_link *_shm_src_link(knet_handle_t knet_h, int sockfd, struct knet_host *src_host);
+
+#endif
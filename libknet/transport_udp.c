@@ -25,11 +25,15 @@
 #include "compat.h"
 #include "host.h"
 #include "link.h"
+#include "links.h"
 #include "logging.h"
 #include "common.h"
+#include "netutils.h"
 #include "transport_common.h"
 #include "transport_udp.h"
 #include "threads_common.h"
+#include "threads_pmtud.h"
+#include "uring.h"
 
 typedef struct udp_handle_info {
 	struct knet_list_head links_list;
@@ -40,12 +44,15 @@ typedef struct udp_link_info {
 	struct sockaddr_storage local_address;
 	int socket_fd;
 	int on_epoll;
+	int on_uring;
+	int connected;	/* owned by one link, connect()ed to its dst_addr */
 } udp_link_info_t;
 
 int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_link)
 {
 	int err = 0, savederrno = 0;
 	int sock = -1;
+	int connected = 0;
 	struct epoll_event ev;
 	udp_link_info_t *info;
 	udp_handle_info_t *handle_info = knet_h->transports[KNET_TRANSPORT_UDP];
@@ -53,16 +60,29 @@ int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_lin
 	int value;
 #endif
 
+	kn_link->outsock_connected = 0;
+
+	if (kn_link->flags & KNET_LINK_FLAG_CONNECTED) {
+		if (kn_link->dynamic == KNET_LINK_STATIC) {
+			connected = 1;
+		} else {
+			log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Dynamic link, using the shared UDP socket");
+		}
+	}
+
 	/*
 	 * Only allocate a new link if the local address is different
 	 */
-	knet_list_for_each_entry(info, &handle_info->links_list, list) {
-		if (memcmp(&info->local_address, &kn_link->src_addr, sizeof(struct sockaddr_storage)) == 0) {
-			log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Re-using existing UDP socket for new link");
-			kn_link->outsock = info->socket_fd;
-			kn_link->transport_link = info;
-			kn_link->transport_connected = 1;
-			return 0;
+	if (!connected) {
+		knet_list_for_each_entry(info, &handle_info->links_list, list) {
+			if ((!info->connected) &&
+			    (memcmp(&info->local_address, &kn_link->src_addr, sizeof(struct sockaddr_storage)) == 0)) {
+				log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Re-using existing UDP socket for new link");
+				kn_link->outsock = info->socket_fd;
+				kn_link->transport_link = info;
+				kn_link->transport_connected = 1;
+				return 0;
+			}
 		}
 	}
 
@@ -71,6 +91,7 @@ int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_lin
 		err = -1;
 		goto exit_error;
 	}
+	memset(info, 0, sizeof(udp_link_info_t));
 
 	sock = socket(kn_link->src_addr.ss_family, SOCK_DGRAM, 0);
 	if (sock < 0) {
@@ -126,19 +147,50 @@ int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_lin
 		goto exit_error;
 	}
 
-	memset(&ev, 0, sizeof(struct epoll_event));
-	ev.events = EPOLLIN;
-	ev.data.fd = sock;
+	/*
+	 * the shared socket of src_addr (SO_REUSEADDR) can coexist,
+	 * the kernel prefers the connected one for packets from dst_addr
+	 */
+	if (connected) {
+		if (connect(sock, (struct sockaddr *)&kn_link->dst_addr, sockaddr_len(&kn_link->dst_addr))) {
+			savederrno = errno;
+			err = -1;
+			log_err(knet_h, KNET_SUB_TRANSP_UDP, "Unable to connect UDP socket: %s",
+				strerror(savederrno));
+			goto exit_error;
+		}
+		log_debug(knet_h, KNET_SUB_TRANSP_UDP, "UDP socket %d connected to peer", sock);
+	}
 
-	if (epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_ADD, sock, &ev)) {
-		savederrno = errno;
-		err = -1;
-		log_err(knet_h, KNET_SUB_TRANSP_UDP, "Unable to add listener to epoll pool: %s",
-			strerror(savederrno));
-		goto exit_error;
+#ifdef HAVE_IO_URING
+	if (knet_h->uring) {
+		if (uring_add_sock(knet_h, sock) < 0) {
+			savederrno = errno;
+			err = -1;
+			log_err(knet_h, KNET_SUB_TRANSP_UDP, "Unable to add listener to io_uring: %s",
+				strerror(savederrno));
+			goto exit_error;
+		}
+
+		info->on_uring = 1;
 	}
+#endif
+
+	if (!info->on_uring) {
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.fd = sock;
 
-	info->on_epoll = 1;
+		if (epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_ADD, sock, &ev)) {
+			savederrno = errno;
+			err = -1;
+			log_err(knet_h, KNET_SUB_TRANSP_UDP, "Unable to add listener to epoll pool: %s",
+				strerror(savederrno));
+			goto exit_error;
+		}
+
+		info->on_epoll = 1;
+	}
 
 	if (_set_fd_tracker(knet_h, sock, KNET_TRANSPORT_UDP, 0, info) < 0) {
 		savederrno = errno;
@@ -150,9 +202,11 @@ int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_lin
 
 	memmove(&info->local_address, &kn_link->src_addr, sizeof(struct sockaddr_storage));
 	info->socket_fd = sock;
+	info->connected = connected;
 	knet_list_add(&info->list, &handle_info->links_list);
 
 	kn_link->outsock = sock;
+	kn_link->outsock_connected = connected;
 	kn_link->transport_link = info;
 	kn_link->transport_connected = 1;
 
@@ -162,6 +216,11 @@ exit_error:
 			if (info->on_epoll) {
 				epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_DEL, sock, &ev);
 			}
+#ifdef HAVE_IO_URING
+			if (info->on_uring) {
+				uring_del_sock(knet_h, sock);
+			}
+#endif
 			free(info);
 		}
 		if (sock >= 0) {
@@ -216,6 +275,19 @@ int udp_transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_l
 		info->on_epoll = 0;
 	}
 
+#ifdef HAVE_IO_URING
+	if (info->on_uring) {
+		if (uring_del_sock(knet_h, info->socket_fd) < 0) {
+			savederrno = errno;
+			err = -1;
+			log_err(knet_h, KNET_SUB_TRANSP_UDP, "Unable to remove UDP socket from io_uring: %s",
+				strerror(savederrno));
+			goto exit_error;
+		}
+		info->on_uring = 0;
+	}
+#endif
+
 	if (_set_fd_tracker(knet_h, info->socket_fd, KNET_MAX_TRANSPORTS, 0, NULL) < 0) {
 		savederrno = errno;
 		err = -1;
@@ -227,6 +299,7 @@ int udp_transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_l
 	close(info->socket_fd);
 	knet_list_del(&info->list);
 	free(kn_link->transport_link);
+	kn_link->outsock_connected = 0;
 
 exit_error:
 	errno = savederrno;
@@ -283,6 +356,54 @@ int udp_transport_init(knet_handle_t knet_h)
 }
 
 #if defined (IP_RECVERR) || defined (IPV6_RECVERR)
+/*
+ * a packet to remote was too big for the path, let PMTUd know
+ * about the link(s) going there
+ */
+static void udp_pmtud_notify(knet_handle_t knet_h, struct sockaddr_storage *remote, uint32_t mtu)
+{
+	struct knet_host *host;
+	struct knet_link *link;
+	struct sockaddr_storage pckt_dst, link_dst;
+	int link_idx, match_port = 1;
+
+	cpyaddrport(&pckt_dst, remote);
+
+	/*
+	 * errors generated locally (EMSGSIZE) on unconnected sockets
+	 * don't carry the destination port, match on the address only
+	 */
+	if (((pckt_dst.ss_family == AF_INET) && (!((struct sockaddr_in *)&pckt_dst)->sin_port)) ||
+	    ((pckt_dst.ss_family == AF_INET6) && (!((struct sockaddr_in6 *)&pckt_dst)->sin6_port))) {
+		match_port = 0;
+	}
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		for (link_idx = 0; link_idx < KNET_MAX_LINK; link_idx++) {
+			link = &host->link[link_idx];
+
+			if ((!link->configured) ||
+			    (link->transport_type != KNET_TRANSPORT_UDP)) {
+				continue;
+			}
+
+			cpyaddrport(&link_dst, &link->dst_addr);
+			if (!match_port) {
+				if (link_dst.ss_family == AF_INET) {
+					((struct sockaddr_in *)&link_dst)->sin_port = 0;
+				} else {
+					((struct sockaddr_in6 *)&link_dst)->sin6_port = 0;
+				}
+			}
+
+			if (!cmpaddr(&pckt_dst, sockaddr_len(&pckt_dst),
+				     &link_dst, sockaddr_len(&link_dst))) {
+				_pmtud_link_too_big(knet_h, link, mtu);
+			}
+		}
+	}
+}
+
 static int read_errs_from_sock(knet_handle_t knet_h, int sockfd)
 {
 	int err = 0, savederrno = 0;
@@ -339,21 +460,9 @@ static int read_errs_from_sock(knet_handle_t knet_h, int sockfd)
 								}
 
 								/*
-								 * we can only try to take a lock here. This part of the code
-								 * can be invoked by any thread, including PMTUd that is already
-								 * holding a lock at that stage.
-								 * If PMTUd is holding the lock, most likely it is already running
-								 * and we don't need to notify it back.
+								 * only the links to remote need to be probed again
 								 */
-								if (!pthread_mutex_trylock(&knet_h->pmtud_mutex)) {
-									if (!knet_h->pmtud_running) {
-										if (!knet_h->pmtud_forcerun) {
-											log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Notifying PMTUd to rerun");
-											knet_h->pmtud_forcerun = 1;
-										}
-									}
-									pthread_mutex_unlock(&knet_h->pmtud_mutex);
-								}
+								udp_pmtud_notify(knet_h, &remote, sock_err->ee_info);
 							}
 							/*
 							 * those errors are way too noisy
@@ -370,6 +479,12 @@ static int read_errs_from_sock(knet_handle_t knet_h, int sockfd)
 							} else {
 								log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Received ICMP error from %s: %s", addr_str, strerror(sock_err->ee_errno));
 							}
+							/*
+							 * frag needed / packet too big, ee_info contains the next hop MTU
+							 */
+							if (sock_err->ee_errno == EMSGSIZE) {
+								udp_pmtud_notify(knet_h, &remote, sock_err->ee_info);
+							}
 							break;
 					}
 				} else {
@@ -418,12 +533,15 @@ int udp_transport_tx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err,
 	return 0;
 }
 
-int udp_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg)
+int udp_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data)
 {
-	if (msg->msg_len == 0)
-		return 0;
+	int i;
+
+	for (i = 0; i < msg_recv; i++) {
+		is_data[i] = (msg[i].msg_len != 0);
+	}
 
-	return 2;
+	return msg_recv;
 }
 
 int udp_transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link)
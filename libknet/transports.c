@@ -14,6 +14,8 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "libknet.h"
 #include "compat.h"
@@ -25,16 +27,27 @@
 #include "transport_loopback.h"
 #include "transport_udp.h"
 #include "transport_sctp.h"
+#include "transport_mcast.h"
+#include "transport_shm.h"
+#include "transport_common.h"
 #include "threads_common.h"
+#include "uring.h"
 
-#define empty_module 0, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+#define empty_module 0, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
 
 static knet_transport_ops_t transport_modules_cmd[KNET_MAX_TRANSPORTS] = {
-	{ "LOOPBACK", KNET_TRANSPORT_LOOPBACK, 1, KNET_PMTUD_LOOPBACK_OVERHEAD, loopback_transport_init, loopback_transport_free, loopback_transport_link_set_config, loopback_transport_link_clear_config, loopback_transport_link_dyn_connect, loopback_transport_rx_sock_error, loopback_transport_tx_sock_error, loopback_transport_rx_is_data },
-	{ "UDP", KNET_TRANSPORT_UDP, 1, KNET_PMTUD_UDP_OVERHEAD, udp_transport_init, udp_transport_free, udp_transport_link_set_config, udp_transport_link_clear_config, udp_transport_link_dyn_connect, udp_transport_rx_sock_error, udp_transport_tx_sock_error, udp_transport_rx_is_data },
+	{ "LOOPBACK", KNET_TRANSPORT_LOOPBACK, 1, KNET_PMTUD_LOOPBACK_OVERHEAD, loopback_transport_init, loopback_transport_free, loopback_transport_link_set_config, loopback_transport_link_clear_config, loopback_transport_link_dyn_connect, loopback_transport_rx_sock_error, loopback_transport_tx_sock_error, loopback_transport_rx_is_data, NULL, NULL, NULL },
+	{ "UDP", KNET_TRANSPORT_UDP, 1, KNET_PMTUD_UDP_OVERHEAD, udp_transport_init, udp_transport_free, udp_transport_link_set_config, udp_transport_link_clear_config, udp_transport_link_dyn_connect, udp_transport_rx_sock_error, udp_transport_tx_sock_error, udp_transport_rx_is_data, NULL, NULL, NULL },
 	{ "SCTP", KNET_TRANSPORT_SCTP,
 #ifdef HAVE_NETINET_SCTP_H
-				       1, KNET_PMTUD_SCTP_OVERHEAD, sctp_transport_init, sctp_transport_free, sctp_transport_link_set_config, sctp_transport_link_clear_config, sctp_transport_link_dyn_connect, sctp_transport_rx_sock_error, sctp_transport_tx_sock_error, sctp_transport_rx_is_data },
+				       1, KNET_PMTUD_SCTP_OVERHEAD, sctp_transport_init, sctp_transport_free, sctp_transport_link_set_config, sctp_transport_link_clear_config, sctp_transport_link_dyn_connect, sctp_transport_rx_sock_error, sctp_transport_tx_sock_error, sctp_transport_rx_is_data, NULL, NULL, sctp_transport_tx_channel },
+#else
+empty_module
+#endif
+	{ "MCAST", KNET_TRANSPORT_MCAST, 1, KNET_PMTUD_MCAST_OVERHEAD, mcast_transport_init, mcast_transport_free, mcast_transport_link_set_config, mcast_transport_link_clear_config, mcast_transport_link_dyn_connect, mcast_transport_rx_sock_error, mcast_transport_tx_sock_error, mcast_transport_rx_is_data, NULL, NULL, NULL },
+	{ "SHM", KNET_TRANSPORT_SHM,
+#ifdef HAVE_SYS_EVENTFD_H
+				     1, KNET_PMTUD_SHM_OVERHEAD, shm_transport_init, shm_transport_free, shm_transport_link_set_config, shm_transport_link_clear_config, shm_transport_link_dyn_connect, shm_transport_rx_sock_error, shm_transport_tx_sock_error, shm_transport_rx_is_data, shm_transport_tx_msgs, shm_transport_rx_msgs, NULL },
 #else
 empty_module
 #endif
@@ -113,9 +126,77 @@ int transport_tx_sock_error(knet_handle_t knet_h, uint8_t transport, int sockfd,
 	return transport_modules_cmd[transport].transport_tx_sock_error(knet_h, sockfd, recv_err, recv_errno);
 }
 
-int transport_rx_is_data(knet_handle_t knet_h, uint8_t transport, int sockfd, struct knet_mmsghdr *msg)
+int transport_rx_is_data(knet_handle_t knet_h, uint8_t transport, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data)
+{
+	return transport_modules_cmd[transport].transport_rx_is_data(knet_h, sockfd, msg, msg_recv, is_data);
+}
+
+int transport_recvmmsg(knet_handle_t knet_h, uint8_t transport, int sockfd, struct knet_mmsghdr *msg, unsigned int vlen, unsigned int flags)
+{
+	if (transport_modules_cmd[transport].transport_rx_msgs) {
+		return transport_modules_cmd[transport].transport_rx_msgs(knet_h, sockfd, msg, vlen);
+	}
+	return _recvmmsg(sockfd, msg, vlen, flags);
+}
+
+void transport_link_tx_channel(knet_handle_t knet_h, struct knet_link *kn_link, struct knet_mmsghdr *msg, unsigned int vlen, int8_t channel)
+{
+	if (transport_modules_cmd[kn_link->transport_type].transport_tx_channel) {
+		transport_modules_cmd[kn_link->transport_type].transport_tx_channel(knet_h, kn_link, msg, vlen, channel);
+	}
+}
+
+int transport_link_sendmmsg(knet_handle_t knet_h, struct knet_link *kn_link, struct knet_mmsghdr *msg, unsigned int vlen, unsigned int flags)
+{
+	if (transport_modules_cmd[kn_link->transport_type].transport_tx_msgs) {
+		return transport_modules_cmd[kn_link->transport_type].transport_tx_msgs(knet_h, kn_link, msg, vlen);
+	}
+#ifdef HAVE_IO_URING
+	if ((knet_h->uring) && (kn_link->transport_type == KNET_TRANSPORT_UDP)) {
+		return uring_sendmsgs(knet_h, kn_link->outsock, msg, vlen, flags);
+	}
+#endif
+	return _sendmmsg(kn_link->outsock, msg, vlen, flags);
+}
+
+static ssize_t transport_link_send_one(knet_handle_t knet_h, struct knet_link *kn_link, const void *buf, size_t len)
+{
+	struct knet_mmsghdr msg;
+	struct iovec iov;
+	int err;
+
+	memset(&msg, 0, sizeof(struct knet_mmsghdr));
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	msg.msg_hdr.msg_iov = &iov;
+	msg.msg_hdr.msg_iovlen = 1;
+
+	err = transport_modules_cmd[kn_link->transport_type].transport_tx_msgs(knet_h, kn_link, &msg, 1);
+	if (err < 0) {
+		return err;
+	}
+	return len;
+}
+
+ssize_t transport_link_sendto(knet_handle_t knet_h, struct knet_link *kn_link, const void *buf, size_t len, int flags)
 {
-	return transport_modules_cmd[transport].transport_rx_is_data(knet_h, sockfd, msg);
+	if (transport_modules_cmd[kn_link->transport_type].transport_tx_msgs) {
+		return transport_link_send_one(knet_h, kn_link, buf, len);
+	}
+	if (kn_link->outsock_connected) {
+		return send(kn_link->outsock, buf, len, flags);
+	}
+	return sendto(kn_link->outsock, buf, len, flags,
+		      (struct sockaddr *)&kn_link->dst_addr,
+		      sizeof(struct sockaddr_storage));
+}
+
+ssize_t transport_link_sendto_ctrl(knet_handle_t knet_h, struct knet_link *kn_link, const void *buf, size_t len, int flags)
+{
+	if (transport_modules_cmd[kn_link->transport_type].transport_tx_msgs) {
+		return transport_link_send_one(knet_h, kn_link, buf, len);
+	}
+	return _sendto_ctrl(kn_link, buf, len, flags);
 }
 
 /*
@@ -270,3 +351,190 @@ int knet_handle_get_transport_reconnect_interval(knet_handle_t knet_h, uint32_t
 	errno = 0;
 	return 0;
 }
+
+int knet_handle_set_sockbuf_limits(knet_handle_t knet_h, uint32_t min_size, uint32_t max_size)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((min_size) || (max_size)) {
+		if ((min_size < KNET_SOCKBUF_MIN_SIZE) ||
+		    (max_size > KNET_SOCKBUF_MAX_SIZE) ||
+		    (min_size > max_size)) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->sockbuf_min = min_size;
+	knet_h->sockbuf_max = max_size;
+
+	if (max_size) {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Socket buffers resized between %u and %u bytes",
+			  min_size, max_size);
+	} else {
+		log_debug(knet_h, KNET_SUB_HANDLE, "Socket buffers resizing disabled");
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_get_sockbuf_limits(knet_handle_t knet_h, uint32_t *min_size, uint32_t *max_size)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((!min_size) || (!max_size)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*min_size = knet_h->sockbuf_min;
+	*max_size = knet_h->sockbuf_max;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = 0;
+	return 0;
+}
+
+int knet_handle_set_mcast(knet_handle_t knet_h, uint8_t link_id,
+			  struct sockaddr_storage *src_addr,
+			  struct sockaddr_storage *mcast_addr)
+{
+	int err = 0, savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (mcast_addr) {
+		if (!src_addr) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (src_addr->ss_family != mcast_addr->ss_family) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		switch (mcast_addr->ss_family) {
+			case AF_INET:
+				if (!IN_MULTICAST(ntohl(((struct sockaddr_in *)mcast_addr)->sin_addr.s_addr))) {
+					errno = EINVAL;
+					return -1;
+				}
+				break;
+			case AF_INET6:
+				if (!IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6 *)mcast_addr)->sin6_addr)) {
+					errno = EINVAL;
+					return -1;
+				}
+				break;
+			default:
+				errno = EINVAL;
+				return -1;
+				break;
+		}
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	err = _mcast_clear_config(knet_h, link_id);
+	savederrno = errno;
+	if ((err) || (!mcast_addr)) {
+		goto exit_unlock;
+	}
+
+	err = _mcast_set_config(knet_h, link_id, src_addr, mcast_addr);
+	savederrno = errno;
+	if (err) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to join multicast group for link %u: %s",
+			link_id, strerror(savederrno));
+		goto exit_unlock;
+	}
+
+	log_debug(knet_h, KNET_SUB_HANDLE, "Multicast group for link %u configured", link_id);
+
+exit_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_handle_get_mcast(knet_handle_t knet_h, uint8_t link_id,
+			  struct sockaddr_storage *src_addr,
+			  struct sockaddr_storage *mcast_addr,
+			  uint8_t *enabled)
+{
+	int savederrno = 0;
+
+	if (!knet_h) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (link_id >= KNET_MAX_LINK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((!src_addr) || (!mcast_addr) || (!enabled)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	memset(src_addr, 0, sizeof(struct sockaddr_storage));
+	memset(mcast_addr, 0, sizeof(struct sockaddr_storage));
+	*enabled = _mcast_get_config(knet_h, link_id, src_addr, mcast_addr);
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = 0;
+	return 0;
+}
@@ -17,6 +17,15 @@ int transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_link)
 int transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link);
 int transport_rx_sock_error(knet_handle_t knet_h, uint8_t transport, int sockfd, int recv_err, int recv_errno);
 int transport_tx_sock_error(knet_handle_t knet_h, uint8_t transport, int sockfd, int recv_err, int recv_errno);
-int transport_rx_is_data(knet_handle_t knet_h, uint8_t transport, int sockfd, struct knet_mmsghdr *msg);
+int transport_rx_is_data(knet_handle_t knet_h, uint8_t transport, int sockfd, struct knet_mmsghdr *msg, int msg_recv, uint8_t *is_data);
+
+/*
+ * socket calls of the links, see transport_tx_msgs/transport_rx_msgs
+ */
+int transport_recvmmsg(knet_handle_t knet_h, uint8_t transport, int sockfd, struct knet_mmsghdr *msg, unsigned int vlen, unsigned int flags);
+void transport_link_tx_channel(knet_handle_t knet_h, struct knet_link *kn_link, struct knet_mmsghdr *msg, unsigned int vlen, int8_t channel);
+int transport_link_sendmmsg(knet_handle_t knet_h, struct knet_link *kn_link, struct knet_mmsghdr *msg, unsigned int vlen, unsigned int flags);
+ssize_t transport_link_sendto(knet_handle_t knet_h, struct knet_link *kn_link, const void *buf, size_t len, int flags);
+ssize_t transport_link_sendto_ctrl(knet_handle_t knet_h, struct knet_link *kn_link, const void *buf, size_t len, int flags);
 
 #endif
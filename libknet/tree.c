@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+
+#include "crypto.h"
+#include "internals.h"
+#include "logging.h"
+#include "relay.h"
+#include "threads_tx.h"
+#include "tree.h"
+
+/*
+ * broadcast tree
+ *
+ * Instead of sending a broadcast to every node, the sender splits the
+ * other nodes, in node id order, into at most fanout ranges and sends the
+ * packet to the node with the lowest latency of each range, inside a
+ * KNET_HEADER_TYPE_TREE packet that tells it which range it is responsible
+ * for. That node delivers the packet and does the same with the rest of
+ * its range, split around its own id. A range with a single node gets
+ * the packet as it is.
+ *
+ * The packet inside is the one the source would have sent, encrypted
+ * once by the source and with its seq_num, so the receivers deduplicate it
+ * as usual. Every node sends at most fanout packets for each broadcast,
+ * and the tree is about log(nodes) / log(fanout) levels deep.
+ *
+ * Everything here is protected by tx_mutex.
+ */
+
+#define _tree_pos(first, id) ((knet_node_id_t)((id) - (first)))
+
+int _tree_init(knet_handle_t knet_h)
+{
+	int i;
+
+	if (knet_h->treebuf_crypt[0]) {
+		return 0;
+	}
+
+	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+		knet_h->treebuf_crypt[i] = malloc(KNET_TREE_BUFSIZE);
+		if (!knet_h->treebuf_crypt[i]) {
+			_tree_fini(knet_h);
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void _tree_fini(knet_handle_t knet_h)
+{
+	int i;
+
+	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+		free(knet_h->treebuf_crypt[i]);
+		knet_h->treebuf_crypt[i] = NULL;
+	}
+}
+
+unsigned int _tree_data_mtu(knet_handle_t knet_h, unsigned int data_mtu)
+{
+	size_t overhead = KNET_HEADER_TREE_SIZE + knet_h->sec_header_size;
+
+	if (data_mtu <= overhead) {
+		return 0;
+	}
+
+	return data_mtu - overhead;
+}
+
+/*
+ * host that gets the packet from us, NULL if it doesn't
+ */
+static struct knet_host *_tree_member(knet_handle_t knet_h, knet_node_id_t src,
+				      knet_node_id_t first, knet_node_id_t last,
+				      knet_node_id_t host_id)
+{
+	struct knet_host *host;
+
+	if ((host_id == src) || (host_id == knet_h->host_id) ||
+	    (_tree_pos(first, host_id) > _tree_pos(first, last))) {
+		return NULL;
+	}
+
+	host = knet_h->host_index[host_id];
+	if ((!host) || (!host->status.reachable)) {
+		return NULL;
+	}
+
+	return host;
+}
+
+/*
+ * send the packets to child, inside a tree header if there are
+ * other nodes in [first, last]
+ */
+static int _tree_send_child(knet_handle_t knet_h, struct knet_host *child, knet_node_id_t src,
+			    knet_node_id_t first, knet_node_id_t last, uint8_t fanout,
+			    struct knet_mmsghdr *msg, int msgs_to_send, int8_t channel,
+			    unsigned char **crypt_bufs)
+{
+	struct knet_header tree_hdr;
+	struct knet_mmsghdr tree_msg[PCKT_FRAG_MAX];
+	struct iovec iov[PCKT_FRAG_MAX][3];
+	ssize_t outlen;
+	int msg_idx, iovcnt;
+	unsigned int i;
+
+	if (src == knet_h->host_id) {
+		knet_h->stats.tx_bcast_tree_packets += msgs_to_send;
+	} else {
+		knet_h->stats.rx_bcast_tree_forwarded += msgs_to_send;
+	}
+
+	if ((first == child->host_id) && (last == child->host_id)) {
+		return _dispatch_to_links(knet_h, child, msg, msgs_to_send, 0, channel);
+	}
+
+	memset(&tree_hdr, 0, KNET_HEADER_TREE_SIZE);
+	tree_hdr.kh_version = KNET_HEADER_VERSION;
+	tree_hdr.kh_type = KNET_HEADER_TYPE_TREE;
+	tree_hdr.kh_node = htons(knet_h->host_id);
+	tree_hdr.khp_tree_src_node = htons(src);
+	tree_hdr.khp_tree_first = htons(first);
+	tree_hdr.khp_tree_last = htons(last);
+	tree_hdr.khp_tree_fanout = fanout;
+
+	memset(&tree_msg, 0, sizeof(struct knet_mmsghdr) * msgs_to_send);
+
+	for (msg_idx = 0; msg_idx < msgs_to_send; msg_idx++) {
+		iov[msg_idx][0].iov_base = &tree_hdr;
+		iov[msg_idx][0].iov_len = KNET_HEADER_TREE_SIZE;
+		iovcnt = 1;
+		/* Cast for Linux/BSD compatibility */
+		for (i = 0; i < (unsigned int)msg[msg_idx].msg_hdr.msg_iovlen; i++) {
+			if (iovcnt == 3) {
+				log_debug(knet_h, KNET_SUB_TX, "Too many buffers to send a packet along the tree");
+				errno = EINVAL;
+				return -1;
+			}
+			iov[msg_idx][iovcnt] = msg[msg_idx].msg_hdr.msg_iov[i];
+			iovcnt++;
+		}
+
+		if (knet_h->crypto_instance) {
+			if (crypto_encrypt_and_signv(knet_h,
+						     iov[msg_idx], iovcnt,
+						     crypt_bufs[msg_idx],
+						     &outlen) < 0) {
+				log_debug(knet_h, KNET_SUB_TX, "Unable to encrypt broadcast tree packet");
+				errno = ECHILD;
+				return -1;
+			}
+			iov[msg_idx][0].iov_base = crypt_bufs[msg_idx];
+			iov[msg_idx][0].iov_len = outlen;
+			iovcnt = 1;
+		}
+
+		tree_msg[msg_idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		tree_msg[msg_idx].msg_hdr.msg_iov = iov[msg_idx];
+		tree_msg[msg_idx].msg_hdr.msg_iovlen = iovcnt;
+	}
+
+	return _dispatch_to_links(knet_h, child, &tree_msg[0], msgs_to_send, 0, channel);
+}
+
+int _tree_send(knet_handle_t knet_h, knet_node_id_t src, knet_node_id_t first, knet_node_id_t last,
+	       uint8_t fanout, struct knet_mmsghdr *msg, int msgs_to_send, int8_t channel,
+	       unsigned char **crypt_bufs)
+{
+	struct knet_host *host, *child = NULL;
+	knet_node_id_t self_pos = _tree_pos(first, knet_h->host_id);
+	knet_node_id_t side_first[2], side_last[2], host_id, range_first = 0, range_last;
+	unsigned int side_count[2] = { 0, 0 }, side_chunks[2];
+	unsigned int total, side, cur_side = 2, chunk = 0, in_chunk = 0, chunk_size = 0;
+	uint32_t child_latency = 0;
+	size_t start, n;
+	int err = 0, savederrno = 0;
+
+	if (!knet_h->host_ids_entries) {
+		return 0;
+	}
+
+	if (fanout < KNET_TREE_FANOUT_MIN) {
+		fanout = KNET_TREE_FANOUT_MIN;
+	}
+	if (fanout > KNET_TREE_FANOUT_MAX) {
+		fanout = KNET_TREE_FANOUT_MAX;
+	}
+
+	/*
+	 * ranges never contain our own id, the nodes before it
+	 * and after it are split separately
+	 */
+	side_first[0] = first;
+	if (self_pos <= _tree_pos(first, last)) {
+		side_last[0] = knet_h->host_id - 1;
+		side_first[1] = knet_h->host_id + 1;
+	} else {
+		side_last[0] = last;
+		side_first[1] = last;
+	}
+	side_last[1] = last;
+
+	/*
+	 * host_ids is sorted, walk it in ring order starting from first
+	 */
+	for (start = 0; start < knet_h->host_ids_entries; start++) {
+		if (knet_h->host_ids[start] >= first) {
+			break;
+		}
+	}
+
+	for (n = 0; n < knet_h->host_ids_entries; n++) {
+		host_id = knet_h->host_ids[(start + n) % knet_h->host_ids_entries];
+		if (!_tree_member(knet_h, src, first, last, host_id)) {
+			continue;
+		}
+		side_count[_tree_pos(first, host_id) > self_pos]++;
+	}
+
+	total = side_count[0] + side_count[1];
+	if (!total) {
+		return 0;
+	}
+
+	side_chunks[0] = (fanout * side_count[0]) / total;
+	if ((side_count[0]) && (!side_chunks[0])) {
+		side_chunks[0] = 1;
+	}
+	side_chunks[1] = fanout - side_chunks[0];
+	if ((side_count[1]) && (!side_chunks[1])) {
+		side_chunks[0]--;
+		side_chunks[1] = 1;
+	}
+	for (side = 0; side < 2; side++) {
+		if (side_chunks[side] > side_count[side]) {
+			side_chunks[side] = side_count[side];
+		}
+	}
+
+	for (n = 0; n < knet_h->host_ids_entries; n++) {
+		host_id = knet_h->host_ids[(start + n) % knet_h->host_ids_entries];
+		host = _tree_member(knet_h, src, first, last, host_id);
+		if (!host) {
+			continue;
+		}
+
+		side = _tree_pos(first, host_id) > self_pos;
+		if (side != cur_side) {
+			cur_side = side;
+			chunk = 0;
+			in_chunk = 0;
+			range_first = side_first[side];
+		}
+
+		if (!in_chunk) {
+			chunk_size = side_count[side] / side_chunks[side];
+			if (chunk < side_count[side] % side_chunks[side]) {
+				chunk_size++;
+			}
+			child = NULL;
+		}
+
+		if ((!child) || (_relay_host_latency(host) < child_latency)) {
+			child = host;
+			child_latency = _relay_host_latency(host);
+		}
+
+		in_chunk++;
+		if (in_chunk < chunk_size) {
+			continue;
+		}
+
+		/*
+		 * the last range of a side also covers the nodes we can't
+		 * reach after it, the child might be able to
+		 */
+		chunk++;
+		if (chunk == side_chunks[side]) {
+			range_last = side_last[side];
+		} else {
+			range_last = host_id;
+		}
+
+		if (_tree_send_child(knet_h, child, src, range_first, range_last, fanout,
+				     msg, msgs_to_send, channel, crypt_bufs) < 0) {
+			err = -1;
+			savederrno = errno;
+		}
+
+		range_first = range_last + 1;
+		in_chunk = 0;
+	}
+
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+void _tree_forward(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t len)
+{
+	struct knet_mmsghdr msg;
+	struct iovec iov;
+
+	memset(&msg, 0, sizeof(struct knet_mmsghdr));
+	iov.iov_base = inbuf->khp_tree_data;
+	iov.iov_len = len - KNET_HEADER_TREE_SIZE;
+	msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+	msg.msg_hdr.msg_iov = &iov;
+	msg.msg_hdr.msg_iovlen = 1;
+
+	if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to get TX mutex lock");
+		return;
+	}
+
+	if (_tree_send(knet_h, ntohs(inbuf->khp_tree_src_node),
+		       ntohs(inbuf->khp_tree_first), ntohs(inbuf->khp_tree_last),
+		       inbuf->khp_tree_fanout, &msg, 1, -1,
+		       &knet_h->recv_from_links_buf_crypt) < 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to pass on broadcast from host %u: %s",
+			  ntohs(inbuf->khp_tree_src_node), strerror(errno));
+	}
+
+	pthread_mutex_unlock(&knet_h->tx_mutex);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#ifndef __KNET_TREE_H__
+#define __KNET_TREE_H__
+
+#include "internals.h"
+#include "onwire.h"
+
+#define KNET_TREE_FANOUT_MIN	2
+#define KNET_TREE_FANOUT_MAX	16
+#define KNET_TREE_BUFSIZE	(KNET_HEADER_TREE_SIZE + KNET_DATABUFSIZE_CRYPT + KNET_DATABUFSIZE_CRYPT_PAD)
+
+int _tree_init(knet_handle_t knet_h);
+void _tree_fini(knet_handle_t knet_h);
+
+/*
+ * fragment size for a broadcast along the tree,
+ * data_mtu is the smallest data MTU of the destinations
+ */
+unsigned int _tree_data_mtu(knet_handle_t knet_h, unsigned int data_mtu);
+
+/*
+ * needs tx_mutex. Sends the packets to the nodes in the ring of node ids
+ * [first, last], except src and ourselves, directly or through other nodes.
+ * crypt_bufs must have room for msgs_to_send packets.
+ */
+int _tree_send(knet_handle_t knet_h, knet_node_id_t src, knet_node_id_t first, knet_node_id_t last,
+	       uint8_t fanout, struct knet_mmsghdr *msg, int msgs_to_send, int8_t channel,
+	       unsigned char **crypt_bufs);
+
+void _tree_forward(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t len);
+
+#endif
@@ -0,0 +1,797 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+
+#include "internals.h"
+#include "logging.h"
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+
+/*
+ * io_uring I/O engine for UDP link sockets (KNET_HANDLE_FLAG_IO_URING)
+ *
+ * RX: every socket has one multishot IORING_OP_RECVMSG request that picks
+ * buffers from a provided buffer ring. The kernel keeps receiving without
+ * any syscall from us, the RX thread only wakes up on the ring fd (that
+ * sits in recv_from_links_epollfd with the other transports' sockets)
+ * and reaps completions. A request ends when the buffers run out or on
+ * socket errors, and is armed again by the RX thread once the buffers
+ * are given back.
+ *
+ * Requests are owned by the task that submits them and their receive work
+ * runs in that task context, so only the RX thread arms them. Sockets added
+ * from the API are queued and the RX thread is woken with a NOP.
+ *
+ * TX: a batch is queued as SENDMSG requests and submitted with a single
+ * io_uring_enter that also waits for the completions, so the msg vectors
+ * don't need to outlive the call. MSG_DONTWAIT keeps the requests from
+ * being parked on EAGAIN.
+ *
+ * We talk to the kernel with the raw syscalls, the subset we need is small.
+ */
+
+#define KNET_URING_RX_ENTRIES		64
+#define KNET_URING_RX_CQ_ENTRIES	1024
+#define KNET_URING_TX_ENTRIES		256
+
+#define KNET_URING_RX_BUFS		128	/* power of 2 */
+#define KNET_URING_RX_BGID		0
+#define KNET_URING_RX_NAMELEN		sizeof(struct sockaddr_storage)
+#define KNET_URING_RX_CMSGLEN		256
+#define KNET_URING_RX_BUFSIZE		(sizeof(struct io_uring_recvmsg_out) + KNET_URING_RX_NAMELEN + \
+					 KNET_URING_RX_CMSGLEN + KNET_DATABUFSIZE)
+
+/*
+ * user_data of NOPs and cancels, sockets use their uring_sock_t
+ */
+#define KNET_URING_NOSOCK		0
+
+typedef struct uring_ring {
+	int fd;
+	void *map;
+	size_t map_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned int sq_entries;
+	unsigned int sqe_tail;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+} uring_ring_t;
+
+typedef struct uring_sock {
+	struct knet_list_head list;
+	int fd;
+	int armed;	/* a multishot request is (or might still be) in flight */
+	int closing;	/* free once the request is gone */
+} uring_sock_t;
+
+struct knet_uring {
+	uring_ring_t rx;
+	uring_ring_t tx;
+	pthread_mutex_t rx_mutex;	/* rx sq, socks list */
+	pthread_mutex_t tx_mutex;	/* tx ring */
+	struct knet_list_head socks;
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_len;
+	uint16_t buf_tail;
+	uint8_t *bufs;
+	uint16_t rx_used[KNET_URING_RX_BUFS];
+	unsigned int rx_used_count;
+	struct msghdr rx_msg;
+	uint32_t tx_seq;
+};
+
+static int _io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int _io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int _io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int _ring_init(uring_ring_t *ring, unsigned int entries, unsigned int cq_entries)
+{
+	struct io_uring_params p;
+	size_t sq_len, cq_len;
+	int savederrno;
+
+	memset(&p, 0, sizeof(struct io_uring_params));
+	if (cq_entries) {
+		p.flags |= IORING_SETUP_CQSIZE;
+		p.cq_entries = cq_entries;
+	}
+
+	ring->fd = _io_uring_setup(entries, &p);
+	if (ring->fd < 0) {
+		return -1;
+	}
+
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->map_len = (sq_len > cq_len) ? sq_len : cq_len;
+
+	ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			 ring->fd, IORING_OFF_SQ_RING);
+	if (ring->map == MAP_FAILED) {
+		savederrno = errno;
+		ring->map = NULL;
+		errno = savederrno;
+		return -1;
+	}
+
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		savederrno = errno;
+		ring->sqes = NULL;
+		errno = savederrno;
+		return -1;
+	}
+
+	ring->sq_entries = p.sq_entries;
+	ring->sq_head = (unsigned int *)((uint8_t *)ring->map + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((uint8_t *)ring->map + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((uint8_t *)ring->map + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((uint8_t *)ring->map + p.sq_off.array);
+	ring->cq_head = (unsigned int *)((uint8_t *)ring->map + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((uint8_t *)ring->map + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((uint8_t *)ring->map + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((uint8_t *)ring->map + p.cq_off.cqes);
+	ring->sqe_tail = *ring->sq_tail;
+
+	return 0;
+}
+
+static void _ring_fini(uring_ring_t *ring)
+{
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_len);
+		ring->sqes = NULL;
+	}
+	if (ring->map) {
+		munmap(ring->map, ring->map_len);
+		ring->map = NULL;
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+		ring->fd = -1;
+	}
+}
+
+static struct io_uring_sqe *_ring_get_sqe(uring_ring_t *ring)
+{
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	unsigned int idx;
+	struct io_uring_sqe *sqe;
+
+	if (ring->sqe_tail - head >= ring->sq_entries) {
+		return NULL;
+	}
+
+	idx = ring->sqe_tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	ring->sq_array[idx] = idx;
+	ring->sqe_tail++;
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	return sqe;
+}
+
+/*
+ * submit what is queued and optionally wait for wait_nr completions
+ */
+static int _ring_submit(uring_ring_t *ring, unsigned int wait_nr)
+{
+	unsigned int to_submit;
+	int err;
+
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+	while (1) {
+		to_submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if ((!to_submit) && (!wait_nr)) {
+			return 0;
+		}
+		err = _io_uring_enter(ring->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+		if ((err < 0) && (errno == EINTR)) {
+			continue;
+		}
+		if (err < 0) {
+			return -1;
+		}
+		if ((unsigned int)err >= to_submit) {
+			return 0;
+		}
+	}
+}
+
+static void _rx_buf_add(struct knet_uring *uring, uint16_t bid)
+{
+	struct io_uring_buf *buf = &uring->buf_ring->bufs[uring->buf_tail & (KNET_URING_RX_BUFS - 1)];
+
+	buf->addr = (uintptr_t)(uring->bufs + (size_t)bid * KNET_URING_RX_BUFSIZE);
+	buf->len = KNET_URING_RX_BUFSIZE;
+	buf->bid = bid;
+	uring->buf_tail++;
+}
+
+static void _rx_buf_publish(struct knet_uring *uring)
+{
+	__atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * needs rx_mutex
+ */
+static int _rx_kick(struct knet_uring *uring)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = _ring_get_sqe(&uring->rx);
+	if (!sqe) {
+		errno = EBUSY;
+		return -1;
+	}
+	sqe->opcode = IORING_OP_NOP;
+	sqe->user_data = KNET_URING_NOSOCK;
+
+	return _ring_submit(&uring->rx, 0);
+}
+
+/*
+ * RX thread only, needs rx_mutex
+ */
+static int _rx_arm(struct knet_uring *uring, uring_sock_t *sock)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = _ring_get_sqe(&uring->rx);
+	if (!sqe) {
+		errno = EBUSY;
+		return -1;
+	}
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = sock->fd;
+	sqe->addr = (uintptr_t)&uring->rx_msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = KNET_URING_RX_BGID;
+	sqe->user_data = (uintptr_t)sock;
+
+	sock->armed = 1;
+
+	return 0;
+}
+
+int uring_init(knet_handle_t knet_h)
+{
+	struct knet_uring *uring;
+	struct io_uring_buf_reg reg;
+	struct epoll_event ev;
+	int savederrno = 0;
+	uint16_t i;
+
+	uring = malloc(sizeof(struct knet_uring));
+	if (!uring) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(uring, 0, sizeof(struct knet_uring));
+	uring->rx.fd = -1;
+	uring->tx.fd = -1;
+	knet_list_init(&uring->socks);
+	pthread_mutex_init(&uring->rx_mutex, NULL);
+	pthread_mutex_init(&uring->tx_mutex, NULL);
+
+	/*
+	 * assign early so that uring_fini can clean up after any failure
+	 */
+	knet_h->uring = uring;
+
+	if (_ring_init(&uring->rx, KNET_URING_RX_ENTRIES, KNET_URING_RX_CQ_ENTRIES) < 0) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSPORT, "Unable to setup io_uring rx ring: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	if (_ring_init(&uring->tx, KNET_URING_TX_ENTRIES, 0) < 0) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSPORT, "Unable to setup io_uring tx ring: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	uring->bufs = malloc((size_t)KNET_URING_RX_BUFS * KNET_URING_RX_BUFSIZE);
+	if (!uring->bufs) {
+		savederrno = ENOMEM;
+		log_err(knet_h, KNET_SUB_TRANSPORT, "Unable to allocate io_uring rx buffers");
+		goto exit_fail;
+	}
+
+	uring->buf_ring_len = KNET_URING_RX_BUFS * sizeof(struct io_uring_buf);
+	uring->buf_ring = mmap(NULL, uring->buf_ring_len, PROT_READ | PROT_WRITE,
+			       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (uring->buf_ring == MAP_FAILED) {
+		savederrno = errno;
+		uring->buf_ring = NULL;
+		log_err(knet_h, KNET_SUB_TRANSPORT, "Unable to allocate io_uring buffer ring: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+	reg.ring_addr = (uintptr_t)uring->buf_ring;
+	reg.ring_entries = KNET_URING_RX_BUFS;
+	reg.bgid = KNET_URING_RX_BGID;
+
+	if (_io_uring_register(uring->rx.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSPORT, "Unable to register io_uring buffer ring: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	for (i = 0; i < KNET_URING_RX_BUFS; i++) {
+		_rx_buf_add(uring, i);
+	}
+	_rx_buf_publish(uring);
+
+	/*
+	 * multishot recvmsg only looks at the lengths, the layout of
+	 * each buffer is: io_uring_recvmsg_out, name, control, payload
+	 */
+	uring->rx_msg.msg_namelen = KNET_URING_RX_NAMELEN;
+	uring->rx_msg.msg_controllen = KNET_URING_RX_CMSGLEN;
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.fd = uring->rx.fd;
+
+	if (epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_ADD, uring->rx.fd, &ev)) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TRANSPORT, "Unable to add io_uring to epoll pool: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	log_debug(knet_h, KNET_SUB_TRANSPORT, "io_uring I/O engine enabled (rx: %d tx: %d)",
+		  uring->rx.fd, uring->tx.fd);
+
+	return 0;
+
+exit_fail:
+	uring_fini(knet_h);
+	errno = savederrno;
+	return -1;
+}
+
+void uring_fini(knet_handle_t knet_h)
+{
+	struct knet_uring *uring = knet_h->uring;
+	struct knet_list_head *pos, *next;
+	uring_sock_t *sock;
+	struct epoll_event ev;
+
+	if (!uring) {
+		return;
+	}
+
+	if (uring->rx.fd >= 0) {
+		memset(&ev, 0, sizeof(struct epoll_event));
+		epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_DEL, uring->rx.fd, &ev);
+	}
+
+	/*
+	 * closing the ring cancels whatever is still in flight
+	 */
+	_ring_fini(&uring->rx);
+	_ring_fini(&uring->tx);
+
+	knet_list_for_each_safe(pos, next, &uring->socks) {
+		sock = knet_list_entry(pos, uring_sock_t, list);
+		knet_list_del(&sock->list);
+		free(sock);
+	}
+
+	if (uring->buf_ring) {
+		munmap(uring->buf_ring, uring->buf_ring_len);
+	}
+	free(uring->bufs);
+
+	pthread_mutex_destroy(&uring->rx_mutex);
+	pthread_mutex_destroy(&uring->tx_mutex);
+
+	free(uring);
+	knet_h->uring = NULL;
+}
+
+int uring_rx_fd(knet_handle_t knet_h)
+{
+	if (!knet_h->uring) {
+		return -1;
+	}
+	return knet_h->uring->rx.fd;
+}
+
+int uring_add_sock(knet_handle_t knet_h, int sockfd)
+{
+	struct knet_uring *uring = knet_h->uring;
+	uring_sock_t *sock;
+	int err, savederrno = 0;
+
+	sock = malloc(sizeof(uring_sock_t));
+	if (!sock) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(sock, 0, sizeof(uring_sock_t));
+	sock->fd = sockfd;
+
+	pthread_mutex_lock(&uring->rx_mutex);
+	knet_list_add(&sock->list, &uring->socks);
+	err = _rx_kick(uring);
+	if (err < 0) {
+		savederrno = errno;
+		knet_list_del(&sock->list);
+		free(sock);
+	}
+	pthread_mutex_unlock(&uring->rx_mutex);
+
+	errno = savederrno;
+	return err;
+}
+
+int uring_del_sock(knet_handle_t knet_h, int sockfd)
+{
+	struct knet_uring *uring = knet_h->uring;
+	struct io_uring_sqe *sqe;
+	uring_sock_t *sock;
+	int found = 0, err = 0, savederrno = 0;
+
+	pthread_mutex_lock(&uring->rx_mutex);
+
+	knet_list_for_each_entry(sock, &uring->socks, list) {
+		if ((sock->fd == sockfd) && (!sock->closing)) {
+			found = 1;
+			break;
+		}
+	}
+
+	if (!found) {
+		savederrno = ENOENT;
+		err = -1;
+		goto out_unlock;
+	}
+
+	if (!sock->armed) {
+		knet_list_del(&sock->list);
+		free(sock);
+		goto out_unlock;
+	}
+
+	/*
+	 * the RX thread frees it when the final completion shows up,
+	 * the cancel itself completes in our context
+	 */
+	sock->closing = 1;
+
+	sqe = _ring_get_sqe(&uring->rx);
+	if (!sqe) {
+		savederrno = EBUSY;
+		err = -1;
+		goto out_unlock;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->addr = (uintptr_t)sock;
+	sqe->user_data = KNET_URING_NOSOCK;
+
+	err = _ring_submit(&uring->rx, 0);
+	savederrno = errno;
+
+out_unlock:
+	pthread_mutex_unlock(&uring->rx_mutex);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+static void _rx_fill_msg(uint8_t *buf, struct knet_mmsghdr *msg)
+{
+	struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+	uint8_t *name = buf + sizeof(struct io_uring_recvmsg_out);
+	uint8_t *control = name + KNET_URING_RX_NAMELEN;
+	uint8_t *payload = control + KNET_URING_RX_CMSGLEN;
+	size_t len;
+
+	len = out->namelen;
+	if (len > KNET_URING_RX_NAMELEN) {
+		len = KNET_URING_RX_NAMELEN;
+	}
+	memmove(msg->msg_hdr.msg_name, name, len);
+	msg->msg_hdr.msg_namelen = len;
+
+	len = out->controllen;
+	if (len > msg->msg_hdr.msg_controllen) {
+		len = msg->msg_hdr.msg_controllen;
+	}
+	memmove(msg->msg_hdr.msg_control, control, len);
+	msg->msg_hdr.msg_controllen = len;
+
+	msg->msg_hdr.msg_iov->iov_base = payload;
+	msg->msg_hdr.msg_flags = out->flags;
+	msg->msg_len = out->payloadlen;
+}
+
+int uring_recv_msgs(knet_handle_t knet_h, int *sockfd, struct knet_mmsghdr *msg, unsigned int vlen)
+{
+	struct knet_uring *uring = knet_h->uring;
+	uring_ring_t *ring = &uring->rx;
+	struct io_uring_cqe *cqe;
+	uring_sock_t *sock;
+	unsigned int head, tail, got = 0;
+	uint16_t bid;
+	int more, savederrno = 0;
+
+	pthread_mutex_lock(&uring->rx_mutex);
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		sock = (uring_sock_t *)(uintptr_t)cqe->user_data;
+
+		/*
+		 * one batch only carries data from one socket,
+		 * errors are reported on their own
+		 */
+		if ((got) && (sock) && (!sock->closing) &&
+		    ((sock->fd != *sockfd) || (cqe->res < 0) || (got == vlen))) {
+			break;
+		}
+
+		head++;
+
+		if (!sock) {
+			/*
+			 * kicks and cancels, pending sockets are armed in uring_recv_done
+			 */
+			continue;
+		}
+
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			uring->rx_used[uring->rx_used_count++] = bid;
+		}
+
+		more = cqe->flags & IORING_CQE_F_MORE;
+		if (!more) {
+			sock->armed = 0;
+		}
+
+		if (sock->closing) {
+			if (!more) {
+				knet_list_del(&sock->list);
+				free(sock);
+			}
+			continue;
+		}
+
+		if (cqe->res < 0) {
+			/*
+			 * out of buffers, we will re-arm after giving them back
+			 */
+			if ((cqe->res == -ENOBUFS) || (cqe->res == -ECANCELED)) {
+				continue;
+			}
+			*sockfd = sock->fd;
+			savederrno = -cqe->res;
+			break;
+		}
+
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			*sockfd = sock->fd;
+			_rx_fill_msg(uring->bufs + (size_t)bid * KNET_URING_RX_BUFSIZE, &msg[got]);
+			got++;
+		}
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&uring->rx_mutex);
+
+	if (savederrno) {
+		errno = savederrno;
+		return -1;
+	}
+
+	errno = 0;
+	return got;
+}
+
+void uring_recv_done(knet_handle_t knet_h)
+{
+	struct knet_uring *uring = knet_h->uring;
+	uring_sock_t *sock;
+	unsigned int i;
+
+	pthread_mutex_lock(&uring->rx_mutex);
+
+	for (i = 0; i < uring->rx_used_count; i++) {
+		_rx_buf_add(uring, uring->rx_used[i]);
+	}
+	if (uring->rx_used_count) {
+		_rx_buf_publish(uring);
+		uring->rx_used_count = 0;
+	}
+
+	knet_list_for_each_entry(sock, &uring->socks, list) {
+		if ((!sock->armed) && (!sock->closing)) {
+			if (_rx_arm(uring, sock) < 0) {
+				log_warn(knet_h, KNET_SUB_TRANSPORT, "Unable to arm io_uring receive on socket %d: %s",
+					 sock->fd, strerror(errno));
+				break;
+			}
+		}
+	}
+
+	if (_ring_submit(&uring->rx, 0) < 0) {
+		log_warn(knet_h, KNET_SUB_TRANSPORT, "Unable to submit io_uring receive requests: %s",
+			 strerror(errno));
+	}
+
+	pthread_mutex_unlock(&uring->rx_mutex);
+}
+
+int uring_sendmsgs(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, unsigned int vlen, unsigned int flags)
+{
+	struct knet_uring *uring = knet_h->uring;
+	uring_ring_t *ring = &uring->tx;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int res[KNET_URING_TX_ENTRIES];
+	unsigned int i, n, head, reaped, first, sent = 0;
+	int savederrno = 0, submit_failed;
+
+	pthread_mutex_lock(&uring->tx_mutex);
+
+	while (sent < vlen) {
+		n = vlen - sent;
+		if (n > ring->sq_entries) {
+			n = ring->sq_entries;
+		}
+
+		/*
+		 * completions of a previous failed submission
+		 * carry an older seq and are skipped
+		 */
+		uring->tx_seq++;
+
+		first = ring->sqe_tail;
+		for (i = 0; i < n; i++) {
+			sqe = _ring_get_sqe(ring);
+			if (!sqe) {
+				break;
+			}
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = sockfd;
+			sqe->addr = (uintptr_t)&msg[sent + i].msg_hdr;
+			sqe->len = 1;
+			sqe->msg_flags = flags;
+			sqe->user_data = ((uint64_t)uring->tx_seq << 32) | i;
+			res[i] = -EINPROGRESS;
+		}
+		n = i;
+
+		submit_failed = 0;
+		if (_ring_submit(ring, n) < 0) {
+			savederrno = errno;
+			submit_failed = 1;
+			/*
+			 * take back what the kernel did not consume,
+			 * the requests before it are in flight
+			 */
+			ring->sqe_tail = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+			__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+			n = ring->sqe_tail - first;
+		}
+
+		/*
+		 * the kernel reads msg until the request completes,
+		 * never return to the caller with requests in flight
+		 */
+		reaped = 0;
+		while (reaped < n) {
+			head = *ring->cq_head;
+			if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+				if ((_io_uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0) &&
+				    (errno != EINTR)) {
+					/*
+					 * completions are still posted to the CQ ring,
+					 * poll for them instead
+					 */
+					usleep(knet_h->threads_timer_res / 16);
+				}
+				continue;
+			}
+			cqe = &ring->cqes[head & *ring->cq_mask];
+			if ((cqe->user_data >> 32) == uring->tx_seq) {
+				res[cqe->user_data & 0xffffffff] = cqe->res;
+				reaped++;
+			}
+			__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+		}
+
+		/*
+		 * like sendmmsg, report what went out in order
+		 * up to the first failure
+		 */
+		for (i = 0; i < n; i++) {
+			if (res[i] < 0) {
+				break;
+			}
+			msg[sent + i].msg_len = res[i];
+		}
+		sent += i;
+
+		if (i < n) {
+			if (res[i] != -EINPROGRESS) {
+				savederrno = -res[i];
+			}
+			break;
+		}
+
+		if (submit_failed) {
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&uring->tx_mutex);
+
+	errno = savederrno;
+	if (sent > 0) {
+		return sent;
+	}
+	return vlen ? -1 : 0;
+}
+
+#endif
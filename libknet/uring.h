@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.  All rights reserved.
+ *
+ * This software licensed under GPL-2.0+, LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include "internals.h"
+
+#ifndef __KNET_URING_H__
+#define __KNET_URING_H__
+
+#ifdef HAVE_IO_URING
+
+int uring_init(knet_handle_t knet_h);
+void uring_fini(knet_handle_t knet_h);
+
+/*
+ * start/stop receiving from a link socket instead of epoll
+ */
+int uring_add_sock(knet_handle_t knet_h, int sockfd);
+int uring_del_sock(knet_handle_t knet_h, int sockfd);
+
+/*
+ * fd to watch in the recv_from_links epoll
+ */
+int uring_rx_fd(knet_handle_t knet_h);
+
+/*
+ * RX thread only. Returns the number of packets received on *sockfd,
+ * 0 when there is nothing left to reap, or -1 with errno set on a
+ * receive error on *sockfd. iov_base of the msgs is pointed to the
+ * registered buffers, that are valid until uring_recv_done.
+ */
+int uring_recv_msgs(knet_handle_t knet_h, int *sockfd, struct knet_mmsghdr *msg, unsigned int vlen);
+void uring_recv_done(knet_handle_t knet_h);
+
+/*
+ * same return values as _sendmmsg
+ */
+int uring_sendmsgs(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg, unsigned int vlen, unsigned int flags);
+
+#endif
+
+#endif